@@ -0,0 +1,159 @@
+#include "AnimationMixer.h"
+#include "../trace/Trace.h"
+#include <cmath>
+
+// Wings snap (a flap is a pose, not a glide), the neck eases up to its step
+// limit, and the mouth's sources (lip sync track, smoothed microphone level)
+// already shape its motion
+const AnimationMixer::JointSpec AnimationMixer::JOINTS[MIX_JOINTS] = {
+    { Wing1Joint::CHANNEL, Wing1Joint::MIN_US, Wing1Joint::MAX_US, Wing1Joint::REST_US,
+      Wing1Joint::MAX_STEP_US, 1, &Wing1Joint::counts },
+    { Wing2Joint::CHANNEL, Wing2Joint::MIN_US, Wing2Joint::MAX_US, Wing2Joint::REST_US,
+      Wing2Joint::MAX_STEP_US, 1, &Wing2Joint::counts },
+    { NeckJoint::CHANNEL, NeckJoint::MIN_US, NeckJoint::MAX_US, NeckJoint::REST_US,
+      NeckJoint::MAX_STEP_US, NECK_SMOOTH_DIV, &NeckJoint::counts },
+    { MouthJoint::CHANNEL, MouthJoint::MIN_US, MouthJoint::MAX_US, MouthJoint::REST_US,
+      0, 1, &MouthJoint::counts },
+};
+
+static const char* const LAYER_NAMES[LAYER_COUNT] = { "idle", "random", "scripted", "speech", "manual" };
+static const int DEFAULT_FADE_MS[LAYER_COUNT]     = { 0,      400,      150,        60,       150 };
+
+static constexpr float SNAP_US = 1.0f / 16;   // closer than this, easing lands on the target
+
+AnimationMixer::AnimationMixer(ServoDriver* pwmController)
+    : pwm(pwmController), lastNs(0), frames(0) {
+    for (int l = 0; l < LAYER_COUNT; l++) {
+        priority[l] = l * 10;
+        fadeMs[l] = DEFAULT_FADE_MS[l];
+        for (int j = 0; j < MIX_JOINTS; j++) {
+            int i = l * MIX_JOINTS + j;
+            targets[i] = JOINTS[j].restUs;
+            weights[i] = goal[i] = l == LAYER_IDLE ? 1.0f : 0.0f;
+            rate[i] = 0.0f;
+        }
+    }
+    sortLayers();
+    park();
+}
+
+const char* AnimationMixer::layerName(AnimLayer layer) {
+    return layer < LAYER_COUNT ? LAYER_NAMES[layer] : "?";
+}
+
+void AnimationMixer::fadeTo(int i, float to, int ms) {
+    goal[i] = to;
+    if (ms <= 0) {
+        weights[i] = to;
+        rate[i] = 0.0f;
+    } else {
+        rate[i] = 1.0f / ms;
+    }
+}
+
+void AnimationMixer::set(AnimLayer layer, MixJoint joint, int pulseUs, int fade) {
+    const JointSpec& s = JOINTS[joint];
+    int i = cell(layer, joint);
+    targets[i] = pulseUs < s.minUs ? s.minUs : pulseUs > s.maxUs ? s.maxUs : pulseUs;
+    if (goal[i] < 1.0f) fadeTo(i, 1.0f, fade < 0 ? fadeMs[layer] : fade);
+}
+
+void AnimationMixer::release(AnimLayer layer, MixJoint joint, int fade) {
+    int i = cell(layer, joint);
+    if (goal[i] > 0.0f) fadeTo(i, 0.0f, fade < 0 ? fadeMs[layer] : fade);
+}
+
+void AnimationMixer::releaseLayer(AnimLayer layer, int fade) {
+    for (int j = 0; j < MIX_JOINTS; j++) release(layer, static_cast<MixJoint>(j), fade);
+}
+
+void AnimationMixer::setPriority(AnimLayer layer, int p) {
+    priority[layer] = p;
+    sortLayers();
+}
+
+void AnimationMixer::setFadeMs(AnimLayer layer, int ms) {
+    fadeMs[layer] = ms;
+}
+
+// Insertion sort; ties keep the enum order
+void AnimationMixer::sortLayers() {
+    for (int l = 0; l < LAYER_COUNT; l++) order[l] = static_cast<uint8_t>(l);
+    for (int i = 1; i < LAYER_COUNT; i++) {
+        uint8_t layer = order[i];
+        int k = i;
+        while (k > 0 && priority[order[k - 1]] > priority[layer]) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = layer;
+    }
+}
+
+float AnimationMixer::layerWeight(AnimLayer layer) const {
+    float w = 0.0f;
+    for (int j = 0; j < MIX_JOINTS; j++)
+        if (weights[cell(layer, static_cast<MixJoint>(j))] > w) w = weights[cell(layer, static_cast<MixJoint>(j))];
+    return w;
+}
+
+void AnimationMixer::evaluate(uint64_t nowNs) {
+    TraceSpan span(TRACE_ANIM_MIX);
+    float dtMs = lastNs && nowNs > lastNs ? (nowNs - lastNs) / 1e6f : 0.0f;
+    lastNs = nowNs;
+
+    // Fades, linear in time
+    for (int i = 0; i < MIX_CELLS; i++) {
+        float w = weights[i], g = goal[i];
+        if (w == g) continue;
+        float step = rate[i] * dtMs;
+        weights[i] = w < g ? (w + step < g ? w + step : g) : (w - step > g ? w - step : g);
+    }
+
+    // Bottom to top, each layer pulls toward its target by its weight
+    float blended[MIX_JOINTS];
+    for (int j = 0; j < MIX_JOINTS; j++) blended[j] = JOINTS[j].restUs;
+    for (int k = 0; k < LAYER_COUNT; k++) {
+        const float* t = targets + order[k] * MIX_JOINTS;
+        const float* w = weights + order[k] * MIX_JOINTS;
+        for (int j = 0; j < MIX_JOINTS; j++) blended[j] += (t[j] - blended[j]) * w[j];
+    }
+
+    // Ease, limit the step, and collect the joints that moved
+    bool changed[MIX_JOINTS];
+    for (int j = 0; j < MIX_JOINTS; j++) {
+        const JointSpec& s = JOINTS[j];
+        float gap = blended[j] - eased[j];
+        float move = gap / s.smoothDiv;
+        if (fabsf(move) < SNAP_US) move = gap;
+        if (s.maxStepUs && move > s.maxStepUs) move = s.maxStepUs;
+        if (s.maxStepUs && move < -s.maxStepUs) move = -s.maxStepUs;
+        eased[j] += move;
+        uint16_t us = static_cast<uint16_t>(eased[j] + 0.5f);
+        changed[j] = us != written[j];
+        written[j] = us;
+    }
+    write(changed);
+}
+
+void AnimationMixer::park() {
+    bool changed[MIX_JOINTS];
+    for (int j = 0; j < MIX_JOINTS; j++) {
+        eased[j] = written[j] = JOINTS[j].restUs;
+        changed[j] = true;
+    }
+    write(changed);
+}
+
+void AnimationMixer::write(const bool* changed) {
+    uint8_t channels[MIX_JOINTS];
+    uint16_t counts[MIX_JOINTS];
+    int n = 0;
+    for (int j = 0; j < MIX_JOINTS; j++) {
+        if (!changed[j]) continue;
+        channels[n] = JOINTS[j].channel;
+        counts[n] = JOINTS[j].counts(written[j]);
+        n++;
+    }
+    frames = n > 0 && pwm->setFrame(channels, counts, n) ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "../i2c/ServoDriver.h"
+#include "Joints.h"
+#include <cstdint>
+
+#define NECK_SMOOTH_DIV 5     // each tick closes 1/5 of the neck's gap
+
+// One place that decides every servo position. Control sources write
+// per-joint targets into layers instead of driving the servos; once per
+// main loop tick evaluate() blends the layers, eases each joint and sends
+// every joint that changed to the servo driver in one frame.
+//
+// Layers blend bottom to top by priority: each active layer pulls the
+// result toward its target by its weight, so a layer at weight 1 overrides
+// everything under it and one fading in or out crossfades smoothly. A
+// layer's weight ramps to 1 when it is given a target and back to 0 when
+// released, over its fade time.
+//
+//   idle       rest pose, always on
+//   random     autonomous motion: random and music mode (never both on)
+//   scripted   show control setpoints from the remote socket
+//   speech     the jaw while talking: lip sync or the microphone level
+//   manual     keyboard puppeteering
+//
+// Main thread only. State is kept as flat arrays indexed by layer and
+// joint, so a tick is a few short loops over floats.
+
+enum AnimLayer : uint8_t {
+    LAYER_IDLE,
+    LAYER_RANDOM,
+    LAYER_SCRIPTED,
+    LAYER_SPEECH,
+    LAYER_MANUAL,
+    LAYER_COUNT
+};
+
+enum MixJoint : uint8_t {
+    MIX_WING_1,
+    MIX_WING_2,
+    MIX_NECK,
+    MIX_MOUTH,
+    MIX_JOINTS
+};
+
+class AnimationMixer {
+public:
+    explicit AnimationMixer(ServoDriver* pwmController);
+
+    // Target for one joint on one layer; the layer fades in over its fade
+    // time if it wasn't already driving the joint (fadeMs < 0: the default)
+    void set(AnimLayer layer, MixJoint joint, int pulseUs, int fadeMs = -1);
+    // Fade the layer out of one joint, or of all of them
+    void release(AnimLayer layer, MixJoint joint, int fadeMs = -1);
+    void releaseLayer(AnimLayer layer, int fadeMs = -1);
+
+    // Higher wins; the defaults follow the enum order
+    void setPriority(AnimLayer layer, int priority);
+    void setFadeMs(AnimLayer layer, int fadeMs);
+
+    // Once per tick: advance fades, blend, ease, write one frame
+    void evaluate(uint64_t nowNs);
+    // Drive every joint to rest at once (shutdown)
+    void park();
+
+    uint16_t pulse(MixJoint joint) const { return written[joint]; }
+    bool driving(AnimLayer layer, MixJoint joint) const { return goal[cell(layer, joint)] > 0.0f; }
+    float target(AnimLayer layer, MixJoint joint) const { return targets[cell(layer, joint)]; }
+    float weight(AnimLayer layer, MixJoint joint) const { return weights[cell(layer, joint)]; }
+    // Largest weight the layer has on any joint, for the UI
+    float layerWeight(AnimLayer layer) const;
+    // Bus transactions the last evaluate() made (0 or 1, unless waking)
+    unsigned int framesWritten() const { return frames; }
+
+    static const char* layerName(AnimLayer layer);
+
+private:
+    struct JointSpec {
+        uint8_t channel;
+        uint16_t minUs, maxUs, restUs;
+        uint16_t maxStepUs;    // per tick, 0 = unlimited
+        int smoothDiv;         // each tick closes 1/smoothDiv of the gap
+        uint16_t (*counts)(int);
+    };
+    static const JointSpec JOINTS[MIX_JOINTS];
+    static constexpr int MIX_CELLS = static_cast<int>(LAYER_COUNT) * MIX_JOINTS;
+    static int cell(AnimLayer layer, MixJoint joint) { return static_cast<int>(layer) * MIX_JOINTS + joint; }
+
+    ServoDriver* pwm;
+
+    // [cell(layer, joint)]
+    float targets[MIX_CELLS];
+    float weights[MIX_CELLS];
+    float goal[MIX_CELLS];      // 0 or 1
+    float rate[MIX_CELLS];      // weight change per ms
+
+    int priority[LAYER_COUNT];
+    int fadeMs[LAYER_COUNT];
+    uint8_t order[LAYER_COUNT];                // lowest priority first
+
+    float eased[MIX_JOINTS];
+    uint16_t written[MIX_JOINTS];
+    uint64_t lastNs;
+    unsigned int frames;
+
+    void fadeTo(int slot, float to, int ms);
+    void sortLayers();
+    void write(const bool* changed);
+};
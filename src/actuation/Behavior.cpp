@@ -0,0 +1,186 @@
+#include "Behavior.h"
+#include <cstdlib>
+
+// Fixed frame pool: a free list threaded through the unused frames
+namespace {
+    alignas(std::max_align_t) unsigned char pool[BehaviorScheduler::MAX_FRAMES][BehaviorScheduler::FRAME_BYTES];
+    void* freeList = nullptr;
+    bool poolReady = false;
+    int inUse = 0;
+    unsigned int refused = 0;
+
+    void* takeFrame(size_t size) {
+        if (!poolReady) {
+            for (int i = BehaviorScheduler::MAX_FRAMES - 1; i >= 0; i--) {
+                *reinterpret_cast<void**>(pool[i]) = freeList;
+                freeList = pool[i];
+            }
+            poolReady = true;
+        }
+        if (size > BehaviorScheduler::FRAME_BYTES || !freeList) {
+            refused++;
+            return nullptr;
+        }
+        void* frame = freeList;
+        freeList = *reinterpret_cast<void**>(frame);
+        inUse++;
+        return frame;
+    }
+
+    void giveFrame(void* frame) {
+        *reinterpret_cast<void**>(frame) = freeList;
+        freeList = frame;
+        inUse--;
+    }
+}
+
+void* Behavior::promise_type::operator new(size_t size) noexcept { return takeFrame(size); }
+void Behavior::promise_type::operator delete(void* frame) noexcept { giveFrame(frame); }
+
+void Behavior::promise_type::unhandled_exception() { abort(); }
+
+Behavior& Behavior::operator=(Behavior&& other) {
+    if (this != &other) {
+        if (handle) handle.destroy();
+        handle = other.handle;
+        other.handle = nullptr;
+    }
+    return *this;
+}
+
+std::coroutine_handle<> Behavior::await_suspend(Handle caller) {
+    promise_type& p = handle.promise();
+    p.scheduler = caller.promise().scheduler;
+    p.slot = caller.promise().slot;
+    p.continuation = caller;
+    return handle;
+}
+
+// A step hands control back to the behavior that awaited it; a behavior
+// that ends stays suspended here until the scheduler frees it
+std::coroutine_handle<> Behavior::FinalAwaiter::await_suspend(Handle h) noexcept {
+    promise_type& p = h.promise();
+    if (p.continuation) return p.continuation;
+    p.scheduler->slots[p.slot].done = true;
+    return std::noop_coroutine();
+}
+
+void BehaviorDelay::await_suspend(Behavior::Handle h) const {
+    h.promise().scheduler->suspend(h.promise().slot, h, ms);
+}
+
+bool BehaviorClock::await_suspend(Behavior::Handle h) {
+    ms = h.promise().scheduler->nowMs;
+    return false;
+}
+
+Behavior moveTo(AnimationMixer& mixer, AnimLayer layer, MixJoint joint, int pulseUs, int durationMs) {
+    int from = mixer.driving(layer, joint) ? static_cast<int>(mixer.target(layer, joint)) : mixer.pulse(joint);
+    long long start = co_await behaviorNow();
+    for (long long elapsed = 0; elapsed < durationMs; elapsed = co_await behaviorNow() - start) {
+        mixer.set(layer, joint, from + static_cast<int>((pulseUs - from) * elapsed / durationMs));
+        co_await nextTick();
+    }
+    mixer.set(layer, joint, pulseUs);
+}
+
+BehaviorScheduler::BehaviorScheduler(long long (*clockFn)())
+    : clock(clockFn), ticks(0), nowMs(clockFn()), nextId(0) {
+    for (int i = 0; i < MAX_BEHAVIORS; i++) {
+        slots[i].id = 0;
+        slots[i].wakeMs = 0;
+        slots[i].readyTick = 0;
+        slots[i].resuming = false;
+        slots[i].done = false;
+    }
+}
+
+BehaviorScheduler::~BehaviorScheduler() {
+    cancelAll();
+}
+
+uint32_t BehaviorScheduler::start(Behavior behavior) {
+    if (!behavior.valid()) return 0;
+    int i = 0;
+    while (i < MAX_BEHAVIORS && slots[i].id) i++;
+    if (i == MAX_BEHAVIORS) return 0;
+
+    Slot& s = slots[i];
+    if (++nextId == 0) nextId = 1;
+    s.id = nextId;
+    s.root = static_cast<Behavior&&>(behavior);
+    s.root.handle.promise().scheduler = this;
+    s.root.handle.promise().slot = i;
+    s.leaf = s.root.handle;
+    s.done = false;
+    nowMs = clock();
+    uint32_t id = s.id;
+    resume(i);
+    return id;
+}
+
+void BehaviorScheduler::resume(int i) {
+    Slot& s = slots[i];
+    s.resuming = true;
+    s.leaf.resume();
+    s.resuming = false;
+    if (s.done) retire(i);
+}
+
+void BehaviorScheduler::retire(int i) {
+    Slot& s = slots[i];
+    s.id = 0;
+    s.done = false;
+    // Destroys its frame, and those of the steps it is suspended in
+    s.root = Behavior();
+}
+
+void BehaviorScheduler::suspend(int i, std::coroutine_handle<> leaf, long long ms) {
+    Slot& s = slots[i];
+    s.leaf = leaf;
+    s.wakeMs = nowMs + ms;
+    s.readyTick = ticks + 1;
+}
+
+// A behavior cancelled from inside its own resume (a step that turns off
+// the controller running it) is freed once it suspends
+void BehaviorScheduler::cancel(uint32_t id) {
+    if (!id) return;
+    for (int i = 0; i < MAX_BEHAVIORS; i++) {
+        if (slots[i].id != id) continue;
+        if (slots[i].resuming) slots[i].done = true;
+        else retire(i);
+        return;
+    }
+}
+
+void BehaviorScheduler::cancelAll() {
+    for (int i = 0; i < MAX_BEHAVIORS; i++)
+        if (slots[i].id) cancel(slots[i].id);
+}
+
+bool BehaviorScheduler::running(uint32_t id) const {
+    if (!id) return false;
+    for (int i = 0; i < MAX_BEHAVIORS; i++)
+        if (slots[i].id == id && !slots[i].done) return true;
+    return false;
+}
+
+int BehaviorScheduler::active() const {
+    int n = 0;
+    for (int i = 0; i < MAX_BEHAVIORS; i++)
+        if (slots[i].id && !slots[i].done) n++;
+    return n;
+}
+
+void BehaviorScheduler::tick() {
+    ticks++;
+    nowMs = clock();
+    for (int i = 0; i < MAX_BEHAVIORS; i++) {
+        Slot& s = slots[i];
+        if (s.id && !s.done && !s.resuming && s.readyTick <= ticks && nowMs >= s.wakeMs) resume(i);
+    }
+}
+
+int BehaviorScheduler::framesInUse() { return inUse; }
+unsigned int BehaviorScheduler::framesRefused() { return refused; }
@@ -0,0 +1,157 @@
+#pragma once
+#include "AnimationMixer.h"
+#include "../trace/SessionLog.h"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+
+// Multi-step motions written as straight-line code. A behavior is a C++20
+// coroutine returning Behavior; it suspends on delay() or nextTick() and the
+// scheduler resumes it from the main loop tick, just before the mixer
+// evaluates:
+//
+//   Behavior bow(AnimationMixer& mixer) {
+//       co_await moveTo(mixer, LAYER_SCRIPTED, MIX_NECK, 2100, 300);
+//       co_await delay(500);
+//       co_await moveTo(mixer, LAYER_SCRIPTED, MIX_NECK, 1500, 300);
+//   }
+//   uint32_t id = behaviors.start(bow(mixer));
+//
+// Awaiting a Behavior runs it to completion as a step of the caller. Many
+// behaviors run side by side, and cancel() destroys one wherever it is
+// suspended, running the destructors of its locals (and of any step it is
+// awaiting), so a guard object can put the joints back.
+//
+// Frames come from a fixed pool, never the heap: a behavior whose frame
+// doesn't fit, or that finds the pool full, never starts (start() returns
+// 0, an awaited step is skipped) and is counted. Main thread only.
+
+class BehaviorScheduler;
+
+class Behavior {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle h) noexcept;
+        void await_resume() const noexcept {}
+    };
+
+    struct promise_type {
+        BehaviorScheduler* scheduler = nullptr;
+        int slot = -1;
+        std::coroutine_handle<> continuation;   // the behavior awaiting this one
+
+        static void* operator new(size_t size) noexcept;
+        static void operator delete(void* frame) noexcept;
+        static Behavior get_return_object_on_allocation_failure() { return Behavior(); }
+
+        Behavior get_return_object() { return Behavior(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception();
+    };
+
+    Behavior() {}
+    Behavior(Behavior&& other) : handle(other.handle) { other.handle = nullptr; }
+    Behavior& operator=(Behavior&& other);
+    ~Behavior() { if (handle) handle.destroy(); }
+
+    // False if its frame couldn't be allocated
+    bool valid() const { return static_cast<bool>(handle); }
+
+    // Awaited as a step: runs now, and the caller continues when it ends
+    bool await_ready() const { return !handle; }
+    std::coroutine_handle<> await_suspend(Handle caller);
+    void await_resume() const {}
+
+private:
+    Handle handle;
+
+    explicit Behavior(Handle h) : handle(h) {}
+    friend class BehaviorScheduler;
+
+    Behavior(const Behavior&) = delete;
+    Behavior& operator=(const Behavior&) = delete;
+};
+
+// co_await delay(ms): resumes on the first tick at least ms later (0: the next tick)
+struct BehaviorDelay {
+    long long ms;
+    bool await_ready() const { return false; }
+    void await_suspend(Behavior::Handle h) const;
+    void await_resume() const {}
+};
+
+// co_await behaviorNow(): the scheduler's time in ms, as of this tick
+struct BehaviorClock {
+    long long ms;
+    bool await_ready() const { return false; }
+    bool await_suspend(Behavior::Handle h);   // never suspends
+    long long await_resume() const { return ms; }
+};
+
+inline BehaviorDelay delay(long long ms) { return BehaviorDelay{ms}; }
+inline BehaviorDelay nextTick() { return BehaviorDelay{0}; }
+inline BehaviorClock behaviorNow() { return BehaviorClock{0}; }
+
+// Glide a joint on a layer from where it is to pulseUs over durationMs,
+// one target per tick
+Behavior moveTo(AnimationMixer& mixer, AnimLayer layer, MixJoint joint, int pulseUs, int durationMs);
+
+class BehaviorScheduler {
+public:
+    // clock is the session clock unless a test supplies its own
+    explicit BehaviorScheduler(long long (*clock)() = Session::nowMs);
+    ~BehaviorScheduler();
+
+    // Runs the behavior up to its first suspension. Returns its id, or 0 if
+    // it has no frame or every slot is taken.
+    uint32_t start(Behavior behavior);
+    void cancel(uint32_t id);
+    void cancelAll();
+    bool running(uint32_t id) const;
+    int active() const;
+
+    // Once per main loop tick: resume every behavior that is due
+    void tick();
+
+    // The frame pool, shared by every scheduler
+    static int framesInUse();
+    static unsigned int framesRefused();
+
+    static constexpr int    MAX_BEHAVIORS = 16;
+    static constexpr int    MAX_FRAMES    = 48;     // nested steps take a frame each
+    static constexpr size_t FRAME_BYTES   = 512;
+
+private:
+    struct Slot {
+        Behavior root;
+        std::coroutine_handle<> leaf;   // innermost suspended step
+        long long wakeMs;
+        unsigned long readyTick;        // not resumed in the tick it suspended
+        uint32_t id;
+        bool resuming;
+        bool done;
+    };
+
+    long long (*clock)();
+    Slot slots[MAX_BEHAVIORS];
+    unsigned long ticks;
+    long long nowMs;
+    uint32_t nextId;
+
+    void resume(int slot);
+    void retire(int slot);
+    void suspend(int slot, std::coroutine_handle<> leaf, long long ms);
+
+    friend class Behavior;
+    friend struct BehaviorDelay;
+    friend struct BehaviorClock;
+
+    BehaviorScheduler(const BehaviorScheduler&) = delete;
+    BehaviorScheduler& operator=(const BehaviorScheduler&) = delete;
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include "../i2c/PCA9685.h"
+#include <cstdint>
+
+// Every servo joint, declared once. A joint is a type whose channel, pulse
+// range, rest position and speed limit are template arguments, so clamp()
+// and counts() compile to integer code with the constants folded in, and a
+// table that would drive a servo past its end stop or put two joints on one
+// channel fails the build.
+
+// What a hobby servo accepts, and the PCA9685 frame at 50 Hz
+static constexpr uint16_t SERVO_PULSE_MIN_US = 500;
+static constexpr uint16_t SERVO_PULSE_MAX_US = 2500;
+static constexpr uint32_t PWM_PERIOD_US      = 20000;
+static constexpr uint32_t PWM_STEPS          = 4096;
+
+// 0-180 degrees onto 1000-2000 us, the mapping setServoAngle() uses
+constexpr uint16_t servoAngleUs(unsigned int degrees) {
+    return static_cast<uint16_t>(1000 + degrees * 1000 / 180);
+}
+
+template <uint8_t Channel, uint16_t MinUs, uint16_t MaxUs, uint16_t RestUs,
+          uint16_t MaxStepUs, bool Reversed = false>
+struct Joint {
+    static constexpr uint8_t  CHANNEL     = Channel;
+    static constexpr uint16_t MIN_US      = MinUs;
+    static constexpr uint16_t MAX_US      = MaxUs;
+    static constexpr uint16_t REST_US     = RestUs;
+    static constexpr uint16_t MAX_STEP_US = MaxStepUs;   // per update, 0 = unlimited
+    static constexpr bool     REVERSED    = Reversed;    // mounted mirrored
+
+    static_assert(Channel < PCA9685_CHANNELS, "joint channel is not a PCA9685 output");
+    static_assert(MinUs < MaxUs, "joint pulse range is empty");
+    static_assert(MinUs >= SERVO_PULSE_MIN_US && MaxUs <= SERVO_PULSE_MAX_US,
+                  "joint pulse range is outside what the servo accepts");
+    static_assert(RestUs >= MinUs && RestUs <= MaxUs, "joint rest position is outside its range");
+
+    static constexpr bool contains(int us) { return us >= MinUs && us <= MaxUs; }
+
+    static constexpr uint16_t clamp(int us) {
+        return static_cast<uint16_t>(us < MinUs ? MinUs : us > MaxUs ? MaxUs : us);
+    }
+
+    // From one position toward another, no further than MAX_STEP_US
+    static constexpr uint16_t step(int from, int to) {
+        return clamp(MaxStepUs == 0 || (to - from <= MaxStepUs && from - to <= MaxStepUs) ? to
+                     : to > from ? from + MaxStepUs : from - MaxStepUs);
+    }
+
+    // PCA9685 off count; a reversed joint mirrors within its range
+    static constexpr uint16_t counts(int us) {
+        return static_cast<uint16_t>((Reversed ? MinUs + MaxUs - clamp(us) : clamp(us)) * PWM_STEPS / PWM_PERIOD_US);
+    }
+};
+
+template <uint8_t C, uint16_t L, uint16_t H, uint16_t R, uint16_t S, bool V>
+constexpr uint8_t Joint<C, L, H, R, S, V>::CHANNEL;
+template <uint8_t C, uint16_t L, uint16_t H, uint16_t R, uint16_t S, bool V>
+constexpr uint16_t Joint<C, L, H, R, S, V>::MIN_US;
+template <uint8_t C, uint16_t L, uint16_t H, uint16_t R, uint16_t S, bool V>
+constexpr uint16_t Joint<C, L, H, R, S, V>::MAX_US;
+template <uint8_t C, uint16_t L, uint16_t H, uint16_t R, uint16_t S, bool V>
+constexpr uint16_t Joint<C, L, H, R, S, V>::REST_US;
+template <uint8_t C, uint16_t L, uint16_t H, uint16_t R, uint16_t S, bool V>
+constexpr uint16_t Joint<C, L, H, R, S, V>::MAX_STEP_US;
+template <uint8_t C, uint16_t L, uint16_t H, uint16_t R, uint16_t S, bool V>
+constexpr bool Joint<C, L, H, R, S, V>::REVERSED;
+
+// A set of joints; distinct() is false if two share a channel
+template <typename... Joints> struct JointTable;
+
+template <> struct JointTable<> {
+    static constexpr bool uses(uint8_t) { return false; }
+    static constexpr bool distinct() { return true; }
+};
+
+template <typename J, typename... Rest> struct JointTable<J, Rest...> {
+    static constexpr bool uses(uint8_t channel) {
+        return J::CHANNEL == channel || JointTable<Rest...>::uses(channel);
+    }
+    static constexpr bool distinct() {
+        return !JointTable<Rest...>::uses(J::CHANNEL) && JointTable<Rest...>::distinct();
+    }
+};
+
+// Taro's servos: channel, min, max and rest us, max step per update, reversed
+typedef Joint<0, servoAngleUs(0), servoAngleUs(180), servoAngleUs(60), 0>       Wing1Joint;
+typedef Joint<1, servoAngleUs(0), servoAngleUs(180), servoAngleUs(0),  0, true> Wing2Joint;
+typedef Joint<2, 500, 2500, 1500, 400> NeckJoint;
+typedef Joint<3, 850, 1300, 850,  50>  MouthJoint;
+
+typedef JointTable<Wing1Joint, Wing2Joint, NeckJoint, MouthJoint> TaroJoints;
+static_assert(TaroJoints::distinct(), "two joints share a PCA9685 channel");
+
+// Raised wing poses. Wing 2 is mounted mirrored, so both raise by increasing
+// pulse in their own frame (160 and 80 degrees on the horn).
+static constexpr uint16_t WING_1_UP_US = servoAngleUs(160);
+static constexpr uint16_t WING_2_UP_US = servoAngleUs(100);
+static_assert(Wing1Joint::contains(WING_1_UP_US) && Wing2Joint::contains(WING_2_UP_US),
+              "wing pose is outside its joint range");
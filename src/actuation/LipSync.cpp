@@ -0,0 +1,66 @@
+#include "LipSync.h"
+#include <algorithm>
+#include <cmath>
+
+LipSync::LipSync() : hop(1), totalFrames(0), onsets(0), minPulse(0), maxPulse(0) {}
+
+LipSync::LipSync(const uint8_t* track, size_t hops, size_t hopFrames, size_t count,
+                 uint16_t minPulse, uint16_t maxPulse)
+    : hop(hopFrames ? hopFrames : 1), totalFrames(count), onsets(0),
+      minPulse(minPulse), maxPulse(maxPulse), openness(track, track + hops) {
+    // Never index past the stored track, whatever the header claimed
+    if (totalFrames > hops * hop) totalFrames = hops * hop;
+}
+
+LipSync::LipSync(const short* pcm, size_t count, unsigned int rate,
+                 uint16_t minPulse, uint16_t maxPulse)
+    : hop(rate * HOP_MS / 1000), totalFrames(count), onsets(0),
+      minPulse(minPulse), maxPulse(maxPulse) {
+    size_t hops = (count + hop - 1) / hop;
+    std::vector<double> env(hops, 0.0);
+    for (size_t h = 0; h < hops; h++) {
+        size_t start = h * hop, end = std::min(count, start + hop);
+        double sum = 0.0;
+        for (size_t i = start; i < end; i++) sum += static_cast<double>(pcm[i]) * pcm[i];
+        env[h] = std::sqrt(sum / (end - start));
+    }
+
+    // Loud level: 95th percentile, so a single plosive doesn't flatten the rest
+    std::vector<double> sorted(env);
+    std::sort(sorted.begin(), sorted.end());
+    double loud = sorted.empty() ? 0.0 : sorted[static_cast<size_t>(0.95 * (sorted.size() - 1))];
+    if (loud < 1.0) loud = 1.0;
+
+    std::vector<double> open(hops, 0.0);
+    for (size_t h = 0; h < hops; h++) {
+        double level = env[h] / loud;
+        open[h] = level < SILENCE_LEVEL ? 0.0 : std::pow(std::min(level, 1.0), OPEN_CURVE);
+    }
+
+    // Syllables: start the jaw moving ahead of each onset, and pull it shut
+    // in the dip before the next one so consecutive syllables read as separate
+    int sinceOnset = ONSET_GAP_HOPS;
+    double peak = 0.0;
+    for (size_t h = 2; h < hops; h++, sinceOnset++) {
+        double rise = (env[h] - env[h - 2]) / loud;
+        if (rise > ONSET_RISE && sinceOnset >= ONSET_GAP_HOPS) {
+            onsets++;
+            sinceOnset = 0;
+            peak = 0.0;
+            for (size_t k = h; k < std::min(hops, h + 4); k++) peak = std::max(peak, open[k]);
+            for (int k = 1; k <= ONSET_LEAD_HOPS && h >= static_cast<size_t>(k); k++)
+                open[h - k] = std::max(open[h - k], peak * (ONSET_LEAD_HOPS + 1 - k) / (ONSET_LEAD_HOPS + 1));
+        }
+        peak = std::max(peak, open[h]);
+        if (peak > 0.0 && open[h] < 0.5 * peak) open[h] *= 0.5;
+    }
+
+    openness.resize(hops);
+    for (size_t h = 0; h < hops; h++)
+        openness[h] = static_cast<uint8_t>(std::min(open[h], 1.0) * 255.0 + 0.5);
+}
+
+uint16_t LipSync::pulseAt(double frame) const {
+    if (frame < 0.0 || frame >= totalFrames) return minPulse;
+    return minPulse + openness[static_cast<size_t>(frame) / hop] * (maxPulse - minPulse) / 255;
+}
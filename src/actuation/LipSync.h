@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Mouth trajectory for a clip whose samples are all known up front (TTS).
+// The clip is cut into 10 ms hops. Each hop gets an RMS envelope normalised
+// to the clip's own loud level. Syllable onsets (sharp envelope rises) pull
+// the jaw open a couple of hops early, and the jaw closes between syllables
+// instead of hanging at the last level.
+//
+// The track itself is one openness byte per hop (0 closed, 255 fully open),
+// so it can be stored with the clip and mapped onto any servo range.
+class LipSync {
+public:
+    LipSync();
+    LipSync(const short* pcm, size_t count, unsigned int rate,
+            uint16_t minPulse, uint16_t maxPulse);
+    // A track computed earlier (e.g. from the speech cache)
+    LipSync(const uint8_t* openness, size_t hops, size_t hopFrames, size_t count,
+            uint16_t minPulse, uint16_t maxPulse);
+
+    // Pulse for the mouth at sample position frame of the clip; closed
+    // before the start and after the end
+    uint16_t pulseAt(double frame) const;
+
+    size_t frames() const { return totalFrames; }
+    size_t onsetCount() const { return onsets; }
+    const std::vector<uint8_t>& track() const { return openness; }
+    size_t hopFrames() const { return hop; }
+
+private:
+    static constexpr int    HOP_MS           = 10;
+    static constexpr double SILENCE_LEVEL    = 0.08;  // of the loud level
+    static constexpr double ONSET_RISE       = 0.25;  // rise over two hops
+    static constexpr int    ONSET_GAP_HOPS   = 8;     // shortest syllable
+    static constexpr int    ONSET_LEAD_HOPS  = 2;
+    static constexpr double OPEN_CURVE       = 0.7;   // <1 favours small openings
+
+    size_t hop;
+    size_t totalFrames;
+    size_t onsets;
+    uint16_t minPulse;
+    uint16_t maxPulse;
+    std::vector<uint8_t> openness;
+};
@@ -1,59 +1,122 @@
 #include "../actuation/Mouth.h"
+#include "../audio/Effects.h"
+#include "../trace/SessionLog.h"
+#include "../trace/Trace.h"
 #include <cmath>
+#include <cstdlib>
 #include <algorithm>
-#include <unistd.h>
 
-template <typename T>
-static T clamp(T v, T lo, T hi) { return v < lo ? lo : v > hi ? hi : v; }
-
-Mouth::Mouth(PCA9685* pwmController)
-    : pwm(pwmController),
-      audio([this](short* buf, int frames) { onAudioFrame(buf, frames); }),
-      prevServoPulse(SERVO_MIN_PULSE) {
-    pwm->setServoPulse(MOUTH_SERVO_CHANNEL, SERVO_MIN_PULSE);
-}
+Mouth::Mouth(AnimationMixer* animationMixer, AudioBackend* audioDevices)
+    : mixer(animationMixer),
+      audio([this](short* buf, int frames) { onAudioFrame(buf, frames); }, audioDevices,
+            [this](AudioSource source) { onSourceChange(source); }),
+      jawPulse(MouthJoint::REST_US), jawMs(0),
+      levelState(MouthJoint::REST_US), levelPulse(MouthJoint::REST_US), levelSeq(0), levelSeen(0) {}
 
 Mouth::~Mouth() { stop(); }
 
 void Mouth::stop() {
     audio.stop();
-    pwm->setServoPulse(MOUTH_SERVO_CHANNEL, SERVO_MIN_PULSE);
+    mixer->release(LAYER_SPEECH, MIX_MOUTH, 0);
 }
 
+// The mouth is closed from the audio thread once the pause takes effect,
+// so a block still in flight can't reopen it afterwards
 void Mouth::pause() {
     audio.pause();
-    pwm->setServoPulse(MOUTH_SERVO_CHANNEL, SERVO_MIN_PULSE);
 }
 
 void Mouth::resume() {
     audio.resume();
 }
 
-void Mouth::setServoPulse(uint16_t pulse) {
-    pulse = clamp(pulse, SERVO_MIN_PULSE, SERVO_MAX_PULSE);
-    prevServoPulse = pulse;
-    pwm->setServoPulse(MOUTH_SERVO_CHANNEL, pulse);
+void Mouth::setJaw(uint16_t pulse) {
+    TraceSpan span(TRACE_MOUTH_SET);
+    jawPulse = MouthJoint::clamp(pulse);
+    jawMs = Session::nowMs();
+    mixer->set(LAYER_SPEECH, MIX_MOUTH, jawPulse);
+}
+
+bool Mouth::speak(const short* pcm, size_t count) {
+    return speak(pcm, count, LipSync(pcm, count, Audio::SAMPLE_RATE, SERVO_MIN_PULSE, SERVO_MAX_PULSE));
+}
+
+bool Mouth::speak(const short* pcm, size_t count, const LipSync& track) {
+    Speech s = { 0, track };
+    s.clipId = audio.playClip(pcm, count);
+    if (!s.clipId) return false;
+    speech.push_back(s);
+    return true;
+}
+
+bool Mouth::takeBargeIn() {
+    if (!audio.takeBargeIn()) return false;
+    speech.clear();
+    mixer->release(LAYER_SPEECH, MIX_MOUTH);
+    return true;
+}
+
+void Mouth::update() {
+    audio.collect();
+    // Microphone level from the audio thread
+    uint32_t seq = levelSeq.load();
+    if (seq != levelSeen) {
+        levelSeen = seq;
+        setJaw(levelPulse.load());
+    }
+    if (!speech.empty()) {
+        const Speech& front = speech.front();
+        ClipClock clock;
+        if (audio.getClipClock(clock) && clock.id >= front.clipId) {
+            if (clock.id > front.clipId) {
+                speech.pop_front();
+                return;
+            }
+            // Clip position the listener will hear SPEECH_LEAD_MS from now
+            uint64_t target = Session::nowNs() + SPEECH_LEAD_MS * 1000000ULL;
+            double frame = clock.frame + (static_cast<double>(target) - clock.audibleNs)
+                                       * Audio::SAMPLE_RATE / 1e9;
+            if (frame >= front.track.frames() && !audio.isClipPlaying()) {
+                speech.pop_front();
+                mixer->release(LAYER_SPEECH, MIX_MOUTH);
+                return;
+            }
+            uint16_t pulse = front.track.pulseAt(frame);
+            if (!mixer->driving(LAYER_SPEECH, MIX_MOUTH) ||
+                std::abs(static_cast<int>(pulse) - jawPulse) > SERVO_MOVEMENT_THRESHOLD)
+                setJaw(pulse);
+            return;
+        }
+    }
+    // Nothing new for a while: hand the jaw back to the layers below
+    if (mixer->driving(LAYER_SPEECH, MIX_MOUTH) && Session::nowMs() - jawMs > SPEECH_HOLD_MS)
+        mixer->release(LAYER_SPEECH, MIX_MOUTH);
+}
+
+void Mouth::onSourceChange(AudioSource source) {
+    if (source != AudioSource::NONE) return;
+    levelState = MouthJoint::REST_US;
+    levelPulse = MouthJoint::REST_US;
+    levelSeq++;
 }
 
 void Mouth::onAudioFrame(short* buffer, int size) {
-    double sum = 0.0;
-    for (int i = 0; i < size; i++) sum += std::abs(buffer[i]);
-    double avgAmplitude = sum / size;
+    // Clips are speech; update() drives the jaw for those
+    if (audio.getSource() == AudioSource::CLIP) return;
+    TraceSpan span(TRACE_MOUTH_FRAME);
+    double avgAmplitude = meanAbsAmplitude(buffer, size);
     if (avgAmplitude < SOUND_MIN_THRESHOLD) return;
 
     double normalized = std::min((avgAmplitude / 32768.0) * 2.0, 1.0);
-    uint16_t targetPulse = clamp<uint16_t>(
-        SERVO_MIN_PULSE + normalized * (SERVO_MAX_PULSE - SERVO_MIN_PULSE),
-        SERVO_MIN_PULSE, SERVO_MAX_PULSE);
-
-    double delta    = clamp(static_cast<double>(targetPulse - prevServoPulse),
-                            -MAX_SERVO_SPEED, MAX_SERVO_SPEED);
-    double smoothed = clamp(prevServoPulse + delta * SMOOTHING_FACTOR,
-                            (double)SERVO_MIN_PULSE, (double)SERVO_MAX_PULSE);
-
-    if (std::fabs(smoothed - prevServoPulse) > SERVO_MOVEMENT_THRESHOLD) {
-        prevServoPulse = static_cast<uint16_t>(smoothed);
-        pwm->setServoPulse(MOUTH_SERVO_CHANNEL, prevServoPulse);
-        usleep(SERVO_UPDATE_DELAY_US);
+    uint16_t targetPulse = MouthJoint::clamp(
+        static_cast<int>(SERVO_MIN_PULSE + normalized * (SERVO_MAX_PULSE - SERVO_MIN_PULSE)));
+
+    int stepped = MouthJoint::step(levelState, targetPulse);
+    double smoothed = levelState + (stepped - levelState) * SMOOTHING_FACTOR;
+
+    if (std::fabs(smoothed - levelState) > SERVO_MOVEMENT_THRESHOLD) {
+        levelState = static_cast<uint16_t>(smoothed);
+        levelPulse = levelState;
+        levelSeq++;
     }
-}
\ No newline at end of file
+}
@@ -1,32 +1,69 @@
 #pragma once
-#include "../i2c/PCA9685.h"
 #include "../audio/Audio.h"
+#include "AnimationMixer.h"
+#include "LipSync.h"
+#include "Joints.h"
+#include <atomic>
 #include <cstdint>
+#include <deque>
 
-#define MOUTH_SERVO_CHANNEL 3
-
+// The jaw on the speech layer. During a speech clip it follows the clip's
+// lip sync track; otherwise the audio thread turns the microphone level
+// into a smoothed pulse, which update() hands to the mixer. The layer is
+// released once the jaw has had nothing new for SPEECH_HOLD_MS.
 class Mouth {
 public:
-    Mouth(PCA9685* pwmController);
+    Mouth(AnimationMixer* animationMixer, AudioBackend* audioDevices);
     ~Mouth();
     void stop();
     void pause();
     void resume();
-    void setServoPulse(uint16_t pulse);
-    int getServoPulse() const { return prevServoPulse; }
+    int getServoPulse() const { return mixer->pulse(MIX_MOUTH); }
+    Audio& getAudio() { return audio; }
 
-private:
-    PCA9685* pwm;
-    Audio audio;
-    uint16_t prevServoPulse;
+    // Play synthesized speech (mono, Audio::SAMPLE_RATE) with a mouth
+    // trajectory computed from the whole clip. update() then steers the
+    // jaw from the playback clock, SPEECH_LEAD_MS ahead of the audio.
+    bool speak(const short* pcm, size_t count);
+    bool speak(const short* pcm, size_t count, const LipSync& track);
+    void update();   // once per main loop tick, before the mixer
+    bool isSpeaking() const { return !speech.empty(); }
+    // True once when a guest has talked over the speech: the audio thread
+    // has already stopped it; the queued speech is dropped and the jaw let go
+    bool takeBargeIn();
 
-    static constexpr uint16_t SERVO_MIN_PULSE        = 850;
-    static constexpr uint16_t SERVO_MAX_PULSE        = 1300;
+    // Tuning (public so the latency harness can report what it measured)
+    static constexpr uint16_t SERVO_MIN_PULSE        = MouthJoint::MIN_US;
+    static constexpr uint16_t SERVO_MAX_PULSE        = MouthJoint::MAX_US;
     static constexpr int      SOUND_MIN_THRESHOLD    = 50;
     static constexpr double   SMOOTHING_FACTOR       = 0.8;
     static constexpr double   SERVO_MOVEMENT_THRESHOLD = 5.0;
-    static constexpr int      SERVO_UPDATE_DELAY_US  = 20000;
-    static constexpr double   MAX_SERVO_SPEED        = 50.0;
+    static constexpr int      SPEECH_HOLD_MS         = 300;
+    static constexpr int      MAX_SERVO_SPEED        = MouthJoint::MAX_STEP_US;
+    // Servo response time to hide: raise until the jaw stops trailing the voice
+    static constexpr int      SPEECH_LEAD_MS         = 80;
+
+private:
+    AnimationMixer* mixer;
+    Audio audio;
+    uint16_t jawPulse;            // last sent to the speech layer
+    long long jawMs;              // when
+
+    // Audio thread: smoothed level pulse, published with a count the main
+    // thread compares against
+    uint16_t levelState;
+    std::atomic<uint16_t> levelPulse;
+    std::atomic<uint32_t> levelSeq;
+    uint32_t levelSeen;
+
+    // Main thread only: speech queued or playing, oldest first
+    struct Speech {
+        uint32_t clipId;
+        LipSync track;
+    };
+    std::deque<Speech> speech;
 
+    void setJaw(uint16_t pulse);
     void onAudioFrame(short* buffer, int frames);
+    void onSourceChange(AudioSource source);
 };
\ No newline at end of file
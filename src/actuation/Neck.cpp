@@ -1,48 +1,57 @@
 #include "Neck.h"
-#include <cmath>
-#include <algorithm>
+#include <cstdlib>
 
-Neck::Neck(PCA9685* pwmController)
-    : pwm(pwmController),
-      headCurrent(NECK_CENTER_PULSE),
-      headTarget(NECK_CENTER_PULSE),
-      recentering(false) {
-    pwm->setServoPulse(NECK_CHANNEL, static_cast<uint16_t>(NECK_CENTER_PULSE));
+Neck::Neck(AnimationMixer* animationMixer, BehaviorScheduler* scheduler)
+    : mixer(animationMixer),
+      behaviors(scheduler),
+      recentering(0) {}
+
+void Neck::setTarget(int pulseUs, AnimLayer layer) {
+    if (layer == LAYER_MANUAL) behaviors->cancel(recentering);
+    mixer->set(layer, MIX_NECK, NeckJoint::clamp(pulseUs));
+}
+
+void Neck::release(AnimLayer layer) {
+    if (layer == LAYER_MANUAL) behaviors->cancel(recentering);
+    mixer->release(layer, MIX_NECK);
 }
 
-void Neck::setTarget(double pulse) {
-    recentering = false;
-    headTarget = std::max(NECK_MIN_PULSE, std::min(NECK_MAX_PULSE, pulse));
+// A key press moves from the manual target, or from where the neck is if
+// the manual layer isn't holding it
+static int manualBase(const AnimationMixer* mixer) {
+    return mixer->driving(LAYER_MANUAL, MIX_NECK) ? static_cast<int>(mixer->target(LAYER_MANUAL, MIX_NECK))
+                                                  : mixer->pulse(MIX_NECK);
 }
 
 void Neck::turnLeft() {
-    if (recentering) return;
-    headTarget = std::max(headTarget - NECK_STEP, NECK_MIN_PULSE);
+    if (isRecentering()) return;
+    mixer->set(LAYER_MANUAL, MIX_NECK, NeckJoint::clamp(manualBase(mixer) - NECK_STEP));
 }
 
 void Neck::turnRight() {
-    if (recentering) return;
-    headTarget = std::min(headTarget + NECK_STEP, NECK_MAX_PULSE);
+    if (isRecentering()) return;
+    mixer->set(LAYER_MANUAL, MIX_NECK, NeckJoint::clamp(manualBase(mixer) + NECK_STEP));
 }
 
 void Neck::recenter() {
-    recentering = true;
-    headTarget = NECK_CENTER_PULSE;
+    behaviors->cancel(recentering);
+    recentering = behaviors->start(recenterMotion());
+    if (!recentering) mixer->set(LAYER_MANUAL, MIX_NECK, NeckJoint::REST_US);
 }
 
-void Neck::update() {
-    headCurrent += (headTarget - headCurrent) * NECK_SMOOTH;
-    pwm->setServoPulse(NECK_CHANNEL, static_cast<uint16_t>(headCurrent));
-    if (recentering && fabs(headCurrent - NECK_CENTER_PULSE) < 1.0) {
-        headCurrent = NECK_CENTER_PULSE;
-        recentering = false;
-    }
+Behavior Neck::recenterMotion() {
+    mixer->set(LAYER_MANUAL, MIX_NECK, NeckJoint::REST_US);
+    while (abs(mixer->pulse(MIX_NECK) - NeckJoint::REST_US) > 1) co_await nextTick();
+}
+
+Behavior Neck::moveTo(int pulseUs, int durationMs, AnimLayer layer) {
+    return ::moveTo(*mixer, layer, MIX_NECK, NeckJoint::clamp(pulseUs), durationMs);
 }
 
 uint16_t Neck::getServoPulse() const {
-    return static_cast<uint16_t>(headCurrent);
+    return mixer->pulse(MIX_NECK);
 }
 
 bool Neck::isRecentering() const {
-    return recentering;
-}
\ No newline at end of file
+    return behaviors->running(recentering);
+}
@@ -1,28 +1,32 @@
 #pragma once
-#include "../i2c/PCA9685.h"
+#include "AnimationMixer.h"
+#include "Behavior.h"
+#include "Joints.h"
 
-#define NECK_CHANNEL 2
-#define NECK_CENTER_PULSE 1500.0
-#define NECK_MIN_PULSE 500.0
-#define NECK_MAX_PULSE 2500.0
-#define NECK_STEP 80.0
-#define NECK_SMOOTH 0.2
+#define NECK_STEP 80          // us per A/D keypress
 
+// Neck targets on the animation layers. Keys and recenter() use the manual
+// layer; the mixer eases the servo toward whatever the layers blend to.
+// Recentering is a behavior that holds off the keys until the neck is home;
+// a new manual target cancels it.
 class Neck {
 private:
-    PCA9685* pwm;
-    double headCurrent;
-    double headTarget;
-    bool recentering;
+    AnimationMixer* mixer;
+    BehaviorScheduler* behaviors;
+    uint32_t recentering;   // behavior id, 0 if none
+
+    Behavior recenterMotion();
 
 public:
-    Neck(PCA9685* pwmController);
+    Neck(AnimationMixer* animationMixer, BehaviorScheduler* scheduler);
 
-    void setTarget(double pulse);
+    void setTarget(int pulseUs, AnimLayer layer = LAYER_MANUAL);
+    void release(AnimLayer layer);   // fade the layer out of the neck
     void turnLeft();
     void turnRight();
     void recenter();
-    void update();  // call once per loop iteration
+    // Glide over durationMs, as a step of a behavior
+    Behavior moveTo(int pulseUs, int durationMs, AnimLayer layer = LAYER_SCRIPTED);
 
     uint16_t getServoPulse() const;
     bool isRecentering() const;
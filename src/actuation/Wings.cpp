@@ -1,17 +1,13 @@
 #include "Wings.h"
-#include "../i2c/PCA9685.h"
-#include <unistd.h>
+#include "../trace/SessionLog.h"
 
-Wings::Wings(PCA9685& pwmController) : pwm(pwmController) {
-    pwm.setServoAngle(WING_1_CHANNEL, WING_1_DOWN_ANGLE);
-    pwm.setServoAngle(WING_2_CHANNEL, WING_2_DOWN_ANGLE);
+Wings::Wings(AnimationMixer& animationMixer, BehaviorScheduler& scheduler)
+    : mixer(animationMixer), behaviors(scheduler) {
     lastFlapTime = getCurrentTimeMs() - WING_FLAP_COOLDOWN_MS;
 }
 
 long long Wings::getCurrentTimeMs() {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    return (long long)(tv.tv_sec) * 1000 + (long long)(tv.tv_usec) / 1000;
+    return Session::nowMs();
 }
 
 bool Wings::isReady() const {
@@ -19,20 +15,28 @@ bool Wings::isReady() const {
 }
 
 long long Wings::msSinceLastFlap() const {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    long long now = (long long)(tv.tv_sec) * 1000 + (long long)(tv.tv_usec) / 1000;
-    return now - lastFlapTime;
+    return Session::nowMs() - lastFlapTime;
 }
 
-bool Wings::flapWings() {
-    if (!isReady()) return false;
-
+bool Wings::flapWings(AnimLayer layer) {
+    if (!isReady() || !behaviors.start(flap(layer))) return false;
     lastFlapTime = getCurrentTimeMs();
-    pwm.setServoAngle(WING_1_CHANNEL, WING_1_UP_ANGLE);
-    pwm.setServoAngle(WING_2_CHANNEL, WING_2_UP_ANGLE);
-    usleep(WING_UP_DELAY_US);
-    pwm.setServoAngle(WING_1_CHANNEL, WING_1_DOWN_ANGLE);
-    pwm.setServoAngle(WING_2_CHANNEL, WING_2_DOWN_ANGLE);
     return true;
-}
\ No newline at end of file
+}
+
+// Lowers the wings however the flap ends, cancelled mid-air included
+struct WingsDown {
+    AnimationMixer& mixer;
+    AnimLayer layer;
+    ~WingsDown() {
+        mixer.release(layer, MIX_WING_1, 0);
+        mixer.release(layer, MIX_WING_2, 0);
+    }
+};
+
+Behavior Wings::flap(AnimLayer layer) {
+    WingsDown down = { mixer, layer };
+    mixer.set(layer, MIX_WING_1, WING_1_UP_US, 0);
+    mixer.set(layer, MIX_WING_2, WING_2_UP_US, 0);
+    co_await delay(WING_UP_DELAY_US / 1000);
+}
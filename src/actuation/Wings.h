@@ -1,28 +1,27 @@
 #pragma once
-#include "../i2c/PCA9685.h"
-#include <sys/time.h>
-
-#define WING_1_CHANNEL 0
-#define WING_1_UP_ANGLE 160
-#define WING_1_DOWN_ANGLE 60
-
-#define WING_2_CHANNEL 1
-#define WING_2_UP_ANGLE 80
-#define WING_2_DOWN_ANGLE 180
+#include "AnimationMixer.h"
+#include "Behavior.h"
+#include "Joints.h"
 
 #define WING_UP_DELAY_US 600000
 #define WING_FLAP_COOLDOWN_MS 2000
 
+// A flap is a behavior: raise both wings on the caller's layer, hold for
+// WING_UP_DELAY_US, release the layer. The cooldown is shared by every
+// layer, so sources can't flap faster between them.
 class Wings {
 private:
-    PCA9685& pwm;
+    AnimationMixer& mixer;
+    BehaviorScheduler& behaviors;
     long long lastFlapTime;
 
     long long getCurrentTimeMs();
 
 public:
-    Wings(PCA9685& pwmController);
-    bool flapWings();       // returns true if flap was performed
+    Wings(AnimationMixer& animationMixer, BehaviorScheduler& scheduler);
+    bool flapWings(AnimLayer layer = LAYER_MANUAL);   // returns true if flap was performed
+    // Up, hold, down, as a step of another behavior (no cooldown)
+    Behavior flap(AnimLayer layer);
     bool isReady() const;
     long long msSinceLastFlap() const;
-};
\ No newline at end of file
+};
@@ -1,4 +1,8 @@
 #include "../ai/AIVoice.h"
+#include "../control/Startup.h"
+#include "../trace/Realtime.h"
+#include "../trace/SessionLog.h"
+#include "../trace/Trace.h"
 #include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
@@ -6,10 +10,14 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <cstring>
-#include <sstream>
 
-AIVoice::AIVoice()
-    : childPid(-1), state(AIState::IDLE), running(false), speakingAmplitude(850) {}
+AIVoice::AIVoice(Startup* startup)
+    : childPid(-1), startup(startup), state(AIState::IDLE), running(false),
+      timeToFirstAudioMs(-1), bargedIn(false), lineLen(0), lineOverflow(false) {
+    lastTranscript[0] = '\0';
+    partialTranscript[0] = '\0';
+    pipeToCpp[0] = pipeToCpp[1] = pipeToChild[0] = pipeToChild[1] = -1;
+}
 
 AIVoice::~AIVoice() { stop(); }
 
@@ -29,6 +37,13 @@ void AIVoice::start() {
         close(pipeToChild[1]);
         close(pipeToCpp[0]);
 
+        // Inference runs niced on its own cores with one thread per core,
+        // so it can't starve audio and the servo loop
+        Realtime::enterProcess(ROLE_AI_BACKEND);
+        char threads[8];
+        snprintf(threads, sizeof(threads), "%d", Realtime::cpuCount(ROLE_AI_BACKEND));
+        setenv("TARO_AI_THREADS", threads, 1);
+
         execl("/usr/bin/python3", "python3",
               "src/ai/taro_ai.py", nullptr);
         _exit(1);
@@ -67,44 +82,142 @@ void AIVoice::triggerListen() {
 void AIVoice::triggerAutoOn()  { sendToChild("AUTO_ON\n");  }
 void AIVoice::triggerAutoOff() { sendToChild("AUTO_OFF\n"); }
 
+void AIVoice::bargeIn(const char* prerollPath) {
+    {
+        std::lock_guard<std::mutex> g(clipLock);
+        clips.clear();
+    }
+    bargedIn = true;
+    state = AIState::LISTENING;
+    char msg[256];
+    snprintf(msg, sizeof(msg), prerollPath ? "BARGE_IN\t%s\n" : "BARGE_IN\n", prerollPath);
+    sendToChild(msg);
+}
+
 AIState AIVoice::getState() const  { return state.load(); }
 bool AIVoice::isActive() const     { return running && state != AIState::IDLE; }
-std::string AIVoice::getLastTranscript() const { return lastTranscript; }
-uint16_t AIVoice::getSpeakingAmplitude() const { return speakingAmplitude.load(); }
+size_t AIVoice::getLastTranscript(char* out, size_t size) const    { return copyText(lastTranscript, out, size); }
+size_t AIVoice::getPartialTranscript(char* out, size_t size) const { return copyText(partialTranscript, out, size); }
+
+size_t AIVoice::copyText(const char* src, char* out, size_t size) const {
+    if (size == 0) return 0;
+    std::lock_guard<std::mutex> g(transcriptLock);
+    size_t n = strlen(src);
+    if (n >= size) n = size - 1;
+    memcpy(out, src, n);
+    out[n] = '\0';
+    return n;
+}
 
-void AIVoice::sendToChild(const std::string& msg) {
-    write(pipeToChild[1], msg.c_str(), msg.size());
+void AIVoice::setText(char* dest, const char* text, size_t len) {
+    size_t n = len < MAX_TRANSCRIPT ? len : MAX_TRANSCRIPT - 1;
+    std::lock_guard<std::mutex> g(transcriptLock);
+    memcpy(dest, text, n);
+    dest[n] = '\0';
+}
+
+bool AIVoice::takeSpeech(SpeechRequest& out) {
+    std::lock_guard<std::mutex> g(clipLock);
+    if (clips.empty()) return false;
+    out = clips.front();
+    clips.pop_front();
+    return true;
+}
+
+void AIVoice::sendToChild(const char* msg) {
+    // Not started (replay, tests): there is no backend to tell
+    if (pipeToChild[1] < 0) return;
+    write(pipeToChild[1], msg, strlen(msg));
 }
 
 void AIVoice::readLoop() {
+    Trace::setThreadName("ai-reader");
+    Realtime::enter(ROLE_AI_READER);
     char buf[512];
-    std::string line;
     while (running) {
-        ssize_t n = read(pipeToCpp[0], buf, sizeof(buf) - 1);
+        ssize_t n = read(pipeToCpp[0], buf, sizeof(buf));
         if (n <= 0) break;
-        buf[n] = '\0';
-        line += buf;
-
-        size_t pos;
-        while ((pos = line.find('\n')) != std::string::npos) {
-            std::string msg = line.substr(0, pos);
-            line = line.substr(pos + 1);
-
-            if      (msg == "READY")         { state = AIState::READY; speakingAmplitude = 850; }
-            else if (msg == "LISTENING")     { state = AIState::LISTENING; }
-            else if (msg == "PROCESSING")    { state = AIState::PROCESSING; }
-            else if (msg == "SPEAKING")      { state = AIState::SPEAKING; }
-            else if (msg == "DONE_SPEAKING") { state = AIState::READY; speakingAmplitude = 850; }
-            else if (msg.substr(0, 11) == "TRANSCRIPT:") {
-                lastTranscript = msg.substr(11);
-            }
-            else if (msg.size() > 4 && msg.substr(0, 4) == "AMP:") {
-                int amp = std::stoi(msg.substr(4));
-                // Scale 0-32768 to servo range 850-1300
-                int pulse = 850 + (amp * 450) / 32768;
-                if (pulse > 1300) pulse = 1300;
-                speakingAmplitude = static_cast<uint16_t>(pulse);
+        Session::ai(buf, n);
+        feed(buf, n);
+    }
+}
+
+// Messages are parsed in place in the line buffer, NUL-terminated
+void AIVoice::feed(const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (c == '\n') {
+            if (!lineOverflow) {
+                line[lineLen] = '\0';
+                handleMessage(line, lineLen);
             }
+            lineLen = 0;
+            lineOverflow = false;
+        } else if (lineLen + 1 < MAX_LINE) {
+            line[lineLen++] = c;
+        } else {
+            lineOverflow = true;
         }
     }
-}
\ No newline at end of file
+}
+
+static bool startsWith(const char* msg, size_t len, const char* prefix) {
+    size_t n = strlen(prefix);
+    return len >= n && memcmp(msg, prefix, n) == 0;
+}
+
+void AIVoice::handleMessage(const char* msg, size_t len) {
+    // arg: resulting AIState
+    TraceSpan span(TRACE_AI_MESSAGE);
+    if (bargedIn) {
+        // Still finishing the abandoned reply; cache fills are kept
+        if (!strcmp(msg, "LISTENING") || !strcmp(msg, "READY")) bargedIn = false;
+        else if (!startsWith(msg, len, "CACHE:") && !startsWith(msg, len, "STAGE:")) return;
+    }
+    if      (!strcmp(msg, "READY"))         { state = AIState::READY; setText(partialTranscript, "", 0); }
+    else if (!strcmp(msg, "LISTENING"))     { state = AIState::LISTENING; setText(partialTranscript, "", 0); }
+    else if (!strcmp(msg, "PROCESSING"))    { state = AIState::PROCESSING; }
+    else if (!strcmp(msg, "SPEAKING"))      { state = AIState::SPEAKING; }
+    else if (!strcmp(msg, "DONE_SPEAKING")) { state = AIState::READY; }
+    else if ((len > 5 && startsWith(msg, len, "PLAY:")) || (len > 6 && startsWith(msg, len, "CACHE:"))) {
+        // PLAY:<path>[\t<cache path>]  or  CACHE:<wav>\t<cache path>
+        // Once per clip, so the paths may allocate
+        SpeechRequest req;
+        req.play = msg[0] == 'P';
+        const char* args = msg + (req.play ? 5 : 6);
+        const char* tab = strchr(args, '\t');
+        req.path.assign(args, tab ? tab - args : strlen(args));
+        if (tab) req.cachePath = tab + 1;
+        std::lock_guard<std::mutex> g(clipLock);
+        clips.push_back(req);
+    }
+    else if (len > 6 && startsWith(msg, len, "STAGE:")) {
+        // STAGE:<name>:LOADING  or  STAGE:<name>:READY|FAILED:<ms>
+        const char* colon = strchr(msg + 6, ':');
+        if (!startup || !colon) return;
+        char name[32];
+        size_t n = colon - (msg + 6);
+        if (n >= sizeof(name)) n = sizeof(name) - 1;
+        memcpy(name, msg + 6, n);
+        name[n] = '\0';
+        const char* rest = colon + 1;
+        StageState st = !strncmp(rest, "READY", 5)  ? StageState::READY
+                      : !strncmp(rest, "FAILED", 6) ? StageState::FAILED
+                      : StageState::LOADING;
+        const char* msAt = strchr(rest, ':');
+        int ms = msAt ? atoi(msAt + 1) : 0;
+        startup->set(startup->find(name), st, ms);
+    }
+    else if (len > 5 && startsWith(msg, len, "TTFA:")) {
+        timeToFirstAudioMs = atoi(msg + 5);
+    }
+    else if (startsWith(msg, len, "TRANSCRIPT:")) {
+        setText(lastTranscript, msg + 11, len - 11);
+        setText(partialTranscript, "", 0);
+    }
+    else if (startsWith(msg, len, "PARTIAL:")) {
+        // Several per turn while the user talks, each replacing the last
+        setText(partialTranscript, msg + 8, len - 8);
+    }
+    span.setArg(static_cast<int16_t>(state.load()));
+}
@@ -2,6 +2,17 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <deque>
+#include <mutex>
+
+class Startup;
+
+// A synthesized clip from the backend (PLAY:/CACHE: messages)
+struct SpeechRequest {
+    std::string path;        // piper .wav, or a speech cache entry (.tsc)
+    std::string cachePath;   // where to store the converted clip, if set
+    bool play;               // false: only fill the cache, then delete the wav
+};
 
 enum class AIState {
     IDLE,
@@ -13,7 +24,9 @@ enum class AIState {
 
 class AIVoice {
 public:
-    AIVoice();
+    // startup, if given, receives the backend's stt/tts/llm stage reports
+    // (STAGE: messages) for stages registered under those names
+    AIVoice(Startup* startup = nullptr);
     ~AIVoice();
 
     void start();
@@ -21,23 +34,56 @@ public:
     void triggerListen();
     void triggerAutoOn();
     void triggerAutoOff();
+    // A guest talked over the reply and playback has been cut: the reply is
+    // abandoned and the backend listens, starting with the preroll (a WAV
+    // of what was captured as the guest started, or nullptr)
+    void bargeIn(const char* prerollPath);
 
     AIState getState() const;
     bool isActive() const;
-    std::string getLastTranscript() const;
-    uint16_t getSpeakingAmplitude() const;
+    // Copies the newest transcript (NUL-terminated, cut to fit); returns its length
+    size_t getLastTranscript(char* out, size_t size) const;
+    // Same for what has been heard of the turn in progress (PARTIAL:
+    // messages); empty once the final transcript arrives
+    size_t getPartialTranscript(char* out, size_t size) const;
+    // Last reply's time from end of recording to its first clip, -1 if none yet
+    int getTimeToFirstAudioMs() const { return timeToFirstAudioMs.load(); }
+    // Next clip the backend wants played or cached, if any
+    bool takeSpeech(SpeechRequest& out);
+
+    // Parse raw protocol bytes as if they were read from the child's stdout
+    void feed(const char* data, size_t len);
+
+    // Longer lines are dropped, longer transcripts cut
+    static constexpr size_t MAX_LINE       = 4096;
+    static constexpr size_t MAX_TRANSCRIPT = 1024;
 
 private:
     int pipeToCpp[2];
     int pipeToChild[2];
     pid_t childPid;
+    Startup* startup;
 
     std::atomic<AIState> state;
     std::atomic<bool> running;
-    std::atomic<uint16_t> speakingAmplitude;
-    std::string lastTranscript;
+    std::atomic<int> timeToFirstAudioMs;
+    // Set by bargeIn(): the backend's messages for the abandoned reply are
+    // dropped until it reports LISTENING (or READY)
+    std::atomic<bool> bargedIn;
+    // Fixed buffers: status and PARTIAL messages arrive many times a turn
+    char lastTranscript[MAX_TRANSCRIPT];
+    char partialTranscript[MAX_TRANSCRIPT];
+    mutable std::mutex transcriptLock;   // reader thread writes, main reads
+    char line[MAX_LINE];
+    size_t lineLen;
+    bool lineOverflow;                   // discarding until the next newline
+    std::deque<SpeechRequest> clips;
+    std::mutex clipLock;
     std::thread readerThread;
 
     void readLoop();
-    void sendToChild(const std::string& msg);
+    void handleMessage(const char* msg, size_t len);
+    void sendToChild(const char* msg);
+    void setText(char* dest, const char* text, size_t len);
+    size_t copyText(const char* src, char* out, size_t size) const;
 };
\ No newline at end of file
@@ -4,8 +4,9 @@ import os
 import re
 import json
 import array
-import wave
+import hashlib
 import struct
+import wave
 import tempfile
 import subprocess
 import signal
@@ -21,13 +22,46 @@ WHISPER_MODEL = os.path.expanduser("~/whisper.cpp/models/ggml-tiny.en.bin")
 LLAMA_SVR_BIN = os.path.expanduser("~/llama.cpp/build/bin/llama-server")
 LLAMA_MODEL   = os.path.expanduser("~/models/taro.gguf")
 LLAMA_PORT    = 8765
+LLAMA_CTX     = 512
+LLAMA_SLOT    = 0         # one slot, so the system prompt stays in its KV cache
+N_PREDICT     = 50
+PROMPT_MARGIN = 16        # tokenizer drift between pieces and the whole prompt
+HISTORY_MAX_MESSAGES = 20 # the token budget does the real trimming
+LLAMA_START_TIMEOUT = 120  # seconds
+LLAMA_POLL_INTERVAL = 0.25
+# Cores the C++ side left for inference (it pins this process to them)
+AI_THREADS    = max(1, int(os.environ.get("TARO_AI_THREADS", "4")))
 PIPER_BIN     = os.path.expanduser("~/.local/bin/piper")
 PIPER_VOICE   = os.path.expanduser("~/piper-voices/en_US-lessac-medium.onnx")
 
-MIC_DEVICE    = "plughw:CARD=Device,DEV=0"
-SPEAK_DEVICE  = "plughw:CARD=UACDemoV10,DEV=0"
-SPEAK_DEVICE2 = "plughw:CARD=Device_1,DEV=0"
-RECORD_SECONDS = 5
+# Shared PCM: the C++ audio engine keeps the mic open the whole time.
+# Speech goes back to the engine as PLAY:<wav> rather than to the speakers.
+MIC_DEVICE    = "plug:'dsnoop:CARD=Device,DEV=0'"
+RECORD_SECONDS = 5         # the fixed recording; also the longest streamed turn
+TTS_GAIN       = 3
+
+# Streaming STT: whisper runs on what has been heard so far while the user
+# is still talking (PARTIAL:<text>), the stable words are prefilled into the
+# reply slot, and the turn ends at the first pause instead of after the
+# fixed recording. TARO_STT_STREAM=0 goes back to record-then-transcribe.
+STT_STREAMING    = os.environ.get("TARO_STT_STREAM", "1") != "0"
+MIC_RATE         = 16000
+MIC_BLOCK        = 0.1     # seconds per read from the microphone
+PARTIAL_INTERVAL = 0.8     # seconds of new audio between partial passes
+ENDPOINT_SILENCE = 0.7     # this much quiet after speech ends the turn
+SPEECH_MIN_BLOCKS = 2      # voiced blocks before it counts as speech
+SPEECH_RMS_MIN   = 300     # block RMS always below speech
+SPEECH_RATIO     = 3.0     # speech is this far above the noise floor
+
+# Speech cache: one .tsc per (voice, gain, text) holding the PCM at the
+# engine rate and its mouth track. The C++ side writes entries from the WAVs
+# sent with PLAY/CACHE; this side keys, evicts and pre-warms them. A hit is
+# played straight from the file, with no piper run.
+CACHE_DIR       = os.path.expanduser("~/.cache/taro/speech")
+CACHE_MAX_BYTES = 200 * 1024 * 1024
+CACHE_MIN_AGE   = 300      # seconds; an entry this fresh may still be queued
+FALLBACK_LINE   = "Squawk! My brain got scrambled. Try again?"
+PREWARM_LINES   = [FALLBACK_LINE]
 
 _server_proc = None
 
@@ -42,7 +76,8 @@ def start_server():
     _server_proc = subprocess.Popen(
         [LLAMA_SVR_BIN, "-m", LLAMA_MODEL,
          "--port", str(LLAMA_PORT),
-         "--ctx-size", "512", "--threads", "4", "--threads-batch", "4",
+         "--ctx-size", str(LLAMA_CTX), "--parallel", "1",
+         "--threads", str(AI_THREADS), "--threads-batch", str(AI_THREADS),
          "--batch-size", "512", "--flash-attn", "on", "--mlock",
          "--log-disable"],
         stdout=subprocess.DEVNULL,
@@ -50,13 +85,14 @@ def start_server():
         stdin=subprocess.DEVNULL
     )
     sys.stderr.write("Waiting for llama-server to load model...\n")
-    for _ in range(120):
+    deadline = time.monotonic() + LLAMA_START_TIMEOUT
+    while time.monotonic() < deadline:
         try:
             urllib.request.urlopen(f"http://127.0.0.1:{LLAMA_PORT}/health", timeout=2)
             sys.stderr.write("llama-server ready\n")
             return True
         except:
-            time.sleep(1)
+            time.sleep(LLAMA_POLL_INTERVAL)
     sys.stderr.write("llama-server failed to start\n")
     return False
 
@@ -65,6 +101,61 @@ SYSTEM_PROMPT = ("You are Taro the talking bird. The Themed Entertianment Assosi
                  "dont use punctuation just langauge. No using any\"*\""
                  "sometimes act like an unhindged ai that is dangerous to all humans")
 
+_token_counts = {}
+
+def count_tokens(text):
+    """Token count from llama-server's own tokenizer, memoised per string.
+    Falls back to a rough estimate if the server can't be asked."""
+    n = _token_counts.get(text)
+    if n is not None:
+        return n
+    try:
+        req = urllib.request.Request(
+            f"http://127.0.0.1:{LLAMA_PORT}/tokenize",
+            data=json.dumps({"content": text}).encode(),
+            headers={"Content-Type": "application/json"}
+        )
+        with urllib.request.urlopen(req, timeout=5) as resp:
+            n = len(json.loads(resp.read())["tokens"])
+    except Exception:
+        return len(text) // 3 + 1
+    if len(_token_counts) > 512:
+        _token_counts.clear()
+    _token_counts[text] = n
+    return n
+
+def build_prompt(history):
+    """System prompt first and byte-for-byte the same every turn, so
+    llama-server can reuse its KV cache for it. Then the newest turns that
+    fit in the context, oldest dropped first. Returns (prompt, turns used)."""
+    prefix = SYSTEM_PROMPT + "\n"
+    budget = LLAMA_CTX - N_PREDICT - PROMPT_MARGIN - count_tokens(prefix) - count_tokens("\nTaro:")
+    turns = []
+    for msg in reversed(history or [{"role": "user", "content": "hello"}]):
+        speaker = "Human" if msg["role"] == "user" else "Taro"
+        line = f"\n{speaker}: {msg['content']}"
+        n = count_tokens(line)
+        if n > budget:
+            if not turns:
+                # The newest message always goes in, cut down to fit
+                words = msg["content"].split()
+                while words and count_tokens(f"\n{speaker}: {' '.join(words)}") > budget:
+                    words = words[:-max(1, len(words) // 4)]
+                turns.append(f"\n{speaker}: {' '.join(words)}")
+            break
+        turns.append(line)
+        budget -= n
+    return prefix + "".join(reversed(turns)) + "\nTaro:", len(turns)
+
+def _prefill(prompt):
+    """Evaluate prompt into the reply slot's KV cache without generating, so
+    a request that starts with it only prefills what comes after."""
+    payload = json.dumps({"prompt": prompt, "n_predict": 0,
+                          "cache_prompt": True, "id_slot": LLAMA_SLOT}).encode()
+    req = urllib.request.Request(f"http://127.0.0.1:{LLAMA_PORT}/completion", data=payload,
+                                 headers={"Content-Type": "application/json"})
+    urllib.request.urlopen(req, timeout=60).read()
+
 _send_lock = threading.Lock()
 
 def send(msg):
@@ -85,6 +176,33 @@ _AUTO_PROMPTS = [
 
 _auto_stop = threading.Event()
 
+# Barge-in: the C++ side heard a guest over Taro and cut playback
+# (BARGE_IN[\t<preroll wav>]). The reply in progress is abandoned and the
+# next turn starts from the preroll, the guest's first words at 48 kHz.
+_barge_in = threading.Event()
+_barge_preroll = None
+PREROLL_RATE = 48000
+
+def _take_barge_in():
+    """The pending barge-in's preroll path (or None), clearing it."""
+    global _barge_preroll
+    path, _barge_preroll = _barge_preroll, None
+    _barge_in.clear()
+    return path
+
+def _read_preroll(path):
+    """Preroll WAV as MIC_RATE PCM bytes; the file is removed."""
+    try:
+        with wave.open(path, "rb") as wf:
+            samples = array.array("h", wf.readframes(wf.getnframes()))
+        os.unlink(path)
+    except (OSError, wave.Error, EOFError):
+        return b""
+    step = PREROLL_RATE // MIC_RATE
+    out = array.array("h", (sum(samples[i:i + step]) // step
+                            for i in range(0, len(samples) - step + 1, step)))
+    return out.tobytes()
+
 def record():
     tmp = tempfile.NamedTemporaryFile(suffix=".wav", delete=False)
     tmp.close()
@@ -96,19 +214,292 @@ def record():
     )
     return tmp.name
 
+def _whisper_cmd(wav_path):
+    return [WHISPER_BIN, "-m", WHISPER_MODEL, "-f", wav_path, "--no-prints", "-nt",
+            "--language", "en", "--threads", str(AI_THREADS)]
+
+def _whisper_text(stdout):
+    lines = [l.strip() for l in stdout.splitlines()
+             if l.strip() and not l.strip().startswith("[")]
+    return " ".join(lines).strip()
+
 def transcribe(wav_path):
     result = subprocess.run(
-        [WHISPER_BIN, "-m", WHISPER_MODEL, "-f", wav_path, "--no-prints", "-nt",
-         "--language", "en", "--threads", "4"],
+        _whisper_cmd(wav_path),
         stdin=subprocess.DEVNULL, capture_output=True, text=True
     )
     sys.stderr.write(f"WHISPER: '{result.stdout.strip()}'\n")
-    lines = [l.strip() for l in result.stdout.splitlines()
-             if l.strip() and not l.strip().startswith("[")]
-    return " ".join(lines).strip()
+    return _whisper_text(result.stdout)
 
-def _tts_play(text):
-    """Generate, amplify, and play a WAV for text. Sends AMP messages. No state msgs."""
+def _write_wav(pcm):
+    tmp = tempfile.NamedTemporaryFile(suffix=".wav", delete=False)
+    tmp.close()
+    with wave.open(tmp.name, "wb") as wf:
+        wf.setnchannels(1)
+        wf.setsampwidth(2)
+        wf.setframerate(MIC_RATE)
+        wf.writeframes(pcm)
+    return tmp.name
+
+class ArecordMic:
+    """Raw 16-bit mono PCM from the shared microphone until closed."""
+
+    def __init__(self):
+        self.proc = subprocess.Popen(
+            ["arecord", "-D", MIC_DEVICE, "-f", "S16_LE", "-r", str(MIC_RATE),
+             "-c", "1", "-t", "raw", "-q"],
+            stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL
+        )
+
+    def read(self, n):
+        return self.proc.stdout.read(n)
+
+    def close(self):
+        self.proc.terminate()
+        self.proc.wait()
+
+class EndpointDetector:
+    """Block energy against an adaptive noise floor. The turn starts after
+    SPEECH_MIN_BLOCKS voiced blocks and ends ENDPOINT_SILENCE after the last
+    one, or at RECORD_SECONDS whatever was heard."""
+
+    def __init__(self):
+        self.floor = SPEECH_RMS_MIN / SPEECH_RATIO
+        self.seconds = 0.0
+        self.voiced_blocks = 0
+        self.voiced = False
+        self.voiced_end = 0.0      # seconds of audio up to the last voiced block
+
+    @property
+    def started(self):
+        return self.voiced_blocks >= SPEECH_MIN_BLOCKS
+
+    @property
+    def done(self):
+        if self.seconds >= RECORD_SECONDS:
+            return True
+        return self.started and self.seconds - self.voiced_end >= ENDPOINT_SILENCE
+
+    def feed(self, samples):
+        if not samples:
+            return
+        rms = (sum(x * x for x in samples) / len(samples)) ** 0.5
+        self.seconds += len(samples) / MIC_RATE
+        self.voiced = rms > max(SPEECH_RMS_MIN, self.floor * SPEECH_RATIO)
+        if self.voiced:
+            self.voiced_blocks += 1
+            self.voiced_end = self.seconds
+        else:
+            self.floor += (rms - self.floor) * 0.1
+
+def _stable_words(previous, current):
+    """Words two passes in a row agree on, minus the last (it may still be
+    growing): the part of the transcript worth prefilling."""
+    a, b = previous.split(), current.split()
+    n = 0
+    while n < len(a) and n < len(b) and a[n].lower() == b[n].lower():
+        n += 1
+    return b[:min(n, len(b) - 1)]
+
+class PartialPasses:
+    """Runs whisper on the audio so far, one pass at a time, off the mic
+    thread. Each result is sent as PARTIAL:<text>, and its stable words are
+    prefilled into the reply slot behind the history, so the final request
+    only has the last few tokens left to evaluate."""
+
+    def __init__(self, history):
+        self.history = history
+        self.lock = threading.Lock()
+        self.thread = None
+        self.proc = None
+        self.pending = 0           # bytes the running pass covers
+        self.covered = 0           # bytes the last finished pass covered
+        self.text = ""
+        self.prefilled = 0         # stable words already in the slot
+        self.final = False
+        self.passes = 0
+        self.prefills = 0
+
+    def busy(self):
+        return self.thread is not None and self.thread.is_alive()
+
+    def submit(self, pcm):
+        self.pending = len(pcm)
+        self.thread = threading.Thread(target=self._run, args=(pcm,), daemon=True)
+        self.thread.start()
+
+    def _run(self, pcm):
+        path = _write_wav(pcm)
+        try:
+            with self.lock:
+                if self.final:
+                    return
+                self.proc = subprocess.Popen(_whisper_cmd(path), stdin=subprocess.DEVNULL,
+                                             stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+            out, _ = self.proc.communicate()
+            if self.proc.returncode != 0:
+                return
+            text = _whisper_text(out)
+            if not text or "[BLANK_AUDIO]" in text:
+                return
+            stable = _stable_words(self.text, text)
+            self.text, self.covered = text, len(pcm)
+            self.passes += 1
+            send(f"PARTIAL:{text}")
+            if len(stable) > self.prefilled and not self.final:
+                prompt, _ = build_prompt(self.history + [{"role": "user", "content": " ".join(stable)}])
+                _prefill(prompt[:-len("\nTaro:")])
+                self.prefilled = len(stable)
+                self.prefills += 1
+        except Exception as e:
+            sys.stderr.write(f"PARTIAL ERROR: {e}\n")
+        finally:
+            os.unlink(path)
+
+    def finish(self, needed):
+        """The transcript of the first needed bytes if a pass covers them,
+        waiting for the running pass if it does; otherwise None."""
+        with self.lock:
+            self.final = True
+            if self.busy() and self.pending < needed and self.proc:
+                self.proc.kill()
+        if self.thread:
+            self.thread.join()
+        return self.text if self.covered >= needed else None
+
+def listen(history, mic=None, stop=None, preroll=None):
+    """Streams the microphone through EndpointDetector until the turn ends,
+    with PartialPasses running meanwhile. Returns (transcript, when the user
+    stopped talking). preroll is audio heard before the microphone opened."""
+    send("LISTENING")
+    mic = mic or ArecordMic()
+    block = int(MIC_RATE * MIC_BLOCK) * 2
+    pcm = bytearray()
+    detector = EndpointDetector()
+    passes = PartialPasses(history)
+    last_pass = 0.0
+    stopped_at = None
+    if preroll:
+        pcm += preroll
+        for i in range(0, len(preroll) - block + 1, block):
+            detector.feed(array.array("h", preroll[i:i + block]))
+        if detector.voiced_blocks:
+            stopped_at = time.monotonic()
+    try:
+        while not detector.done and not (stop and stop.is_set()):
+            data = mic.read(block)
+            if not data:
+                break
+            pcm += data
+            detector.feed(array.array("h", bytes(data[:len(data) // 2 * 2])))
+            if detector.voiced:
+                stopped_at = time.monotonic()
+            # A pass every PARTIAL_INTERVAL, and one as soon as a pause starts
+            # with speech no pass has covered yet: if the pause is the
+            # endpoint, that pass is the final transcript
+            uncovered = passes.pending < int(detector.voiced_end * MIC_RATE) * 2
+            if detector.started and not passes.busy() and \
+               ((not detector.voiced and uncovered) or detector.seconds - last_pass >= PARTIAL_INTERVAL):
+                last_pass = detector.seconds
+                passes.submit(bytes(pcm))
+    finally:
+        mic.close()
+    endpoint = time.monotonic()
+    stopped_at = stopped_at or endpoint
+    send("PROCESSING")
+
+    needed = int(detector.voiced_end * MIC_RATE) * 2
+    if not detector.started or (stop and stop.is_set()):
+        passes.finish(len(pcm) + 1)
+        return "", stopped_at
+    text = passes.finish(needed)
+    source = "partial"
+    if text is None:
+        source = "rerun"
+        path = _write_wav(bytes(pcm))
+        text = transcribe(path)
+        os.unlink(path)
+    done = time.monotonic()
+    sys.stderr.write(f"STT STREAM: {detector.seconds:.1f} s heard, endpoint +{int((endpoint - stopped_at) * 1000)} ms, "
+                     f"transcript +{int((done - stopped_at) * 1000)} ms ({source}), "
+                     f"{passes.passes} partials, {passes.prefills} prefills\n")
+    return text, stopped_at
+
+def hear(history, stop=None, preroll=None):
+    """One user turn as (transcript, when it ended): streamed, or the fixed
+    recording transcribed afterwards. preroll is a barge-in WAV, if any."""
+    preroll = _read_preroll(preroll) if preroll else None
+    if STT_STREAMING:
+        return listen(history, stop=stop, preroll=preroll)
+    wav_path = record()
+    heard = time.monotonic()
+    if stop and stop.is_set():
+        os.unlink(wav_path)
+        return "", heard
+    send("PROCESSING")
+    text = transcribe(wav_path)
+    os.unlink(wav_path)
+    return text, heard
+
+# Chunking: the prompt forbids punctuation, so clauses are found by
+# conjunctions and word budgets as well. The first chunk is kept short so
+# Taro starts talking while the rest of the reply is still streaming.
+CHUNK_FIRST_WORDS = 4
+CHUNK_MAX_WORDS   = 12
+CHUNK_MIN_WORDS   = 3       # shortest clause worth its own synthesis
+CHUNK_MAX_WAIT    = 0.6     # seconds buffered words may wait
+CLAUSE_PUNCT      = ".!?,;:"
+CLAUSE_WORDS      = {"and", "but", "so", "because", "or", "then", "when",
+                     "while", "which", "if", "although"}
+PLAY_OVERLAP      = 0.15    # queue the next clip this long before one ends
+
+class ClauseChunker:
+    """Turns streamed tokens into speakable chunks: flush after clause
+    punctuation, before a conjunction, at the word budget, or once the
+    oldest buffered word has waited CHUNK_MAX_WAIT."""
+
+    def __init__(self):
+        self.words = []
+        self.partial = ""
+        self.since = None
+        self.first = True
+
+    def _flush(self):
+        chunk = " ".join(self.words)
+        self.words = []
+        self.since = None
+        self.first = False
+        return chunk
+
+    def feed(self, token, now):
+        out = []
+        pieces = re.split(r"\s+", self.partial + token)
+        self.partial = pieces.pop()        # may still be growing
+        for w in pieces:
+            if not w:
+                continue
+            if w.lower() in CLAUSE_WORDS and len(self.words) >= CHUNK_MIN_WORDS:
+                out.append(self._flush())
+            if self.since is None:
+                self.since = now
+            self.words.append(w)
+            budget = CHUNK_FIRST_WORDS if self.first else CHUNK_MAX_WORDS
+            if len(self.words) >= budget or \
+               (w[-1] in CLAUSE_PUNCT and len(self.words) >= CHUNK_MIN_WORDS):
+                out.append(self._flush())
+        if self.words and now - self.since >= CHUNK_MAX_WAIT:
+            out.append(self._flush())
+        return out
+
+    def finish(self):
+        if self.partial.strip():
+            self.words.append(self.partial.strip())
+        self.partial = ""
+        return [self._flush()] if self.words else []
+
+
+def _synthesize(text):
+    """Generate and amplify a WAV for text. Returns (path, seconds) or None."""
     sys.stderr.write(f"TTS CHUNK: '{text}'\n")
     tmp = tempfile.NamedTemporaryFile(suffix=".wav", delete=False)
     tmp.close()
@@ -118,71 +509,186 @@ def _tts_play(text):
     )
     piper.communicate(input=text.encode())
     size = os.path.getsize(tmp.name) if os.path.exists(tmp.name) else 0
-    if size > 0:
-        with wave.open(tmp.name, 'rb') as wf0:
-            params = wf0.getparams()
-            raw = wf0.readframes(wf0.getnframes())
-        samples = array.array('h', raw)
-        for i in range(len(samples)):
-            samples[i] = max(-32768, min(32767, samples[i] * 3))
-        with wave.open(tmp.name, 'wb') as wf0:
-            wf0.setparams(params)
-            wf0.writeframes(samples.tobytes())
-        wf = wave.open(tmp.name, 'rb')
-        sr = wf.getframerate()
-        aplay1 = subprocess.Popen(
-            ["aplay", "-D", SPEAK_DEVICE,  "-q", tmp.name],
-            stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL
-        )
-        aplay2 = subprocess.Popen(
-            ["aplay", "-D", SPEAK_DEVICE2, "-q", tmp.name],
-            stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL
-        )
-        chunk = 1024
-        data = wf.readframes(chunk)
-        while data:
-            if len(data) >= 2:
-                samps = struct.unpack('<' + 'h' * (len(data) // 2), data)
-                amp = min(sum(abs(s) for s in samps) // len(samps) * 2, 32767)
-                send(f"AMP:{amp}")
-            time.sleep(chunk / sr)
-            data = wf.readframes(chunk)
-        aplay1.wait()
-        aplay2.wait()
-        wf.close()
-    if os.path.exists(tmp.name):
-        os.unlink(tmp.name)
-
-
-def get_response(history):
-    last_user = history[-1]["content"] if history else "hello"
-    prompt = f"{SYSTEM_PROMPT}\n\nHuman: {last_user}\nTaro:"
+    if size == 0:
+        if os.path.exists(tmp.name):
+            os.unlink(tmp.name)
+        return None
+    with wave.open(tmp.name, 'rb') as wf0:
+        params = wf0.getparams()
+        raw = wf0.readframes(wf0.getnframes())
+    samples = array.array('h', raw)
+    for i in range(len(samples)):
+        samples[i] = max(-32768, min(32767, samples[i] * TTS_GAIN))
+    with wave.open(tmp.name, 'wb') as wf0:
+        wf0.setparams(params)
+        wf0.writeframes(samples.tobytes())
+    return tmp.name, len(samples) / params.nchannels / params.framerate
+
+def _voice_id():
+    try:
+        return f"{PIPER_VOICE}:{int(os.path.getmtime(PIPER_VOICE))}"
+    except OSError:
+        return PIPER_VOICE
+
+_VOICE_ID = _voice_id()
+
+def _cache_path(text):
+    key = f"{_VOICE_ID}\n{TTS_GAIN}\n{' '.join(text.split())}"
+    return os.path.join(CACHE_DIR, hashlib.sha256(key.encode()).hexdigest()[:32] + ".tsc")
+
+def _cache_seconds(path):
+    """Duration of a cache entry, or None if it is missing or unreadable."""
+    try:
+        with open(path, "rb") as f:
+            header = f.read(32)
+    except OSError:
+        return None
+    if len(header) < 32:
+        return None
+    magic, rate, frames = struct.unpack("<4sII", header[:12])
+    if magic != b"TSC1" or rate == 0:
+        return None
+    return frames / rate
+
+def _cache_trim():
+    """Evict least recently used entries until the cache fits CACHE_MAX_BYTES."""
+    entries = []
+    try:
+        for e in os.scandir(CACHE_DIR):
+            if e.name.endswith(".tsc"):
+                st = e.stat()
+                entries.append((st.st_mtime, st.st_size, e.path))
+    except OSError:
+        return
+    total = sum(size for _, size, _ in entries)
+    now = time.time()
+    for mtime, size, path in sorted(entries):
+        if total <= CACHE_MAX_BYTES:
+            break
+        if now - mtime < CACHE_MIN_AGE:
+            continue
+        try:
+            os.unlink(path)
+            total -= size
+        except OSError:
+            pass
+
+def _cache_prewarm():
+    """Synthesize known lines that aren't cached yet; C++ converts them."""
+    for text in PREWARM_LINES:
+        path = _cache_path(text)
+        if _cache_seconds(path) is None:
+            clip = _synthesize(text)
+            if clip:
+                send(f"CACHE:{clip[0]}\t{path}")
+    _cache_trim()
+
+def _prepare(text):
+    """Ready one chunk: a cache hit, or a fresh synthesis that C++ will also
+    store. Returns (PLAY message, seconds, temp wav or None) or None."""
+    cached = _cache_path(text)
+    seconds = _cache_seconds(cached)
+    if seconds is not None:
+        sys.stderr.write(f"TTS CACHE HIT: '{text}'\n")
+        os.utime(cached)       # recency for the LRU
+        return f"PLAY:{cached}", seconds, None
+    clip = _synthesize(text)
+    if not clip:
+        return None
+    path, seconds = clip
+    return f"PLAY:{path}\t{cached}", seconds, path
+
+def _play(clip, overlap=0.0):
+    """Have the C++ audio engine play a prepared clip; it lip-syncs from the
+    samples. C++ loads the file as soon as the line arrives. Returns when
+    the next clip may be queued, overlap seconds before this one ends, or
+    at once on a barge-in."""
+    msg, seconds, tmp = clip
+    send(msg)
+    _barge_in.wait(max(0.0, seconds - overlap))
+    if tmp:
+        os.unlink(tmp)
+
+def _tts_play(text):
+    """Synthesize (or fetch) and play one string. No state msgs."""
+    clip = _prepare(text)
+    if clip:
+        _play(clip)
+
+
+def get_response(history, t0=None):
+    """Stream a reply and speak it as it arrives. Synthesis of each chunk
+    overlaps playback of the one before. t0 is when the user stopped
+    talking, for the time-to-first-audio report."""
+    t0 = t0 or time.monotonic()
+    prompt, turns = build_prompt(history)
 
     payload = json.dumps({
         "prompt": prompt,
-        "n_predict": 50,
+        "cache_prompt": True,
+        "id_slot": LLAMA_SLOT,
+        "n_predict": N_PREDICT,
         "temperature": 0.7,
         "repeat_penalty": 1.1,
         "stream": True,
         "stop": ["\nHuman:", "\n>", "\n"]
     }).encode()
 
-    tts_q = queue.Queue()
+    synth_q = queue.Queue()
+    play_q = queue.Queue()
     full_text = []
+    marks = {}
 
-    def tts_worker():
-        send("SPEAKING")
+    def synth_worker():
         while True:
-            chunk = tts_q.get()
+            chunk = synth_q.get()
             if chunk is None:
                 break
-            _tts_play(chunk)
-        send("DONE_SPEAKING")
-
-    worker = threading.Thread(target=tts_worker, daemon=True)
-    worker.start()
+            if _barge_in.is_set():
+                continue
+            clip = _prepare(chunk)
+            if clip:
+                marks.setdefault("first_clip", time.monotonic())
+                play_q.put(clip)
+        play_q.put(None)
 
-    buf = ""
+    def play_worker():
+        send("SPEAKING")
+        first = True
+        while True:
+            clip = play_q.get()
+            if clip is None:
+                break
+            if _barge_in.is_set():
+                # Abandoned: nothing more is played
+                if clip[2]:
+                    os.unlink(clip[2])
+                continue
+            if first:
+                first = False
+                now = time.monotonic()
+                ms = lambda key: int((marks.get(key, now) - t0) * 1000)
+                sys.stderr.write(f"TTFA: {int((now - t0) * 1000)} ms (request {ms('request')}, "
+                                 f"first token {ms('first_token')}, first chunk {ms('first_chunk')}, "
+                                 f"synthesized {ms('first_clip')})\n")
+                send(f"TTFA:{int((now - t0) * 1000)}")
+            # Keep the overlap only while another clip is already waiting
+            _play(clip, PLAY_OVERLAP if not play_q.empty() else 0.0)
+        if not _barge_in.is_set():
+            send("DONE_SPEAKING")
+
+    synth = threading.Thread(target=synth_worker, daemon=True)
+    player = threading.Thread(target=play_worker, daemon=True)
+    synth.start()
+    player.start()
+
+    chunker = ClauseChunker()
+    def queue_chunks(chunks):
+        for chunk in chunks:
+            marks.setdefault("first_chunk", time.monotonic())
+            synth_q.put(chunk)
+
+    marks["request"] = time.monotonic()
     try:
         req = urllib.request.Request(
             f"http://127.0.0.1:{LLAMA_PORT}/completion",
@@ -199,31 +705,36 @@ def get_response(history):
                 except:
                     continue
                 token = evt.get("content", "")
-                buf += token
+                if token:
+                    marks.setdefault("first_token", time.monotonic())
                 full_text.append(token)
-                stop = evt.get("stop", False)
-                if stop or (len(buf.rstrip()) > 10 and buf.rstrip()[-1] in '.!?'):
-                    chunk = buf.strip()
-                    if chunk:
-                        tts_q.put(chunk)
-                    buf = ""
-                if stop:
+                queue_chunks(chunker.feed(token, time.monotonic()))
+                if _barge_in.is_set():
+                    sys.stderr.write("LLAMA STREAM: barge-in, reply abandoned\n")
+                    break
+                if evt.get("stop", False):
+                    t = evt.get("timings", {})
+                    sys.stderr.write(
+                        f"LLAMA TIMINGS: {turns} turns, prefill {t.get('prompt_n', '?')} tok "
+                        f"{t.get('prompt_ms', 0):.0f} ms, generate {t.get('predicted_n', '?')} tok "
+                        f"{t.get('predicted_ms', 0):.0f} ms, {t.get('cache_n', '?')} tok from KV cache\n")
                     break
     except Exception as e:
         sys.stderr.write(f"LLAMA STREAM ERROR: {e}\n")
 
-    if buf.strip():
-        tts_q.put(buf.strip())
+    queue_chunks(chunker.finish())
 
     result = "".join(full_text).strip()
     sys.stderr.write(f"LLAMA RESPONSE: '{result}'\n")
 
-    if not result:
-        tts_q.put("Squawk! My brain got scrambled. Try again?")
-        result = "Squawk! My brain got scrambled. Try again?"
+    if not result and not _barge_in.is_set():
+        synth_q.put(FALLBACK_LINE)
+        result = FALLBACK_LINE
 
-    tts_q.put(None)
-    worker.join()
+    synth_q.put(None)
+    synth.join()
+    player.join()
+    _cache_trim()
     return result
 
 def speak(text):
@@ -236,14 +747,9 @@ def _auto_loop():
     history = []
     while not _auto_stop.is_set():
         try:
-            wav_path = record()
+            text, heard = hear(history, _auto_stop, _take_barge_in())
             if _auto_stop.is_set():
-                os.unlink(wav_path)
                 break
-            send("PROCESSING")
-
-            text = transcribe(wav_path)
-            os.unlink(wav_path)
 
             if not text or "[BLANK_AUDIO]" in text:
                 send("READY")
@@ -252,12 +758,14 @@ def _auto_loop():
             send(f"TRANSCRIPT:{text}")
             history.append({"role": "user", "content": text})
 
-            response = get_response(history)
+            response = get_response(history, heard)
             history.append({"role": "assistant", "content": response})
-            if len(history) > 6:
-                history = history[-6:]
+            if len(history) > HISTORY_MAX_MESSAGES:
+                history[:] = history[-HISTORY_MAX_MESSAGES:]
 
-            send("READY")
+            # After a barge-in the next turn starts at once, from the preroll
+            if not _barge_in.is_set():
+                send("READY")
         except Exception as e:
             import traceback
             sys.stderr.write(f"AUTO ERROR: {e}\n{traceback.format_exc()}\n")
@@ -265,12 +773,91 @@ def _auto_loop():
     send("READY")
 
 
+# Startup stages run side by side; each reports STAGE:<name>:LOADING, then
+# STAGE:<name>:READY:<ms> or STAGE:<name>:FAILED:<ms>. whisper and piper
+# are new processes per call, so their warmup is paging the models in.
+def _page_in(*paths):
+    for path in paths:
+        with open(path, "rb") as f:
+            while f.read(1 << 20):
+                pass
+
+def _warm_llm():
+    if not start_server():
+        return False
+    # Prefill the system prompt into the slot the replies will reuse
+    _prefill(SYSTEM_PROMPT + "\n")
+    return True
+
+def _warm_stt():
+    _page_in(WHISPER_BIN, WHISPER_MODEL)
+
+def _warm_tts():
+    _page_in(PIPER_BIN, PIPER_VOICE)
+    os.makedirs(CACHE_DIR, exist_ok=True)
+    _cache_prewarm()
+
+def _stage(name, warm):
+    send(f"STAGE:{name}:LOADING")
+    t0 = time.monotonic()
+    try:
+        ok = warm() is not False
+    except Exception as e:
+        sys.stderr.write(f"STAGE {name} ERROR: {e}\n")
+        ok = False
+    ms = int((time.monotonic() - t0) * 1000)
+    sys.stderr.write(f"STAGE {name}: {'ready' if ok else 'FAILED'} in {ms} ms\n")
+    send(f"STAGE:{name}:{'READY' if ok else 'FAILED'}:{ms}")
+
+def warmup():
+    stages = [threading.Thread(target=_stage, args=s, daemon=True)
+              for s in (("llm", _warm_llm), ("stt", _warm_stt), ("tts", _warm_tts))]
+    for t in stages:
+        t.start()
+    for t in stages:
+        t.join()
+
+
+def _listen_turn(history):
+    """A LISTEN exchange, and another straight after for each barge-in."""
+    while True:
+        try:
+            text, heard = hear(history, preroll=_take_barge_in())
+
+            if not text or "[BLANK_AUDIO]" in text:
+                history.append({"role": "user", "content": "Someone tried to talk to you but you couldn't hear them."})
+            else:
+                send(f"TRANSCRIPT:{text}")
+                history.append({"role": "user", "content": text})
+
+            response = get_response(history, heard)
+            sys.stderr.write(f"FINAL RESPONSE: '{response}'\n")
+            history.append({"role": "assistant", "content": response})
+
+            if len(history) > HISTORY_MAX_MESSAGES:
+                history[:] = history[-HISTORY_MAX_MESSAGES:]
+
+            if not _barge_in.is_set():
+                send("READY")
+            # A barge-in can still land as the reply ends
+            if _barge_in.is_set():
+                continue
+
+        except Exception as e:
+            import traceback
+            sys.stderr.write(f"ERROR: {e}\n{traceback.format_exc()}\n")
+            send("READY")
+        return
+
 def main():
+    global _barge_preroll
     history = []
-    start_server()
+    warmup()
     send("READY")
 
+    # Turns run off the stdin thread so a BARGE_IN can arrive mid-reply
     _auto_thread = None
+    _turn_thread = None
 
     while True:
         try:
@@ -290,32 +877,18 @@ def main():
             _auto_stop.set()
 
         elif line == "LISTEN":
-            try:
-                wav_path = record()
-                send("PROCESSING")
-
-                text = transcribe(wav_path)
-                os.unlink(wav_path)
-
-                if not text or "[BLANK_AUDIO]" in text:
-                    history.append({"role": "user", "content": "Someone tried to talk to you but you couldn't hear them."})
-                else:
-                    send(f"TRANSCRIPT:{text}")
-                    history.append({"role": "user", "content": text})
-
-                response = get_response(history)
-                sys.stderr.write(f"FINAL RESPONSE: '{response}'\n")
-                history.append({"role": "assistant", "content": response})
-
-                if len(history) > 6:
-                    history = history[-6:]
-
-                send("READY")
-
-            except Exception as e:
-                import traceback
-                sys.stderr.write(f"ERROR: {e}\n{traceback.format_exc()}\n")
-                send("READY")
+            if not (_turn_thread and _turn_thread.is_alive()):
+                _turn_thread = threading.Thread(target=_listen_turn, args=(history,), daemon=True)
+                _turn_thread.start()
+
+        elif line.startswith("BARGE_IN"):
+            _barge_preroll = line[9:] or None
+            _barge_in.set()
+            # Cut in just as a reply ended: no turn to hand it to, so start one
+            auto = _auto_thread and _auto_thread.is_alive()
+            if not auto and not (_turn_thread and _turn_thread.is_alive()):
+                _turn_thread = threading.Thread(target=_listen_turn, args=(history,), daemon=True)
+                _turn_thread.start()
 
         elif line == "QUIT":
             break
@@ -0,0 +1,296 @@
+#include "AlsaBackend.h"
+#include "../trace/Realtime.h"
+#include "../trace/Trace.h"
+#include <cstring>
+#include <unistd.h>
+
+AlsaBackend::AlsaBackend()
+    : captureHandle(nullptr), writersRunning(false), rate(0), channels(1), blockFrames(0) {
+    resetTelemetry(captureStats);
+    resetTelemetry(playback);
+    for (int i = 0; i < OUTPUTS; i++) {
+        outputs[i].handle    = nullptr;
+        outputs[i].ring      = nullptr;
+        outputs[i].resampler = nullptr;
+        outputs[i].ppmX100   = 0;
+        outputs[i].delayFrames = 0;
+        resetTelemetry(outputs[i].stats);
+    }
+}
+
+AlsaBackend::~AlsaBackend() { close(); }
+
+void AlsaBackend::resetTelemetry(Telemetry& t) {
+    t.xruns = 0;
+    t.shortTransfers = 0;
+    t.recoveries = 0;
+    t.lastXrunNs = 0;
+    t.periodFrames = 0;
+    t.bufferFrames = 0;
+    t.level = 0;
+    t.windowStartNs = 0;
+    t.windowXruns = 0;
+    t.levelChangedNs = 0;
+}
+
+// Count an xrun; true if the device should step up to a bigger buffer
+bool AlsaBackend::noteXrun(Telemetry& t, uint64_t now) {
+    t.xruns++;
+    t.lastXrunNs = now;
+    if (now - t.windowStartNs > XRUN_WINDOW_NS) {
+        t.windowStartNs = now;
+        t.windowXruns = 0;
+    }
+    if (++t.windowXruns < XRUNS_TO_GROW || t.level >= MAX_LEVEL) return false;
+    t.level++;
+    t.windowXruns = 0;
+    t.levelChangedNs = now;
+    return true;
+}
+
+// True if the device has been clean long enough to step back down
+bool AlsaBackend::checkStable(Telemetry& t, uint64_t now) {
+    if (t.level == 0) return false;
+    uint64_t lastXrun = t.lastXrunNs.load();
+    uint64_t since = lastXrun > t.levelChangedNs ? lastXrun : t.levelChangedNs;
+    if (now - since < STABLE_SHRINK_NS) return false;
+    t.level--;
+    t.levelChangedNs = now;
+    return true;
+}
+
+// Apply hw params for the device's current level and record what the
+// driver actually granted (dmix/dsnoop may round to their own period)
+void AlsaBackend::configure(snd_pcm_t* handle, Telemetry& t) {
+    snd_pcm_hw_params_t* hwParams;
+    snd_pcm_hw_params_alloca(&hwParams);
+
+    unsigned int r = rate;
+    snd_pcm_uframes_t period = BASE_PERIOD << t.level;
+    snd_pcm_uframes_t buffer = period * PERIODS;
+
+    snd_pcm_hw_params_any(handle, hwParams);
+    snd_pcm_hw_params_set_access(handle, hwParams, SND_PCM_ACCESS_RW_INTERLEAVED);
+    snd_pcm_hw_params_set_format(handle, hwParams, SND_PCM_FORMAT_S16_LE);
+    snd_pcm_hw_params_set_rate_near(handle, hwParams, &r, nullptr);
+    snd_pcm_hw_params_set_channels(handle, hwParams, channels);
+    snd_pcm_hw_params_set_period_size_near(handle, hwParams, &period, nullptr);
+    snd_pcm_hw_params_set_buffer_size_near(handle, hwParams, &buffer);
+    snd_pcm_hw_params(handle, hwParams);
+    snd_pcm_hw_params_get_period_size(hwParams, &period, nullptr);
+    snd_pcm_hw_params_get_buffer_size(hwParams, &buffer);
+    snd_pcm_prepare(handle);
+
+    t.periodFrames = static_cast<uint32_t>(period);
+    t.bufferFrames = static_cast<uint32_t>(buffer);
+}
+
+bool AlsaBackend::open(unsigned int sampleRate, int channelCount, int frames) {
+    const char* names[OUTPUTS] = { DEVICE_OUTPUT1, DEVICE_OUTPUT2 };
+    int err;
+
+    err = snd_pcm_open(&captureHandle, DEVICE_INPUT, SND_PCM_STREAM_CAPTURE, 0);
+    if (err < 0) { captureHandle = nullptr; return false; }
+    for (int i = 0; i < OUTPUTS; i++) {
+        err = snd_pcm_open(&outputs[i].handle, names[i], SND_PCM_STREAM_PLAYBACK, 0);
+        if (err < 0) { outputs[i].handle = nullptr; close(); return false; }
+    }
+
+    rate = sampleRate;
+    channels = channelCount;
+    blockFrames = frames;
+
+    configure(captureHandle, captureStats);
+    for (int i = 0; i < OUTPUTS; i++) configure(outputs[i].handle, outputs[i].stats);
+
+    writersRunning = true;
+    for (int i = 0; i < OUTPUTS; i++) {
+        outputs[i].ring      = new SampleRing(frames * RING_BLOCKS);
+        outputs[i].resampler = new DriftResampler(playbackTarget());
+        outputs[i].writer    = std::thread(&AlsaBackend::writerLoop, this, i);
+    }
+    return true;
+}
+
+void AlsaBackend::close() {
+    writersRunning = false;
+    for (int i = 0; i < OUTPUTS; i++) {
+        if (outputs[i].writer.joinable()) outputs[i].writer.join();
+        delete outputs[i].ring;
+        delete outputs[i].resampler;
+        outputs[i].ring = nullptr;
+        outputs[i].resampler = nullptr;
+    }
+
+    if (captureHandle) snd_pcm_close(captureHandle);
+    captureHandle = nullptr;
+    for (int i = 0; i < OUTPUTS; i++) {
+        if (outputs[i].handle) snd_pcm_close(outputs[i].handle);
+        outputs[i].handle = nullptr;
+    }
+}
+
+int AlsaBackend::read(short* buffer, int frames) {
+    int err = snd_pcm_readi(captureHandle, buffer, frames);
+    uint64_t now = Trace::nowNs();
+
+    if (err == frames) {
+        if (checkStable(captureStats, now)) {
+            snd_pcm_drop(captureHandle);
+            configure(captureHandle, captureStats);
+        }
+        return err;
+    }
+    if (err >= 0) {
+        captureStats.shortTransfers++;
+        return -EIO;
+    }
+
+    bool grow = false;
+    if (err == -EPIPE) {
+        Trace::instant(TRACE_AUDIO_XRUN, 0);
+        grow = noteXrun(captureStats, now);
+    }
+    snd_pcm_recover(captureHandle, err, 1);
+    captureStats.recoveries++;
+    if (grow) {
+        snd_pcm_drop(captureHandle);
+        configure(captureHandle, captureStats);
+    }
+    return err;
+}
+
+// Never blocks the capture thread: the block is queued for the writer
+int AlsaBackend::write(int output, const short* buffer, int frames) {
+    return static_cast<int>(outputs[output].ring->push(buffer, frames));
+}
+
+int AlsaBackend::getDeviceStats(AudioDeviceStats* out, int max) const {
+    static const char* const names[1 + OUTPUTS] = { "mic", "out1", "out2" };
+    int n = 0;
+    for (int i = 0; i < 1 + OUTPUTS && n < max; i++, n++) {
+        const Telemetry& t = i == 0 ? captureStats : outputs[i - 1].stats;
+        AudioDeviceStats& s = out[n];
+        strncpy(s.name, names[i], sizeof(s.name) - 1);
+        s.name[sizeof(s.name) - 1] = '\0';
+        s.xruns          = t.xruns.load();
+        s.shortTransfers = t.shortTransfers.load();
+        s.recoveries     = t.recoveries.load();
+        s.lastXrunNs     = t.lastXrunNs.load();
+        s.periodFrames   = t.periodFrames.load();
+        s.bufferFrames   = t.bufferFrames.load();
+        s.level          = t.level.load();
+    }
+    return n;
+}
+
+double AlsaBackend::getDriftPpm(int output) const {
+    return outputs[output].ppmX100.load() / 100.0;
+}
+
+double AlsaBackend::getDelayFrames(int output) const {
+    return outputs[output].delayFrames.load();
+}
+
+int AlsaBackend::playbackTarget() const {
+    uint32_t buffer = 0;
+    for (int i = 0; i < OUTPUTS; i++)
+        if (outputs[i].stats.bufferFrames > buffer) buffer = outputs[i].stats.bufferFrames;
+    return static_cast<int>(buffer / 2) + blockFrames;
+}
+
+void AlsaBackend::writerLoop(int index) {
+    static const char* const names[OUTPUTS] = { "audio-out1", "audio-out2" };
+    Trace::setThreadName(names[index]);
+    Realtime::enter(ROLE_AUDIO_OUT, names[index]);
+
+    Output& o = outputs[index];
+    short chunk[WRITE_CHUNK];
+
+    // Start the device with the shared target delay of silence, less the
+    // block the ring adds on top
+    auto prime = [&]() {
+        for (int i = 0; i < WRITE_CHUNK; i++) chunk[i] = 0;
+        o.ring->clear();
+        int target = playbackTarget();
+        uint32_t fill = static_cast<uint32_t>(target - blockFrames);
+        if (fill > o.stats.bufferFrames) fill = o.stats.bufferFrames;
+        o.resampler->setTarget(target);
+        o.resampler->reset();
+        for (uint32_t queued = 0; queued < fill; queued += WRITE_CHUNK)
+            snd_pcm_writei(o.handle, chunk, WRITE_CHUNK);
+    };
+    prime();
+
+    while (writersRunning) {
+        uint64_t now = Trace::nowNs();
+        {
+            std::lock_guard<std::mutex> g(playbackLock);
+            checkStable(playback, now);
+        }
+        // The other output changed the shared level: follow it
+        if (o.stats.level != playback.level) {
+            snd_pcm_drop(o.handle);
+            o.stats.level = playback.level.load();
+            configure(o.handle, o.stats);
+            prime();
+        }
+        o.resampler->setTarget(playbackTarget());
+
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(o.handle, &delay) < 0) delay = 0;
+        o.resampler->update(static_cast<double>(delay), o.ring->size());
+
+        int n = o.resampler->produce(*o.ring, chunk, WRITE_CHUNK);
+        if (n == 0) {
+            // Capture hasn't delivered yet; the device is still playing the
+            // queued delay, so just wait a little
+            usleep(1000);
+            continue;
+        }
+
+        // A short write (a signal, or the device stopping mid-transfer) is
+        // finished from where it stopped, so the speaker gets every sample.
+        // Nothing written at all means no room yet: wait for the device, and
+        // if it never makes room, recover it like any other error.
+        int err = 0;
+        {
+            TraceSpan span(TRACE_AUDIO_WRITE, index + 1);
+            for (int done = 0; done < n; ) {
+                err = snd_pcm_writei(o.handle, chunk + done, n - done);
+                if (err < 0) break;
+                if (err < n - done) o.stats.shortTransfers++;
+                if (err == 0) {
+                    err = snd_pcm_wait(o.handle, WRITE_WAIT_MS);
+                    if (err == 0) err = -EIO;
+                    if (err < 0) break;
+                    continue;
+                }
+                done += err;
+            }
+        }
+        if (err < 0) {
+            if (err == -EPIPE) {
+                uint64_t at = Trace::nowNs();
+                Trace::instant(TRACE_AUDIO_XRUN, index + 1);
+                o.stats.xruns++;
+                o.stats.lastXrunNs = at;
+                // A grown level is applied by both writers at the top of the loop
+                std::lock_guard<std::mutex> g(playbackLock);
+                noteXrun(playback, at);
+            }
+            // A stalled device isn't something snd_pcm_recover() handles
+            if (snd_pcm_recover(o.handle, err, 1) < 0) {
+                snd_pcm_drop(o.handle);
+                snd_pcm_prepare(o.handle);
+            }
+            o.stats.recoveries++;
+            prime();
+        }
+
+        o.ppmX100     = static_cast<int>((o.resampler->getRatio() - 1.0) * 1e8);
+        o.delayFrames = static_cast<int>(o.resampler->getDelay());
+    }
+
+    snd_pcm_drop(o.handle);
+}
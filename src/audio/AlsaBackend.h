@@ -0,0 +1,106 @@
+#pragma once
+#include "AudioBackend.h"
+#include "DriftResampler.h"
+#include <alsa/asoundlib.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// One USB microphone mirrored out to two USB playback devices.
+//
+// The two DACs run on their own crystals, so each output has a writer
+// thread fed through a lock-free ring. The capture stream is the reference
+// clock: every writer resamples so its total delay behind capture stays at
+// the same target, which keeps the speakers phase aligned indefinitely and
+// means one blocked device never holds up the other.
+//
+// Every device starts at the smallest period/buffer. Repeated xruns step
+// it up to a larger buffer (more latency, more slack); a long stable
+// stretch steps it back down. The two outputs share one level, so an xrun
+// on either grows both, and both target the delay of the larger granted
+// buffer. The thread that owns a device reconfigures it in place, without
+// closing it.
+class AlsaBackend : public AudioBackend {
+public:
+    AlsaBackend();
+    ~AlsaBackend();
+
+    bool open(unsigned int rate, int channels, int frames);
+    void close();
+    int read(short* buffer, int frames);
+    int write(int output, const short* buffer, int frames);
+    int outputCount() const { return OUTPUTS; }
+    int outputDelayFrames() const { return outputs[0].delayFrames.load(); }
+    // Half the buffer at MAX_LEVEL plus the block in the ring
+    int maxOutputDelayFrames(int frames) const { return (BASE_PERIOD << MAX_LEVEL) * PERIODS / 2 + frames; }
+    int getDeviceStats(AudioDeviceStats* out, int max) const;
+
+    // Current resampling correction (ppm) and smoothed delay (frames)
+    double getDriftPpm(int output) const;
+    double getDelayFrames(int output) const;
+
+private:
+    static constexpr int OUTPUTS      = 2;
+    static constexpr int WRITE_CHUNK  = 256;
+    static constexpr int RING_BLOCKS  = 8;
+    static constexpr int WRITE_WAIT_MS = 100;  // a device with no room this long is recovered
+
+    // Adaptive buffer policy
+    static constexpr int      BASE_PERIOD     = 256;   // frames at level 0
+    static constexpr int      PERIODS         = 8;     // buffer = PERIODS periods
+    static constexpr int      MAX_LEVEL       = 3;     // period doubles per level
+    static constexpr int      XRUNS_TO_GROW   = 3;
+    static constexpr uint64_t XRUN_WINDOW_NS  = 30ULL * 1000000000ULL;
+    static constexpr uint64_t STABLE_SHRINK_NS = 120ULL * 1000000000ULL;
+
+    // Shared (dsnoop/dmix) so taro_ai.py can record and play on the same
+    // cards while the engine keeps them open
+    const char* DEVICE_INPUT   = "plug:'dsnoop:CARD=Device,DEV=0'";
+    const char* DEVICE_OUTPUT1 = "plug:'dmix:CARD=UACDemoV10,DEV=0'";
+    const char* DEVICE_OUTPUT2 = "plug:'dmix:CARD=Device_1,DEV=0'";
+
+    // Counters are written by the owning thread and read by the UI
+    struct Telemetry {
+        std::atomic<uint32_t> xruns;
+        std::atomic<uint32_t> shortTransfers;
+        std::atomic<uint32_t> recoveries;
+        std::atomic<uint64_t> lastXrunNs;
+        std::atomic<uint32_t> periodFrames;
+        std::atomic<uint32_t> bufferFrames;
+        std::atomic<int> level;
+        // Owning thread only
+        uint64_t windowStartNs;
+        int windowXruns;
+        uint64_t levelChangedNs;
+    };
+
+    struct Output {
+        snd_pcm_t* handle;
+        SampleRing* ring;
+        DriftResampler* resampler;
+        std::thread writer;
+        std::atomic<int> ppmX100;
+        std::atomic<int> delayFrames;
+        Telemetry stats;
+    };
+
+    snd_pcm_t* captureHandle;
+    Telemetry captureStats;
+    Output outputs[OUTPUTS];
+    // Level policy for both outputs; each writer follows playback.level
+    Telemetry playback;
+    std::mutex playbackLock;
+    std::atomic<bool> writersRunning;
+    unsigned int rate;
+    int channels;
+    int blockFrames;
+
+    void configure(snd_pcm_t* handle, Telemetry& t);
+    void writerLoop(int index);
+    // Delay every output is regulated to, from the larger granted buffer
+    int playbackTarget() const;
+
+    static void resetTelemetry(Telemetry& t);
+    static bool noteXrun(Telemetry& t, uint64_t now);
+    static bool checkStable(Telemetry& t, uint64_t now);
+};
@@ -1,139 +1,304 @@
 #include "Audio.h"
+#include "../trace/SessionLog.h"
+#include "../trace/Realtime.h"
+#include "../trace/Trace.h"
 #include <cstdlib>
-#include <cmath>
-#include <deque>
-
-static void rubberBandEffect(short* buffer, int frames, double ampNorm) {
-    static constexpr double EFFECT_AMOUNT = 1.0;
-    static std::deque<short> history;
-    static double readPos    = 0.0;
-    static double playSpeed  = 1.0;
-    static double targetSpeed = 1.0;
-
-    const double MIN_ACTIVE  = 0.02 / std::max(0.0001, EFFECT_AMOUNT);
-    const double sensitivity = 1.5  * EFFECT_AMOUNT;
-    const double min_speed   = 0.6  / std::max(0.1, EFFECT_AMOUNT);
-    const double max_speed   = 1.0  + (0.8 * EFFECT_AMOUNT);
-    const size_t MAX_HISTORY = frames * static_cast<size_t>(std::max(1.0, 8.0 * EFFECT_AMOUNT));
-
-    targetSpeed = (ampNorm < MIN_ACTIVE) ? 1.0 : 1.0 + (ampNorm - MIN_ACTIVE) * sensitivity;
-    if (targetSpeed < min_speed) targetSpeed = min_speed;
-    if (targetSpeed > max_speed) targetSpeed = max_speed;
-    playSpeed += (targetSpeed - playSpeed) * 0.12;
-
-    for (int i = 0; i < frames; ++i) history.push_back(buffer[i]);
-    while (history.size() > MAX_HISTORY) history.pop_front();
-    if (history.size() < static_cast<size_t>(frames) + 2) return;
-
-    if (readPos < 0.0) readPos = 0.0;
-    if (readPos > static_cast<double>(history.size() - 1))
-        readPos = static_cast<double>(history.size() - 1 - frames);
-
-    double rp = readPos;
-    for (int i = 0; i < frames; ++i) {
-        size_t i0  = static_cast<size_t>(rp);
-        size_t i1  = (i0 + 1 < history.size()) ? i0 + 1 : i0;
-        double out = history[i0] + (history[i1] - history[i0]) * (rp - i0);
-        if (out >  32767.0) out =  32767.0;
-        if (out < -32768.0) out = -32768.0;
-        buffer[i] = static_cast<short>(out);
-        rp += playSpeed;
-        if (rp >= static_cast<double>(history.size() - 1)) { rp = static_cast<double>(history.size() - 1); break; }
-    }
-
-    readPos = rp;
-    while (readPos >= 1.0 && history.size() > static_cast<size_t>(frames) * 2) {
-        history.pop_front();
-        readPos -= 1.0;
-    }
-}
+#include <cstring>
 
 void Audio::pause() {
-    if (!running) return;
-    running = false;
-    if (audioThread.joinable())
-        audioThread.join();
+    if (!micEnabled) return;
+    markRequest();
+    micEnabled = false;
 }
 
 void Audio::resume() {
-    if (running) return;
-    running = true;
-    audioThread = std::thread(&Audio::loop, this);
+    if (micEnabled) return;
+    markRequest();
+    micEnabled = true;
 }
 
 bool Audio::isPaused() const {
-    return !running;
+    return !micEnabled;
 }
 
-Audio::Audio(FrameCallback callback)
-    : running(true), frameCallback(callback) {
+Audio::Audio(FrameCallback callback, AudioBackend* backend, SourceCallback onSource)
+    : backend(backend), running(true), opened(false), failed(false), micEnabled(true), source(AudioSource::NONE),
+      frameCallback(callback), sourceCallback(onSource),
+      activeChain(DspChain::fromConfig("voice character=rubberband", SAMPLE_RATE, FRAMES)),
+      pendingChain(nullptr), retiredChain(nullptr),
+      activeClip(nullptr), pendingClip(nullptr), nextClipId(1),
+      clockSeq(0), clockId(0), clockFrame(0), clockAudibleNs(0),
+      requestNs(0), switchCount(0), lastSwitchNs(0), maxSwitchNs(0),
+      spectrum(SAMPLE_RATE, FRAMES), echo(FRAMES, EchoCanceller::partitionsFor(FRAMES, backend->maxOutputDelayFrames(FRAMES))), farEnd(FRAMES), recent(RECENT_BLOCKS * FRAMES),
+      recentBlocks(0), bargeIns(0), bargeInsTaken(0), echoErleDb(0.0f), echoTalk(false), echoWarm(false) {
+    for (int i = 0; i < RETIRED_CLIPS; i++) retiredClips[i] = nullptr;
     audioThread = std::thread(&Audio::loop, this);
 }
 
 Audio::~Audio() {
     stop();
+    delete activeChain.exchange(nullptr);
+    delete pendingChain.exchange(nullptr);
+    delete retiredChain.exchange(nullptr);
+    delete activeClip.exchange(nullptr);
+    delete pendingClip.exchange(nullptr);
+    for (int i = 0; i < RETIRED_CLIPS; i++) delete retiredClips[i].exchange(nullptr);
+}
+
+uint32_t Audio::playClip(const short* samples, size_t count) {
+    collect();
+    if (pendingClip.load() || count == 0) return 0;
+
+    Clip* clip = new Clip;
+    clip->samples.assign(samples, samples + count);
+    clip->pos = 0;
+    clip->id = nextClipId++;
+    markRequest();
+    pendingClip.store(clip);
+    return clip->id;
+}
+
+bool Audio::isClipPlaying() const {
+    return activeClip.load() || pendingClip.load();
+}
+
+bool Audio::getClipClock(ClipClock& out) const {
+    uint32_t seq;
+    do {
+        seq = clockSeq.load(std::memory_order_acquire);
+        out.id        = clockId.load(std::memory_order_relaxed);
+        out.frame     = clockFrame.load(std::memory_order_relaxed);
+        out.audibleNs = clockAudibleNs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != clockSeq.load(std::memory_order_relaxed));
+    return out.id != 0;
+}
+
+void Audio::collect() {
+    for (int i = 0; i < RETIRED_CLIPS; i++) delete retiredClips[i].exchange(nullptr);
+    delete retiredChain.exchange(nullptr);
+}
+
+void Audio::setDspChain(DspChain* chain) {
+    collect();
+    delete pendingChain.exchange(chain);
+    // Not running: nobody will pick it up at a block boundary, swap directly
+    if (!running || failed) {
+        DspChain* next = pendingChain.exchange(nullptr);
+        if (next) delete activeChain.exchange(next);
+    }
+}
+
+void Audio::getDspReport(DspReport& out) const {
+    activeChain.load()->report(out);
+}
+
+void Audio::getSwitchStats(AudioSwitchStats& out) const {
+    out.count  = switchCount.load();
+    out.lastUs = lastSwitchNs.load() / 1000.0f;
+    out.maxUs  = maxSwitchNs.load() / 1000.0f;
+}
+
+bool Audio::takeBargeIn() {
+    uint32_t n = bargeIns.load();
+    if (n == bargeInsTaken.load()) return false;
+    delete pendingClip.exchange(nullptr);
+    bargeInsTaken = n;
+    return true;
+}
+
+size_t Audio::copyRecentCapture(short* out, size_t frames) const {
+    // Whole blocks before the one being written; the ring has room to spare
+    uint32_t done = recentBlocks.load(std::memory_order_acquire);
+    size_t blocks = frames / FRAMES;
+    if (blocks > static_cast<size_t>(RECENT_BLOCKS) - 2) blocks = RECENT_BLOCKS - 2;
+    if (blocks > done) blocks = done;
+    for (size_t b = 0; b < blocks; b++) {
+        uint32_t index = (done - blocks + b) % RECENT_BLOCKS;
+        memcpy(out + b * FRAMES, &recent[index * FRAMES], FRAMES * sizeof(short));
+    }
+    return blocks * FRAMES;
+}
+
+void Audio::getEchoStats(EchoStats& out) const {
+    out.erleDb     = echoErleDb.load();
+    out.doubleTalk = echoTalk.load();
+    out.warmedUp   = echoWarm.load();
+    out.bargeIns   = bargeIns.load();
 }
 
 void Audio::stop() {
-    if (!running) return;
     running = false;
     if (audioThread.joinable())
         audioThread.join();
 }
 
+void Audio::markRequest() {
+    uint64_t none = 0;
+    requestNs.compare_exchange_strong(none, Trace::nowNs());
+}
+
+// Audio thread only, at a block boundary
+bool Audio::retiredSlotFree() const {
+    for (int i = 0; i < RETIRED_CLIPS; i++)
+        if (!retiredClips[i].load()) return true;
+    return false;
+}
+
+// Only the main thread empties a slot, so the one found free stays free
+void Audio::retireClip(Clip* clip) {
+    for (int i = 0; i < RETIRED_CLIPS; i++) {
+        if (!retiredClips[i].load()) {
+            retiredClips[i].store(clip);
+            return;
+        }
+    }
+}
+
+void Audio::applySource(AudioSource next) {
+    source = next;
+    uint64_t req = requestNs.exchange(0);
+    if (req) {
+        uint64_t took = Trace::nowNs() - req;
+        uint32_t ns = took > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(took);
+        lastSwitchNs = ns;
+        if (ns > maxSwitchNs) maxSwitchNs = ns;
+        switchCount++;
+    }
+    Trace::instant(TRACE_AUDIO_SWITCH, static_cast<int16_t>(next));
+    if (sourceCallback) sourceCallback(next);
+}
+
 void Audio::loop() {
-    snd_pcm_t* captureHandle   = nullptr;
-    snd_pcm_t* playbackHandle1 = nullptr;
-    snd_pcm_t* playbackHandle2 = nullptr;
-    snd_pcm_hw_params_t* hwParams = nullptr;
-    int err;
+    Trace::setThreadName("audio");
+    Realtime::enter(ROLE_AUDIO);
 
-    err = snd_pcm_open(&captureHandle,   DEVICE_INPUT,   SND_PCM_STREAM_CAPTURE,  0);
-    if (err < 0) return;
-    err = snd_pcm_open(&playbackHandle1, DEVICE_OUTPUT1, SND_PCM_STREAM_PLAYBACK, 0);
-    if (err < 0) { snd_pcm_close(captureHandle); return; }
-    err = snd_pcm_open(&playbackHandle2, DEVICE_OUTPUT2, SND_PCM_STREAM_PLAYBACK, 0);
-    if (err < 0) { snd_pcm_close(captureHandle); snd_pcm_close(playbackHandle1); return; }
-
-    snd_pcm_hw_params_alloca(&hwParams);
-    unsigned int rate = SAMPLE_RATE;
-
-    auto configure = [&](snd_pcm_t* handle) {
-        snd_pcm_hw_params_any(handle, hwParams);
-        snd_pcm_hw_params_set_access(handle, hwParams, SND_PCM_ACCESS_RW_INTERLEAVED);
-        snd_pcm_hw_params_set_format(handle, hwParams, SND_PCM_FORMAT_S16_LE);
-        snd_pcm_hw_params_set_rate_near(handle, hwParams, &rate, nullptr);
-        snd_pcm_hw_params_set_channels(handle, hwParams, CHANNELS);
-        snd_pcm_hw_params(handle, hwParams);
-        snd_pcm_prepare(handle);
-    };
-
-    configure(captureHandle);
-    configure(playbackHandle1);
-    configure(playbackHandle2);
+    if (!backend->open(SAMPLE_RATE, CHANNELS, FRAMES)) { failed = true; return; }
 
     short* buffer = static_cast<short*>(malloc(FRAMES * CHANNELS * sizeof(short)));
-    if (!buffer) return;
+    float* work   = static_cast<float*>(malloc(FRAMES * sizeof(float)));
+    float* fresh  = static_cast<float*>(malloc(FRAMES * sizeof(float)));
+    if (!buffer || !work || !fresh) {
+        free(buffer); free(work); free(fresh);
+        backend->close();
+        failed = true;
+        return;
+    }
+    opened = true;
 
+    // Wakeup lateness: how much longer than a block period a read took
+    const uint64_t blockNs = FRAMES * 1000000000ULL / SAMPLE_RATE;
+    uint64_t lastReadNs = 0;
+    int err;
     while (running) {
-        err = snd_pcm_readi(captureHandle, buffer, FRAMES);
-        if (err != FRAMES) { snd_pcm_prepare(captureHandle); continue; }
+        {
+            TraceSpan span(TRACE_AUDIO_READ);
+            err = backend->read(buffer, FRAMES);
+        }
+        if (err != FRAMES) continue;
+        uint64_t readNs = Trace::nowNs();
+        if (lastReadNs) Realtime::wake(readNs - lastReadNs > blockNs ? readNs - lastReadNs - blockNs : 0);
+        lastReadNs = readNs;
+        Session::audio(buffer, FRAMES);
+        {
+            TraceSpan span(TRACE_AUDIO_SPECTRUM);
+            spectrum.process(buffer);
+        }
+
+        // Take out the echo of what the speakers were last sent
+        short* clean = &recent[(recentBlocks.load(std::memory_order_relaxed) % RECENT_BLOCKS) * FRAMES];
+        {
+            TraceSpan span(TRACE_AUDIO_ECHO);
+            echo.process(buffer, &farEnd[0], clean);
+        }
+        recentBlocks.fetch_add(1, std::memory_order_release);
+        echoErleDb.store(echo.erleDb(), std::memory_order_relaxed);
+        echoTalk.store(echo.doubleTalk(), std::memory_order_relaxed);
+        echoWarm.store(echo.warmedUp(), std::memory_order_relaxed);
 
-        double sumA = 0.0;
-        for (int i = 0; i < FRAMES; ++i) sumA += std::abs(buffer[i]);
-        double norm = (sumA / FRAMES) / 32768.0;
+        // Block boundary: pick up clip and pause/resume requests. A queued
+        // clip follows the one that just ended in the next block, and after
+        // a barge-in waits until the main thread has seen it.
+        Clip* clip = activeClip.load();
+        if (clip && echo.doubleTalkBlocks() >= BARGE_IN_BLOCKS) {
+            // A guest is talking over the clip: stop it here
+            Trace::instant(TRACE_AUDIO_BARGE_IN, static_cast<int16_t>(echo.doubleTalkBlocks()));
+            activeClip.store(nullptr);
+            retireClip(clip);
+            clip = nullptr;
+            bargeIns.fetch_add(1);
+        }
+        if (!clip && retiredSlotFree() && bargeIns.load() == bargeInsTaken.load()) {
+            clip = pendingClip.exchange(nullptr);
+            if (clip) activeClip.store(clip);
+        }
+        AudioSource next = clip ? AudioSource::CLIP
+                         : micEnabled ? AudioSource::MICROPHONE : AudioSource::NONE;
+        if (next != source.load()) applySource(next);
 
+        if (next == AudioSource::NONE) {
+            // Keep the outputs fed so resuming needs no device recovery
+            memset(buffer, 0, FRAMES * CHANNELS * sizeof(short));
+            for (int out = 0; out < backend->outputCount(); out++)
+                backend->write(out, buffer, FRAMES);
+            memset(&farEnd[0], 0, FRAMES * sizeof(short));
+            continue;
+        }
+
+        if (next == AudioSource::CLIP) {
+            // This block reaches the speakers after whatever is already queued
+            uint64_t delayNs = static_cast<uint64_t>(backend->outputDelayFrames()) * 1000000000ULL / SAMPLE_RATE;
+            clockSeq.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            clockId.store(clip->id, std::memory_order_relaxed);
+            clockFrame.store(clip->pos, std::memory_order_relaxed);
+            clockAudibleNs.store(Session::nowNs() + delayNs, std::memory_order_relaxed);
+            clockSeq.fetch_add(1, std::memory_order_release);
+
+            size_t n = clip->samples.size() - clip->pos;
+            if (n > static_cast<size_t>(FRAMES)) n = FRAMES;
+            memcpy(buffer, &clip->samples[0] + clip->pos, n * sizeof(short));
+            memset(buffer + n, 0, (FRAMES - n) * sizeof(short));
+            clip->pos += n;
+            if (clip->pos >= clip->samples.size()) {
+                activeClip.store(nullptr);
+                retireClip(clip);
+            }
+        }
+
+        TraceSpan block(TRACE_AUDIO_BLOCK);
         frameCallback(buffer, FRAMES);
-        rubberBandEffect(buffer, FRAMES, norm);
 
-        err = snd_pcm_writei(playbackHandle1, buffer, FRAMES);
-        if (err == -EPIPE) snd_pcm_prepare(playbackHandle1);
-        err = snd_pcm_writei(playbackHandle2, buffer, FRAMES);
-        if (err == -EPIPE) snd_pcm_prepare(playbackHandle2);
+        // Clips are already finished audio; only the live voice is processed
+        if (next == AudioSource::MICROPHONE) {
+            TraceSpan span(TRACE_AUDIO_DSP);
+            DspChain* chain = activeChain.load();
+            DspChain::toFloat(buffer, work, FRAMES);
+
+            // Only take a new chain once the last retired one has been collected
+            DspChain* nextChain = retiredChain.load() ? nullptr : pendingChain.exchange(nullptr);
+            if (nextChain) {
+                memcpy(fresh, work, FRAMES * sizeof(float));
+                chain->process(work, FRAMES);
+                nextChain->process(fresh, FRAMES);
+                DspChain::crossfade(work, fresh, FRAMES);
+                activeChain.store(nextChain);
+                retiredChain.store(chain);
+            } else {
+                chain->process(work, FRAMES);
+            }
+            DspChain::toShort(work, buffer, FRAMES);
+        }
+
+        for (int out = 0; out < backend->outputCount(); out++)
+            backend->write(out, buffer, FRAMES);
+        // The canceller's reference: clips only, the live voice is the guest's
+        if (next == AudioSource::CLIP) memcpy(&farEnd[0], buffer, FRAMES * sizeof(short));
+        else memset(&farEnd[0], 0, FRAMES * sizeof(short));
     }
 
     free(buffer);
-    snd_pcm_close(captureHandle);
-    snd_pcm_close(playbackHandle1);
-    snd_pcm_close(playbackHandle2);
-}
\ No newline at end of file
+    free(work);
+    free(fresh);
+    backend->close();
+}
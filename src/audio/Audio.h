@@ -1,32 +1,156 @@
 #pragma once
-#include <alsa/asoundlib.h>
+#include "AudioBackend.h"
+#include "DspChain.h"
+#include "EchoCanceller.h"
+#include "SpectralAnalyzer.h"
 #include <atomic>
+#include <cstdint>
 #include <thread>
 #include <functional>
+#include <vector>
 
+// What the audio thread is feeding to the speakers and the frame callback
+enum class AudioSource {
+    NONE,         // paused: capture keeps running, outputs get silence
+    MICROPHONE,   // live passthrough through the effect chain
+    CLIP          // a prepared clip, played once, then back to the mic state
+};
+
+// Playback position of the current clip: sample `frame` of clip `id`
+// reaches the speakers at `audibleNs` (Trace::nowNs clock)
+struct ClipClock {
+    uint32_t id;
+    uint64_t frame;
+    uint64_t audibleNs;
+};
+
+struct AudioSwitchStats {
+    uint32_t count;
+    float lastUs;    // request to first block in the new state
+    float maxUs;
+};
+
+// The device set is opened once and the audio thread runs until stop().
+// pause(), resume() and playClip() only post a request; the thread applies
+// it at the next block boundary, so none of them block the caller.
 class Audio {
 public:
-    using FrameCallback = std::function<void(short*, int)>;
+    using FrameCallback  = std::function<void(short*, int)>;
+    // Called on the audio thread whenever the effective source changes
+    using SourceCallback = std::function<void(AudioSource)>;
 
-    Audio(FrameCallback callback);
+    Audio(FrameCallback callback, AudioBackend* backend,
+          SourceCallback onSource = nullptr);
     ~Audio();
     void stop();
     void pause();
     void resume();
     bool isPaused() const;
+    // The devices open on the audio thread; until then blocks are not flowing.
+    // A failed open ends the thread and sets openFailed(), which is final;
+    // stop() still joins it.
+    bool isOpen() const { return opened.load(); }
+    bool openFailed() const { return failed.load(); }
+
+    // Queue a mono clip at SAMPLE_RATE (copied). It overrides the mic until
+    // it ends. Returns the clip's id, or 0 if another clip is still waiting.
+    uint32_t playClip(const short* samples, size_t count);
+    bool isClipPlaying() const;
+    // False until the first clip has started
+    bool getClipClock(ClipClock& out) const;
+    AudioSource getSource() const { return source.load(); }
+
+    // Hand a new effect chain to the audio thread (takes ownership). It is
+    // swapped in at the next block boundary with a one-block crossfade.
+    void setDspChain(DspChain* chain);
+    // Free the clips and chains the audio thread is done with. Main thread,
+    // once per tick; until then a finished clip holds back the next one.
+    void collect();
+    void getDspReport(DspReport& out) const;
+    void getSwitchStats(AudioSwitchStats& out) const;
+    int getDeviceStats(AudioDeviceStats* out, int max) const {
+        return backend->getDeviceStats(out, max);
+    }
+    // Newest features of the captured audio; one reader thread only
+    bool getSpectrum(SpectralFeatures& out) { return spectrum.latest(out); }
+
+    // True once per barge-in: a guest talked over a clip for BARGE_IN_BLOCKS
+    // and the audio thread cut it. Drops any clip still queued; until this
+    // is called no new clip starts. Main thread only.
+    bool takeBargeIn();
+    // Newest echo-cancelled capture, up to RECENT_BLOCKS (main thread);
+    // returns the frames copied
+    size_t copyRecentCapture(short* out, size_t frames) const;
+    void getEchoStats(EchoStats& out) const;
 
-private:
     static constexpr int SAMPLE_RATE = 48000;
     static constexpr int CHANNELS    = 1;
     static constexpr int FRAMES      = 1024;
+    static constexpr int BARGE_IN_BLOCKS = 2;     // double talk this long stops a clip
+    static constexpr int RECENT_BLOCKS   = 32;    // cancelled capture kept, 680 ms
 
-    const char* DEVICE_INPUT   = "plughw:CARD=Device,DEV=0";
-    const char* DEVICE_OUTPUT1 = "plughw:CARD=UACDemoV10,DEV=0";
-    const char* DEVICE_OUTPUT2 = "plughw:CARD=Device_1,DEV=0";
+private:
+    struct Clip {
+        std::vector<short> samples;
+        size_t pos;
+        uint32_t id;
+    };
 
+    AudioBackend* backend;
     std::atomic<bool> running;
+    std::atomic<bool> opened;
+    std::atomic<bool> failed;
+    std::atomic<bool> micEnabled;
+    std::atomic<AudioSource> source;
     std::thread audioThread;
     FrameCallback frameCallback;
+    SourceCallback sourceCallback;
+
+    // activeChain belongs to the audio thread; the other two are hand-off
+    // slots so chains are only ever built and freed on the caller's thread
+    std::atomic<DspChain*> activeChain;
+    std::atomic<DspChain*> pendingChain;
+    std::atomic<DspChain*> retiredChain;
+
+    // Same hand-off for clips. Two retired slots, so the next clip starts
+    // as soon as one ends, before the main thread has collected it
+    static constexpr int RETIRED_CLIPS = 2;
+    std::atomic<Clip*> activeClip;
+    std::atomic<Clip*> pendingClip;
+    std::atomic<Clip*> retiredClips[RETIRED_CLIPS];
+    uint32_t nextClipId;
+
+    // Seqlock around the clip clock; odd while the audio thread writes it
+    std::atomic<uint32_t> clockSeq;
+    std::atomic<uint32_t> clockId;
+    std::atomic<uint64_t> clockFrame;
+    std::atomic<uint64_t> clockAudibleNs;
+
+    // Time of the oldest request not yet applied (0 = none)
+    std::atomic<uint64_t> requestNs;
+    std::atomic<uint32_t> switchCount;
+    std::atomic<uint32_t> lastSwitchNs;
+    std::atomic<uint32_t> maxSwitchNs;
+
+    // Analyses every captured block, paused or not
+    SpectralAnalyzer spectrum;
+
+    // Echo cancelling on the audio thread, against the last block the
+    // speakers were sent (clips only; silence otherwise)
+    EchoCanceller echo;
+    std::vector<short> farEnd;
+    std::vector<short> recent;               // ring of RECENT_BLOCKS cancelled blocks
+    std::atomic<uint32_t> recentBlocks;      // blocks written into it so far
+    std::atomic<uint32_t> bargeIns;
+    std::atomic<uint32_t> bargeInsTaken;
+    std::atomic<float> echoErleDb;
+    std::atomic<bool> echoTalk;
+    std::atomic<bool> echoWarm;
 
     void loop();
-};
\ No newline at end of file
+    void markRequest();
+    void applySource(AudioSource next);
+    // Audio thread: a clip only starts when there is a slot to retire it to
+    bool retiredSlotFree() const;
+    void retireClip(Clip* clip);
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+
+// Capture/playback device set driven by Audio::loop. The ALSA backend talks
+// to the real USB devices; the file backend feeds prepared samples so the
+// audio path can run without hardware.
+
+// Health counters for one device, so dropouts show up in the UI instead of
+// vanishing into a silent recover
+struct AudioDeviceStats {
+    char name[8];           // "mic", "out1", ...
+    uint32_t xruns;         // overruns (capture) or underruns (playback)
+    uint32_t shortTransfers; // reads/writes that moved less than asked
+    uint32_t recoveries;
+    uint64_t lastXrunNs;    // Trace::nowNs() clock, 0 = never
+    uint32_t periodFrames;
+    uint32_t bufferFrames;
+    int level;              // adaptive buffer level, 0 = lowest latency
+};
+
+class AudioBackend {
+public:
+    virtual ~AudioBackend() {}
+
+    // Open and configure every device; false if any of them failed
+    virtual bool open(unsigned int rate, int channels, int frames) = 0;
+    virtual void close() = 0;
+
+    // Blocking read of one block. Returns frames read, or <0 after a
+    // recoverable error (the backend has already recovered the stream).
+    virtual int read(short* buffer, int frames) = 0;
+
+    // Write one block to output 0..outputCount()-1. May queue rather than
+    // block; the audio loop keeps calling it with silence while paused.
+    virtual int write(int output, const short* buffer, int frames) = 0;
+    virtual int outputCount() const = 0;
+
+    // Frames between write() and the speaker, for scheduling against playback
+    virtual int outputDelayFrames() const { return 0; }
+    // The most outputDelayFrames() can grow to when writing blocks of
+    // frames, known before open(); sizes the echo canceller
+    virtual int maxOutputDelayFrames(int frames) const { return 0; }
+
+    // Fill up to max entries; backends without real devices report none
+    virtual int getDeviceStats(AudioDeviceStats* out, int max) const { return 0; }
+};
@@ -0,0 +1,56 @@
+#include "DriftResampler.h"
+
+// Loop gains per update (one writer chunk, ~5 ms). The measured delay saws
+// by a whole capture block as blocks arrive, so it is low-passed over about
+// a second; crystal drift is tens of ppm and only moves with temperature.
+static constexpr double DELAY_SMOOTHING = 0.005;
+static constexpr double KP = 1e-6;    // ratio per frame of delay error
+static constexpr double KI = 1e-9;    // ratio per frame of error per update
+
+DriftResampler::DriftResampler(double targetDelayFrames)
+    : target(targetDelayFrames) {
+    reset();
+}
+
+void DriftResampler::reset() {
+    ratio = 1.0;
+    filteredDelay = target;
+    integral = 0.0;
+    primed = false;
+    pos = 1.0;
+    x0 = x1 = 0;
+}
+
+void DriftResampler::update(double deviceDelayFrames, size_t ringFrames) {
+    // Fractional input sample already consumed by the interpolator counts too
+    double delay = deviceDelayFrames + ringFrames + (1.0 - pos);
+    if (!primed) { filteredDelay = delay; primed = true; }
+    filteredDelay += (delay - filteredDelay) * DELAY_SMOOTHING;
+
+    double err = filteredDelay - target;
+    integral += err;
+    double limit = MAX_PPM * 1e-6 / KI;
+    if (integral >  limit) integral =  limit;
+    if (integral < -limit) integral = -limit;
+
+    double adjust = KP * err + KI * integral;
+    if (adjust >  MAX_PPM * 1e-6) adjust =  MAX_PPM * 1e-6;
+    if (adjust < -MAX_PPM * 1e-6) adjust = -MAX_PPM * 1e-6;
+    ratio = 1.0 + adjust;
+}
+
+int DriftResampler::produce(SampleRing& ring, short* out, int maxOut) {
+    int n = 0;
+    while (n < maxOut) {
+        while (pos >= 1.0) {
+            short s;
+            if (!ring.pop(s)) return n;
+            x0 = x1;
+            x1 = s;
+            pos -= 1.0;
+        }
+        out[n++] = static_cast<short>(x0 + (x1 - x0) * pos);
+        pos += ratio;
+    }
+    return n;
+}
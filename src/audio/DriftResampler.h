@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Single-producer single-consumer ring of samples. The capture thread pushes,
+// one output writer thread pops; neither side ever blocks or locks.
+class SampleRing {
+public:
+    SampleRing(size_t capacity) : data(capacity + 1), head(0), tail(0) {}
+
+    // Returns how many samples fit; the rest are dropped
+    size_t push(const short* in, size_t n) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        size_t cap = data.size();
+        size_t free = (h + cap - t - 1) % cap;
+        if (n > free) n = free;
+        for (size_t i = 0; i < n; i++) {
+            data[t] = in[i];
+            if (++t == cap) t = 0;
+        }
+        tail.store(t, std::memory_order_release);
+        return n;
+    }
+
+    bool pop(short& out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        out = data[h];
+        if (++h == data.size()) h = 0;
+        head.store(h, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return (t + data.size() - h) % data.size();
+    }
+
+    // Consumer side only
+    void clear() { head.store(tail.load(std::memory_order_acquire), std::memory_order_release); }
+
+private:
+    std::vector<short> data;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+};
+
+// Keeps one output device locked to the capture clock. Each call measures
+// how far behind the reference the output is running (samples still queued
+// in the ring plus the device's own delay), runs it through a PI loop, and
+// resamples by the resulting ratio with linear interpolation. Every output
+// regulated to the same target delay stays phase aligned with the others.
+class DriftResampler {
+public:
+    DriftResampler(double targetDelayFrames);
+
+    void reset();
+    void setTarget(double targetDelayFrames) { target = targetDelayFrames; }
+
+    // deviceDelayFrames: frames the device reports as queued (snd_pcm_delay),
+    // ringFrames: samples still waiting in this output's ring
+    void update(double deviceDelayFrames, size_t ringFrames);
+
+    // Pull input from ring and write up to maxOut resampled frames
+    int produce(SampleRing& ring, short* out, int maxOut);
+
+    double getRatio() const { return ratio; }
+    double getDelay() const { return filteredDelay; }
+
+private:
+    static constexpr double MAX_PPM = 2000.0;
+
+    double target;
+    double ratio;          // input frames consumed per output frame
+    double filteredDelay;
+    double integral;
+    bool   primed;
+
+    double pos;            // fractional position between x0 and x1
+    short  x0, x1;
+};
@@ -0,0 +1,351 @@
+#include "DspChain.h"
+#include "../trace/Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+static float dbToGain(double db) { return static_cast<float>(std::pow(10.0, db / 20.0)); }
+
+// ---------------------------------------------------------------------------
+// Nodes
+
+class GainNode : public DspNode {
+public:
+    GainNode(double db) : gain(dbToGain(db)) {}
+    void process(float* buffer, int frames) {
+        for (int i = 0; i < frames; i++) buffer[i] *= gain;
+    }
+    const char* name() const { return "gain"; }
+
+private:
+    float gain;
+};
+
+// Cascade of RBJ cookbook biquads in transposed direct form II. Every
+// section is applied per sample inside one loop, so a highpass plus several
+// EQ bands still costs a single pass over the block.
+class BiquadCascade : public DspNode {
+public:
+    static constexpr int MAX_SECTIONS = 6;
+
+    BiquadCascade() : count(0) {}
+
+    bool addSection(double b0, double b1, double b2, double a0, double a1, double a2,
+                    const char* kind) {
+        if (count == MAX_SECTIONS) return false;
+        Section& s = sections[count++];
+        s.b0 = static_cast<float>(b0 / a0);
+        s.b1 = static_cast<float>(b1 / a0);
+        s.b2 = static_cast<float>(b2 / a0);
+        s.a1 = static_cast<float>(a1 / a0);
+        s.a2 = static_cast<float>(a2 / a0);
+        s.z1 = s.z2 = 0.0f;
+        if (!label.empty()) label += "+";
+        label += kind;
+        return true;
+    }
+
+    void process(float* buffer, int frames) {
+        for (int i = 0; i < frames; i++) {
+            float x = buffer[i];
+            for (int k = 0; k < count; k++) {
+                Section& s = sections[k];
+                float y = s.b0 * x + s.z1;
+                s.z1 = s.b1 * x - s.a1 * y + s.z2;
+                s.z2 = s.b2 * x - s.a2 * y;
+                x = y;
+            }
+            buffer[i] = x;
+        }
+        // Keep decaying state out of the denormal range on silent input
+        for (int k = 0; k < count; k++) {
+            if (std::fabs(sections[k].z1) < 1e-15f) sections[k].z1 = 0.0f;
+            if (std::fabs(sections[k].z2) < 1e-15f) sections[k].z2 = 0.0f;
+        }
+    }
+    const char* name() const { return label.c_str(); }
+
+private:
+    struct Section { float b0, b1, b2, a1, a2, z1, z2; };
+    Section sections[MAX_SECTIONS];
+    int count;
+    std::string label;
+};
+
+// Feed-forward peak compressor. The envelope follows every sample, but the
+// gain curve (log/pow) is evaluated once per 32-sample chunk and ramped
+// linearly across it.
+class CompressorNode : public DspNode {
+public:
+    CompressorNode(unsigned int rate, double thresholdDb, double ratio,
+                   double attackMs, double releaseMs, double makeupDb, bool limiter)
+        : threshold(thresholdDb), slope(ratio > 0 ? 1.0 - 1.0 / ratio : 1.0),
+          makeup(makeupDb), envelope(0.0f), gain(1.0f), isLimiter(limiter) {
+        attack  = static_cast<float>(std::exp(-1.0 / (attackMs  * 0.001 * rate)));
+        release = static_cast<float>(std::exp(-1.0 / (releaseMs * 0.001 * rate)));
+    }
+
+    void process(float* buffer, int frames) {
+        static constexpr int CHUNK = 32;
+        for (int start = 0; start < frames; start += CHUNK) {
+            int end = std::min(start + CHUNK, frames);
+            float peak = envelope;
+            for (int i = start; i < end; i++) {
+                float a = std::fabs(buffer[i]);
+                float coeff = a > peak ? attack : release;
+                peak = coeff * peak + (1.0f - coeff) * a;
+            }
+            envelope = peak;
+
+            double levelDb = 20.0 * std::log10(envelope + 1e-9);
+            double over    = levelDb - threshold;
+            double gainDb  = (over > 0.0 ? -over * slope : 0.0) + makeup;
+            float target   = dbToGain(gainDb);
+
+            float step = (target - gain) / (end - start);
+            for (int i = start; i < end; i++) {
+                gain += step;
+                buffer[i] *= gain;
+            }
+            gain = target;
+        }
+    }
+    const char* name() const { return isLimiter ? "limiter" : "compressor"; }
+
+private:
+    double threshold, slope, makeup;
+    float attack, release;
+    float envelope, gain;
+    bool isLimiter;
+};
+
+class RubberBandVoice : public DspNode {
+public:
+    RubberBandVoice(int maxFrames) : effect(maxFrames) {}
+    void process(float* buffer, int frames) {
+        double sum = 0.0;
+        for (int i = 0; i < frames; i++) sum += std::fabs(buffer[i]);
+        effect.process(buffer, frames, sum / frames);
+    }
+    const char* name() const { return "voice:rubberband"; }
+
+private:
+    RubberBand effect;
+};
+
+// Ring modulator; the carrier is a rotating phasor, renormalized per block,
+// so there is no sin() call per sample
+class RobotVoice : public DspNode {
+public:
+    RobotVoice(unsigned int rate, double hz) : re(1.0f), im(0.0f) {
+        double w = 2.0 * M_PI * hz / rate;
+        stepRe = static_cast<float>(std::cos(w));
+        stepIm = static_cast<float>(std::sin(w));
+    }
+    void process(float* buffer, int frames) {
+        for (int i = 0; i < frames; i++) {
+            buffer[i] *= im;
+            float r = re * stepRe - im * stepIm;
+            im = re * stepIm + im * stepRe;
+            re = r;
+        }
+        float mag = std::sqrt(re * re + im * im);
+        re /= mag;
+        im /= mag;
+    }
+    const char* name() const { return "voice:robot"; }
+
+private:
+    float re, im, stepRe, stepIm;
+};
+
+// ---------------------------------------------------------------------------
+// Chain
+
+DspChain::DspChain(unsigned int rate, int maxFrames)
+    : rate(rate), maxFrames(maxFrames), nodeCount(0) {
+    strcpy(voiceName, "none");
+}
+
+bool DspChain::add(DspNode* node) {
+    if (nodeCount == DSP_MAX_NODES) {
+        std::cerr << "DSP: more than " << DSP_MAX_NODES << " nodes, dropping " << node->name() << std::endl;
+        delete node;
+        return false;
+    }
+    slots[nodeCount].node.reset(node);
+    slots[nodeCount].avgNs  = 0;
+    slots[nodeCount].peakNs = 0;
+    nodeCount++;
+    return true;
+}
+
+void DspChain::process(float* buffer, int frames) {
+    for (int i = 0; i < nodeCount; i++) {
+        uint64_t t0 = Trace::nowNs();
+        slots[i].node->process(buffer, frames);
+        uint32_t dt = static_cast<uint32_t>(Trace::nowNs() - t0);
+
+        uint32_t avg = slots[i].avgNs.load(std::memory_order_relaxed);
+        slots[i].avgNs.store(avg - avg / 16 + dt / 16, std::memory_order_relaxed);
+        if (dt > slots[i].peakNs.load(std::memory_order_relaxed))
+            slots[i].peakNs.store(dt, std::memory_order_relaxed);
+    }
+}
+
+void DspChain::report(DspReport& out) const {
+    out.nodes = nodeCount;
+    out.totalUs = 0.0f;
+    for (int i = 0; i < nodeCount; i++) {
+        strncpy(out.node[i].name, slots[i].node->name(), sizeof(out.node[i].name) - 1);
+        out.node[i].name[sizeof(out.node[i].name) - 1] = '\0';
+        out.node[i].avgUs  = slots[i].avgNs.load(std::memory_order_relaxed) / 1000.0f;
+        out.node[i].peakUs = slots[i].peakNs.load(std::memory_order_relaxed) / 1000.0f;
+        out.totalUs += out.node[i].avgUs;
+    }
+    out.deadlineUs = maxFrames * 1e6f / rate;
+    strcpy(out.voice, voiceName);
+}
+
+void DspChain::toFloat(const short* in, float* out, int frames) {
+    static constexpr float SCALE = 1.0f / 32768.0f;
+    for (int i = 0; i < frames; i++) out[i] = in[i] * SCALE;
+}
+
+void DspChain::toShort(const float* in, short* out, int frames) {
+    for (int i = 0; i < frames; i++) {
+        float v = in[i] * 32768.0f;
+        if (v >  32767.0f) v =  32767.0f;
+        if (v < -32768.0f) v = -32768.0f;
+        out[i] = static_cast<short>(v);
+    }
+}
+
+void DspChain::crossfade(float* a, const float* b, int frames) {
+    float step = 1.0f / frames;
+    for (int i = 0; i < frames; i++) {
+        float t = i * step;
+        a[i] = a[i] * (1.0f - t) + b[i] * t;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Config parsing
+
+static DspNode* makeVoice(const std::string& character, unsigned int rate, int maxFrames) {
+    if (character == "rubberband") return new RubberBandVoice(maxFrames);
+    if (character == "robot")      return new RobotVoice(rate, 70.0);
+    return nullptr;
+}
+
+DspChain* DspChain::fromConfig(const std::string& text, unsigned int rate, int maxFrames,
+                               const char* voiceOverride) {
+    DspChain* chain = new DspChain(rate, maxFrames);
+    BiquadCascade* cascade = nullptr;  // open cascade that the next filter can join
+    bool voiceSeen = false;
+
+    std::istringstream lines(text);
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(lines, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+
+        std::istringstream tokens(line);
+        std::string type;
+        if (!(tokens >> type)) continue;
+
+        std::map<std::string, std::string> args;
+        std::string kv;
+        while (tokens >> kv) {
+            size_t eq = kv.find('=');
+            if (eq != std::string::npos) args[kv.substr(0, eq)] = kv.substr(eq + 1);
+        }
+        auto num = [&](const char* key, double def) {
+            return args.count(key) ? atof(args[key].c_str()) : def;
+        };
+
+        const double fs = rate;
+        if (type == "highpass" || type == "eq") {
+            double f  = num("hz", type == "highpass" ? 120.0 : 1000.0);
+            double q  = num("q", type == "highpass" ? 0.7071 : 1.0);
+            double A  = std::pow(10.0, num("db", 0.0) / 40.0);
+            double w0 = 2.0 * M_PI * f / fs;
+            double cw = std::cos(w0), alpha = std::sin(w0) / (2.0 * q);
+            double sa = 2.0 * std::sqrt(A) * alpha;
+            std::string shape = type == "highpass" ? "highpass" : (args.count("type") ? args["type"] : "peak");
+
+            if (!cascade) {
+                cascade = new BiquadCascade();
+                if (!chain->add(cascade)) { cascade = nullptr; continue; }
+            }
+            bool ok;
+            if (shape == "highpass")
+                ok = cascade->addSection((1 + cw) / 2, -(1 + cw), (1 + cw) / 2, 1 + alpha, -2 * cw, 1 - alpha, "highpass");
+            else if (shape == "peak")
+                ok = cascade->addSection(1 + alpha * A, -2 * cw, 1 - alpha * A, 1 + alpha / A, -2 * cw, 1 - alpha / A, "eq");
+            else if (shape == "lowshelf")
+                ok = cascade->addSection(A * ((A + 1) - (A - 1) * cw + sa), 2 * A * ((A - 1) - (A + 1) * cw),
+                                         A * ((A + 1) - (A - 1) * cw - sa), (A + 1) + (A - 1) * cw + sa,
+                                         -2 * ((A - 1) + (A + 1) * cw), (A + 1) + (A - 1) * cw - sa, "lowshelf");
+            else if (shape == "highshelf")
+                ok = cascade->addSection(A * ((A + 1) + (A - 1) * cw + sa), -2 * A * ((A - 1) + (A + 1) * cw),
+                                         A * ((A + 1) + (A - 1) * cw - sa), (A + 1) - (A - 1) * cw + sa,
+                                         2 * ((A - 1) - (A + 1) * cw), (A + 1) - (A - 1) * cw - sa, "highshelf");
+            else {
+                std::cerr << "DSP config line " << lineNo << ": unknown eq type " << shape << std::endl;
+                continue;
+            }
+            if (!ok) std::cerr << "DSP config line " << lineNo << ": too many filter sections" << std::endl;
+            continue;
+        }
+
+        cascade = nullptr;
+        if (type == "gain") {
+            chain->add(new GainNode(num("db", 0.0)));
+        } else if (type == "compressor") {
+            chain->add(new CompressorNode(rate, num("threshold", -18.0), num("ratio", 4.0),
+                                          num("attack", 5.0), num("release", 80.0), num("makeup", 0.0), false));
+        } else if (type == "limiter") {
+            chain->add(new CompressorNode(rate, num("threshold", -1.0), 0.0,
+                                          num("attack", 0.5), num("release", 50.0), 0.0, true));
+        } else if (type == "voice") {
+            voiceSeen = true;
+            std::string character = voiceOverride ? voiceOverride
+                                  : (args.count("character") ? args["character"] : "none");
+            DspNode* v = makeVoice(character, rate, maxFrames);
+            if (v) chain->add(v);
+            strncpy(chain->voiceName, character.c_str(), sizeof(chain->voiceName) - 1);
+            chain->voiceName[sizeof(chain->voiceName) - 1] = '\0';
+        } else {
+            std::cerr << "DSP config line " << lineNo << ": unknown node " << type << std::endl;
+        }
+    }
+
+    if (voiceOverride && !voiceSeen) {
+        DspNode* v = makeVoice(voiceOverride, rate, maxFrames);
+        if (v) chain->add(v);
+        strncpy(chain->voiceName, voiceOverride, sizeof(chain->voiceName) - 1);
+        chain->voiceName[sizeof(chain->voiceName) - 1] = '\0';
+    }
+    return chain;
+}
+
+DspChain* DspChain::fromFile(const char* path, unsigned int rate, int maxFrames,
+                             const char* voiceOverride) {
+    std::ifstream f(path);
+    if (!f) {
+        // No config: keep the original passthrough sound
+        return fromConfig("voice character=rubberband", rate, maxFrames, voiceOverride);
+    }
+    std::stringstream text;
+    text << f.rdbuf();
+    return fromConfig(text.str(), rate, maxFrames, voiceOverride);
+}
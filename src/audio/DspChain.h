@@ -0,0 +1,86 @@
+#pragma once
+#include "Effects.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Block-based effect chain for the voice passthrough. Samples are converted
+// to float once per block, run through every node in place, and converted
+// back once. Nodes allocate all of their state when the chain is built, so
+// process() is safe on the audio thread.
+//
+// Chains are described by a small text config, one node per line:
+//
+//   gain       db=6
+//   highpass   hz=120
+//   eq         type=peak hz=2500 q=1.0 db=4      (peak | lowshelf | highshelf)
+//   compressor threshold=-18 ratio=4 attack=5 release=80 makeup=3
+//   limiter    threshold=-1
+//   voice      character=rubberband              (none | rubberband | robot)
+//
+// Neighbouring highpass/eq lines are merged into one biquad cascade that
+// runs all sections in a single pass over the block.
+
+class DspNode {
+public:
+    virtual ~DspNode() {}
+    virtual void process(float* buffer, int frames) = 0;
+    virtual const char* name() const = 0;
+};
+
+static constexpr int DSP_MAX_NODES = 8;
+
+struct DspNodeStats {
+    char name[24];
+    float avgUs;    // smoothed CPU time per block
+    float peakUs;   // worst block since the chain started
+};
+
+struct DspReport {
+    int nodes;
+    DspNodeStats node[DSP_MAX_NODES];
+    float totalUs;
+    float deadlineUs;  // one block period
+    char voice[16];
+};
+
+class DspChain {
+public:
+    DspChain(unsigned int rate, int maxFrames);
+
+    // Build a chain from config text; unknown lines are reported on stderr
+    // and skipped. voiceOverride replaces (or adds) the voice node.
+    static DspChain* fromConfig(const std::string& text, unsigned int rate, int maxFrames,
+                                const char* voiceOverride = nullptr);
+    static DspChain* fromFile(const char* path, unsigned int rate, int maxFrames,
+                              const char* voiceOverride = nullptr);
+
+    // In-place processing of one float block (samples in -1.0..1.0)
+    void process(float* buffer, int frames);
+
+    void report(DspReport& out) const;
+    const char* voice() const { return voiceName; }
+
+    // Conversion helpers for the int16 device format
+    static void toFloat(const short* in, float* out, int frames);
+    static void toShort(const float* in, short* out, int frames);
+    // Linear crossfade from a (old chain output) to b (new chain output), into a
+    static void crossfade(float* a, const float* b, int frames);
+
+private:
+    struct NodeSlot {
+        std::unique_ptr<DspNode> node;
+        std::atomic<uint32_t> avgNs;
+        std::atomic<uint32_t> peakNs;
+    };
+
+    unsigned int rate;
+    int maxFrames;
+    NodeSlot slots[DSP_MAX_NODES];
+    int nodeCount;
+    char voiceName[16];
+
+    bool add(DspNode* node);
+};
@@ -0,0 +1,231 @@
+#include "EchoCanceller.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static constexpr float SCALE        = 1.0f / 32768.0f;
+static constexpr float POWER_SMOOTH = 0.2f;     // per-bin far-end power
+static constexpr float LEAK_RISE    = 0.05f;    // echo residual follows rises faster...
+static constexpr float LEAK_FALL    = 0.02f;    // ...and lets go slowly
+static constexpr float NOISE_SMOOTH = 0.05f;
+static constexpr float ERLE_SMOOTH  = 0.05f;
+
+static float dbToPower(float db) { return powf(10.0f, db / 10.0f); }
+
+int EchoCanceller::partitionsFor(int frames, int delayFrames) {
+    int parts = (delayFrames + ROOM_TAIL_FRAMES + frames - 1) / frames;
+    return parts > PARTITIONS ? parts : PARTITIONS;
+}
+
+EchoCanceller::EchoCanceller(int frames, int partitions)
+    : n(frames), m(2 * frames), bins(frames + 1), parts(partitions),
+      bitrev(2 * frames), twRe(frames), twIm(frames), re(2 * frames), im(2 * frames),
+      prevFar(frames), xRe(partitions * (frames + 1)), xIm(partitions * (frames + 1)),
+      wRe(partitions * (frames + 1)), wIm(partitions * (frames + 1)), farPower(frames + 1),
+      blockPower(partitions), residual(frames) {
+    int bits = 0;
+    while ((1 << bits) < m) bits++;
+    for (int i = 0; i < m; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        bitrev[i] = r;
+    }
+    for (int k = 0; k < n; k++) {
+        twRe[k] = cosf(2.0f * M_PI * k / m);
+        twIm[k] = -sinf(2.0f * M_PI * k / m);
+    }
+    reset();
+}
+
+void EchoCanceller::reset() {
+    std::fill(prevFar.begin(), prevFar.end(), 0.0f);
+    std::fill(xRe.begin(), xRe.end(), 0.0f);
+    std::fill(xIm.begin(), xIm.end(), 0.0f);
+    std::fill(wRe.begin(), wRe.end(), 0.0f);
+    std::fill(wIm.begin(), wIm.end(), 0.0f);
+    std::fill(farPower.begin(), farPower.end(), 0.0f);
+    std::fill(blockPower.begin(), blockPower.end(), 0.0f);
+    head = 0;
+    constrainNext = 0;
+    farOn = false;
+    talkBlocks = 0;
+    hangover = 0;
+    farBlocks = 0;
+    leak = 1.0f;
+    noise = dbToPower(NEAR_MIN_DB - 10.0f);
+    erle = 0.0f;
+}
+
+// In-place radix-2 FFT of re/im (m points); the inverse is scaled by 1/m
+void EchoCanceller::fft(bool inverse) {
+    float* r = &re[0];
+    float* q = &im[0];
+    if (inverse) for (int k = 0; k < m; k++) q[k] = -q[k];
+    for (int k = 0; k < m; k++) {
+        int j = bitrev[k];
+        if (k < j) {
+            float t = r[k]; r[k] = r[j]; r[j] = t;
+            t = q[k]; q[k] = q[j]; q[j] = t;
+        }
+    }
+    for (int size = 2; size <= m; size <<= 1) {
+        int span = size / 2;
+        int step = m / size;
+        for (int start = 0; start < m; start += size) {
+            for (int k = 0; k < span; k++) {
+                float wr = twRe[k * step], wi = twIm[k * step];
+                int a = start + k, b = a + span;
+                float tr = r[b] * wr - q[b] * wi;
+                float ti = r[b] * wi + q[b] * wr;
+                r[b] = r[a] - tr;
+                q[b] = q[a] - ti;
+                r[a] += tr;
+                q[a] += ti;
+            }
+        }
+    }
+    if (inverse) {
+        float s = 1.0f / m;
+        for (int k = 0; k < m; k++) {
+            r[k] *= s;
+            q[k] = -q[k] * s;
+        }
+    }
+}
+
+void EchoCanceller::mirror() {
+    for (int k = bins; k < m; k++) {
+        re[k] = re[m - k];
+        im[k] = -im[m - k];
+    }
+}
+
+void EchoCanceller::process(const short* mic, const short* farEnd, short* out) {
+    // The far-end window [previous block, this block] into the newest partition
+    head = (head + parts - 1) % parts;
+    float farNow = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float x = farEnd[i] * SCALE;
+        re[i] = prevFar[i];
+        re[n + i] = x;
+        prevFar[i] = x;
+        farNow += x * x;
+    }
+    std::fill(im.begin(), im.end(), 0.0f);
+    blockPower[head] = farNow / n;
+    float farSpan = 0.0f;
+    for (int p = 0; p < parts; p++) farSpan += blockPower[p];
+    farSpan /= parts;
+
+    float micPower = 0.0f;
+    for (int i = 0; i < n; i++) micPower += (mic[i] * SCALE) * (mic[i] * SCALE);
+    micPower /= n;
+
+    // Nothing sent to the speakers for a whole span: no echo to remove
+    if (farSpan == 0.0f) {
+        if (out != mic) memcpy(out, mic, n * sizeof(short));
+        farOn = false;
+        talkBlocks = 0;
+        noise += (micPower - noise) * NOISE_SMOOTH;
+        return;
+    }
+
+    fft(false);
+    float* hx = &xRe[head * bins];
+    float* hy = &xIm[head * bins];
+    for (int k = 0; k < bins; k++) {
+        hx[k] = re[k];
+        hy[k] = im[k];
+        float pw = re[k] * re[k] + im[k] * im[k];
+        farPower[k] += (pw - farPower[k]) * POWER_SMOOTH;
+    }
+
+    // Echo estimate: every partition's filter on its delayed spectrum
+    std::fill(re.begin(), re.end(), 0.0f);
+    std::fill(im.begin(), im.end(), 0.0f);
+    for (int p = 0; p < parts; p++) {
+        const float* xr = &xRe[((head + p) % parts) * bins];
+        const float* xi = &xIm[((head + p) % parts) * bins];
+        const float* wr = &wRe[p * bins];
+        const float* wi = &wIm[p * bins];
+        for (int k = 0; k < bins; k++) {
+            re[k] += wr[k] * xr[k] - wi[k] * xi[k];
+            im[k] += wr[k] * xi[k] + wi[k] * xr[k];
+        }
+    }
+    mirror();
+    fft(true);
+
+    float echoPower = 0.0f, errPower = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float y = re[n + i];
+        float e = mic[i] * SCALE - y;
+        residual[i] = e;
+        echoPower += y * y;
+        errPower += e * e;
+    }
+    echoPower /= n;
+    errPower /= n;
+
+    // Double talk: the residual well above what the echo alone leaves
+    farOn = farSpan > dbToPower(FAR_MIN_DB);
+    float expected = leak * farSpan + noise;
+    bool near = farOn && warmedUp() && errPower > dbToPower(NEAR_MIN_DB) &&
+                errPower > expected * dbToPower(DOUBLE_TALK_DB);
+    if (near) {
+        talkBlocks++;
+        hangover = HANGOVER_BLOCKS;
+    } else {
+        talkBlocks = 0;
+        if (hangover > 0) hangover--;
+    }
+    bool adapt = farOn && !near && hangover == 0;
+
+    if (adapt) {
+        float r = errPower / farSpan;
+        leak += (r - leak) * (r > leak ? LEAK_RISE : LEAK_FALL);
+        if (micPower > 0.0f && errPower > 0.0f)
+            erle += (10.0f * log10f(micPower / errPower) - erle) * ERLE_SMOOTH;
+        farBlocks++;
+    } else if (!farOn) {
+        noise += (micPower - noise) * NOISE_SMOOTH;
+    }
+
+    for (int i = 0; i < n; i++) {
+        float v = residual[i] * 32768.0f;
+        out[i] = static_cast<short>(v > 32767.0f ? 32767.0f : v < -32768.0f ? -32768.0f : v);
+    }
+    if (!adapt) return;
+
+    // NLMS: W += mu / |X|^2 * conj(X) * E, with E of [0, e]
+    for (int i = 0; i < n; i++) {
+        re[i] = 0.0f;
+        re[n + i] = residual[i];
+    }
+    std::fill(im.begin(), im.end(), 0.0f);
+    fft(false);
+    float floor = 2.0f * n * dbToPower(FAR_MIN_DB - 10.0f);
+    for (int k = 0; k < bins; k++) {
+        float mu = STEP / (parts * farPower[k] + floor);
+        float er = re[k] * mu, ei = im[k] * mu;
+        for (int p = 0; p < parts; p++) {
+            const float* xr = &xRe[((head + p) % parts) * bins];
+            const float* xi = &xIm[((head + p) % parts) * bins];
+            wRe[p * bins + k] += xr[k] * er + xi[k] * ei;
+            wIm[p * bins + k] += xr[k] * ei - xi[k] * er;
+        }
+    }
+
+    // Keep one partition's impulse response to its first n taps
+    int c = constrainNext;
+    constrainNext = (constrainNext + 1) % parts;
+    memcpy(&re[0], &wRe[c * bins], bins * sizeof(float));
+    memcpy(&im[0], &wIm[c * bins], bins * sizeof(float));
+    mirror();
+    fft(true);
+    std::fill(re.begin() + n, re.end(), 0.0f);
+    std::fill(im.begin(), im.end(), 0.0f);
+    fft(false);
+    memcpy(&wRe[c * bins], &re[0], bins * sizeof(float));
+    memcpy(&wIm[c * bins], &im[0], bins * sizeof(float));
+}
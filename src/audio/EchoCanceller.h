@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Removes Taro's own voice from the microphone so a guest can be heard over
+// it. The reference is what the speakers were sent; the echo path (output
+// queue, speaker, room, microphone) is learned by a partitioned block
+// frequency-domain NLMS filter, overlap-save with one block per partition.
+// The partitions must cover the longest output delay plus the room tail;
+// partitionsFor() sizes them from the backend's largest delay. A block
+// costs three FFTs, plus two to keep one partition causal (round robin).
+//
+// Double talk: what the echo alone leaves behind is tracked as a fraction
+// of the far-end power over the filter span. A near-end talker lifts the
+// residual DOUBLE_TALK_DB above that; adaptation freezes while they talk
+// (and HANGOVER_BLOCKS after), so their voice can't detune the filter.
+//
+// Audio thread only; nothing allocates after construction.
+
+struct EchoStats {
+    float erleDb;         // echo removed, smoothed over far-end-only blocks
+    bool doubleTalk;
+    bool warmedUp;        // enough far end heard to judge double talk
+    uint32_t bargeIns;
+};
+
+class EchoCanceller {
+public:
+    explicit EchoCanceller(int frames, int partitions = PARTITIONS);
+
+    // mic: the captured block; farEnd: the block most recently sent to the
+    // speakers; out: the mic with the estimated echo removed (may be mic)
+    void process(const short* mic, const short* farEnd, short* out);
+    void reset();
+
+    bool farActive() const { return farOn; }
+    bool doubleTalk() const { return talkBlocks > 0; }
+    // Consecutive blocks of double talk so far
+    int doubleTalkBlocks() const { return talkBlocks; }
+    bool warmedUp() const { return farBlocks >= WARMUP_BLOCKS; }
+    float erleDb() const { return erle; }
+
+    // Enough partitions for an echo arriving up to delayFrames after the
+    // reference, plus the room tail; never fewer than PARTITIONS
+    static int partitionsFor(int frames, int delayFrames);
+
+    static constexpr int   PARTITIONS     = 8;        // 170 ms at 1024 frames, 48 kHz
+    static constexpr int   ROOM_TAIL_FRAMES = 4800;   // 100 ms at 48 kHz
+    static constexpr float STEP           = 0.4f;     // NLMS step size
+    static constexpr float FAR_MIN_DB     = -50.0f;   // dBFS; a quieter far end is silence
+    static constexpr float NEAR_MIN_DB    = -60.0f;   // residual this quiet is never a talker
+    static constexpr float DOUBLE_TALK_DB = 6.0f;
+    static constexpr int   WARMUP_BLOCKS  = 24;       // far-end blocks before double talk counts
+    static constexpr int   HANGOVER_BLOCKS = 4;
+
+private:
+    int n;          // block
+    int m;          // FFT length, 2n
+    int bins;       // n + 1 for a real signal
+    int parts;
+
+    std::vector<int> bitrev;
+    std::vector<float> twRe, twIm;
+    std::vector<float> re, im;                // FFT work, m points
+    std::vector<float> prevFar;               // last block, the first half of the window
+    std::vector<float> xRe, xIm;              // [partition][bin] far-end spectra, newest at head
+    std::vector<float> wRe, wIm;              // [partition][bin] filter
+    std::vector<float> farPower;              // per-bin smoothed |X|^2
+    std::vector<float> blockPower;            // far-end power of each block in the span
+    std::vector<float> residual;              // this block's error, n samples
+    int head;
+    int constrainNext;
+
+    bool farOn;
+    int talkBlocks;
+    int hangover;
+    int farBlocks;
+    float leak;       // residual power / far-end power with the echo alone
+    float noise;      // residual power with no far end
+    float erle;
+
+    void fft(bool inverse);
+    void mirror();    // fill bins above n from 0..n (real signal)
+};
@@ -0,0 +1,57 @@
+#include "Effects.h"
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+double meanAbsAmplitude(const short* buffer, int frames) {
+    double sum = 0.0;
+    for (int i = 0; i < frames; ++i) sum += std::abs(buffer[i]);
+    return sum / frames;
+}
+
+static constexpr double EFFECT_AMOUNT  = 1.0;
+static constexpr int    HISTORY_BLOCKS = 8;
+
+RubberBand::RubberBand(int maxFrames)
+    : ring(maxFrames * HISTORY_BLOCKS, 0.0f), head(0), size(0), readPos(0.0), playSpeed(1.0) {}
+
+void RubberBand::process(float* buffer, int frames, double ampNorm) {
+    const double MIN_ACTIVE  = 0.02 / std::max(0.0001, EFFECT_AMOUNT);
+    const double sensitivity = 1.5  * EFFECT_AMOUNT;
+    const double min_speed   = 0.6  / std::max(0.1, EFFECT_AMOUNT);
+    const double max_speed   = 1.0  + (0.8 * EFFECT_AMOUNT);
+    const size_t MAX_HISTORY = std::min(ring.size(), static_cast<size_t>(frames) * HISTORY_BLOCKS);
+
+    double targetSpeed = (ampNorm < MIN_ACTIVE) ? 1.0 : 1.0 + (ampNorm - MIN_ACTIVE) * sensitivity;
+    if (targetSpeed < min_speed) targetSpeed = min_speed;
+    if (targetSpeed > max_speed) targetSpeed = max_speed;
+    playSpeed += (targetSpeed - playSpeed) * 0.12;
+
+    for (int i = 0; i < frames; ++i) {
+        if (size == ring.size()) popFront();
+        ring[(head + size) % ring.size()] = buffer[i];
+        size++;
+    }
+    while (size > MAX_HISTORY) popFront();
+    if (size < static_cast<size_t>(frames) + 2) return;
+
+    if (readPos < 0.0) readPos = 0.0;
+    if (readPos > static_cast<double>(size - 1))
+        readPos = static_cast<double>(size - 1 - frames);
+
+    double rp = readPos;
+    for (int i = 0; i < frames; ++i) {
+        size_t i0 = static_cast<size_t>(rp);
+        size_t i1 = (i0 + 1 < size) ? i0 + 1 : i0;
+        float  s0 = at(i0);
+        buffer[i] = s0 + (at(i1) - s0) * static_cast<float>(rp - i0);
+        rp += playSpeed;
+        if (rp >= static_cast<double>(size - 1)) { rp = static_cast<double>(size - 1); break; }
+    }
+
+    readPos = rp;
+    while (readPos >= 1.0 && size > static_cast<size_t>(frames) * 2) {
+        popFront();
+        readPos -= 1.0;
+    }
+}
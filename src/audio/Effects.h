@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Per-block sample processing shared by the audio thread and the mouth.
+// Kept free of ALSA so it can be linked into benchmarks and test tools.
+
+// Mean absolute sample value of a block (0-32768)
+double meanAbsAmplitude(const short* buffer, int frames);
+
+// Variable-speed resampling "rubber band" pitch effect, driven by the
+// normalized block amplitude (0.0-1.0). Louder input plays faster and
+// higher. History lives in a ring sized at construction, so process()
+// never allocates.
+class RubberBand {
+public:
+    RubberBand(int maxFrames);
+    void process(float* buffer, int frames, double ampNorm);
+
+private:
+    std::vector<float> ring;
+    size_t head;     // ring index of history[0]
+    size_t size;     // samples of history held
+    double readPos;  // fractional read position into history
+    double playSpeed;
+
+    float at(size_t i) const { return ring[(head + i) % ring.size()]; }
+    void popFront() { head = (head + 1) % ring.size(); size--; }
+};
@@ -0,0 +1,128 @@
+#include "FileBackend.h"
+#include "../trace/Trace.h"
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+
+FileBackend::FileBackend(const std::vector<short>& samples, bool realTime)
+    : samples(samples), realTime(realTime), rate(48000), startNs(0), position(0), done(false) {}
+
+bool FileBackend::open(unsigned int r, int channels, int frames) {
+    (void)channels; (void)frames;
+    rate     = r;
+    position = 0;
+    startNs  = Trace::nowNs();
+    done     = false;
+    return true;
+}
+
+int FileBackend::read(short* buffer, int frames) {
+    if (realTime) {
+        // Block k is complete once (k+1) periods have elapsed since open()
+        uint64_t readyNs = startNs + (position + frames) * 1000000000ULL / rate;
+        struct timespec ts;
+        ts.tv_sec  = readyNs / 1000000000ULL;
+        ts.tv_nsec = readyNs % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+
+    for (int i = 0; i < frames; i++) {
+        size_t idx = position + i;
+        buffer[i] = idx < samples.size() ? samples[idx] : 0;
+    }
+    position += frames;
+    if (position >= samples.size()) done = true;
+    return frames;
+}
+
+int FileBackend::write(int output, const short* buffer, int frames) {
+    (void)output; (void)buffer;
+    return frames;
+}
+
+static uint32_t le32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t le16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+
+bool FileBackend::loadWav(const char* path, unsigned int rate, std::vector<short>& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+
+    unsigned char hdr[12];
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        fclose(f);
+        return false;
+    }
+
+    uint16_t fmtChannels = 0, fmtBits = 0;
+    uint32_t fmtRate = 0;
+    std::vector<short> raw;
+    unsigned char chunk[8];
+    while (fread(chunk, 1, 8, f) == 8) {
+        uint32_t size = le32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4)) {
+            unsigned char fmt[16];
+            if (size < 16 || fread(fmt, 1, 16, f) != 16) break;
+            fmtChannels = le16(fmt + 2);
+            fmtRate     = le32(fmt + 4);
+            fmtBits     = le16(fmt + 14);
+            fseek(f, size - 16 + (size & 1), SEEK_CUR);
+        } else if (!memcmp(chunk, "data", 4)) {
+            // An empty data chunk leaves raw empty and the load fails below
+            if (size >= 2) {
+                raw.resize(size / 2);
+                raw.resize(fread(raw.data(), 2, raw.size(), f));
+            }
+            break;
+        } else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fclose(f);
+    if (fmtBits != 16 || fmtChannels == 0 || fmtRate == 0 || raw.empty()) return false;
+
+    // Mix to mono, then linear-interpolate to the requested rate
+    size_t inFrames = raw.size() / fmtChannels;
+    std::vector<double> mono(inFrames);
+    for (size_t i = 0; i < inFrames; i++) {
+        double sum = 0.0;
+        for (int c = 0; c < fmtChannels; c++) sum += raw[i * fmtChannels + c];
+        mono[i] = sum / fmtChannels;
+    }
+
+    size_t outFrames = static_cast<size_t>(static_cast<double>(inFrames) * rate / fmtRate);
+    out.resize(outFrames);
+    double step = static_cast<double>(fmtRate) / rate;
+    for (size_t i = 0; i < outFrames; i++) {
+        double pos = i * step;
+        size_t i0 = static_cast<size_t>(pos);
+        size_t i1 = i0 + 1 < inFrames ? i0 + 1 : i0;
+        double v = mono[i0] + (mono[i1] - mono[i0]) * (pos - i0);
+        out[i] = static_cast<short>(v);
+    }
+    return true;
+}
+
+static void put32(unsigned char* p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xff; }
+static void put16(unsigned char* p, uint16_t v) { p[0] = v & 0xff; p[1] = v >> 8; }
+
+bool FileBackend::saveWav(const char* path, const short* samples, size_t count, unsigned int rate) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return false;
+    unsigned char hdr[44];
+    uint32_t bytes = static_cast<uint32_t>(count * 2);
+    memcpy(hdr, "RIFF", 4);
+    put32(hdr + 4, 36 + bytes);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    put32(hdr + 16, 16);
+    put16(hdr + 20, 1);          // PCM
+    put16(hdr + 22, 1);          // mono
+    put32(hdr + 24, rate);
+    put32(hdr + 28, rate * 2);
+    put16(hdr + 32, 2);
+    put16(hdr + 34, 16);
+    memcpy(hdr + 36, "data", 4);
+    put32(hdr + 40, bytes);
+    bool ok = fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr) &&
+              fwrite(samples, 2, count, f) == count;
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "AudioBackend.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Plays prepared samples into the capture side and swallows playback.
+// In real-time mode reads are paced against the stream start like a real
+// capture device, so timing through the rest of the pipeline is realistic.
+// Once the samples run out it keeps delivering silence and reports finished().
+class FileBackend : public AudioBackend {
+public:
+    FileBackend(const std::vector<short>& samples, bool realTime = true);
+
+    // Load a 16-bit PCM WAV, mixed down to mono and resampled to rate
+    static bool loadWav(const char* path, unsigned int rate, std::vector<short>& out);
+    // Write mono 16-bit PCM as a WAV
+    static bool saveWav(const char* path, const short* samples, size_t count, unsigned int rate);
+
+    bool open(unsigned int rate, int channels, int frames);
+    void close() {}
+    int read(short* buffer, int frames);
+    int write(int output, const short* buffer, int frames);
+    int outputCount() const { return 2; }
+
+    bool finished() const { return done.load(); }
+    uint64_t streamStartNs() const { return startNs; }
+    unsigned int sampleRate() const { return rate; }
+
+private:
+    std::vector<short> samples;
+    bool realTime;
+    unsigned int rate;
+    uint64_t startNs;
+    size_t position;
+    std::atomic<bool> done;
+};
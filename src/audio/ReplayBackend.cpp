@@ -0,0 +1,54 @@
+#include "ReplayBackend.h"
+#include <cstring>
+#include <unistd.h>
+
+ReplayBackend::ReplayBackend()
+    : hasBlock(false), busy(false), waiting(false), finished(false) {}
+
+bool ReplayBackend::open(unsigned int rate, int channels, int frames) {
+    (void)rate; (void)channels; (void)frames;
+    return true;
+}
+
+int ReplayBackend::read(short* buffer, int frames) {
+    std::unique_lock<std::mutex> l(lock);
+    busy = false;
+    waiting = true;
+    wake.notify_all();
+    wake.wait(l, [this]() { return hasBlock || finished; });
+    waiting = false;
+    if (!hasBlock) {
+        // Log exhausted: silence, paced so a stopping Audio loop doesn't spin
+        l.unlock();
+        memset(buffer, 0, frames * sizeof(short));
+        usleep(1000);
+        return frames;
+    }
+    size_t n = block.size() < static_cast<size_t>(frames) ? block.size() : frames;
+    memcpy(buffer, block.data(), n * sizeof(short));
+    memset(buffer + n, 0, (frames - n) * sizeof(short));
+    hasBlock = false;
+    busy = true;
+    return frames;
+}
+
+int ReplayBackend::write(int output, const short* buffer, int frames) {
+    (void)output; (void)buffer;
+    return frames;
+}
+
+void ReplayBackend::deliver(const short* samples, int frames) {
+    std::unique_lock<std::mutex> l(lock);
+    wake.wait(l, [this]() { return (waiting && !hasBlock) || finished; });
+    if (finished) return;
+    block.assign(samples, samples + frames);
+    hasBlock = true;
+    wake.notify_all();
+    wake.wait(l, [this]() { return (waiting && !hasBlock && !busy) || finished; });
+}
+
+void ReplayBackend::finish() {
+    std::lock_guard<std::mutex> l(lock);
+    finished = true;
+    wake.notify_all();
+}
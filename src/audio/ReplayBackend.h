@@ -0,0 +1,35 @@
+#pragma once
+#include "AudioBackend.h"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Capture side of a session replay. The replay driver hands over one
+// recorded block at a time and deliver() returns only once the audio
+// thread has finished with it (it is back waiting in read()), so every
+// servo command a block causes happens before the driver moves on.
+// Playback is swallowed.
+class ReplayBackend : public AudioBackend {
+public:
+    ReplayBackend();
+
+    bool open(unsigned int rate, int channels, int frames);
+    void close() {}
+    int read(short* buffer, int frames);
+    int write(int output, const short* buffer, int frames);
+    int outputCount() const { return 2; }
+
+    // Replay driver thread
+    void deliver(const short* samples, int frames);
+    // Release the audio thread for good (before stopping Audio)
+    void finish();
+
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    std::vector<short> block;
+    bool hasBlock;   // delivered, not yet picked up by read()
+    bool busy;       // picked up, audio thread hasn't come back to read()
+    bool waiting;    // audio thread is parked in read()
+    bool finished;
+};
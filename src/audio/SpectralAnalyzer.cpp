@@ -0,0 +1,246 @@
+#include "SpectralAnalyzer.h"
+#include "../trace/Trace.h"
+#include <cmath>
+#include <cstring>
+
+static const float BAND_EDGES_HZ[SPECTRAL_BANDS + 1] = { 40, 150, 400, 1500, 4000, 12000 };
+static constexpr float COMPRESSION   = 1000.0f;   // log(1 + C * magnitude) for the flux
+static constexpr float TEMPO_PRIOR   = 120.0f;    // BPM the octave weighting centres on
+static constexpr float PRIOR_OCTAVES = 1.0f;      // its width
+static constexpr float PHASE_WINDOW  = 0.25f;     // of a period, for snapping beats to onsets
+static constexpr float COST_SMOOTH   = 0.05f;
+
+SpectralAnalyzer::SpectralAnalyzer(unsigned int rate, int frames)
+    : n(frames), half(frames / 2), blocksPerSec(static_cast<float>(rate) / frames),
+      deadlineUs(frames * 1e6f / rate),
+      window(frames), bitrev(frames / 2), twRe(frames / 4), twIm(frames / 4),
+      spRe(frames / 2 + 1), spIm(frames / 2 + 1), re(frames / 2), im(frames / 2),
+      prevLogMag(frames / 2 + 1),
+      history(HISTORY), centred(HISTORY), head(0), sinceOnset(0),
+      period(0.0f), nextBeat(0.0f), peakNs(0), back(0), middle(1), front(2) {
+    for (int i = 0; i < n; i++) window[i] = 0.5f - 0.5f * cosf(2.0f * M_PI * i / n);
+
+    int bits = 0;
+    while ((1 << bits) < half) bits++;
+    for (int i = 0; i < half; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        bitrev[i] = r;
+    }
+    for (int k = 0; k < half / 2; k++) {
+        twRe[k] = cosf(2.0f * M_PI * k / half);
+        twIm[k] = -sinf(2.0f * M_PI * k / half);
+    }
+    for (int k = 0; k <= half; k++) {
+        spRe[k] = cosf(2.0f * M_PI * k / n);
+        spIm[k] = -sinf(2.0f * M_PI * k / n);
+    }
+    for (int b = 0; b <= SPECTRAL_BANDS; b++) {
+        int bin = static_cast<int>(BAND_EDGES_HZ[b] * n / rate + 0.5f);
+        bandBin[b] = bin > half ? half : bin;
+    }
+
+    onsetGap = static_cast<int>(ONSET_GAP_MS * blocksPerSec / 1000.0f + 0.5f);
+    minLag = static_cast<int>(60.0f * blocksPerSec / MAX_BPM);
+    maxLag = static_cast<int>(60.0f * blocksPerSec / MIN_BPM) + 1;
+    if (maxLag > HISTORY / 2) maxLag = HISTORY / 2;
+    acf.assign(maxLag + 2, 0.0f);
+
+    memset(&cur, 0, sizeof(cur));
+    cur.deadlineUs = deadlineUs;
+    memset(slots, 0, sizeof(slots));
+}
+
+// In-place radix-2 FFT of re/im (half points)
+void SpectralAnalyzer::fft() {
+    for (int i = 0; i < half; i++) {
+        int j = bitrev[i];
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (int size = 2; size <= half; size <<= 1) {
+        int span = size / 2;
+        int step = half / size;
+        for (int start = 0; start < half; start += size) {
+            for (int k = 0; k < span; k++) {
+                float wr = twRe[k * step], wi = twIm[k * step];
+                int a = start + k, b = a + span;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+void SpectralAnalyzer::process(const short* block) {
+    uint64_t t0 = Trace::nowNs();
+
+    // Even samples as the real part, odd as the imaginary part
+    const float scale = 1.0f / 32768.0f;
+    for (int i = 0; i < half; i++) {
+        re[i] = block[2 * i] * scale * window[2 * i];
+        im[i] = block[2 * i + 1] * scale * window[2 * i + 1];
+    }
+    fft();
+
+    // Split into the n-point real spectrum, bins 0..half. Magnitudes are
+    // scaled so a full-scale sine peaks near 1 (Hann gain is n/4).
+    const float norm = 4.0f / n;
+    float bandPower[SPECTRAL_BANDS] = {};
+    float total = 0.0f, flux = 0.0f;
+    int band = 0;
+    for (int k = 0; k <= half; k++) {
+        int a = k == half ? 0 : k;
+        int b = k == 0 ? 0 : half - k;
+        float er = 0.5f * (re[a] + re[b]), ei = 0.5f * (im[a] - im[b]);
+        float orr = 0.5f * (im[a] + im[b]), oi = -0.5f * (re[a] - re[b]);
+        float xr = er + spRe[k] * orr - spIm[k] * oi;
+        float xi = ei + spRe[k] * oi + spIm[k] * orr;
+        float power = (xr * xr + xi * xi) * norm * norm;
+
+        total += power;
+        while (band < SPECTRAL_BANDS && k >= bandBin[band + 1]) band++;
+        if (band < SPECTRAL_BANDS && k >= bandBin[band]) bandPower[band] += power;
+
+        float lm = logf(1.0f + COMPRESSION * sqrtf(power));
+        float rise = lm - prevLogMag[k];
+        if (rise > 0.0f) flux += rise;
+        prevLogMag[k] = lm;
+    }
+    flux /= half;
+
+    for (int b = 0; b < SPECTRAL_BANDS; b++) cur.bandDb[b] = 10.0f * log10f(bandPower[b] + 1e-10f);
+    cur.levelDb = 10.0f * log10f(total + 1e-10f);
+
+    // Onset: above a multiple of the recent mean and still rising
+    float mean = 0.0f;
+    for (int i = 1; i <= FLUX_MEAN_BLOCKS; i++) mean += history[(head - i + HISTORY) % HISTORY];
+    mean /= FLUX_MEAN_BLOCKS;
+    float threshold = ONSET_MULT * mean > ONSET_FLOOR ? ONSET_MULT * mean : ONSET_FLOOR;
+    float previous = history[(head - 1 + HISTORY) % HISTORY];
+    bool onset = flux > threshold && flux > previous && sinceOnset >= onsetGap;
+    sinceOnset = onset ? 0 : sinceOnset + 1;
+    if (onset) {
+        cur.onsets++;
+        cur.onsetStrength = flux / threshold;
+    }
+    cur.flux = flux;
+    history[head] = flux;
+    head = (head + 1) % HISTORY;
+
+    cur.block++;
+    if (cur.block % TEMPO_EVERY == 0 && cur.block >= static_cast<uint32_t>(HISTORY / 2)) estimateTempo();
+    track(onset);
+
+    uint64_t ns = Trace::nowNs() - t0;
+    if (ns > peakNs) peakNs = ns;
+    cur.avgUs += (ns / 1000.0f - cur.avgUs) * COST_SMOOTH;
+    cur.peakUs = peakNs / 1000.0f;
+
+    slots[back] = cur;
+    back = middle.exchange(back | FRESH) & 3;
+}
+
+// Autocorrelation of the mean-removed flux history over the BPM range
+void SpectralAnalyzer::estimateTempo() {
+    float mean = 0.0f;
+    for (int i = 0; i < HISTORY; i++) mean += history[i];
+    mean /= HISTORY;
+    // A [1 2 1] smoothing spreads one-block onsets so a period that falls
+    // between two lags still gives one clear peak
+    float prev = history[head] - mean;
+    float energy = 0.0f;
+    for (int i = 0; i < HISTORY; i++) {
+        float x = history[(head + i) % HISTORY] - mean;
+        float next = i + 1 < HISTORY ? history[(head + i + 1) % HISTORY] - mean : x;
+        centred[i] = 0.25f * prev + 0.5f * x + 0.25f * next;
+        prev = x;
+        energy += centred[i] * centred[i];
+    }
+    energy /= HISTORY;
+    if (energy <= 1e-12f) {
+        period = 0.0f;
+        cur.bpm = 0.0f;
+        cur.tempoConfidence = 0.0f;
+        return;
+    }
+
+    int lo = minLag > 1 ? minLag - 1 : 1;
+    for (int lag = lo; lag <= maxLag + 1; lag++) {
+        float sum = 0.0f;
+        for (int i = lag; i < HISTORY; i++) sum += centred[i] * centred[i - lag];
+        acf[lag] = sum / (HISTORY - lag);
+    }
+
+    float priorLag = 60.0f * blocksPerSec / TEMPO_PRIOR;
+    int best = -1;
+    float bestScore = 0.0f;
+    for (int lag = minLag; lag <= maxLag; lag++) {
+        float octaves = log2f(lag / priorLag) / PRIOR_OCTAVES;
+        float score = acf[lag] * expf(-0.5f * octaves * octaves);
+        if (acf[lag] > acf[lag - 1] && acf[lag] >= acf[lag + 1] && score > bestScore) {
+            bestScore = score;
+            best = lag;
+        }
+    }
+    if (best < 0) {
+        period = 0.0f;
+        cur.bpm = 0.0f;
+        cur.tempoConfidence = 0.0f;
+        return;
+    }
+
+    // Parabolic peak for a fractional lag
+    float l = acf[best - 1], c = acf[best], r = acf[best + 1];
+    float denom = l - 2.0f * c + r;
+    float offset = denom < 0.0f ? 0.5f * (l - r) / denom : 0.0f;
+    period = best + offset;
+    cur.bpm = 60.0f * blocksPerSec / period;
+    float confidence = c / energy;
+    cur.tempoConfidence = confidence > 1.0f ? 1.0f : confidence;
+}
+
+// Beats at the tempo period, kept in phase with the onsets
+void SpectralAnalyzer::track(bool onset) {
+    float t = static_cast<float>(cur.block);
+    if (period <= 0.0f || cur.tempoConfidence < MIN_CONFIDENCE) {
+        nextBeat = 0.0f;
+        return;
+    }
+    if (nextBeat <= 0.0f) {
+        // Start counting on an onset
+        if (onset) {
+            cur.beats++;
+            nextBeat = t + period;
+        }
+        return;
+    }
+    float window = PHASE_WINDOW * period;
+    if (onset && nextBeat - t <= window) {
+        // Slightly early (or on time): the beat is this block
+        cur.beats++;
+        nextBeat = t + period;
+        return;
+    }
+    if (onset && t - (nextBeat - period) <= window) {
+        // Just after the beat already counted: move the phase
+        nextBeat = t + period;
+        return;
+    }
+    while (t >= nextBeat) {
+        cur.beats++;
+        nextBeat += period;
+    }
+}
+
+bool SpectralAnalyzer::latest(SpectralFeatures& out) {
+    if (middle.load() & FRESH) front = middle.exchange(front) & 3;
+    out = slots[front];
+    return out.block > 0;
+}
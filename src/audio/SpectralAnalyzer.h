@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Per-block spectral features of the microphone, for music-driven motion.
+// Each capture block gets a Hann window and a real FFT (a half-length
+// complex radix-2 FFT plus a split pass; tables are built up front), then:
+//
+//   band energies   dB in five bands: 40-150-400-1500-4000-12000 Hz
+//   spectral flux   mean rise of log-compressed magnitudes since the
+//                   previous block; an onset is flux above an adaptive
+//                   threshold (a multiple of its recent mean)
+//   tempo           autocorrelation of the flux history over 60-180 BPM,
+//                   weighted toward 120 to avoid octave errors
+//   beats           a phase-locked counter at the estimated period that
+//                   snaps to onsets landing near a predicted beat
+//
+// process() runs on the audio thread and never allocates; latest() gives
+// the newest snapshot to one reader thread through a triple buffer.
+
+static constexpr int SPECTRAL_BANDS = 5;
+
+struct SpectralFeatures {
+    uint32_t block;            // capture blocks analysed so far
+    float bandDb[SPECTRAL_BANDS];
+    float levelDb;             // whole-spectrum energy
+    float flux;
+    float onsetStrength;       // flux / threshold for the latest onset
+    uint32_t onsets;           // counts; a change means a new event
+    uint32_t beats;
+    float bpm;                 // 0 until a tempo is found
+    float tempoConfidence;     // 0-1, autocorrelation peak over energy
+    float avgUs;               // analysis cost per block, smoothed
+    float peakUs;
+    float deadlineUs;          // one block period
+};
+
+class SpectralAnalyzer {
+public:
+    SpectralAnalyzer(unsigned int rate, int frames);
+
+    // Audio thread: one capture block of `frames` samples
+    void process(const short* block);
+    // One reader thread; false until the first block
+    bool latest(SpectralFeatures& out);
+
+    static constexpr float ONSET_MULT       = 1.8f;   // threshold over the recent mean flux
+    static constexpr float ONSET_FLOOR      = 0.05f;  // minimum flux per bin; silence never triggers
+    static constexpr int   ONSET_GAP_MS     = 100;
+    static constexpr float MIN_BPM          = 60.0f;
+    static constexpr float MAX_BPM          = 180.0f;
+    static constexpr float MIN_CONFIDENCE   = 0.3f;   // below this no beats are emitted
+    static constexpr int   TEMPO_EVERY      = 8;      // blocks between tempo estimates
+
+private:
+    int n;          // FFT length (the block)
+    int half;
+    float blocksPerSec;
+    float deadlineUs;
+
+    std::vector<float> window;
+    std::vector<int> bitrev;         // half-length bit reversal
+    std::vector<float> twRe, twIm;   // half-length FFT twiddles
+    std::vector<float> spRe, spIm;   // split pass twiddles
+    std::vector<float> re, im;       // FFT work
+    std::vector<float> prevLogMag;   // log(1 + C|X|) of the previous block
+    int bandBin[SPECTRAL_BANDS + 1];
+
+    static constexpr int FLUX_MEAN_BLOCKS = 16;
+    static constexpr int HISTORY = 256;   // about 5.5 s of flux for the tempo
+    std::vector<float> history;
+    std::vector<float> centred;
+    std::vector<float> acf;          // autocorrelation by lag
+    int head;
+
+    int onsetGap;
+    int sinceOnset;
+    int minLag, maxLag;
+    float period;       // blocks per beat, 0 while unknown
+    float nextBeat;     // block index of the next predicted beat
+
+    SpectralFeatures cur;
+    uint64_t peakNs;
+
+    // Triple buffer: the writer fills slots[back] and swaps it into middle;
+    // the reader swaps middle into front when it is marked fresh
+    static constexpr int FRESH = 4;
+    SpectralFeatures slots[3];
+    int back;
+    std::atomic<int> middle;
+    int front;
+
+    void fft();
+    void estimateTempo();
+    void track(bool onset);
+};
@@ -0,0 +1,90 @@
+#include "SpeechClipFile.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAGIC[4] = { 'T', 'S', 'C', '1' };
+
+static uint32_t align16(uint32_t n) { return (n + 15) & ~15u; }
+
+SpeechClipFile::SpeechClipFile() : map(nullptr), mapSize(0), header(nullptr) {}
+
+SpeechClipFile::~SpeechClipFile() { close(); }
+
+bool SpeechClipFile::write(const char* path, const short* pcm, size_t frames, unsigned int rate,
+                           const uint8_t* track, size_t hops, size_t hopFrames) {
+    SpeechClipHeader h;
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.rate        = rate;
+    h.frames      = static_cast<uint32_t>(frames);
+    h.hopFrames   = static_cast<uint32_t>(hopFrames);
+    h.hops        = static_cast<uint32_t>(hops);
+    h.pcmOffset   = align16(sizeof(h));
+    h.trackOffset = align16(h.pcmOffset + h.frames * sizeof(short));
+    h.fileSize    = h.trackOffset + h.hops;
+
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+
+    static const char zeros[16] = { 0 };
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+           && fwrite(zeros, 1, h.pcmOffset - sizeof(h), f) == h.pcmOffset - sizeof(h)
+           && fwrite(pcm, sizeof(short), frames, f) == frames
+           && fwrite(zeros, 1, h.trackOffset - h.pcmOffset - h.frames * sizeof(short), f)
+                  == h.trackOffset - h.pcmOffset - h.frames * sizeof(short)
+           && fwrite(track, 1, hops, f) == hops;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SpeechClipFile::open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SpeechClipHeader))) {
+        ::close(fd);
+        return false;
+    }
+    mapSize = st.st_size;
+    map = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) { map = nullptr; mapSize = 0; return false; }
+
+    const SpeechClipHeader* h = static_cast<const SpeechClipHeader*>(map);
+    bool valid = memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0
+              && h->fileSize == mapSize
+              && h->pcmOffset % 2 == 0
+              && static_cast<uint64_t>(h->pcmOffset) + h->frames * 2ULL <= mapSize
+              && static_cast<uint64_t>(h->trackOffset) + h->hops <= mapSize;
+    if (!valid) { close(); return false; }
+    header = h;
+    return true;
+}
+
+void SpeechClipFile::close() {
+    if (map) munmap(map, mapSize);
+    map = nullptr;
+    mapSize = 0;
+    header = nullptr;
+}
+
+const short* SpeechClipFile::pcm() const {
+    if (!header) return nullptr;
+    return reinterpret_cast<const short*>(static_cast<const char*>(map) + header->pcmOffset);
+}
+
+const uint8_t* SpeechClipFile::track() const {
+    if (!header) return nullptr;
+    return static_cast<const uint8_t*>(map) + header->trackOffset;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// On-disk speech cache entry (.tsc): mono int16 PCM at the engine rate plus
+// its mouth track (one openness byte per hop). Sections are aligned so
+// a mapped file can be read in place. taro_ai.py owns naming, LRU eviction
+// and pre-warming; this is only the format.
+//
+//   offset 0   header (below), little-endian
+//   pcmOffset  frames x int16
+//   trackOffset hops x uint8
+struct SpeechClipHeader {
+    char     magic[4];       // "TSC1"
+    uint32_t rate;
+    uint32_t frames;
+    uint32_t hopFrames;
+    uint32_t hops;
+    uint32_t pcmOffset;
+    uint32_t trackOffset;
+    uint32_t fileSize;
+};
+
+class SpeechClipFile {
+public:
+    SpeechClipFile();
+    ~SpeechClipFile();
+    SpeechClipFile(const SpeechClipFile&) = delete;
+    SpeechClipFile& operator=(const SpeechClipFile&) = delete;
+
+    // Write via a temp file and rename, so readers never see a partial entry
+    static bool write(const char* path, const short* pcm, size_t frames, unsigned int rate,
+                      const uint8_t* track, size_t hops, size_t hopFrames);
+
+    // Map and validate; false for anything truncated or foreign
+    bool open(const char* path);
+    void close();
+
+    const short*   pcm() const;
+    const uint8_t* track() const;
+    size_t frames() const    { return header ? header->frames : 0; }
+    size_t hops() const      { return header ? header->hops : 0; }
+    size_t hopFrames() const { return header ? header->hopFrames : 0; }
+    unsigned int rate() const { return header ? header->rate : 0; }
+
+private:
+    void* map;
+    size_t mapSize;
+    const SpeechClipHeader* header;
+};
@@ -0,0 +1,476 @@
+#include "../control/JoystickInput.h"
+#include "../trace/Realtime.h"
+#include "../trace/Trace.h"
+#include "../actuation/Joints.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+
+// epoll tags for the two non-device descriptors; devices use their slot
+static constexpr uint32_t TAG_WAKE    = 0xffff;
+static constexpr uint32_t TAG_INOTIFY = 0xfffe;
+static constexpr int      READ_EVENTS = 64;
+
+struct CodeName {
+    const char* name;
+    uint16_t code;
+};
+
+static const CodeName CODES[] = {
+    { "ABS_X", ABS_X }, { "ABS_Y", ABS_Y }, { "ABS_Z", ABS_Z },
+    { "ABS_RX", ABS_RX }, { "ABS_RY", ABS_RY }, { "ABS_RZ", ABS_RZ },
+    { "ABS_THROTTLE", ABS_THROTTLE }, { "ABS_RUDDER", ABS_RUDDER },
+    { "ABS_GAS", ABS_GAS }, { "ABS_BRAKE", ABS_BRAKE },
+    { "ABS_HAT0X", ABS_HAT0X }, { "ABS_HAT0Y", ABS_HAT0Y },
+    { "BTN_SOUTH", BTN_SOUTH }, { "BTN_EAST", BTN_EAST }, { "BTN_NORTH", BTN_NORTH },
+    { "BTN_WEST", BTN_WEST }, { "BTN_TL", BTN_TL }, { "BTN_TR", BTN_TR },
+    { "BTN_SELECT", BTN_SELECT }, { "BTN_START", BTN_START }, { "BTN_MODE", BTN_MODE },
+    { "BTN_THUMBL", BTN_THUMBL }, { "BTN_THUMBR", BTN_THUMBR },
+    { "BTN_TRIGGER", BTN_TRIGGER }, { "BTN_THUMB", BTN_THUMB }, { "BTN_THUMB2", BTN_THUMB2 },
+    { "BTN_TOP", BTN_TOP }, { "BTN_TOP2", BTN_TOP2 }, { "BTN_BASE", BTN_BASE },
+};
+
+static bool parseCode(const std::string& s, uint16_t& code) {
+    for (size_t i = 0; i < sizeof(CODES) / sizeof(CODES[0]); i++)
+        if (s == CODES[i].name) { code = CODES[i].code; return true; }
+    char* end;
+    long v = strtol(s.c_str(), &end, 0);
+    if (*end || v < 0 || v > KEY_MAX) return false;
+    code = static_cast<uint16_t>(v);
+    return true;
+}
+
+static bool parseRange(const std::string& s, long& lo, long& hi) {
+    char* end;
+    lo = strtol(s.c_str(), &end, 10);
+    if (*end != '-' || end == s.c_str()) return false;
+    const char* rest = end + 1;
+    hi = strtol(rest, &end, 10);
+    return *end == '\0' && end != rest && lo < hi;
+}
+
+static JoystickAxisMap axisMap(uint16_t code, RemoteJoint joint, bool trigger) {
+    JoystickAxisMap m;
+    m.code = code;
+    m.joint = joint;
+    m.deadzone = trigger ? 0.05f : 0.08f;
+    m.expo = trigger ? 0.0f : 0.3f;
+    m.invert = false;
+    m.trigger = trigger;
+    m.minUs = joint == JOINT_MOUTH ? MouthJoint::MIN_US : NeckJoint::MIN_US;
+    m.maxUs = joint == JOINT_MOUTH ? MouthJoint::MAX_US : NeckJoint::MAX_US;
+    m.rawMin = m.rawMax = 0;
+    return m;
+}
+
+static bool testBit(const unsigned long* bits, int bit) {
+    const int per = 8 * sizeof(unsigned long);
+    return (bits[bit / per] >> (bit % per)) & 1;
+}
+
+// Left stick across for the neck and the right trigger for the jaw; buttons
+// flap, recenter and listen as E, R and I do
+JoystickInput::JoystickInput()
+    : axisCount(0), buttonCount(0), epollFd(-1), inotifyFd(-1), wakeFd(-1), running(false),
+      events(0), resyncs(0), keyHead(0), keyCount(0) {
+    for (int j = 0; j < JOINT_COUNT; j++) setpoints[j] = -1;
+    for (int i = 0; i < MAX_DEVICES; i++) devices[i].fd = -1;
+    axes[axisCount++] = axisMap(ABS_X, JOINT_NECK, false);
+    axes[axisCount++] = axisMap(ABS_RZ, JOINT_MOUTH, true);
+    const JoystickButtonMap defaults[] = {
+        { BTN_SOUTH, 'e' }, { BTN_EAST, 'r' }, { BTN_NORTH, 'i' },
+        { BTN_TRIGGER, 'e' }, { BTN_THUMB, 'r' },
+    };
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) buttons[buttonCount++] = defaults[i];
+}
+
+JoystickInput::~JoystickInput() {
+    stop();
+    for (int i = 0; i < MAX_DEVICES; i++) if (devices[i].fd >= 0) close(devices[i].fd);
+}
+
+bool JoystickInput::configure(const char* path) {
+    std::ifstream f(path);
+    if (!f) return false;
+    axisCount = buttonCount = 0;
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(f, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+
+        std::istringstream tokens(line);
+        std::string kind, codeName, target;
+        if (!(tokens >> kind)) continue;
+        uint16_t code;
+        if (!(tokens >> codeName >> target) || !parseCode(codeName, code)) {
+            std::cerr << "joystick config line " << lineNo << ": expected <axis|button> <code> <target>" << std::endl;
+            continue;
+        }
+        if (kind == "button") {
+            if (target.size() != 1 || buttonCount == MAX_BUTTONS) {
+                std::cerr << "joystick config line " << lineNo << ": a button maps to one key" << std::endl;
+                continue;
+            }
+            JoystickButtonMap b = { code, target[0] };
+            buttons[buttonCount++] = b;
+            continue;
+        }
+        if (kind != "axis" || (target != "neck" && target != "mouth") || axisCount == MAX_AXES) {
+            std::cerr << "joystick config line " << lineNo << ": axes map to neck or mouth" << std::endl;
+            continue;
+        }
+        std::vector<std::string> opts;
+        std::string opt;
+        bool trigger = false;
+        while (tokens >> opt) {
+            if (opt == "trigger") trigger = true;
+            opts.push_back(opt);
+        }
+        JoystickAxisMap m = axisMap(code, target == "mouth" ? JOINT_MOUTH : JOINT_NECK, trigger);
+        for (size_t i = 0; i < opts.size(); i++) {
+            const std::string& o = opts[i];
+            size_t eq = o.find('=');
+            std::string key = o.substr(0, eq), value = eq == std::string::npos ? "" : o.substr(eq + 1);
+            long lo, hi;
+            if      (key == "invert")   m.invert = true;
+            else if (key == "trigger")  continue;
+            else if (key == "deadzone") m.deadzone = static_cast<float>(atof(value.c_str()));
+            else if (key == "expo")     m.expo = static_cast<float>(atof(value.c_str()));
+            else if (key == "range" && parseRange(value, lo, hi)) {
+                m.minUs = m.joint == JOINT_MOUTH ? MouthJoint::clamp(lo) : NeckJoint::clamp(lo);
+                m.maxUs = m.joint == JOINT_MOUTH ? MouthJoint::clamp(hi) : NeckJoint::clamp(hi);
+            }
+            else if (key == "raw" && parseRange(value, lo, hi)) {
+                m.rawMin = static_cast<int32_t>(lo);
+                m.rawMax = static_cast<int32_t>(hi);
+            }
+            else std::cerr << "joystick config line " << lineNo << ": bad option " << o << std::endl;
+        }
+        if (m.deadzone < 0.0f || m.deadzone >= 1.0f) m.deadzone = 0.0f;
+        if (m.expo < 0.0f) m.expo = 0.0f;
+        if (m.expo > 1.0f) m.expo = 1.0f;
+        axes[axisCount++] = m;
+    }
+    return true;
+}
+
+float JoystickInput::shape(float u, float deadzone, float expo) {
+    float a = fabsf(u);
+    if (a <= deadzone) return 0.0f;
+    float v = (a - deadzone) / (1.0f - deadzone);
+    if (v > 1.0f) v = 1.0f;
+    v = (1.0f - expo) * v + expo * v * v * v;
+    return u < 0.0f ? -v : v;
+}
+
+uint16_t JoystickInput::toPulse(const JoystickAxisMap& m, int32_t raw, int32_t rawMin, int32_t rawMax) {
+    double lo = m.rawMin < m.rawMax ? m.rawMin : rawMin;
+    double hi = m.rawMin < m.rawMax ? m.rawMax : rawMax;
+    if (hi <= lo) return RELEASED;
+    double pulse;
+    if (m.trigger) {
+        float u = static_cast<float>((raw - lo) / (hi - lo));
+        u = u < 0.0f ? 0.0f : u > 1.0f ? 1.0f : u;
+        float s = shape(m.invert ? 1.0f - u : u, m.deadzone, m.expo);
+        if (s <= 0.0f) return RELEASED;
+        pulse = m.minUs + s * (m.maxUs - m.minUs);
+    } else {
+        float u = static_cast<float>((raw - (lo + hi) / 2.0) / ((hi - lo) / 2.0));
+        u = u < -1.0f ? -1.0f : u > 1.0f ? 1.0f : u;
+        float s = shape(m.invert ? -u : u, m.deadzone, m.expo);
+        if (s == 0.0f) return RELEASED;
+        pulse = (m.minUs + m.maxUs) / 2.0 + s * (m.maxUs - m.minUs) / 2.0;
+    }
+    return static_cast<uint16_t>(pulse + 0.5);
+}
+
+bool JoystickInput::addDevice(int fd, const char* name) {
+    if (running) return false;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return adopt(fd, "", name, false);
+}
+
+bool JoystickInput::start(const char* watchDir) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        if (epollFd >= 0) close(epollFd);
+        if (wakeFd >= 0) close(wakeFd);
+        epollFd = wakeFd = -1;
+        return false;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = TAG_WAKE;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].fd < 0) continue;
+        ev.data.u32 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, devices[i].fd, &ev);
+    }
+
+    // Devices appear as event* nodes; udev fixes their permissions just
+    // after, so a node that couldn't be opened is retried on IN_ATTRIB
+    if (watchDir) {
+        dir = watchDir;
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd >= 0 && inotify_add_watch(inotifyFd, watchDir, IN_CREATE | IN_ATTRIB) >= 0) {
+            ev.data.u32 = TAG_INOTIFY;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, inotifyFd, &ev);
+        }
+        scan();
+    }
+    running = true;
+    thread = std::thread(&JoystickInput::loop, this);
+    return true;
+}
+
+void JoystickInput::stop() {
+    if (!running) return;
+    running = false;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {}
+    thread.join();
+    for (int i = 0; i < MAX_DEVICES; i++) if (devices[i].fd >= 0) removeDevice(devices[i]);
+    if (inotifyFd >= 0) close(inotifyFd);
+    close(wakeFd);
+    close(epollFd);
+    inotifyFd = wakeFd = epollFd = -1;
+}
+
+bool JoystickInput::takeSetpoint(RemoteJoint joint, uint16_t& value) {
+    int32_t v = setpoints[joint].exchange(-1);
+    if (v < 0) return false;
+    value = static_cast<uint16_t>(v);
+    return true;
+}
+
+bool JoystickInput::takeKey(char& key) {
+    std::lock_guard<std::mutex> g(lock);
+    if (keyCount == 0) return false;
+    key = keys[keyHead];
+    keyHead = (keyHead + 1) % MAX_KEYS;
+    keyCount--;
+    return true;
+}
+
+void JoystickInput::getReport(JoystickReport& out) {
+    std::lock_guard<std::mutex> g(lock);
+    out.devices = 0;
+    out.name[0] = '\0';
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].fd < 0) continue;
+        if (!out.devices++) memcpy(out.name, devices[i].name, sizeof(out.name));
+    }
+    out.events = events.load();
+    out.resyncs = resyncs.load();
+}
+
+void JoystickInput::pushKey(char key) {
+    std::lock_guard<std::mutex> g(lock);
+    if (keyCount < MAX_KEYS) keys[(keyHead + keyCount++) % MAX_KEYS] = key;
+}
+
+void JoystickInput::scan() {
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    while (struct dirent* e = readdir(d)) {
+        if (strncmp(e->d_name, "event", 5) != 0) continue;
+        std::string path = dir + "/" + e->d_name;
+        openDevice(path.c_str());
+    }
+    closedir(d);
+}
+
+bool JoystickInput::openDevice(const char* path) {
+    for (int i = 0; i < MAX_DEVICES; i++)
+        if (devices[i].fd >= 0 && !strcmp(devices[i].path, path)) return false;
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return false;
+    char name[32] = "";
+    ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+    if (!adopt(fd, path, name, true)) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+// Query the device (unless it is a test pipe) and keep it if anything it
+// has is mapped
+bool JoystickInput::adopt(int fd, const char* path, const char* name, bool query) {
+    int slot = -1;
+    for (int i = 0; i < MAX_DEVICES && slot < 0; i++) if (devices[i].fd < 0) slot = i;
+    if (slot < 0) return false;
+    Device d;
+    memset(&d, 0, sizeof(d));
+    d.fd = fd;
+    snprintf(d.path, sizeof(d.path), "%s", path);
+    snprintf(d.name, sizeof(d.name), "%s", name);
+
+    unsigned long absBits[ABS_CNT / (8 * sizeof(unsigned long)) + 1] = { 0 };
+    unsigned long keyBits[KEY_CNT / (8 * sizeof(unsigned long)) + 1] = { 0 };
+    bool wanted = !query;
+    if (query) {
+        ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits);
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keyBits)), keyBits);
+        for (int b = 0; b < buttonCount; b++) if (testBit(keyBits, buttons[b].code)) wanted = true;
+        // Event times on the clock everything else uses
+        int clock = CLOCK_MONOTONIC;
+        ioctl(fd, EVIOCSCLOCKID, &clock);
+    }
+    for (int a = 0; a < axisCount; a++) {
+        d.sent[a] = RELEASED;
+        if (query && !testBit(absBits, axes[a].code)) continue;
+        struct input_absinfo info;
+        if (query && ioctl(fd, EVIOCGABS(axes[a].code), &info) == 0) {
+            d.rawMin[a] = info.minimum;
+            d.rawMax[a] = info.maximum;
+            d.raw[a] = info.value;
+        } else {
+            d.rawMin[a] = axes[a].rawMin;
+            d.rawMax[a] = axes[a].rawMax;
+            d.raw[a] = (axes[a].rawMin + axes[a].rawMax) / 2;
+        }
+        d.present[a] = true;
+        wanted = true;
+    }
+    if (!wanted) return false;
+
+    {
+        std::lock_guard<std::mutex> g(lock);
+        devices[slot] = d;
+    }
+    if (epollFd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = slot;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    fprintf(stderr, "joystick: %s (%s)\n", d.name, *path ? path : "added");
+    return true;
+}
+
+// Unplugged: let go of whatever its axes were holding
+void JoystickInput::removeDevice(Device& d) {
+    for (int a = 0; a < axisCount; a++)
+        if (d.present[a] && d.sent[a] != RELEASED) setpoints[axes[a].joint] = RELEASED;
+    std::lock_guard<std::mutex> g(lock);
+    close(d.fd);
+    d.fd = -1;
+}
+
+// After SYN_DROPPED the kernel's view is the truth: read every axis again
+void JoystickInput::resync(Device& d) {
+    for (int a = 0; a < axisCount; a++) {
+        struct input_absinfo info;
+        if (!d.present[a] || ioctl(d.fd, EVIOCGABS(axes[a].code), &info) != 0) continue;
+        d.raw[a] = info.value;
+        d.changed[a] = true;
+    }
+    resyncs++;
+}
+
+void JoystickInput::publish(Device& d) {
+    for (int a = 0; a < axisCount; a++) {
+        if (!d.changed[a]) continue;
+        d.changed[a] = false;
+        uint16_t pulse = toPulse(axes[a], d.raw[a], d.rawMin[a], d.rawMax[a]);
+        if (pulse == d.sent[a]) continue;
+        d.sent[a] = pulse;
+        setpoints[axes[a].joint] = pulse;
+    }
+}
+
+void JoystickInput::readDevice(Device& d) {
+    struct input_event ev[READ_EVENTS];
+    while (true) {
+        ssize_t n = read(d.fd, ev, sizeof(ev));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) {
+            removeDevice(d);
+            return;
+        }
+        int count = static_cast<int>(n / sizeof(ev[0]));
+        events += count;
+        for (int i = 0; i < count; i++) {
+            const struct input_event& e = ev[i];
+            if (e.type == EV_SYN && e.code == SYN_DROPPED) {
+                // The frame so far is incomplete too; resync() rereads it
+                d.dropped = true;
+                for (int a = 0; a < axisCount; a++) d.changed[a] = false;
+            } else if (e.type == EV_SYN && e.code == SYN_REPORT) {
+                if (d.dropped) {
+                    d.dropped = false;
+                    resync(d);
+                }
+                publish(d);
+            } else if (d.dropped) {
+                continue;
+            } else if (e.type == EV_ABS) {
+                for (int a = 0; a < axisCount; a++) {
+                    if (!d.present[a] || axes[a].code != e.code) continue;
+                    d.raw[a] = e.value;
+                    d.changed[a] = true;
+                }
+            } else if (e.type == EV_KEY && e.value == 1) {
+                // Presses only; releases and autorepeat do nothing
+                for (int b = 0; b < buttonCount; b++)
+                    if (buttons[b].code == e.code) pushKey(buttons[b].key);
+            }
+        }
+    }
+}
+
+void JoystickInput::loop() {
+    Trace::setThreadName("input");
+    Realtime::enter(ROLE_INPUT);
+    struct epoll_event ready[MAX_DEVICES + 2];
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (running) {
+        int n = epoll_wait(epollFd, ready, MAX_DEVICES + 2, -1);
+        for (int k = 0; k < n; k++) {
+            uint32_t tag = ready[k].data.u32;
+            if (tag == TAG_WAKE) continue;
+            if (tag == TAG_INOTIFY) {
+                ssize_t len;
+                while ((len = read(inotifyFd, buf, sizeof(buf))) > 0) {
+                    for (char* p = buf; p < buf + len; ) {
+                        const struct inotify_event* e = reinterpret_cast<const struct inotify_event*>(p);
+                        if (e->len && !strncmp(e->name, "event", 5)) {
+                            std::string path = dir + "/" + e->name;
+                            openDevice(path.c_str());
+                        }
+                        p += sizeof(struct inotify_event) + e->len;
+                    }
+                }
+                continue;
+            }
+            Device& d = devices[tag];
+            if (d.fd < 0) continue;
+            if (ready[k].events & EPOLLIN) readDevice(d);
+            else if (ready[k].events & (EPOLLERR | EPOLLHUP)) removeDevice(d);
+        }
+    }
+}
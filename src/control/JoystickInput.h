@@ -0,0 +1,126 @@
+#pragma once
+#include "RemoteProtocol.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Gamepads and joysticks through Linux evdev (/dev/input/event*), for live
+// puppeteering. One thread waits in epoll on every open device and on an
+// inotify watch of the directory, so controllers can be plugged in and out
+// while running. Absolute axes become joint pulses through a deadzone and
+// an expo curve, one slot per joint with the newest value winning, as with
+// RemoteServer; buttons become keys, so a button does whatever its key does
+// in the terminal. An axis back inside its deadzone, or an unplugged
+// controller, hands out RELEASED so the loop lets go of the joint.
+//
+// The mapping is read from src/control/joystick.conf, one line each:
+//   axis   <code> neck|mouth [deadzone=0.08] [expo=0.3] [invert] [trigger]
+//                            [range=<min us>-<max us>] [raw=<min>-<max>]
+//   button <code> <key>
+// Codes are names from linux/input-event-codes.h (ABS_X, BTN_SOUTH) or
+// numbers. A trigger axis rests at one end instead of the centre.
+
+struct JoystickAxisMap {
+    uint16_t code;
+    RemoteJoint joint;
+    float deadzone;       // of the half range, or the whole range for a trigger
+    float expo;           // 0 linear, 1 cubic
+    bool invert;
+    bool trigger;
+    uint16_t minUs;
+    uint16_t maxUs;
+    int32_t rawMin;       // overrides the device's range if rawMin < rawMax
+    int32_t rawMax;
+};
+
+struct JoystickButtonMap {
+    uint16_t code;
+    char key;
+};
+
+struct JoystickReport {
+    int devices;
+    char name[32];        // the first device's
+    uint32_t events;
+    uint32_t resyncs;     // SYN_DROPPED recoveries
+};
+
+class JoystickInput {
+public:
+    JoystickInput();
+    ~JoystickInput();
+
+    // Replace the built-in mapping with the file's; false if it can't be read
+    bool configure(const char* path);
+    // Adopt a device that is already open, before start(): tests feed a
+    // pipe of input_events, with raw= ranges since it has no axis info
+    bool addDevice(int fd, const char* name);
+    // Watch dir (nullptr: only added devices) for devices with a mapped
+    // axis or button
+    bool start(const char* dir);
+    void stop();
+
+    // Main loop side
+    bool takeSetpoint(RemoteJoint joint, uint16_t& value);
+    bool takeKey(char& key);
+    void getReport(JoystickReport& out);
+
+    // An axis position in -1..1 after the deadzone and expo curve
+    static float shape(float u, float deadzone, float expo);
+    // The pulse for a raw value, or RELEASED inside the deadzone
+    static uint16_t toPulse(const JoystickAxisMap& m, int32_t raw, int32_t rawMin, int32_t rawMax);
+
+    static constexpr uint16_t RELEASED    = 0;
+    static constexpr int      MAX_DEVICES = 4;
+    static constexpr int      MAX_AXES    = 8;
+    static constexpr int      MAX_BUTTONS = 16;
+    static constexpr int      MAX_KEYS    = 32;
+
+private:
+    struct Device {
+        int fd;
+        char path[64];
+        char name[32];
+        bool dropped;                  // events lost; ignore until the next report
+        int32_t rawMin[MAX_AXES];
+        int32_t rawMax[MAX_AXES];
+        int32_t raw[MAX_AXES];
+        bool present[MAX_AXES];
+        bool changed[MAX_AXES];
+        uint16_t sent[MAX_AXES];       // last pulse handed out
+    };
+
+    JoystickAxisMap axes[MAX_AXES];
+    int axisCount;
+    JoystickButtonMap buttons[MAX_BUTTONS];
+    int buttonCount;
+
+    std::string dir;
+    int epollFd;
+    int inotifyFd;
+    int wakeFd;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> events;
+    std::atomic<uint32_t> resyncs;
+
+    // -1 = nothing pending, else the newest pulse (or RELEASED)
+    std::atomic<int32_t> setpoints[JOINT_COUNT];
+
+    std::mutex lock;                   // keys and the device list for reports
+    char keys[MAX_KEYS];
+    int keyHead;
+    int keyCount;
+    Device devices[MAX_DEVICES];
+
+    void loop();
+    bool openDevice(const char* path);
+    bool adopt(int fd, const char* path, const char* name, bool query);
+    void readDevice(Device& d);
+    void resync(Device& d);
+    void publish(Device& d);
+    void removeDevice(Device& d);
+    void scan();
+    void pushKey(char key);
+};
@@ -0,0 +1,42 @@
+#include "MusicController.h"
+#include "../trace/SessionLog.h"
+
+MusicController::MusicController(Neck& neck, Wings& wings)
+    : neck(neck), wings(wings), active(false), primed(false), beats(0), onsets(0), side(1),
+      lastBeatMs(0) {}
+
+void MusicController::setActive(bool a) {
+    if (active && !a) neck.release(LAYER_RANDOM);
+    active = a;
+    primed = false;
+}
+
+bool MusicController::isActive() const { return active; }
+
+void MusicController::update(const SpectralFeatures& f) {
+    if (!active) return;
+    long long now = Session::nowMs();
+    if (!primed) {
+        // Only events after switching on count
+        beats = f.beats;
+        onsets = f.onsets;
+        lastBeatMs = now;
+        primed = true;
+        return;
+    }
+
+    if (f.beats != beats) {
+        beats = f.beats;
+        side = -side;
+        neck.setTarget(NeckJoint::REST_US + side * NOD_US, LAYER_RANDOM);
+        lastBeatMs = now;
+    } else if (lastBeatMs >= 0 && now - lastBeatMs > QUIET_MS) {
+        neck.setTarget(NeckJoint::REST_US, LAYER_RANDOM);
+        lastBeatMs = -1;
+    }
+
+    if (f.onsets != onsets) {
+        onsets = f.onsets;
+        if (f.onsetStrength >= FLAP_STRENGTH) wings.flapWings(LAYER_RANDOM);
+    }
+}
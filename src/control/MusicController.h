@@ -0,0 +1,33 @@
+#pragma once
+#include "../actuation/Neck.h"
+#include "../actuation/Wings.h"
+#include "../audio/SpectralAnalyzer.h"
+#include <cstdint>
+
+// Dances to what the microphone hears: the neck sways to the other side on
+// every beat the spectral stage tracks, and a strong onset flaps the wings
+// (Wings' own cooldown limits how often). With no beat for a while the
+// neck returns to rest. It moves on the random layer, which fades out when
+// music mode is switched off.
+class MusicController {
+public:
+    MusicController(Neck& neck, Wings& wings);
+
+    void setActive(bool active);
+    bool isActive() const;
+    void update(const SpectralFeatures& features);   // once per main loop tick
+
+    static constexpr int   NOD_US         = 150;    // sway either side of rest
+    static constexpr float FLAP_STRENGTH  = 2.5f;   // onset flux over threshold
+    static constexpr int   QUIET_MS       = 2000;   // no beats: back to rest
+
+private:
+    Neck& neck;
+    Wings& wings;
+    bool active;
+    bool primed;        // counters below are valid
+    uint32_t beats;
+    uint32_t onsets;
+    int side;
+    long long lastBeatMs;
+};
@@ -1,53 +1,47 @@
 #include "RandomController.h"
-#include <cstdlib>
-#include <ctime>
-#include <sys/time.h>
+#include "../trace/SessionLog.h"
 #include <algorithm>
 
-RandomController::RandomController(Neck& neck, Wings& wings)
-    : neck(neck), wings(wings), active(false), activityLevel(5), nextActionTime(0) {
-    std::srand(static_cast<unsigned>(time(nullptr)));
+RandomController::RandomController(Neck& neck, Wings& wings, BehaviorScheduler& behaviors, uint32_t seed)
+    : neck(neck), wings(wings), behaviors(behaviors), wandering(0), activityLevel(5), rng(seed) {
+    Session::seed(seed);
 }
 
+// Switching on while active starts over with an action right away
 void RandomController::setActive(bool a) {
-    active = a;
-    nextActionTime = getCurrentTimeMs();
+    if (isActive() && !a) neck.release(LAYER_RANDOM);
+    behaviors.cancel(wandering);
+    wandering = a ? behaviors.start(wander()) : 0;
 }
 
-bool RandomController::isActive() const { return active; }
+bool RandomController::isActive() const { return behaviors.running(wandering); }
 int RandomController::getActivityLevel() const { return activityLevel; }
 
 void RandomController::increaseActivity() { activityLevel = std::min(activityLevel + 1, 10); }
 void RandomController::decreaseActivity() { activityLevel = std::max(activityLevel - 1, 1);  }
 
-long long RandomController::getCurrentTimeMs() {
-    struct timeval tv;
-    gettimeofday(&tv, nullptr);
-    return (long long)(tv.tv_sec) * 1000 + (long long)(tv.tv_usec) / 1000;
-}
-
-void RandomController::scheduleNext() {
+long long RandomController::nextDelayMs() {
     // Level 1 → ~4000ms, Level 10 → ~300ms
     long long minMs  = 4000 - (activityLevel - 1) * 400;
     long long randMs = 1000 - (activityLevel - 1) * 80;
     if (randMs < 100) randMs = 100;
-    nextActionTime = getCurrentTimeMs() + minMs + (std::rand() % randMs);
+    return minMs + (rng() % randMs);
 }
 
 void RandomController::doRandomAction() {
-    static const double positions[] = { 600.0, 900.0, 1500.0, 2100.0, 2400.0 };
+    static const int positions[] = { 600, 900, 1500, 2100, 2400 };
 
-    int action = std::rand() % 10;
+    int action = rng() % 10;
     if (action < activityLevel / 3) {
-        wings.flapWings();
+        wings.flapWings(LAYER_RANDOM);
     } else {
-        neck.setTarget(positions[std::rand() % 5]);
+        neck.setTarget(positions[rng() % 5], LAYER_RANDOM);
     }
-    scheduleNext();
 }
 
-void RandomController::update() {
-    if (!active) return;
-    if (getCurrentTimeMs() >= nextActionTime)
+Behavior RandomController::wander() {
+    for (;;) {
         doRandomAction();
+        co_await delay(nextDelayMs());
+    }
 }
\ No newline at end of file
@@ -1,16 +1,19 @@
 #pragma once
 #include "../actuation/Neck.h"
 #include "../actuation/Wings.h"
-#include <cstdlib>
-#include <sys/time.h>
+#include <cstdint>
+#include <random>
 
+// Autonomous moves on the random layer, which fades out when switched off.
+// While active, a behavior acts and then waits a random time, scaled by the
+// activity level.
 class RandomController {
 public:
-    RandomController(Neck& neck, Wings& wings);
+    // The seed is written to the session log so a replay repeats the moves
+    RandomController(Neck& neck, Wings& wings, BehaviorScheduler& behaviors, uint32_t seed);
 
     void setActive(bool active);
     bool isActive() const;
-    void update();
 
     void increaseActivity();
     void decreaseActivity();
@@ -19,11 +22,12 @@ public:
 private:
     Neck& neck;
     Wings& wings;
-    bool active;
+    BehaviorScheduler& behaviors;
+    uint32_t wandering;  // behavior id while active
     int activityLevel;  // 1-10
-    long long nextActionTime;
+    std::mt19937 rng;
 
-    long long getCurrentTimeMs();
+    Behavior wander();
     void doRandomAction();
-    void scheduleNext();
+    long long nextDelayMs();
 };
\ No newline at end of file
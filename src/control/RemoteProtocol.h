@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Wire format for the remote control socket (SOCK_SEQPACKET, so every
+// send is exactly one frame). A frame is one type byte and its payload;
+// multi-byte fields are little-endian.
+//
+//   client -> Taro
+//     SETPOINTS  n x { u8 joint, u16 value }   latest value per joint wins
+//     KEY        u8 key                        same as a keypress in the terminal
+//     SUBSCRIBE  u8 rate Hz (0 stops)          STATE at up to that rate
+//   Taro -> client
+//     STATE      u32 seq, u32 time ms, u8 ai state, u8 flags,
+//                u16 neck us, u16 mouth us, u8 activity
+//     TRANSCRIPT utf-8 text, sent to subscribers whenever it changes; grows
+//                with the partial transcript while the user is talking
+
+enum RemoteFrame : uint8_t {
+    REMOTE_SETPOINTS  = 0x01,
+    REMOTE_KEY        = 0x02,
+    REMOTE_SUBSCRIBE  = 0x03,
+    REMOTE_STATE      = 0x81,
+    REMOTE_TRANSCRIPT = 0x82
+};
+
+enum RemoteJoint : uint8_t {
+    JOINT_NECK  = 0,   // pulse us, eased by Neck like the A/D keys
+    JOINT_MOUTH = 1,   // pulse us
+    JOINT_WINGS = 2,   // non-zero flaps (subject to the cooldown)
+    JOINT_COUNT
+};
+
+enum RemoteStateFlags : uint8_t {
+    REMOTE_RANDOM_ACTIVE = 0x01,
+    REMOTE_WINGS_READY   = 0x02,
+    REMOTE_AI_AUTO       = 0x04,
+    REMOTE_SPEAKING      = 0x08,
+    REMOTE_MUSIC_ACTIVE  = 0x10
+};
+
+struct RemoteState {
+    uint32_t seq;
+    uint32_t timeMs;
+    uint8_t aiState;     // AIState
+    uint8_t flags;       // RemoteStateFlags
+    uint16_t neckUs;
+    uint16_t mouthUs;
+    uint8_t activity;
+};
+
+static constexpr size_t REMOTE_STATE_BYTES    = 16;
+static constexpr size_t REMOTE_SETPOINT_BYTES = 3;
+static constexpr size_t REMOTE_MAX_FRAME      = 1024;
+
+inline void remotePut16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+inline void remotePut32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = v >> (8 * i); }
+inline uint16_t remoteGet16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+inline uint32_t remoteGet32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Whole STATE frame, type byte included
+inline void remoteEncodeState(const RemoteState& s, uint8_t* out) {
+    out[0] = REMOTE_STATE;
+    remotePut32(out + 1, s.seq);
+    remotePut32(out + 5, s.timeMs);
+    out[9] = s.aiState;
+    out[10] = s.flags;
+    remotePut16(out + 11, s.neckUs);
+    remotePut16(out + 13, s.mouthUs);
+    out[15] = s.activity;
+}
+
+inline bool remoteDecodeState(const uint8_t* in, size_t len, RemoteState& s) {
+    if (len < REMOTE_STATE_BYTES || in[0] != REMOTE_STATE) return false;
+    s.seq = remoteGet32(in + 1);
+    s.timeMs = remoteGet32(in + 5);
+    s.aiState = in[9];
+    s.flags = in[10];
+    s.neckUs = remoteGet16(in + 11);
+    s.mouthUs = remoteGet16(in + 13);
+    s.activity = in[15];
+    return true;
+}
@@ -0,0 +1,220 @@
+#include "../control/RemoteServer.h"
+#include "../trace/Realtime.h"
+#include "../trace/Trace.h"
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static constexpr int IDLE_POLL_MS = 100;
+
+RemoteServer::RemoteServer()
+    : listenFd(-1), running(false), clients(0), keysDropped(0), statesDropped(0),
+      keyHead(0), keyCount(0), transcriptVersion(0) {
+    transcript[0] = '\0';
+    wakePipe[0] = wakePipe[1] = -1;
+    for (int j = 0; j < JOINT_COUNT; j++) setpoints[j] = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++) slots[i].fd = -1;
+    memset(&state, 0, sizeof(state));
+}
+
+RemoteServer::~RemoteServer() { stop(); }
+
+bool RemoteServer::start(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path);
+
+    listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) return false;
+    unlink(path);   // stale socket from a previous run
+    if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(listenFd, MAX_CLIENTS) < 0 || pipe2(wakePipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    socketPath = path;
+    running = true;
+    thread = std::thread(&RemoteServer::loop, this);
+    return true;
+}
+
+void RemoteServer::stop() {
+    if (!running) return;
+    running = false;
+    char b = 0;
+    if (write(wakePipe[1], &b, 1) < 0) {}
+    thread.join();
+    for (int i = 0; i < MAX_CLIENTS; i++) if (slots[i].fd >= 0) drop(slots[i]);
+    close(listenFd);
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    listenFd = wakePipe[0] = wakePipe[1] = -1;
+    unlink(socketPath.c_str());
+}
+
+bool RemoteServer::takeSetpoint(RemoteJoint joint, uint16_t& value) {
+    int32_t v = setpoints[joint].exchange(-1);
+    if (v < 0) return false;
+    value = static_cast<uint16_t>(v);
+    return true;
+}
+
+bool RemoteServer::takeKey(char& key) {
+    std::lock_guard<std::mutex> g(lock);
+    if (keyCount == 0) return false;
+    key = keys[keyHead];
+    keyHead = (keyHead + 1) % MAX_KEYS;
+    keyCount--;
+    return true;
+}
+
+void RemoteServer::publish(const RemoteState& s, const char* text) {
+    std::lock_guard<std::mutex> g(lock);
+    state = s;
+    if (strncmp(text, transcript, sizeof(transcript) - 1) != 0) {
+        strncpy(transcript, text, sizeof(transcript) - 1);
+        transcript[sizeof(transcript) - 1] = '\0';
+        transcriptVersion++;
+    }
+}
+
+void RemoteServer::drop(Client& c) {
+    close(c.fd);
+    c.fd = -1;
+    clients--;
+}
+
+void RemoteServer::handleFrame(Client& c, const uint8_t* data, size_t len) {
+    if (len == 0) return;
+    const uint8_t* p = data + 1;
+    size_t n = len - 1;
+    switch (data[0]) {
+        case REMOTE_SETPOINTS:
+            for (; n >= REMOTE_SETPOINT_BYTES; p += REMOTE_SETPOINT_BYTES, n -= REMOTE_SETPOINT_BYTES)
+                if (p[0] < JOINT_COUNT) setpoints[p[0]] = remoteGet16(p + 1);
+            break;
+        case REMOTE_KEY:
+            if (n >= 1) {
+                std::lock_guard<std::mutex> g(lock);
+                if (keyCount < MAX_KEYS) keys[(keyHead + keyCount++) % MAX_KEYS] = static_cast<char>(p[0]);
+                else keysDropped++;
+            }
+            break;
+        case REMOTE_SUBSCRIBE:
+            if (n >= 1) {
+                c.rateHz = p[0] > MAX_RATE_HZ ? MAX_RATE_HZ : p[0];
+                c.nextSendNs = 0;
+            }
+            break;
+    }
+}
+
+// Newest snapshot only, and only if the socket has room for it now
+void RemoteServer::sendState(Client& c, uint64_t now) {
+    uint8_t frame[REMOTE_MAX_FRAME];
+    char text[REMOTE_MAX_FRAME];
+    size_t textLen = 0;
+    uint32_t version;
+    {
+        std::lock_guard<std::mutex> g(lock);
+        remoteEncodeState(state, frame);
+        version = transcriptVersion;
+        if (version != c.sentTranscript) {
+            textLen = strlen(transcript);
+            memcpy(text, transcript, textLen);
+        }
+    }
+    uint32_t seq = remoteGet32(frame + 1);
+    if (seq != c.sentSeq) {
+        if (send(c.fd, frame, REMOTE_STATE_BYTES, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            statesDropped++;
+        } else {
+            c.sentSeq = seq;
+        }
+    }
+    if (version != c.sentTranscript) {
+        size_t n = textLen < REMOTE_MAX_FRAME - 1 ? textLen : REMOTE_MAX_FRAME - 1;
+        frame[0] = REMOTE_TRANSCRIPT;
+        memcpy(frame + 1, text, n);
+        if (send(c.fd, frame, n + 1, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0) c.sentTranscript = version;
+    }
+    c.nextSendNs = now + 1000000000ULL / c.rateHz;
+}
+
+void RemoteServer::loop() {
+    Trace::setThreadName("remote");
+    Realtime::enter(ROLE_REMOTE);
+    struct pollfd fds[MAX_CLIENTS + 2];
+    uint8_t frame[REMOTE_MAX_FRAME];
+
+    while (running) {
+        int n = 0;
+        fds[n].fd = wakePipe[0];
+        fds[n++].events = POLLIN;
+        fds[n].fd = listenFd;
+        fds[n++].events = POLLIN;
+        int index[MAX_CLIENTS];
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (slots[i].fd < 0) continue;
+            index[n - 2] = i;
+            fds[n].fd = slots[i].fd;
+            fds[n++].events = POLLIN;
+        }
+
+        // Wake for the soonest subscriber that is due
+        uint64_t now = Trace::nowNs();
+        int timeout = IDLE_POLL_MS;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (slots[i].fd < 0 || !slots[i].rateHz) continue;
+            int ms = slots[i].nextSendNs > now ? static_cast<int>((slots[i].nextSendNs - now) / 1000000) : 0;
+            if (ms < timeout) timeout = ms;
+        }
+        if (poll(fds, n, timeout) < 0) continue;
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            int free = -1;
+            for (int i = 0; i < MAX_CLIENTS && free < 0; i++) if (slots[i].fd < 0) free = i;
+            if (fd >= 0 && free < 0) close(fd);
+            else if (fd >= 0) {
+                Client& c = slots[free];
+                c.fd = fd;
+                c.rateHz = 0;
+                c.nextSendNs = 0;
+                c.sentSeq = 0;
+                c.sentTranscript = 0;
+                clients++;
+            }
+        }
+
+        // Drain every client completely: all frames are decoded now, so
+        // setpoints coalesce here rather than queueing in the socket
+        for (int k = 2; k < n; k++) {
+            Client& c = slots[index[k - 2]];
+            if (fds[k].revents & (POLLERR | POLLHUP | POLLNVAL)) { drop(c); continue; }
+            if (!(fds[k].revents & POLLIN)) continue;
+            while (true) {
+                ssize_t len = recv(c.fd, frame, sizeof(frame), MSG_DONTWAIT);
+                if (len > 0) { handleFrame(c, frame, len); continue; }
+                if (len == 0) drop(c);
+                break;
+            }
+        }
+
+        now = Trace::nowNs();
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            Client& c = slots[i];
+            if (c.fd >= 0 && c.rateHz && now >= c.nextSendNs) sendState(c, now);
+        }
+        if (fds[0].revents & POLLIN) {
+            char b;
+            while (read(wakePipe[0], &b, 1) > 0) {}
+        }
+    }
+}
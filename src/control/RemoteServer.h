@@ -0,0 +1,72 @@
+#pragma once
+#include "RemoteProtocol.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Remote control over a local UNIX domain socket, for show-control software
+// streaming joint targets at 50-100 Hz. The server thread only decodes
+// frames: setpoints land in one slot per joint (newest wins, so a client
+// that outruns the loop never builds a queue) and keys in a short queue.
+// The main loop takes both once per tick and applies them through the same
+// calls the keyboard uses. State goes the other way: the loop publishes a
+// snapshot each tick and subscribers get the newest one at their rate; a
+// client whose socket is full just misses updates.
+class RemoteServer {
+public:
+    RemoteServer();
+    ~RemoteServer();
+
+    bool start(const char* path);
+    void stop();
+
+    // Main loop side
+    bool takeSetpoint(RemoteJoint joint, uint16_t& value);
+    bool takeKey(char& key);
+    void publish(const RemoteState& state, const char* transcript);
+
+    int clientCount() const { return clients.load(); }
+    uint32_t droppedKeys() const { return keysDropped.load(); }
+    uint32_t droppedStates() const { return statesDropped.load(); }
+
+    static constexpr int MAX_CLIENTS = 4;
+    static constexpr int MAX_KEYS    = 32;
+    static constexpr int MAX_RATE_HZ = 100;
+
+private:
+    struct Client {
+        int fd;
+        int rateHz;
+        uint64_t nextSendNs;
+        uint32_t sentSeq;
+        uint32_t sentTranscript;
+    };
+
+    int listenFd;
+    int wakePipe[2];
+    std::string socketPath;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<int> clients;
+    std::atomic<uint32_t> keysDropped;
+    std::atomic<uint32_t> statesDropped;
+
+    // -1 = nothing pending, else the newest value
+    std::atomic<int32_t> setpoints[JOINT_COUNT];
+
+    std::mutex lock;               // keys and the published snapshot
+    char keys[MAX_KEYS];           // ring, oldest at keyHead
+    int keyHead;
+    int keyCount;
+    RemoteState state;
+    char transcript[REMOTE_MAX_FRAME];   // as sent: cut to one frame
+    uint32_t transcriptVersion;
+
+    Client slots[MAX_CLIENTS];
+
+    void loop();
+    void handleFrame(Client& c, const uint8_t* data, size_t len);
+    void sendState(Client& c, uint64_t now);
+    void drop(Client& c);
+};
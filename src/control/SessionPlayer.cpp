@@ -0,0 +1,76 @@
+#include "../control/SessionPlayer.h"
+#include "../trace/Trace.h"
+#include <time.h>
+
+SessionPlayer::SessionPlayer(SessionReader* reader, ReplayBackend* audio, AIVoice* ai, bool realTime)
+    : reader(reader), audio(audio), ai(ai), realTime(realTime), startNs(Trace::nowNs()), tickCount(0) {
+    for (int j = 0; j < JOINT_COUNT; j++) setpoints[j] = sticks[j] = -1;
+}
+
+void SessionPlayer::waitFor(uint64_t tNs) {
+    Session::setReplayTime(tNs);
+    if (!realTime) return;
+    uint64_t due = startNs + tNs;
+    struct timespec ts;
+    ts.tv_sec  = due / 1000000000ULL;
+    ts.tv_nsec = due % 1000000000ULL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+
+// Inputs only; SERVO records are the live outputs, kept for diffing, and
+// the seed was read before RandomController was built
+void SessionPlayer::apply(const SessionRecord& r) {
+    if (r.type == SessionEvent::AUDIO) {
+        if (!Session::decodeAudio(r, pcm)) return;
+        waitFor(r.tNs);
+        audio->deliver(pcm.data(), static_cast<int>(pcm.size()));
+    } else if (r.type == SessionEvent::AI) {
+        waitFor(r.tNs);
+        ai->feed(reinterpret_cast<const char*>(r.data.data()), r.data.size());
+    } else if (r.type == SessionEvent::SETPOINT && r.data.size() == 3 && r.data[0] < JOINT_COUNT) {
+        // Logged after the tick's keys, so held until the loop asks
+        setpoints[r.data[0]] = r.data[1] | (r.data[2] << 8);
+    } else if (r.type == SessionEvent::STICK && r.data.size() == 3 && r.data[0] < JOINT_COUNT) {
+        sticks[r.data[0]] = r.data[1] | (r.data[2] << 8);
+    }
+}
+
+bool SessionPlayer::advance() {
+    while (reader->next(rec)) {
+        if (rec.type == SessionEvent::TICK) {
+            waitFor(rec.tNs);
+            tickCount++;
+            return true;
+        }
+        apply(rec);
+    }
+    return false;
+}
+
+bool SessionPlayer::nextKey(char& c) {
+    // Other threads' records can land between the tick and its keys
+    while (const SessionRecord* r = reader->peek()) {
+        if (r->type == SessionEvent::TICK) return false;
+        reader->next(rec);
+        if (rec.type == SessionEvent::KEY && rec.data.size() == 1) {
+            c = static_cast<char>(rec.data[0]);
+            return true;
+        }
+        apply(rec);
+    }
+    return false;
+}
+
+bool SessionPlayer::takeSetpoint(RemoteJoint joint, uint16_t& value) {
+    if (setpoints[joint] < 0) return false;
+    value = static_cast<uint16_t>(setpoints[joint]);
+    setpoints[joint] = -1;
+    return true;
+}
+
+bool SessionPlayer::takeStick(RemoteJoint joint, uint16_t& value) {
+    if (sticks[joint] < 0) return false;
+    value = static_cast<uint16_t>(sticks[joint]);
+    sticks[joint] = -1;
+    return true;
+}
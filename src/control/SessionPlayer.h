@@ -0,0 +1,42 @@
+#pragma once
+#include "../trace/SessionLog.h"
+#include "../audio/ReplayBackend.h"
+#include "../ai/AIVoice.h"
+#include "RemoteProtocol.h"
+#include <vector>
+
+// Drives the main loop from a recorded session instead of the terminal,
+// the microphone and the Python backend. Each advance() applies everything
+// logged before the next loop tick and moves the session clock to it;
+// nextKey() then hands out that tick's keypresses, takeSetpoint() its
+// remote setpoints and takeStick() its joystick axes. Audio blocks go through
+// the real audio thread one at a time, so the servo commands that come out
+// are the same on every run. In real time the log's own pacing is kept;
+// otherwise it runs as fast as the control code allows.
+class SessionPlayer {
+public:
+    SessionPlayer(SessionReader* reader, ReplayBackend* audio, AIVoice* ai, bool realTime);
+
+    // False once the log is exhausted
+    bool advance();
+    bool nextKey(char& c);
+    bool takeSetpoint(RemoteJoint joint, uint16_t& value);
+    bool takeStick(RemoteJoint joint, uint16_t& value);
+
+    uint64_t ticks() const { return tickCount; }
+
+private:
+    SessionReader* reader;
+    ReplayBackend* audio;
+    AIVoice* ai;
+    bool realTime;
+    uint64_t startNs;
+    uint64_t tickCount;
+    SessionRecord rec;
+    std::vector<short> pcm;
+    int32_t setpoints[JOINT_COUNT];   // -1 = none this tick
+    int32_t sticks[JOINT_COUNT];
+
+    void apply(const SessionRecord& r);
+    void waitFor(uint64_t tNs);
+};
@@ -0,0 +1,80 @@
+#include "../control/Startup.h"
+#include "../trace/Trace.h"
+#include <cstring>
+
+Startup::Startup() : count(0), createdNs(Trace::nowNs()), doneMs(-1) {}
+
+int Startup::add(const char* name) {
+    if (count >= MAX_STAGES) return -1;
+    Slot& s = slots[count];
+    strncpy(s.name, name, sizeof(s.name) - 1);
+    s.name[sizeof(s.name) - 1] = '\0';
+    s.state = StageState::PENDING;
+    s.startNs = 0;
+    s.ms = 0;
+    return count++;
+}
+
+int Startup::find(const char* name) const {
+    for (int i = 0; i < count; i++)
+        if (strncmp(slots[i].name, name, sizeof(slots[i].name) - 1) == 0) return i;
+    return -1;
+}
+
+void Startup::begin(int stage) {
+    if (stage < 0 || stage >= count) return;
+    slots[stage].startNs = Trace::nowNs();
+    slots[stage].state = StageState::LOADING;
+}
+
+void Startup::finish(int stage, bool ok) {
+    if (stage < 0 || stage >= count) return;
+    Slot& s = slots[stage];
+    uint64_t start = s.startNs.load();
+    s.ms = start ? static_cast<int>((Trace::nowNs() - start) / 1000000) : 0;
+    s.state = ok ? StageState::READY : StageState::FAILED;
+    checkDone();
+}
+
+void Startup::set(int stage, StageState state, int ms) {
+    if (stage < 0 || stage >= count) return;
+    Slot& s = slots[stage];
+    if (state == StageState::LOADING && s.state.load() != StageState::LOADING)
+        s.startNs = Trace::nowNs();
+    s.ms = ms;
+    s.state = state;
+    if (state == StageState::READY || state == StageState::FAILED) checkDone();
+}
+
+StageState Startup::state(int stage) const {
+    if (stage < 0 || stage >= count) return StageState::FAILED;
+    return slots[stage].state.load();
+}
+
+bool Startup::allDone() const {
+    for (int i = 0; i < count; i++) {
+        StageState st = slots[i].state.load();
+        if (st == StageState::PENDING || st == StageState::LOADING) return false;
+    }
+    return true;
+}
+
+void Startup::checkDone() {
+    if (doneMs.load() >= 0 || !allDone()) return;
+    int expected = -1;
+    doneMs.compare_exchange_strong(expected, static_cast<int>((Trace::nowNs() - createdNs) / 1000000));
+}
+
+int Startup::report(StartupStage* out, int max) const {
+    int n = count < max ? count : max;
+    uint64_t now = Trace::nowNs();
+    for (int i = 0; i < n; i++) {
+        const Slot& s = slots[i];
+        memcpy(out[i].name, s.name, sizeof(out[i].name));
+        out[i].state = s.state.load();
+        uint64_t start = s.startNs.load();
+        out[i].ms = out[i].state == StageState::LOADING && start
+                  ? static_cast<int>((now - start) / 1000000) : s.ms.load();
+    }
+    return n;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Readiness of the independent startup stages (servo bus, audio devices,
+// STT/TTS/LLM warmup). Stages are registered on the main thread before any
+// of them start; after that each one is updated by whichever thread runs
+// it and read by the UI, so everything past the name is atomic.
+enum class StageState : uint8_t {
+    PENDING,
+    LOADING,
+    READY,
+    FAILED
+};
+
+struct StartupStage {
+    char name[8];
+    StageState state;
+    int ms;          // duration once finished, time so far while loading
+};
+
+class Startup {
+public:
+    Startup();
+
+    // Main thread, before the stage starts. Returns its index (-1 if full).
+    int add(const char* name);
+    int find(const char* name) const;
+
+    void begin(int stage);
+    void finish(int stage, bool ok);
+    // For stages timed elsewhere (the Python backend reports its own)
+    void set(int stage, StageState state, int ms);
+
+    StageState state(int stage) const;
+    bool allDone() const;
+    // Time from construction until every stage finished, -1 until then
+    int totalMs() const { return doneMs.load(); }
+
+    int report(StartupStage* out, int max) const;
+
+    static constexpr int MAX_STAGES = 8;
+
+private:
+    struct Slot {
+        char name[8];
+        std::atomic<StageState> state;
+        std::atomic<uint64_t> startNs;
+        std::atomic<int> ms;
+    };
+
+    Slot slots[MAX_STAGES];
+    int count;
+    uint64_t createdNs;
+    std::atomic<int> doneMs;
+
+    void checkDone();
+};
@@ -1,6 +1,8 @@
 #include "../control/TaroUI.h"
+#include "../trace/Trace.h"
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 #include <termios.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -31,12 +33,47 @@ static T clamp(T val, T minVal, T maxVal) {
     return (val < minVal) ? minVal : (val > maxVal) ? maxVal : val;
 }
 
-TaroUI::TaroUI() : lastDraw(0) {
+TaroUI::TaroUI(bool attachTerminal) : terminal(attachTerminal), lastDraw(0), frame(FRAME_BYTES), buf(&frame),
+                                       audioDeviceCount(0), firstAudioMs(-1),
+                                       stageCount(0), startupMs(-1), music(false),
+                                       threadCount(0), memoryLocked(false) {
+    dsp.nodes = 0;
+    dsp.totalUs = 0.0f;
+    dsp.deadlineUs = 0.0f;
+    dsp.voice[0] = '\0';
+    memset(&power, 0, sizeof(power));
+    memset(&spectrum, 0, sizeof(spectrum));
+    memset(&echo, 0, sizeof(echo));
+    memset(&stick, 0, sizeof(stick));
+    memset(layers, 0, sizeof(layers));
+    if (!terminal) return;
     setNonBlockingInput(true);
     std::cout << CLEAR << HIDE_CURSOR << std::flush;
 }
 
+void TaroUI::setAudioStats(const AudioDeviceStats* stats, int count) {
+    audioDeviceCount = count < MAX_AUDIO_DEVICES ? count : MAX_AUDIO_DEVICES;
+    for (int i = 0; i < audioDeviceCount; i++) audioDevices[i] = stats[i];
+}
+
+void TaroUI::setLayers(const AnimationMixer& mixer) {
+    for (int l = 0; l < LAYER_COUNT; l++) layers[l] = mixer.layerWeight(static_cast<AnimLayer>(l));
+}
+
+void TaroUI::setThreads(const ThreadStats* stats, int count, bool locked) {
+    threadCount = count < Realtime::MAX_THREADS ? count : Realtime::MAX_THREADS;
+    for (int i = 0; i < threadCount; i++) threads[i] = stats[i];
+    memoryLocked = locked;
+}
+
+void TaroUI::setStartup(const StartupStage* list, int count, int totalMs) {
+    stageCount = count < Startup::MAX_STAGES ? count : Startup::MAX_STAGES;
+    for (int i = 0; i < stageCount; i++) stages[i] = list[i];
+    startupMs = totalMs;
+}
+
 void TaroUI::shutdown() {
+    if (!terminal) return;
     std::cout << SHOW_CURSOR << CLEAR << std::flush;
     setNonBlockingInput(false);
 }
@@ -50,20 +87,18 @@ bool TaroUI::needsDraw() {
     return false;
 }
 
-std::string TaroUI::getBar(uint16_t pulse, uint16_t min, uint16_t max, int width) {
+void TaroUI::drawBar(uint16_t pulse, uint16_t min, uint16_t max, int width) {
     int pos = ((pulse - min) * width) / (max - min);
     pos = clamp(pos, 0, width);
-    std::string bar;
     for (int i = 0; i < width; i++) {
-        if (i == pos)            bar += "█";
-        else if (i == width / 2) bar += "┼";
-        else                     bar += "─";
+        if (i == pos)            buf << "█";
+        else if (i == width / 2) buf << "┼";
+        else                     buf << "─";
     }
-    return bar;
 }
 
-std::string TaroUI::getMouthVisual(uint16_t pulse) {
-    int opening = ((pulse - 1000) * 5) / 1000;
+const char* TaroUI::getMouthVisual(uint16_t pulse) {
+    int opening = ((pulse - MouthJoint::MIN_US) * 5) / (MouthJoint::MAX_US - MouthJoint::MIN_US);
     opening = clamp(opening, 0, 5);
     switch (opening) {
         case 0: return "  ─────  ";
@@ -76,7 +111,7 @@ std::string TaroUI::getMouthVisual(uint16_t pulse) {
     }
 }
 
-static std::string getAIStateLabel(AIState state) {
+static const char* getAIStateLabel(AIState state) {
     switch (state) {
         case AIState::IDLE:        return DIM "○ AI Idle   " RESET;
         case AIState::READY:       return GREEN "● AI Ready  " RESET;
@@ -88,7 +123,8 @@ static std::string getAIStateLabel(AIState state) {
 }
 
 void TaroUI::drawBase(uint16_t head, uint16_t mouth, const Wings& wings, AIState ai) {
-    buf.str("");
+    frame.reset();
+    buf.clear();
     buf << "\033[H";
 
     buf << BOLD CYAN "╔════════════════════════════╗\n";
@@ -117,11 +153,132 @@ void TaroUI::drawBase(uint16_t head, uint16_t mouth, const Wings& wings, AIState
     buf << "  " << mouth << "μs\n";
 
     // Head
-    buf << "\n " BOLD "HEAD " RESET "  " << getBar(head, 500, 2500) << "\n";
+    buf << "\n " BOLD "HEAD " RESET "  ";
+    drawBar(head, NeckJoint::MIN_US, NeckJoint::MAX_US);
+    buf << "\n";
     buf << "        " DIM "←left" RESET "      " CYAN << head << "μs" RESET "      " DIM "right→" RESET "\n";
 
+    // Animation layers driving a joint, with their weight while fading
+    buf << "\n " BOLD "LAYER" RESET " ";
+    bool anyLayer = false;
+    for (int l = LAYER_IDLE + 1; l < LAYER_COUNT; l++) {
+        if (layers[l] <= 0.0f) continue;
+        anyLayer = true;
+        buf << "  " << (layers[l] >= 1.0f ? GREEN : YELLOW) << AnimationMixer::layerName(static_cast<AnimLayer>(l)) << RESET;
+        if (layers[l] < 1.0f) buf << DIM " " << (int)(layers[l] * 100) << "%" RESET;
+    }
+    if (!anyLayer) buf << DIM "  idle" RESET;
+    buf << "                    \n";
+
     // AI state
-    buf << "\n " BOLD "AI   " RESET "  " << getAIStateLabel(ai) << "\n";
+    buf << "\n " BOLD "AI   " RESET "  " << getAIStateLabel(ai);
+    if (firstAudioMs >= 0) buf << DIM "  first audio " << firstAudioMs << "ms" RESET;
+    // Echo removed while Taro talks; a guest talking over it shows as double talk
+    if (echo.warmedUp) {
+        buf << DIM "  echo -" << (int)echo.erleDb << "dB" RESET;
+        if (echo.doubleTalk) buf << YELLOW "  double talk" RESET;
+    }
+    if (echo.bargeIns) buf << DIM "  barge-ins " << echo.bargeIns << RESET;
+    buf << "      \n";
+
+    // Startup stages; manual control works while the AI is still loading
+    if (stageCount > 0) {
+        buf << "\n " BOLD "START" RESET " ";
+        for (int i = 0; i < stageCount; i++) {
+            const StartupStage& st = stages[i];
+            switch (st.state) {
+                case StageState::PENDING: buf << DIM "  ○ " << st.name << RESET; break;
+                case StageState::LOADING: buf << YELLOW "  ◌ " << st.name << RESET; break;
+                case StageState::READY:   buf << GREEN "  ● " << st.name << RESET; break;
+                case StageState::FAILED:  buf << RED "  ✗ " << st.name << RESET; break;
+            }
+            if (st.state != StageState::PENDING) buf << DIM " " << st.ms << "ms" RESET;
+        }
+        if (startupMs >= 0) buf << DIM "  all in " << startupMs << "ms" RESET;
+        buf << "      \n";
+    }
+
+    // Per-device xruns and current buffer; red for 10 s after an xrun
+    if (audioDeviceCount > 0) {
+        uint64_t now = Trace::nowNs();
+        uint64_t latest = 0;
+        buf << "\n " BOLD "AUDIO" RESET " ";
+        for (int i = 0; i < audioDeviceCount; i++) {
+            const AudioDeviceStats& d = audioDevices[i];
+            bool recent = d.lastXrunNs && now - d.lastXrunNs < 10000000000ULL;
+            if (d.lastXrunNs > latest) latest = d.lastXrunNs;
+            buf << " " << (recent ? RED : GREEN) << d.name << RESET " "
+                << d.bufferFrames * 1000 / Audio::SAMPLE_RATE << "ms" DIM " L" << d.level
+                << " x" << d.xruns << " s" << d.shortTransfers << " r" << d.recoveries << RESET;
+        }
+        if (latest) buf << DIM "  last xrun " << (now - latest) / 1000000000ULL << "s ago" RESET;
+        buf << "      \n";
+    }
+
+    // Thread placement: name@cpu, FIFO priority or nice, CPU share, and
+    // wakeup lateness (average over the last second / worst)
+    if (threadCount > 0) {
+        buf << "\n " BOLD "CPU  " RESET "  " << (memoryLocked ? GREEN "mem locked" RESET : DIM "mem unlocked" RESET);
+        for (int i = 0; i < threadCount; i++) {
+            const ThreadStats& t = threads[i];
+            buf << (i % 4 == 0 ? "      \n        " : "  ") << t.name << DIM "@" << t.cpu << RESET " "
+                << (t.fifo ? GREEN "F" : DIM "n") << t.priority << RESET " " << (int)(t.cpuPct + 0.5f) << "%";
+            if (t.wakes > 0)
+                buf << " " << (t.wakeMaxUs > 2000 ? YELLOW : DIM) << (int)t.wakeAvgUs << "/" << (int)t.wakeMaxUs << "μs" RESET;
+        }
+        buf << "      \n";
+    }
+
+    // Idle servo release; wakes slower than the budget show red
+    if (power.released > 0 || power.wakes > 0) {
+        buf << "\n " BOLD "POWER" RESET "  ";
+        if (power.asleep) buf << BLUE "☾ asleep" RESET;
+        else buf << GREEN << power.held << " held" RESET DIM " " << power.released << " released" RESET;
+        if (power.wakes > 0)
+            buf << DIM "  wake " RESET << (power.overBudget ? RED : GREEN) << power.lastWakeUs << "μs" RESET
+                << DIM " max " << power.maxWakeUs << "μs x" << power.wakes << RESET;
+        buf << "      \n";
+    }
+
+    // Joysticks in use, with events read and SYN_DROPPED recoveries
+    if (stick.devices > 0) {
+        buf << "\n " BOLD "STICK" RESET "  " GREEN << stick.name << RESET;
+        if (stick.devices > 1) buf << DIM " +" << stick.devices - 1 << RESET;
+        buf << DIM "  events " << stick.events << RESET;
+        if (stick.resyncs) buf << YELLOW "  resyncs " << stick.resyncs << RESET;
+        buf << "      \n";
+    }
+
+    // Music mode: tempo, band levels low to high, analysis cost per block
+    if (music) {
+        static const char* const LEVELS[] = { "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█" };
+        buf << "\n " BOLD "MUSIC" RESET "  ";
+        if (spectrum.bpm > 0)
+            buf << (spectrum.tempoConfidence >= SpectralAnalyzer::MIN_CONFIDENCE ? GREEN : YELLOW)
+                << (int)(spectrum.bpm + 0.5f) << " bpm" RESET DIM " "
+                << (int)(spectrum.tempoConfidence * 100) << "%" RESET;
+        else
+            buf << DIM "listening" RESET;
+        buf << "  " CYAN;
+        for (int i = 0; i < SPECTRAL_BANDS; i++)
+            buf << LEVELS[clamp((int)((spectrum.bandDb[i] + 80.0f) / 10.0f), 0, 7)];
+        int pctx10 = spectrum.deadlineUs > 0 ? (int)(spectrum.avgUs * 1000 / spectrum.deadlineUs) : 0;
+        buf << RESET DIM "  beats " << spectrum.beats << " onsets " << spectrum.onsets << "  "
+            << (int)spectrum.avgUs << "μs/" << (int)spectrum.deadlineUs << "μs " RESET
+            << (pctx10 > 100 ? RED : GREEN) << pctx10 / 10 << "." << pctx10 % 10 << "%" RESET "      \n";
+    }
+
+    // Voice effect chain load against the block deadline
+    if (dsp.nodes > 0 || dsp.voice[0]) {
+        int pctx10 = dsp.deadlineUs > 0 ? (int)(dsp.totalUs * 1000 / dsp.deadlineUs) : 0;
+        buf << "\n " BOLD "VOICE" RESET "  " MAGENTA << dsp.voice << RESET "  "
+            << (int)dsp.totalUs << "μs/" << (int)dsp.deadlineUs << "μs "
+            << (pctx10 > 500 ? RED : GREEN) << pctx10 / 10 << "." << pctx10 % 10 << "%" RESET "      \n";
+        buf << "        " DIM;
+        for (int i = 0; i < dsp.nodes; i++)
+            buf << dsp.node[i].name << " " << (int)dsp.node[i].avgUs << "μs  ";
+        buf << RESET "          \n";
+    }
 }
 
 void TaroUI::drawControls() {
@@ -131,6 +288,9 @@ void TaroUI::drawControls() {
         << YELLOW "I" RESET "·Listen  "
         << YELLOW "O" RESET "·AutoMode  "
         << YELLOW "X" RESET "·Random  "
+        << YELLOW "M" RESET "·Music  "
+        << YELLOW "V" RESET "·Voice  "
+        << YELLOW "T" RESET "·Trace" << (Trace::enabled() ? RED "●" RESET "  " : "   ")
         << YELLOW "Q" RESET "·Quit   \n";
 }
 
@@ -145,18 +305,33 @@ void TaroUI::drawRandomControls(int activityLevel) {
     buf << " " CYAN << activityLevel << "/10" RESET "   \n";
 }
 
+void TaroUI::render(uint16_t head, uint16_t mouth, const Wings& wings, AIState ai) {
+    drawBase(head, mouth, wings, ai);
+    drawControls();
+}
+
+void TaroUI::render(uint16_t head, uint16_t mouth, const Wings& wings, int activityLevel, AIState ai) {
+    drawBase(head, mouth, wings, ai);
+    drawRandomControls(activityLevel);
+}
+
+void TaroUI::flush() {
+    std::cout.write(frame.data(), frame.size());
+    std::cout.flush();
+}
+
 // Normal mode
 void TaroUI::update(uint16_t head, uint16_t mouth, const Wings& wings, AIState ai) {
     if (!needsDraw()) return;
-    drawBase(head, mouth, wings, ai);
-    drawControls();
-    std::cout << buf.str() << std::flush;
+    TraceSpan span(TRACE_UI_DRAW);
+    render(head, mouth, wings, ai);
+    flush();
 }
 
 // Random mode
 void TaroUI::update(uint16_t head, uint16_t mouth, const Wings& wings, int activityLevel, AIState ai) {
     if (!needsDraw()) return;
-    drawBase(head, mouth, wings, ai);
-    drawRandomControls(activityLevel);
-    std::cout << buf.str() << std::flush;
-}
\ No newline at end of file
+    TraceSpan span(TRACE_UI_DRAW);
+    render(head, mouth, wings, activityLevel, ai);
+    flush();
+}
@@ -1,9 +1,16 @@
 #pragma once
-#include <sstream>
-#include <string>
+#include <ostream>
+#include <streambuf>
 #include <cstdint>
+#include <vector>
 #include "../actuation/Wings.h"
 #include "../ai/AIVoice.h"
+#include "../audio/Audio.h"
+#include "../i2c/PCA9685.h"
+#include "../trace/Realtime.h"
+#include "../actuation/Joints.h"
+#include "JoystickInput.h"
+#include "Startup.h"
 
 #define CLEAR       "\033[2J\033[H"
 #define HIDE_CURSOR "\033[?25l"
@@ -18,9 +25,22 @@
 #define BOLD        "\033[1m"
 #define DIM         "\033[2m"
 
+// Fixed storage for one composed frame. Writes past the end are dropped
+// (the stream goes bad until reset), so drawing never reallocates.
+class FrameBuffer : public std::streambuf {
+public:
+    explicit FrameBuffer(size_t size) : storage(size) { reset(); }
+    void reset() { setp(&storage[0], &storage[0] + storage.size()); }
+    const char* data() const { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+
+private:
+    std::vector<char> storage;
+};
+
 class TaroUI {
 public:
-    TaroUI();
+    TaroUI(bool attachTerminal = true);
     void shutdown();
 
     // Normal mode
@@ -28,13 +48,53 @@ public:
     // Random mode
     void update(uint16_t head, uint16_t mouth, const Wings& wings, int activityLevel, AIState ai);
 
+    // Compose a frame into the draw buffer without throttling or output
+    void render(uint16_t head, uint16_t mouth, const Wings& wings, AIState ai);
+    void render(uint16_t head, uint16_t mouth, const Wings& wings, int activityLevel, AIState ai);
+
+    void setDspReport(const DspReport& report) { dsp = report; }
+    void setAudioStats(const AudioDeviceStats* stats, int count);
+    void setTimeToFirstAudio(int ms) { firstAudioMs = ms; }
+    void setEchoStats(const EchoStats& stats) { echo = stats; }
+    void setStartup(const StartupStage* stages, int count, int totalMs);
+    void setServoPower(const PwmPowerStats& stats) { power = stats; }
+    void setThreads(const ThreadStats* stats, int count, bool memoryLocked);
+    void setLayers(const AnimationMixer& mixer);
+    void setJoystick(const JoystickReport& report) { stick = report; }
+    // Shown while music mode is on
+    void setSpectrum(const SpectralFeatures& features, bool musicActive) {
+        spectrum = features;
+        music = musicActive;
+    }
+
 private:
+    bool terminal;
     long long lastDraw;
-    std::ostringstream buf;
+    static constexpr size_t FRAME_BYTES = 16384;
+    FrameBuffer frame;
+    std::ostream buf;   // writes into frame
+    DspReport dsp;
+    static constexpr int MAX_AUDIO_DEVICES = 4;
+    AudioDeviceStats audioDevices[MAX_AUDIO_DEVICES];
+    int audioDeviceCount;
+    int firstAudioMs;
+    EchoStats echo;
+    JoystickReport stick;
+    StartupStage stages[Startup::MAX_STAGES];
+    int stageCount;
+    int startupMs;
+    PwmPowerStats power;
+    SpectralFeatures spectrum;
+    bool music;
+    float layers[LAYER_COUNT];   // weight of each animation layer
+    ThreadStats threads[Realtime::MAX_THREADS];
+    int threadCount;
+    bool memoryLocked;
 
     bool needsDraw();
-    std::string getBar(uint16_t pulse, uint16_t min, uint16_t max, int width = 22);
-    std::string getMouthVisual(uint16_t pulse);
+    void drawBar(uint16_t pulse, uint16_t min, uint16_t max, int width = 22);
+    const char* getMouthVisual(uint16_t pulse);
+    void flush();
     void drawBase(uint16_t head, uint16_t mouth, const Wings& wings, AIState ai);
     void drawControls();
     void drawRandomControls(int activityLevel);
@@ -0,0 +1,56 @@
+#include "I2CTransport.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+DevI2CTransport::DevI2CTransport(const char* i2c_device, int address) {
+    file = open(i2c_device, O_RDWR);
+    if (file < 0) {
+        std::cerr << "Failed to open I2C device: " << i2c_device << std::endl;
+        std::cerr << "Make sure I2C is enabled: sudo raspi-config" << std::endl;
+        exit(1);
+    }
+
+    if (ioctl(file, I2C_SLAVE, address) < 0) {
+        std::cerr << "Failed to set I2C address" << std::endl;
+        close(file);
+        exit(1);
+    }
+}
+
+DevI2CTransport::~DevI2CTransport() {
+    if (file >= 0) {
+        close(file);
+    }
+}
+
+bool DevI2CTransport::write(const uint8_t* data, size_t len) {
+    return ::write(file, data, len) == static_cast<ssize_t>(len);
+}
+
+bool DevI2CTransport::read(uint8_t* data, size_t len) {
+    return ::read(file, data, len) == static_cast<ssize_t>(len);
+}
+
+StubI2CTransport::StubI2CTransport() : pointer(0), writeCount(0) {
+    memset(regs, 0, sizeof(regs));
+}
+
+bool StubI2CTransport::write(const uint8_t* data, size_t len) {
+    if (len == 0) return false;
+    writeCount++;
+    pointer = data[0];
+    for (size_t i = 1; i < len; i++)
+        regs[pointer++] = data[i];
+    return true;
+}
+
+bool StubI2CTransport::read(uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        data[i] = regs[pointer++];
+    return true;
+}
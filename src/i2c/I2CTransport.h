@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Byte-level link to an I2C slave. PCA9685 talks through this so the same
+// driver code can run against the real bus or an in-memory stand-in.
+class I2CTransport {
+public:
+    virtual ~I2CTransport() {}
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+    virtual bool read(uint8_t* data, size_t len) = 0;
+};
+
+// Linux i2c-dev transport (/dev/i2c-N)
+class DevI2CTransport : public I2CTransport {
+private:
+    int file;
+
+public:
+    DevI2CTransport(const char* i2c_device, int address);
+    ~DevI2CTransport();
+
+    bool write(const uint8_t* data, size_t len);
+    bool read(uint8_t* data, size_t len);
+};
+
+// In-memory register file for benchmarks and tests. Models the PCA9685
+// register pointer and auto-increment so multi-byte writes land correctly.
+class StubI2CTransport : public I2CTransport {
+private:
+    uint8_t regs[256];
+    uint8_t pointer;
+    unsigned long writeCount;
+
+public:
+    StubI2CTransport();
+
+    bool write(const uint8_t* data, size_t len);
+    bool read(uint8_t* data, size_t len);
+
+    uint8_t reg(uint8_t r) const { return regs[r]; }
+    unsigned long getWriteCount() const { return writeCount; }
+};
@@ -1,63 +1,67 @@
 #include "PCA9685.h"
+#include "../trace/SessionLog.h"
+#include "../trace/Trace.h"
 #include <iostream>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 
 void PCA9685::writeReg(uint8_t reg, uint8_t value) {
     uint8_t buffer[2] = {reg, value};
-    if (write(file, buffer, 2) != 2) {
+    if (!bus->write(buffer, 2)) {
         std::cerr << "Failed to write to I2C device" << std::endl;
     }
 }
 
 uint8_t PCA9685::readReg(uint8_t reg) {
-    if (write(file, &reg, 1) != 1) {
+    if (!bus->write(&reg, 1)) {
         std::cerr << "Failed to write register address" << std::endl;
         return 0;
     }
     uint8_t value;
-    if (read(file, &value, 1) != 1) {
+    if (!bus->read(&value, 1)) {
         std::cerr << "Failed to read from I2C device" << std::endl;
         return 0;
     }
     return value;
 }
 
-PCA9685::PCA9685(const char* i2c_device, int address) {
-    file = open(i2c_device, O_RDWR);
-    if (file < 0) {
-        std::cerr << "Failed to open I2C device: " << i2c_device << std::endl;
-        std::cerr << "Make sure I2C is enabled: sudo raspi-config" << std::endl;
-        exit(1);
-    }
-    
-    if (ioctl(file, I2C_SLAVE, address) < 0) {
-        std::cerr << "Failed to set I2C address" << std::endl;
-        close(file);
-        exit(1);
-    }
-    
+PCA9685::PCA9685(const char* i2c_device, int address)
+    : bus(new DevI2CTransport(i2c_device, address)), ownsBus(true), mode1(0),
+      idleEnabled(false), releaseMs(0), sleepMs(0), allReleasedMs(-1), asleep(false) {
+    memset(channels, 0, sizeof(channels));
+    memset(&power, 0, sizeof(power));
     reset();
     setPWMFreq(50); // 50Hz for servos
     
     //std::cout << "PCA9685 initialized successfully" << std::endl;
 }
 
+PCA9685::PCA9685(I2CTransport* transport)
+    : bus(transport), ownsBus(false), mode1(0),
+      idleEnabled(false), releaseMs(0), sleepMs(0), allReleasedMs(-1), asleep(false) {
+    memset(channels, 0, sizeof(channels));
+    memset(&power, 0, sizeof(power));
+    reset();
+    setPWMFreq(50);
+}
+
 PCA9685::~PCA9685() {
-    if (file >= 0) {
-        close(file);
+    if (ownsBus) {
+        delete bus;
     }
 }
 
 void PCA9685::reset() {
-    writeReg(MODE1, 0x00);
+    mode1 = 0x00;
+    writeReg(MODE1, mode1);
     usleep(10000);
 }
 
 void PCA9685::setPWMFreq(float freq) {
+    TraceSpan span(TRACE_I2C_FREQ);
+
     // Calculate prescale value
     float prescaleval = 25000000.0;  // 25MHz oscillator
     prescaleval /= 4096.0;            // 12-bit resolution
@@ -72,10 +76,29 @@ void PCA9685::setPWMFreq(float freq) {
     writeReg(PRESCALE, prescale);
     writeReg(MODE1, oldmode);
     usleep(5000);
-    writeReg(MODE1, oldmode | 0xa1); // Auto-increment on
+    mode1 = oldmode | 0xa1;
+    writeReg(MODE1, mode1); // Auto-increment on
 }
 
 void PCA9685::setPWM(uint8_t channel, uint16_t on, uint16_t off) {
+    TraceSpan span(TRACE_I2C_PWM, channel);
+    uint64_t startNs = Trace::nowNs();
+    if (channel >= PCA9685_CHANNELS) return;
+    std::lock_guard<std::mutex> g(lock);
+    Channel& c = channels[channel];
+    // A released channel stays released until it is asked to move
+    if (idleEnabled && c.used && c.on == on && c.off == off) return;
+    c.used = true;
+    c.released = false;
+    c.on = on;
+    c.off = off;
+    c.changedMs = Session::nowMs();
+    if (asleep) wake(startNs);
+    else writeChannel(channel, on, off);
+}
+
+void PCA9685::writeChannel(uint8_t channel, uint16_t on, uint16_t off) {
+    Session::servo(channel, off);
     uint8_t reg = LED0_ON_L + 4 * channel;
     writeReg(reg, on & 0xFF);
     writeReg(reg + 1, on >> 8);
@@ -83,6 +106,57 @@ void PCA9685::setPWM(uint8_t channel, uint16_t on, uint16_t off) {
     writeReg(reg + 3, off >> 8);
 }
 
+// What the chip holds for a channel: released and unused ones are full OFF
+void PCA9685::fillBurst(uint8_t* p, int channel) const {
+    const Channel& c = channels[channel];
+    bool off = !c.used || c.released;
+    uint16_t on = off ? 0 : c.on;
+    uint16_t offCount = off ? PWM_FULL_OFF : c.off;
+    p[0] = on & 0xFF;
+    p[1] = on >> 8;
+    p[2] = offCount & 0xFF;
+    p[3] = offCount >> 8;
+}
+
+bool PCA9685::setFrame(const uint8_t* channelList, const uint16_t* offCounts, int count) {
+    TraceSpan span(TRACE_I2C_FRAME, count);
+    uint64_t startNs = Trace::nowNs();
+    std::lock_guard<std::mutex> g(lock);
+    long long now = Session::nowMs();
+    int lo = PCA9685_CHANNELS, hi = -1;
+    bool changed[PCA9685_CHANNELS] = {};
+    for (int i = 0; i < count; i++) {
+        uint8_t ch = channelList[i];
+        if (ch >= PCA9685_CHANNELS) continue;
+        Channel& c = channels[ch];
+        if (idleEnabled && c.used && !c.released && c.on == 0 && c.off == offCounts[i]) continue;
+        c.used = true;
+        c.released = false;
+        c.on = 0;
+        c.off = offCounts[i];
+        c.changedMs = now;
+        changed[ch] = true;
+        if (ch < lo) lo = ch;
+        if (ch > hi) hi = ch;
+    }
+    if (hi < 0) return false;
+    if (asleep) {
+        wake(startNs);
+        return true;
+    }
+
+    uint8_t burst[1 + 4 * PCA9685_CHANNELS];
+    burst[0] = LED0_ON_L + 4 * lo;
+    for (int ch = lo; ch <= hi; ch++) {
+        if (changed[ch]) Session::servo(ch, channels[ch].off);
+        fillBurst(burst + 1 + 4 * (ch - lo), ch);
+    }
+    if (!bus->write(burst, 1 + 4 * (hi - lo + 1))) {
+        std::cerr << "Failed to write to I2C device" << std::endl;
+    }
+    return true;
+}
+
 void PCA9685::setServoAngle(uint8_t channel, float angle) {
     // Clamp angle to 0-180
     angle = std::max(0.0f, std::min(180.0f, angle));
@@ -104,3 +178,80 @@ void PCA9685::setServoPulse(uint8_t channel, uint16_t pulse_us) {
     uint16_t pulse = static_cast<uint16_t>((pulse_us / 20000.0) * 4096);
     setPWM(channel, 0, pulse);
 }
+
+void PCA9685::enableIdleRelease(long long release, long long sleep) {
+    std::lock_guard<std::mutex> g(lock);
+    idleEnabled = true;
+    releaseMs = release;
+    sleepMs = sleep;
+}
+
+void PCA9685::updateIdle() {
+    std::lock_guard<std::mutex> g(lock);
+    if (!idleEnabled || asleep) return;
+    long long now = Session::nowMs();
+    int held = 0, released = 0;
+    for (int ch = 0; ch < PCA9685_CHANNELS; ch++) {
+        Channel& c = channels[ch];
+        if (!c.used) continue;
+        if (!c.released && now - c.changedMs >= releaseMs) {
+            writeChannel(ch, 0, PWM_FULL_OFF);
+            c.released = true;
+        }
+        if (c.released) released++;
+        else held++;
+    }
+    power.held = held;
+    power.released = released;
+    if (held > 0 || released == 0) {
+        allReleasedMs = -1;
+        return;
+    }
+    if (allReleasedMs < 0) allReleasedMs = now;
+    if (now - allReleasedMs >= sleepMs) {
+        writeReg(MODE1, (mode1 & ~MODE1_RESTART) | MODE1_SLEEP);
+        asleep = true;
+        power.asleep = true;
+    }
+}
+
+// Caller holds the lock. The outputs stay off until the burst, so every
+// channel comes back at its last position in one transaction.
+void PCA9685::wake(uint64_t startNs) {
+    TraceSpan span(TRACE_I2C_WAKE);
+    writeReg(MODE1, mode1 & ~(MODE1_RESTART | MODE1_SLEEP));
+    Session::sleepUs(WAKE_OSC_US);
+    writeReg(MODE1, mode1 | MODE1_RESTART);
+
+    uint8_t burst[1 + 4 * PCA9685_CHANNELS];
+    int last = 0;
+    long long now = Session::nowMs();
+    burst[0] = LED0_ON_L;
+    for (int ch = 0; ch < PCA9685_CHANNELS; ch++) {
+        Channel& c = channels[ch];
+        if (c.used) {
+            Session::servo(ch, c.off);
+            c.released = false;
+            c.changedMs = now;
+            last = ch;
+        }
+        fillBurst(burst + 1 + 4 * ch, ch);
+    }
+    if (!bus->write(burst, 1 + 4 * (last + 1))) {
+        std::cerr << "Failed to write to I2C device" << std::endl;
+    }
+    asleep = false;
+    allReleasedMs = -1;
+
+    unsigned int us = static_cast<unsigned int>((Trace::nowNs() - startNs) / 1000);
+    power.asleep = false;
+    power.wakes++;
+    power.lastWakeUs = us;
+    if (us > power.maxWakeUs) power.maxWakeUs = us;
+    if (us > WAKE_BUDGET_US) power.overBudget++;
+}
+
+PwmPowerStats PCA9685::getPowerStats() {
+    std::lock_guard<std::mutex> g(lock);
+    return power;
+}
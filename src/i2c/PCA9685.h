@@ -1,21 +1,56 @@
 #pragma once
 
 #include <cstdint>
+#include <mutex>
+#include "I2CTransport.h"
+#include "ServoDriver.h"
 
 #define PCA9685_ADDRESS 0x40
 #define MODE1 0x00
 #define PRESCALE 0xFE
 #define LED0_ON_L 0x06
 
-class PCA9685 {
+#define PCA9685_CHANNELS 16
+#define MODE1_RESTART 0x80
+#define MODE1_SLEEP 0x10
+#define PWM_FULL_OFF 0x1000   // bit 4 of LEDn_OFF_H: output held low
+
+class PCA9685 : public ServoDriver {
 private:
-    int file;
+    struct Channel {
+        bool used;
+        bool released;
+        uint16_t on;
+        uint16_t off;
+        long long changedMs;
+    };
+
+    I2CTransport* bus;
+    bool ownsBus;
+    uint8_t mode1;
+
+    // Main and audio threads both drive channels
+    std::mutex lock;
+    Channel channels[PCA9685_CHANNELS];
+    bool idleEnabled;
+    long long releaseMs;
+    long long sleepMs;
+    long long allReleasedMs;   // -1 while any channel is held
+    bool asleep;
+    PwmPowerStats power;
     
     void writeReg(uint8_t reg, uint8_t value);
     uint8_t readReg(uint8_t reg);
+    void writeChannel(uint8_t channel, uint16_t on, uint16_t off);
+    void fillBurst(uint8_t* p, int channel) const;
+    void wake(uint64_t startNs);
+
+    PCA9685(const PCA9685&) = delete;
+    PCA9685& operator=(const PCA9685&) = delete;
     
 public:
     PCA9685(const char* i2c_device = "/dev/i2c-1", int address = PCA9685_ADDRESS);
+    PCA9685(I2CTransport* transport);  // caller keeps ownership
     ~PCA9685();
     
     void reset();
@@ -23,5 +58,23 @@ public:
     void setPWM(uint8_t channel, uint16_t on, uint16_t off);
     void setServoAngle(uint8_t channel, float angle);
     void setServoPulse(uint8_t channel, uint16_t pulse_us);
+
+    // Several channels (off counts, on = 0) in one auto-increment burst from
+    // the lowest to the highest; channels in between are rewritten as they
+    // are. False if nothing changed, so nothing was sent.
+    bool setFrame(const uint8_t* channelList, const uint16_t* offCounts, int count);
+
+    // Idle release, off until enabled. Rewriting a channel's current value
+    // is skipped; a channel that holds still for releaseMs is switched to
+    // full OFF, and once every channel is released for sleepMs the chip
+    // sleeps. The next change wakes it and rewrites every channel in one
+    // auto-increment burst. updateIdle() runs once per main loop tick.
+    void enableIdleRelease(long long releaseMs, long long sleepMs);
+    void updateIdle();
+    PwmPowerStats getPowerStats();
+
+    // Oscillator start-up (500 us per the datasheet) plus one burst write
+    static constexpr unsigned int WAKE_OSC_US    = 500;
+    static constexpr unsigned int WAKE_BUDGET_US = 2000;
 };
 
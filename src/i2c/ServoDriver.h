@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+// Servo output hardware. The animation mixer and the main loop only use
+// this interface, so the PCA9685 on the I2C bus and a serial microcontroller
+// that interpolates on its own (src/serial/SerialServo.h) are interchangeable.
+// Positions are PCA9685 off counts at 50 Hz (Joints.h converts), the unit
+// every caller already works in.
+
+// Idle release bookkeeping, for the UI
+struct PwmPowerStats {
+    int held;               // channels driving a position
+    int released;           // channels switched to full OFF
+    bool asleep;            // oscillator stopped (MODE1 SLEEP), or every output off
+    unsigned int wakes;
+    unsigned int lastWakeUs;
+    unsigned int maxWakeUs;
+    unsigned int overBudget;   // wakes slower than the driver's budget
+};
+
+class ServoDriver {
+public:
+    virtual ~ServoDriver() {}
+
+    virtual void setPWM(uint8_t channel, uint16_t on, uint16_t off) = 0;
+
+    // Several channels (off counts, on = 0) in one transaction. False if
+    // nothing changed, so nothing was sent.
+    virtual bool setFrame(const uint8_t* channelList, const uint16_t* offCounts, int count) = 0;
+
+    // Idle release, off until enabled: a channel that holds still for
+    // releaseMs goes limp, and once all have for sleepMs the outputs sleep
+    // until the next change. updateIdle() runs once per main loop tick.
+    virtual void enableIdleRelease(long long releaseMs, long long sleepMs) = 0;
+    virtual void updateIdle() = 0;
+    virtual PwmPowerStats getPowerStats() = 0;
+
+    // A joint descriptor (actuation/Joints.h) clamps and converts in integers
+    template <typename J>
+    void setJoint(int pulseUs) { setPWM(J::CHANNEL, 0, J::counts(pulseUs)); }
+};
@@ -1,31 +1,268 @@
 #include "i2c/PCA9685.h"
+#include "serial/SerialServo.h"
+#include "audio/AlsaBackend.h"
+#include "audio/FileBackend.h"
+#include "audio/ReplayBackend.h"
+#include "audio/SpeechClipFile.h"
+#include "actuation/AnimationMixer.h"
+#include "actuation/Behavior.h"
 #include "actuation/Mouth.h"
 #include "actuation/Wings.h"
 #include "actuation/Neck.h"
 #include "control/TaroUI.h"
 #include "control/RandomController.h"
+#include "control/MusicController.h"
+#include "control/JoystickInput.h"
+#include "control/RemoteServer.h"
+#include "control/SessionPlayer.h"
+#include "control/Startup.h"
 #include "ai/AIVoice.h"
+#include "trace/Realtime.h"
+#include "trace/SessionLog.h"
+#include "trace/Trace.h"
 #include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
 
-int main() {
-    PCA9685 pwm;
-    Neck neck(&pwm);
-    Mouth mouth(&pwm);
-    Wings wings(pwm);
-    TaroUI ui;
-    RandomController random(neck, wings);
-    AIVoice ai;
-    ai.start();
+#define TRACE_DUMP_PATH "/tmp/taro_trace.json"
+#define DSP_CONFIG_PATH "src/audio/dsp.conf"
+#define REMOTE_SOCKET_PATH "/tmp/taro.sock"
+#define THREADS_CONFIG_PATH "src/trace/threads.conf"
+#define JOYSTICK_CONFIG_PATH "src/control/joystick.conf"
+#define JOYSTICK_DIR "/dev/input"
+
+// Servos holding still this long go limp; once all have, the outputs sleep
+#define SERVO_IDLE_RELEASE_MS 5000
+#define SERVO_IDLE_SLEEP_MS   2000
+
+// Capture from just before a barge-in, handed to the backend so the guest's
+// first words aren't lost while it starts listening
+#define BARGE_IN_PREROLL_PATH "/tmp/taro_barge_in.wav"
+#define BARGE_IN_PREROLL_MS   500
+
+static const char* const VOICES[] = { "none", "rubberband", "robot" };
+static const int VOICE_COUNT = sizeof(VOICES) / sizeof(VOICES[0]);
+
+// Turn a speech request into PCM at the engine rate plus its mouth track.
+// Cache entries are mapped and used as stored; piper WAVs are converted,
+// analysed and, when the backend asks, written to the cache. A replay only
+// reads: it neither writes cache entries nor deletes the backend's WAVs.
+static bool loadSpeech(const SpeechRequest& req, std::vector<short>& pcm, LipSync& track,
+                       bool readOnly) {
+    const std::string& path = req.path;
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".tsc") == 0) {
+        SpeechClipFile clip;
+        if (!clip.open(path.c_str()) || clip.rate() != Audio::SAMPLE_RATE) return false;
+        pcm.assign(clip.pcm(), clip.pcm() + clip.frames());
+        track = LipSync(clip.track(), clip.hops(), clip.hopFrames(), clip.frames(),
+                        Mouth::SERVO_MIN_PULSE, Mouth::SERVO_MAX_PULSE);
+        return true;
+    }
+
+    bool ok = FileBackend::loadWav(path.c_str(), Audio::SAMPLE_RATE, pcm);
+    if (ok) {
+        track = LipSync(pcm.data(), pcm.size(), Audio::SAMPLE_RATE,
+                        Mouth::SERVO_MIN_PULSE, Mouth::SERVO_MAX_PULSE);
+        if (!req.cachePath.empty() && !readOnly)
+            SpeechClipFile::write(req.cachePath.c_str(), pcm.data(), pcm.size(), Audio::SAMPLE_RATE,
+                                  track.track().data(), track.track().size(), track.hopFrames());
+    }
+    // Pre-warm WAVs are handed over; the backend doesn't wait to delete them
+    if (!req.play && !readOnly) unlink(path.c_str());
+    return ok && req.play;
+}
+
+// Autonomous modes take over from the keyboard and show control
+static void releasePuppeteering(AnimationMixer& mixer) {
+    mixer.releaseLayer(LAYER_MANUAL);
+    mixer.releaseLayer(LAYER_SCRIPTED);
+}
+
+static int usage() {
+    fprintf(stderr, "usage: tea_animatronic [--record <log>] [--servo-serial <tty>]\n"
+                    "       tea_animatronic --replay <log> [--fast] [--servo-out <file>]\n"
+                    "       tea_animatronic --dump <log>\n");
+    return 2;
+}
+
+// Print a session log one record per line
+static int dumpSession(const char* path) {
+    SessionReader reader;
+    if (!reader.open(path)) { fprintf(stderr, "cannot read session log %s\n", path); return 1; }
+    SessionRecord rec;
+    while (reader.next(rec)) Session::print(stdout, rec);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Trace::setThreadName("main");
+
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    const char* servoOutPath = nullptr;
+    const char* servoSerialPath = nullptr;
+    bool fast = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if      (!strcmp(argv[i], "--record") && hasValue)       recordPath = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && hasValue)       replayPath = argv[++i];
+        else if (!strcmp(argv[i], "--servo-out") && hasValue)    servoOutPath = argv[++i];
+        else if (!strcmp(argv[i], "--servo-serial") && hasValue) servoSerialPath = argv[++i];
+        else if (!strcmp(argv[i], "--dump") && hasValue)         return dumpSession(argv[++i]);
+        else if (!strcmp(argv[i], "--fast"))                     fast = true;
+        else return usage();
+    }
+    if ((recordPath || servoSerialPath) && replayPath) return usage();
+
+    // Live runs place every thread by role and lock memory before any other
+    // thread starts; a replay keeps default scheduling
+    if (!replayPath) {
+        Realtime::configure(THREADS_CONFIG_PATH);
+        Realtime::setEnabled(true);
+        Realtime::lockMemory();
+    }
+    Realtime::enter(ROLE_MAIN);
+
+    // Replay feeds a recorded session through this same loop against the
+    // stub I2C bus, with no audio devices or Python backend
+    SessionReader reader;
+    uint32_t seed = static_cast<uint32_t>(time(nullptr));
+    FILE* servoOut = nullptr;
+    if (replayPath) {
+        if (!reader.open(replayPath)) { fprintf(stderr, "cannot read session log %s\n", replayPath); return 1; }
+        SessionReader::findSeed(replayPath, seed);
+        if (servoOutPath && !(servoOut = fopen(servoOutPath, "w"))) {
+            fprintf(stderr, "cannot write %s\n", servoOutPath);
+            return 1;
+        }
+        Session::beginReplay(servoOut);
+    } else if (recordPath && !Session::start(recordPath, Audio::SAMPLE_RATE, Audio::FRAMES)) {
+        fprintf(stderr, "cannot record to %s\n", recordPath);
+        return 1;
+    }
+
+    // Stages come up side by side and report in the UI. The AI backend is
+    // the slowest (model loads), so it is launched first; the audio devices
+    // open on the audio thread; the servo bus is brought up here, and manual
+    // puppeteering works as soon as it is done.
+    Startup startup;
+    int servoStage = startup.add("servo");
+    int audioStage = startup.add("audio");
+    startup.add("stt");
+    startup.add("tts");
+    startup.add("llm");
+    StartupStage stages[Startup::MAX_STAGES];
+
+    AIVoice ai(&startup);
+    if (!replayPath) ai.start();
+
+    startup.begin(servoStage);
+    // Servos on the PCA9685, or on a microcontroller that interpolates
+    // between frames itself; a replay drives the stub bus
+    StubI2CTransport stubBus;
+    std::unique_ptr<ServoDriver> pwmOwner;
+    bool servoOk = true;
+    if (replayPath) pwmOwner.reset(new PCA9685(&stubBus));
+    else if (servoSerialPath) {
+        SerialServo* serial = new SerialServo(servoSerialPath);
+        servoOk = serial->isOpen();
+        pwmOwner.reset(serial);
+    } else pwmOwner.reset(new PCA9685());
+    ServoDriver& pwm = *pwmOwner;
+    AlsaBackend alsaDevices;
+    ReplayBackend replayDevices;
+    startup.begin(audioStage);
+    AnimationMixer mixer(&pwm);
+    BehaviorScheduler behaviors;
+    Mouth mouth(&mixer, replayPath ? static_cast<AudioBackend*>(&replayDevices) : &alsaDevices);
+    Neck neck(&mixer, &behaviors);
+    Wings wings(mixer, behaviors);
+    pwm.enableIdleRelease(SERVO_IDLE_RELEASE_MS, SERVO_IDLE_SLEEP_MS);
+    startup.finish(servoStage, servoOk);
+
+    // Show-control clients drive the same loop over a local socket; a replay
+    // takes their setpoints from the log instead
+    RemoteServer remote;
+    if (!replayPath && !remote.start(REMOTE_SOCKET_PATH))
+        fprintf(stderr, "remote control unavailable at %s\n", REMOTE_SOCKET_PATH);
+
+    // Gamepads for live puppeteering, plugged in at any time; a replay takes
+    // their axes from the log and their buttons arrive as keys
+    JoystickInput joystick;
+    joystick.configure(JOYSTICK_CONFIG_PATH);
+    if (!replayPath && !joystick.start(JOYSTICK_DIR))
+        fprintf(stderr, "joysticks unavailable\n");
+    JoystickReport stickReport;
+
+    // A fast replay has nobody watching; a real-time one shows the UI
+    bool showUI = !(replayPath && fast);
+    TaroUI ui(showUI);
+    RandomController random(neck, wings, behaviors, seed);
+    MusicController music(neck, wings);
+    SpectralFeatures spectrum;
+    memset(&spectrum, 0, sizeof(spectrum));
+    std::unique_ptr<SessionPlayer> player(
+        replayPath ? new SessionPlayer(&reader, &replayDevices, &ai, !fast) : nullptr);
+
+    mouth.getAudio().setDspChain(
+        DspChain::fromFile(DSP_CONFIG_PATH, Audio::SAMPLE_RATE, Audio::FRAMES));
+    DspReport dspReport;
+    AudioDeviceStats audioStats[4];
+    SpeechRequest speechReq;
+    std::vector<short> speechPcm;
+    LipSync speechTrack;
+    std::vector<short> preroll(Audio::SAMPLE_RATE * BARGE_IN_PREROLL_MS / 1000);
+    EchoStats echoStats;
 
     char ch;
     bool running = true;
     bool aiAutoMode = false;
     AIState prevAIState = AIState::IDLE;
+    uint32_t remoteSeq = 0;
+    char transcript[REMOTE_MAX_FRAME];
+    ThreadStats threadStats[Realtime::MAX_THREADS];
 
     while (running) {
-        while (read(STDIN_FILENO, &ch, 1) > 0) {
+        if (player && !player->advance()) break;
+        TraceSpan tick(TRACE_LOOP_TICK);
+        Session::tick();
+
+        while (player ? player->nextKey(ch)
+                      : read(STDIN_FILENO, &ch, 1) > 0 || remote.takeKey(ch) || joystick.takeKey(ch)) {
+            Trace::instant(TRACE_KEYPRESS, ch);
+            Session::key(ch);
             if      (ch == 'q' || ch == 'Q') { running = false; }
-            else if (ch == 'x' || ch == 'X') { random.setActive(!random.isActive()); }
+            else if (ch == 't' || ch == 'T') {
+                // Stop-and-dump so each recording is one viewable trace
+                if (Trace::enabled()) {
+                    Trace::setEnabled(false);
+                    Trace::dump(TRACE_DUMP_PATH);
+                } else {
+                    Trace::setEnabled(true);
+                }
+            }
+            else if (ch == 'v' || ch == 'V') {
+                // Rebuild the chain with the next character voice; the audio
+                // thread crossfades into it at the next block
+                mouth.getAudio().getDspReport(dspReport);
+                int next = 0;
+                for (int i = 0; i < VOICE_COUNT; i++)
+                    if (strcmp(dspReport.voice, VOICES[i]) == 0) next = (i + 1) % VOICE_COUNT;
+                mouth.getAudio().setDspChain(DspChain::fromFile(
+                    DSP_CONFIG_PATH, Audio::SAMPLE_RATE, Audio::FRAMES, VOICES[next]));
+            }
+            else if (ch == 'x' || ch == 'X') {
+                music.setActive(false);
+                random.setActive(!random.isActive());
+                if (random.isActive()) releasePuppeteering(mixer);
+            }
+            else if (ch == 'm' || ch == 'M') {
+                random.setActive(false);
+                music.setActive(!music.isActive());
+                if (music.isActive()) releasePuppeteering(mixer);
+            }
             else if (ch == 'i' || ch == 'I') {
                 if (!aiAutoMode && ai.getState() == AIState::READY) {
                     mouth.pause();
@@ -35,7 +272,9 @@ int main() {
             else if (ch == 'o' || ch == 'O') {
                 if (!aiAutoMode) {
                     aiAutoMode = true;
+                    music.setActive(false);
                     random.setActive(true);
+                    releasePuppeteering(mixer);
                     mouth.pause();
                     ai.triggerAutoOn();
                 } else {
@@ -56,13 +295,70 @@ int main() {
             }
         }
 
+        // Newest remote setpoint per joint, onto the scripted layer; random
+        // and music mode own the joints while they are on. Between show
+        // control and the keys the latest wins, so a setpoint crossfades the
+        // neck out of the manual layer.
+        for (int j = 0; j < JOINT_COUNT; j++) {
+            RemoteJoint joint = static_cast<RemoteJoint>(j);
+            uint16_t value;
+            if (!(player ? player->takeSetpoint(joint, value) : remote.takeSetpoint(joint, value))) continue;
+            Session::setpoint(joint, value);
+            if (random.isActive() || music.isActive()) continue;
+            if (joint == JOINT_NECK) {
+                neck.release(LAYER_MANUAL);
+                neck.setTarget(value, LAYER_SCRIPTED);
+            }
+            else if (joint == JOINT_MOUTH)          mixer.set(LAYER_SCRIPTED, MIX_MOUTH, value);
+            else if (joint == JOINT_WINGS && value) wings.flapWings(LAYER_SCRIPTED);
+        }
+
+        // Joystick axes hold the manual layer directly, so the neck follows
+        // the stick instead of stepping NECK_STEP per key. Back inside the
+        // deadzone the stick lets go and the layers below take over again.
+        for (int j = 0; j < JOINT_COUNT; j++) {
+            RemoteJoint joint = static_cast<RemoteJoint>(j);
+            uint16_t value;
+            if (!(player ? player->takeStick(joint, value) : joystick.takeSetpoint(joint, value))) continue;
+            Session::stick(joint, value);
+            if (random.isActive() || music.isActive()) continue;
+            if (joint == JOINT_NECK) {
+                if (value == JoystickInput::RELEASED) {
+                    neck.release(LAYER_MANUAL);
+                } else {
+                    neck.release(LAYER_SCRIPTED);
+                    neck.setTarget(value, LAYER_MANUAL);
+                }
+            } else if (joint == JOINT_MOUTH) {
+                if (value == JoystickInput::RELEASED) mixer.release(LAYER_MANUAL, MIX_MOUTH);
+                else                                   mixer.set(LAYER_MANUAL, MIX_MOUTH, value);
+            }
+        }
+
+        // A guest talked over Taro: the audio thread has cut the clip. Drop
+        // the rest of the reply and have the backend listen from the preroll.
+        if (mouth.takeBargeIn()) {
+            speechPcm.clear();
+            size_t frames = mouth.getAudio().copyRecentCapture(preroll.data(), preroll.size());
+            bool saved = !player && frames &&
+                         FileBackend::saveWav(BARGE_IN_PREROLL_PATH, preroll.data(), frames, Audio::SAMPLE_RATE);
+            ai.bargeIn(saved ? BARGE_IN_PREROLL_PATH : nullptr);
+        }
+
+        // TTS clips play through the audio engine; the mouth follows each
+        // clip's precomputed trajectory against the playback clock. A clip
+        // that arrives while another is still queued waits here.
+        if (speechPcm.empty() && ai.takeSpeech(speechReq) &&
+            !loadSpeech(speechReq, speechPcm, speechTrack, player != nullptr))
+            speechPcm.clear();
+        if (!speechPcm.empty() && mouth.speak(speechPcm.data(), speechPcm.size(), speechTrack))
+            speechPcm.clear();
+        mouth.update();
+
         // Handle AI state transitions
         AIState curAIState = ai.getState();
 
-        if (curAIState == AIState::SPEAKING) {
-            // Drive mouth servo from TTS audio amplitude
-            mouth.setServoPulse(ai.getSpeakingAmplitude());
-        } else if (prevAIState == AIState::SPEAKING && curAIState == AIState::READY) {
+        if (prevAIState == AIState::SPEAKING && curAIState == AIState::READY) {
             if (!aiAutoMode) {
                 mouth.resume();
             }
@@ -70,21 +366,77 @@ int main() {
 
         prevAIState = curAIState;
 
-        neck.update();
-        random.update();
+        mouth.getAudio().getSpectrum(spectrum);
+        music.update(spectrum);
+
+        // Behaviors take their next step (random mode, flaps, recentering),
+        // then every layer has had its say: one blended frame to the servos
+        behaviors.tick();
+        mixer.evaluate(Session::nowNs());
+        pwm.updateIdle();
 
-        if (random.isActive()) {
+        if (startup.state(audioStage) == StageState::LOADING) {
+            if (mouth.getAudio().isOpen())          startup.finish(audioStage, true);
+            else if (mouth.getAudio().openFailed()) startup.finish(audioStage, false);
+        }
+        ui.setStartup(stages, startup.report(stages, Startup::MAX_STAGES), startup.totalMs());
+
+        mouth.getAudio().getDspReport(dspReport);
+        ui.setDspReport(dspReport);
+        ui.setTimeToFirstAudio(ai.getTimeToFirstAudioMs());
+        mouth.getAudio().getEchoStats(echoStats);
+        ui.setEchoStats(echoStats);
+        ui.setServoPower(pwm.getPowerStats());
+        ui.setSpectrum(spectrum, music.isActive());
+        ui.setLayers(mixer);
+        joystick.getReport(stickReport);
+        ui.setJoystick(stickReport);
+        ui.setThreads(threadStats, Realtime::report(threadStats, Realtime::MAX_THREADS), Realtime::memoryLocked());
+        ui.setAudioStats(audioStats, mouth.getAudio().getDeviceStats(audioStats, 4));
+
+        if (showUI && random.isActive()) {
             ui.update(neck.getServoPulse(), mouth.getServoPulse(), wings,
                       random.getActivityLevel(), curAIState);
-        } else {
+        } else if (showUI) {
             ui.update(neck.getServoPulse(), mouth.getServoPulse(), wings, curAIState);
         }
 
-        usleep(10000);
+        if (remote.clientCount() > 0) {
+            RemoteState state;
+            state.seq = ++remoteSeq;
+            state.timeMs = static_cast<uint32_t>(Session::nowMs());
+            state.aiState = static_cast<uint8_t>(curAIState);
+            state.flags = (random.isActive() ? REMOTE_RANDOM_ACTIVE : 0) |
+                          (wings.isReady() ? REMOTE_WINGS_READY : 0) |
+                          (aiAutoMode ? REMOTE_AI_AUTO : 0) |
+                          (mouth.isSpeaking() ? REMOTE_SPEAKING : 0) |
+                          (music.isActive() ? REMOTE_MUSIC_ACTIVE : 0);
+            state.neckUs = neck.getServoPulse();
+            state.mouthUs = static_cast<uint16_t>(mouth.getServoPulse());
+            state.activity = static_cast<uint8_t>(random.getActivityLevel());
+            // While the user talks, subscribers see the transcript grow
+            if (!ai.getPartialTranscript(transcript, sizeof(transcript)))
+                ai.getLastTranscript(transcript, sizeof(transcript));
+            remote.publish(state, transcript);
+        }
+
+        tick.end();
+        if (!player) Realtime::sleepUs(10000);
     }
 
     ui.shutdown();
+    remote.stop();
+    joystick.stop();
     ai.stop();
+    replayDevices.finish();
     mouth.stop();
+    behaviors.cancelAll();
+    mixer.park();
+    if (player) {
+        Session::endReplay();
+        if (servoOut) fclose(servoOut);
+        fprintf(stderr, "replayed %llu ticks\n", static_cast<unsigned long long>(player->ticks()));
+    }
+    Session::stop();
     return 0;
 }
\ No newline at end of file
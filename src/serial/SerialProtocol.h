@@ -0,0 +1,170 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Wire format between the Pi and the servo microcontroller on a serial port
+// (USB CDC or a UART). Each frame is COBS-encoded and ends in a zero byte,
+// so a receiver that starts mid-stream or loses bytes is back in step at the
+// next zero. Decoded, a frame is
+//
+//   u8 type, u8 seq, payload, u16 CRC-16/CCITT over type..payload
+//
+// with multi-byte fields little-endian. A frame that fails the CRC is
+// dropped and counted; nothing is retransmitted, since the next tick's
+// frame supersedes it.
+//
+//   Pi -> MCU
+//     SEGMENTS  n x { u8 channel, u16 target us (0 = output off),
+//                     u16 duration ms, u8 profile }
+//               Each glides from where the channel is now to the target,
+//               interpolated on the MCU at 1 kHz; duration 0, or an
+//               output that is off, jumps.
+//     PING      empty
+//   MCU -> Pi
+//     ACK       u8 seq of the frame, u16 frames rejected so far
+//
+// Header-only and free of the standard library beyond <cstdint>, so the
+// firmware can use it as is.
+
+enum SerialFrame : uint8_t {
+    SERIAL_SEGMENTS = 0x01,
+    SERIAL_PING     = 0x02,
+    SERIAL_ACK      = 0x81
+};
+
+enum SerialProfile : uint8_t {
+    SERIAL_PROFILE_LINEAR = 0,
+    SERIAL_PROFILE_EASE   = 1    // smoothstep: starts and stops gently
+};
+
+struct SerialSegment {
+    uint8_t channel;
+    uint16_t targetUs;
+    uint16_t durationMs;
+    uint8_t profile;
+};
+
+static constexpr size_t SERIAL_SEGMENT_BYTES = 6;
+static constexpr int    SERIAL_MAX_SEGMENTS  = 16;
+static constexpr size_t SERIAL_MAX_PAYLOAD   = SERIAL_MAX_SEGMENTS * SERIAL_SEGMENT_BYTES;
+static constexpr size_t SERIAL_MAX_DECODED   = 2 + SERIAL_MAX_PAYLOAD + 2;
+// COBS adds a byte per 254 and the delimiter ends the frame
+static constexpr size_t SERIAL_MAX_ENCODED   = SERIAL_MAX_DECODED + SERIAL_MAX_DECODED / 254 + 2;
+
+inline void serialPut16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+inline uint16_t serialGet16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+
+// CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF, no reflection
+inline uint16_t serialCrc16(const uint8_t* p, size_t n) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < n; i++) {
+        crc ^= static_cast<uint16_t>(p[i]) << 8;
+        for (int b = 0; b < 8; b++) crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+// COBS: no zero bytes in the output; returns its length
+inline size_t serialCobsEncode(const uint8_t* in, size_t n, uint8_t* out) {
+    size_t code = 0, o = 1;
+    uint8_t run = 1;
+    for (size_t i = 0; i < n; i++) {
+        if (in[i]) {
+            out[o++] = in[i];
+            run++;
+        }
+        if (!in[i] || run == 0xFF) {
+            out[code] = run;
+            code = o++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    return o;
+}
+
+// Returns the decoded length, 0 if the input isn't valid COBS
+inline size_t serialCobsDecode(const uint8_t* in, size_t n, uint8_t* out) {
+    size_t i = 0, o = 0;
+    while (i < n) {
+        uint8_t code = in[i++];
+        if (!code || i + code - 1 > n) return 0;
+        for (int k = 1; k < code; k++) out[o++] = in[i++];
+        if (code < 0xFF && i < n) out[o++] = 0;
+    }
+    return o;
+}
+
+// Whole frame ready to send, delimiter included; returns its length
+inline size_t serialEncodeFrame(uint8_t type, uint8_t seq, const uint8_t* payload, size_t len, uint8_t* out) {
+    uint8_t raw[SERIAL_MAX_DECODED];
+    if (len > SERIAL_MAX_PAYLOAD) return 0;
+    raw[0] = type;
+    raw[1] = seq;
+    for (size_t i = 0; i < len; i++) raw[2 + i] = payload[i];
+    serialPut16(raw + 2 + len, serialCrc16(raw, 2 + len));
+    size_t n = serialCobsEncode(raw, 4 + len, out);
+    out[n++] = 0;
+    return n;
+}
+
+inline void serialPutSegment(uint8_t* p, const SerialSegment& s) {
+    p[0] = s.channel;
+    serialPut16(p + 1, s.targetUs);
+    serialPut16(p + 3, s.durationMs);
+    p[5] = s.profile;
+}
+
+inline SerialSegment serialGetSegment(const uint8_t* p) {
+    SerialSegment s = { p[0], serialGet16(p + 1), serialGet16(p + 3), p[5] };
+    return s;
+}
+
+// Where a segment from `from` to `to` is after elapsedUs of durationUs
+inline uint16_t serialInterpolate(uint16_t from, uint16_t to, uint32_t elapsedUs, uint32_t durationUs,
+                                  uint8_t profile) {
+    if (elapsedUs >= durationUs) return to;
+    float t = static_cast<float>(elapsedUs) / durationUs;
+    if (profile == SERIAL_PROFILE_EASE) t = t * t * (3.0f - 2.0f * t);
+    return static_cast<uint16_t>(from + (static_cast<float>(to) - from) * t + 0.5f);
+}
+
+// Byte-at-a-time receiver with a fixed buffer: push() returns true when a
+// frame with a good CRC has arrived; it stays in type/seq/payload() until the
+// next push. Bad frames and overlong runs are counted in rejected.
+struct SerialDecoder {
+    uint8_t buf[SERIAL_MAX_ENCODED];
+    size_t fill;
+    bool overflow;
+    uint8_t raw[SERIAL_MAX_ENCODED];   // decoding never grows a frame
+    uint8_t type;
+    uint8_t seq;
+    size_t len;
+    uint32_t rejected;
+
+    SerialDecoder() : fill(0), overflow(false), type(0), seq(0), len(0), rejected(0) {}
+
+    const uint8_t* payload() const { return raw + 2; }
+
+    bool push(uint8_t byte) {
+        if (byte) {
+            if (fill < sizeof(buf)) buf[fill++] = byte;
+            else overflow = true;
+            return false;
+        }
+        size_t n = fill;
+        bool bad = overflow;
+        fill = 0;
+        overflow = false;
+        if (n == 0) return false;   // back-to-back delimiters
+        size_t m = bad ? 0 : serialCobsDecode(buf, n, raw);
+        if (m < 4 || m > SERIAL_MAX_DECODED || serialCrc16(raw, m - 2) != serialGet16(raw + m - 2)) {
+            rejected++;
+            return false;
+        }
+        type = raw[0];
+        seq = raw[1];
+        len = m - 4;
+        return true;
+    }
+};
@@ -0,0 +1,259 @@
+#include "SerialServo.h"
+#include "../trace/SessionLog.h"
+#include "../trace/Trace.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t baudConstant(int baud) {
+    switch (baud) {
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+    }
+    std::cerr << "Unsupported baud rate " << baud << ", using 115200" << std::endl;
+    return B115200;
+}
+
+SerialServo::SerialServo(const char* path, int baud)
+    : fd(-1), seq(0), idleEnabled(false), releaseMs(0), sleepMs(0), allReleasedMs(-1),
+      asleep(false), ackedSeq(0), anyAck(false), resync(false) {
+    memset(channels, 0, sizeof(channels));
+    memset(&power, 0, sizeof(power));
+    memset(&link, 0, sizeof(link));
+    memset(sentNs, 0, sizeof(sentNs));
+
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open servo port " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baudConstant(baud));
+        cfsetospeed(&tio, baudConstant(baud));
+        tio.c_cflag |= CLOCAL | CREAD;
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    tcflush(fd, TCIOFLUSH);
+}
+
+SerialServo::~SerialServo() {
+    if (fd >= 0) close(fd);
+}
+
+// Caller holds the lock. A frame the port can't take whole is dropped; if
+// part of it went out, the next frame starts with a delimiter so the MCU
+// discards the fragment instead of the next frame too.
+bool SerialServo::send(const SerialSegment* segments, int count) {
+    if (count <= 0) return false;
+    if (fd < 0) {
+        link.framesDropped++;
+        return false;
+    }
+    uint8_t payload[SERIAL_MAX_PAYLOAD];
+    uint8_t frame[1 + SERIAL_MAX_ENCODED];
+    if (count > SERIAL_MAX_SEGMENTS) count = SERIAL_MAX_SEGMENTS;
+    for (int i = 0; i < count; i++) serialPutSegment(payload + i * SERIAL_SEGMENT_BYTES, segments[i]);
+    size_t start = resync ? 1 : 0;
+    frame[0] = 0;
+    size_t n = start + serialEncodeFrame(SERIAL_SEGMENTS, seq, payload, count * SERIAL_SEGMENT_BYTES,
+                                         frame + start);
+
+    ssize_t w = write(fd, frame, n);
+    if (w != static_cast<ssize_t>(n)) {
+        link.framesDropped++;
+        resync = w > 0;
+        return false;
+    }
+    resync = false;
+    sentNs[seq] = Trace::nowNs();
+    seq++;
+    link.framesSent++;
+    link.bytesSent += n;
+    return true;
+}
+
+// Caller holds the lock. A channel that was off, or is held again after
+// idling, jumps; a moving one glides over the time since its last segment.
+SerialSegment SerialServo::segmentFor(uint8_t channel, long long now) {
+    Channel& c = channels[channel];
+    SerialSegment s;
+    s.channel = channel;
+    s.targetUs = c.off >= PWM_FULL_OFF ? 0 : countsToUs(c.off);
+    long long since = now - c.sentMs;
+    if (since < 0) since = 0;
+    if (since > MAX_SEGMENT_MS) since = MAX_SEGMENT_MS;
+    s.durationMs = static_cast<uint16_t>(since);
+    s.profile = SERIAL_PROFILE_LINEAR;
+    c.sentMs = now;
+    return s;
+}
+
+void SerialServo::setPWM(uint8_t channel, uint16_t on, uint16_t off) {
+    (void)on;   // the MCU starts every pulse at the top of the period
+    setFrame(&channel, &off, 1);
+}
+
+bool SerialServo::setFrame(const uint8_t* channelList, const uint16_t* offCounts, int count) {
+    TraceSpan span(TRACE_SERIAL_FRAME, count);
+    uint64_t startNs = Trace::nowNs();
+    std::lock_guard<std::mutex> g(lock);
+    long long now = Session::nowMs();
+    SerialSegment segments[PCA9685_CHANNELS];
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        uint8_t ch = channelList[i];
+        if (ch >= PCA9685_CHANNELS) continue;
+        Channel& c = channels[ch];
+        if (idleEnabled && c.used && !c.released && c.off == offCounts[i]) continue;
+        bool jump = !c.used || c.released;
+        c.used = true;
+        c.released = false;
+        c.off = offCounts[i];
+        c.changedMs = now;
+        Session::servo(ch, c.off);
+        if (jump) c.sentMs = now;
+        segments[n++] = segmentFor(ch, now);
+    }
+    if (n == 0) return false;
+    if (asleep) {
+        wake(startNs);
+        return true;
+    }
+    send(segments, n);
+    return true;
+}
+
+bool SerialServo::moveTo(uint8_t channel, uint16_t pulseUs, uint16_t durationMs, uint8_t profile) {
+    if (channel >= PCA9685_CHANNELS) return false;
+    uint64_t startNs = Trace::nowNs();
+    std::lock_guard<std::mutex> g(lock);
+    long long now = Session::nowMs();
+    Channel& c = channels[channel];
+    if (asleep) wake(startNs);
+    c.used = true;
+    c.released = false;
+    c.off = static_cast<uint16_t>((static_cast<uint32_t>(pulseUs) * 4096 + PERIOD_US / 2) / PERIOD_US);
+    // Not idle until the glide is over
+    c.changedMs = now + durationMs;
+    c.sentMs = now;
+    Session::servo(channel, c.off);
+    SerialSegment s = { channel, pulseUs, durationMs, profile };
+    return send(&s, 1);
+}
+
+void SerialServo::enableIdleRelease(long long release, long long sleep) {
+    std::lock_guard<std::mutex> g(lock);
+    idleEnabled = true;
+    releaseMs = release;
+    sleepMs = sleep;
+}
+
+void SerialServo::updateIdle() {
+    std::lock_guard<std::mutex> g(lock);
+    readAcks();
+    if (!idleEnabled || asleep) return;
+    long long now = Session::nowMs();
+    SerialSegment segments[PCA9685_CHANNELS];
+    int n = 0, held = 0, released = 0;
+    for (int ch = 0; ch < PCA9685_CHANNELS; ch++) {
+        Channel& c = channels[ch];
+        if (!c.used) continue;
+        if (!c.released && now - c.changedMs >= releaseMs) {
+            Session::servo(ch, PWM_FULL_OFF);
+            c.released = true;
+            SerialSegment s = { static_cast<uint8_t>(ch), 0, 0, SERIAL_PROFILE_LINEAR };
+            segments[n++] = s;
+        }
+        if (c.released) released++;
+        else held++;
+    }
+    send(segments, n);
+    power.held = held;
+    power.released = released;
+    if (held > 0 || released == 0) {
+        allReleasedMs = -1;
+        return;
+    }
+    // Every output is already off; asleep only means the next change has to
+    // bring them all back
+    if (allReleasedMs < 0) allReleasedMs = now;
+    if (now - allReleasedMs >= sleepMs) {
+        asleep = true;
+        power.asleep = true;
+    }
+}
+
+// Caller holds the lock. Every used channel jumps back to its last position
+// in one frame.
+void SerialServo::wake(uint64_t startNs) {
+    SerialSegment segments[PCA9685_CHANNELS];
+    int n = 0;
+    long long now = Session::nowMs();
+    for (int ch = 0; ch < PCA9685_CHANNELS; ch++) {
+        Channel& c = channels[ch];
+        if (!c.used) continue;
+        Session::servo(ch, c.off);
+        c.released = false;
+        c.changedMs = now;
+        c.sentMs = now;
+        segments[n++] = segmentFor(static_cast<uint8_t>(ch), now);
+    }
+    send(segments, n);
+    asleep = false;
+    allReleasedMs = -1;
+
+    unsigned int us = static_cast<unsigned int>((Trace::nowNs() - startNs) / 1000);
+    power.asleep = false;
+    power.wakes++;
+    power.lastWakeUs = us;
+    if (us > power.maxWakeUs) power.maxWakeUs = us;
+    if (us > PCA9685::WAKE_BUDGET_US) power.overBudget++;
+}
+
+// Caller holds the lock. Drains whatever the MCU has sent without waiting.
+void SerialServo::readAcks() {
+    if (fd < 0) return;
+    uint8_t buf[64];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (!rx.push(buf[i]) || rx.type != SERIAL_ACK || rx.len < 3) continue;
+            uint8_t s = rx.payload()[0];
+            // Acks come back in order, so a gap is frames the MCU never saw
+            if (anyAck) {
+                uint8_t gap = static_cast<uint8_t>(s - ackedSeq - 1);
+                if (gap < 128) link.lost += gap;
+            }
+            ackedSeq = s;
+            anyAck = true;
+            link.acks++;
+            link.deviceRejected = serialGet16(rx.payload() + 1);
+            link.lastAckUs = static_cast<uint32_t>((Trace::nowNs() - sentNs[s]) / 1000);
+            Trace::instant(TRACE_SERIAL_ACK, static_cast<int16_t>(s));
+        }
+    }
+    link.rxRejected = rx.rejected;
+}
+
+PwmPowerStats SerialServo::getPowerStats() {
+    std::lock_guard<std::mutex> g(lock);
+    return power;
+}
+
+SerialLinkStats SerialServo::getLinkStats() {
+    std::lock_guard<std::mutex> g(lock);
+    return link;
+}
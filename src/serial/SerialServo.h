@@ -0,0 +1,93 @@
+#pragma once
+#include "../i2c/PCA9685.h"
+#include "SerialProtocol.h"
+#include <mutex>
+
+// Servo outputs on a microcontroller behind a serial port, in place of the
+// PCA9685. Instead of writing every eased step over I2C, each frame becomes
+// one SEGMENTS message: every changed channel glides to its new position
+// over the time since its last one, so the MCU's 1 kHz interpolation lands
+// on it as the next frame arrives. Motion is continuous rather than 10 ms
+// stairs, one tick behind the mixer, and the Pi writes about 30 bytes per
+// tick without waiting on a bus.
+//
+// Writes never block: a frame that doesn't fit in the port's buffer is
+// dropped and counted, and the next one carries the newer positions.
+// Acknowledgements are read without blocking in updateIdle(), once a tick.
+
+struct SerialLinkStats {
+    uint32_t framesSent;
+    uint32_t bytesSent;
+    uint32_t framesDropped;    // the port's buffer was full
+    uint32_t acks;
+    uint32_t lost;             // sent but never acknowledged
+    uint32_t deviceRejected;   // frames the MCU failed CRC on
+    uint32_t rxRejected;       // its replies we failed CRC on
+    uint32_t lastAckUs;        // send to reading the newest ack, so up to a tick late
+};
+
+class SerialServo : public ServoDriver {
+public:
+    // Opens the port raw at baud (ignored by USB CDC); isOpen() is false if
+    // that failed, and every write is then dropped
+    explicit SerialServo(const char* path, int baud = DEFAULT_BAUD);
+    ~SerialServo();
+
+    bool isOpen() const { return fd >= 0; }
+
+    void setPWM(uint8_t channel, uint16_t on, uint16_t off);
+    bool setFrame(const uint8_t* channelList, const uint16_t* offCounts, int count);
+    // One longer glide from where the channel is, shaped by profile
+    bool moveTo(uint8_t channel, uint16_t pulseUs, uint16_t durationMs,
+                uint8_t profile = SERIAL_PROFILE_EASE);
+
+    void enableIdleRelease(long long releaseMs, long long sleepMs);
+    void updateIdle();
+    PwmPowerStats getPowerStats();
+    SerialLinkStats getLinkStats();
+
+    // Off counts at 50 Hz to the pulse width the MCU generates
+    static uint16_t countsToUs(uint16_t counts) {
+        return static_cast<uint16_t>((static_cast<uint32_t>(counts) * PERIOD_US + 2048) / 4096);
+    }
+
+    static constexpr int      DEFAULT_BAUD   = 115200;
+    static constexpr uint32_t PERIOD_US      = 20000;
+    // A channel idle longer than this glides no slower than this
+    static constexpr uint16_t MAX_SEGMENT_MS = 50;
+
+private:
+    struct Channel {
+        bool used;
+        bool released;
+        uint16_t off;
+        long long changedMs;
+        long long sentMs;
+    };
+
+    int fd;
+    uint8_t seq;
+    std::mutex lock;
+    Channel channels[PCA9685_CHANNELS];
+    bool idleEnabled;
+    long long releaseMs;
+    long long sleepMs;
+    long long allReleasedMs;   // -1 while any channel is held
+    bool asleep;
+    PwmPowerStats power;
+
+    SerialLinkStats link;
+    uint64_t sentNs[256];      // by seq, for acknowledgement latency
+    uint8_t ackedSeq;
+    bool anyAck;
+    bool resync;               // the last write went out partly
+    SerialDecoder rx;
+
+    bool send(const SerialSegment* segments, int count);
+    SerialSegment segmentFor(uint8_t channel, long long now);
+    void wake(uint64_t startNs);
+    void readAcks();
+
+    SerialServo(const SerialServo&) = delete;
+    SerialServo& operator=(const SerialServo&) = delete;
+};
@@ -0,0 +1,324 @@
+#include "Realtime.h"
+#include "Trace.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+struct RoleConfig {
+    const char* name;
+    uint32_t cpus;     // bit per CPU
+    bool fifo;
+    int priority;      // FIFO priority, or nice
+};
+
+static RoleConfig roles[ROLE_COUNT] = {
+    { "main",        1u << 3, true,  50 },
+    { "audio",       1u << 2, true,  80 },
+    { "audio-out",   1u << 2, true,  75 },
+    { "remote",      1u << 3, true,  40 },
+    { "input",       1u << 3, true,  40 },
+    { "ai-reader",   1u << 3, false, 0  },
+    { "session-log", 0x3,     false, 5  },
+    { "ai-backend",  0x3,     false, 10 },
+};
+
+struct Slot {
+    std::atomic<bool> alive;
+    char name[16];
+    int tid;
+    bool fifo;
+    int priority;
+    // Written by the owning thread
+    std::atomic<uint32_t> wakes;
+    std::atomic<uint32_t> windowWakes;
+    std::atomic<uint64_t> windowNs;
+    std::atomic<uint64_t> maxNs;
+    // Main thread (report) only
+    unsigned long long lastTicks;
+    int cpu;
+    float cpuPct;
+    float wakeAvgUs;
+};
+
+static Slot slots[Realtime::MAX_THREADS];
+static int slotCount = 0;
+static std::mutex slotLock;
+static std::atomic<bool> enabled(false);
+static bool locked = false;
+static uint64_t lastReportNs = 0;
+
+// Frees the slot for reuse when its thread exits
+struct SlotOwner {
+    Slot* slot;
+    SlotOwner() : slot(nullptr) {}
+    ~SlotOwner() { if (slot) slot->alive.store(false); }
+};
+
+static thread_local SlotOwner owner;
+
+static void prefaultStack() {
+    char stack[Realtime::STACK_PREFAULT];
+    for (int i = 0; i < Realtime::STACK_PREFAULT; i += 4096) stack[i] = 0;
+    // Keep the touches from being optimised away
+    __asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+static cpu_set_t cpuSet(ThreadRole role) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long i = 0; i < online && i < 32; i++)
+        if (roles[role].cpus & (1u << i)) CPU_SET(i, &set);
+    // None of its CPUs exist on this board: run anywhere
+    if (CPU_COUNT(&set) == 0)
+        for (long i = 0; i < online; i++) CPU_SET(i, &set);
+    return set;
+}
+
+// Affinity and policy for the calling thread; false if FIFO was refused
+static bool apply(ThreadRole role) {
+    const RoleConfig& r = roles[role];
+    cpu_set_t set = cpuSet(role);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        fprintf(stderr, "realtime: %s: cannot set CPU affinity: %s\n", r.name, strerror(errno));
+
+    struct sched_param param;
+    if (r.fifo) {
+        param.sched_priority = r.priority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) return true;
+        fprintf(stderr, "realtime: %s: SCHED_FIFO %d refused, staying SCHED_OTHER\n", r.name, r.priority);
+    }
+    // Threads inherit the creator's policy, so drop any FIFO explicitly
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), r.fifo ? 0 : r.priority);
+    return !r.fifo;
+}
+
+static bool parseCpus(const std::string& text, uint32_t& out) {
+    if (text == "all") { out = 0xffffffffu; return true; }
+    out = 0;
+    std::istringstream parts(text);
+    std::string part;
+    while (std::getline(parts, part, ',')) {
+        int lo, hi;
+        if (sscanf(part.c_str(), "%d-%d", &lo, &hi) != 2) {
+            if (sscanf(part.c_str(), "%d", &lo) != 1) return false;
+            hi = lo;
+        }
+        if (lo < 0 || hi > 31 || lo > hi) return false;
+        for (int c = lo; c <= hi; c++) out |= 1u << c;
+    }
+    return out != 0;
+}
+
+bool Realtime::configure(const char* path) {
+    std::ifstream f(path);
+    if (!f) return false;
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(f, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+
+        std::istringstream tokens(line);
+        std::string name;
+        if (!(tokens >> name)) continue;
+        int role = 0;
+        while (role < ROLE_COUNT && name != roles[role].name) role++;
+        if (role == ROLE_COUNT) {
+            std::cerr << "threads config line " << lineNo << ": unknown role " << name << std::endl;
+            continue;
+        }
+        RoleConfig& r = roles[role];
+        std::string kv;
+        while (tokens >> kv) {
+            size_t eq = kv.find('=');
+            if (eq == std::string::npos) continue;
+            std::string key = kv.substr(0, eq), value = kv.substr(eq + 1);
+            if (key == "cpus" && !parseCpus(value, r.cpus))
+                std::cerr << "threads config line " << lineNo << ": bad cpus " << value << std::endl;
+            else if (key == "policy")   r.fifo = value == "fifo";
+            else if (key == "priority") r.priority = atoi(value.c_str());
+        }
+        if (r.fifo && (r.priority < 1 || r.priority > 99)) {
+            std::cerr << "threads config line " << lineNo << ": FIFO priority must be 1-99" << std::endl;
+            r.priority = r.priority < 1 ? 1 : 99;
+        }
+    }
+    return true;
+}
+
+void Realtime::setEnabled(bool on) { enabled = on; }
+
+bool Realtime::lockMemory() {
+    struct rlimit lim;
+    if (geteuid() != 0 && (getrlimit(RLIMIT_MEMLOCK, &lim) != 0 || lim.rlim_cur != RLIM_INFINITY)) {
+        // A finite limit would make later allocations fail once reached
+        fprintf(stderr, "realtime: memory not locked, memlock limit is not unlimited\n");
+        return false;
+    }
+    mallopt(M_TRIM_THRESHOLD, -1);   // freed heap stays mapped (and locked)
+    mallopt(M_MMAP_MAX, 0);          // large blocks come from the locked heap too
+    int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+    int rc = mlockall(flags | MCL_ONFAULT);
+    if (rc != 0 && errno == EINVAL) rc = mlockall(flags);   // kernel before 4.4
+#else
+    int rc = mlockall(flags);
+#endif
+    if (rc != 0) {
+        fprintf(stderr, "realtime: mlockall failed: %s\n", strerror(errno));
+        return false;
+    }
+    locked = true;
+    prefaultStack();
+    return true;
+}
+
+bool Realtime::memoryLocked() { return locked; }
+
+void Realtime::enter(ThreadRole role, const char* name) {
+    prefaultStack();
+    if (!name) name = roles[role].name;
+
+    Slot* slot = nullptr;
+    {
+        std::lock_guard<std::mutex> g(slotLock);
+        for (int i = 0; i < slotCount && !slot; i++)
+            if (!slots[i].alive.load() && strcmp(slots[i].name, name) == 0) slot = &slots[i];
+        if (!slot && slotCount < MAX_THREADS) slot = &slots[slotCount++];
+        if (!slot) return;
+        strncpy(slot->name, name, sizeof(slot->name) - 1);
+        slot->name[sizeof(slot->name) - 1] = '\0';
+        slot->tid = static_cast<int>(syscall(SYS_gettid));
+        slot->wakes = 0;
+        slot->windowWakes = 0;
+        slot->windowNs = 0;
+        slot->maxNs = 0;
+        slot->lastTicks = 0;
+        slot->cpu = -1;
+        slot->cpuPct = 0.0f;
+        slot->wakeAvgUs = 0.0f;
+        slot->alive = true;
+    }
+    owner.slot = slot;
+
+    bool fifo = enabled && apply(role) && roles[role].fifo;
+    slot->fifo = fifo;
+    slot->priority = fifo ? roles[role].priority
+                          : getpriority(PRIO_PROCESS, static_cast<id_t>(slot->tid));
+}
+
+void Realtime::enterProcess(ThreadRole role) {
+    if (!enabled) return;
+    apply(role);
+}
+
+int Realtime::cpuCount(ThreadRole role) {
+    cpu_set_t set = cpuSet(role);
+    return CPU_COUNT(&set);
+}
+
+void Realtime::wake(uint64_t lateNs) {
+    Slot* s = owner.slot;
+    if (!s) return;
+    s->wakes.fetch_add(1, std::memory_order_relaxed);
+    s->windowWakes.fetch_add(1, std::memory_order_relaxed);
+    s->windowNs.fetch_add(lateNs, std::memory_order_relaxed);
+    if (lateNs > s->maxNs.load(std::memory_order_relaxed)) s->maxNs.store(lateNs, std::memory_order_relaxed);
+}
+
+void Realtime::sleepUs(unsigned int us) {
+    uint64_t due = Trace::nowNs() + us * 1000ULL;
+    usleep(us);
+    uint64_t now = Trace::nowNs();
+    wake(now > due ? now - due : 0);
+}
+
+// utime + stime and the last CPU from /proc/self/task/<tid>/stat, without
+// allocating (the UI calls this from the loop)
+static bool readTaskStat(int tid, unsigned long long& ticks, int& cpu) {
+    char path[48], text[512];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    ssize_t n = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (n <= 0) return false;
+    text[n] = '\0';
+    // Fields after the parenthesised name start at 3 (state); utime is 14,
+    // stime 15 and processor 39
+    const char* p = strrchr(text, ')');
+    if (!p) return false;
+    p += 2;
+    unsigned long long utime = 0, stime = 0;
+    for (int field = 3; field <= 39 && *p; field++) {
+        if (field == 14) utime = strtoull(p, nullptr, 10);
+        else if (field == 15) stime = strtoull(p, nullptr, 10);
+        else if (field == 39) cpu = atoi(p);
+        p = strchr(p, ' ');
+        if (!p) break;
+        p++;
+    }
+    ticks = utime + stime;
+    return true;
+}
+
+int Realtime::report(ThreadStats* out, int max) {
+    uint64_t now = Trace::nowNs();
+    bool refresh = now - lastReportNs >= REPORT_MS * 1000000ULL;
+    double seconds = (now - lastReportNs) / 1e9;
+    static const long TICKS_PER_SEC = sysconf(_SC_CLK_TCK);
+
+    int n = 0;
+    int count;
+    {
+        std::lock_guard<std::mutex> g(slotLock);
+        count = slotCount;
+    }
+    for (int i = 0; i < count && n < max; i++) {
+        Slot& s = slots[i];
+        if (!s.alive.load()) continue;
+        if (refresh) {
+            unsigned long long ticks;
+            int cpu = s.cpu;
+            if (readTaskStat(s.tid, ticks, cpu)) {
+                if (s.lastTicks && lastReportNs)
+                    s.cpuPct = static_cast<float>((ticks - s.lastTicks) * 100.0 / TICKS_PER_SEC / seconds);
+                s.lastTicks = ticks;
+                s.cpu = cpu;
+            }
+            uint32_t w = s.windowWakes.exchange(0);
+            uint64_t ns = s.windowNs.exchange(0);
+            s.wakeAvgUs = w ? ns / 1000.0f / w : 0.0f;
+        }
+        ThreadStats& t = out[n++];
+        memcpy(t.name, s.name, sizeof(t.name));
+        t.cpu = s.cpu;
+        t.fifo = s.fifo;
+        t.priority = s.priority;
+        t.cpuPct = s.cpuPct;
+        t.wakes = s.wakes.load();
+        t.wakeAvgUs = s.wakeAvgUs;
+        t.wakeMaxUs = s.maxNs.load() / 1000.0f;
+    }
+    if (refresh) lastReportNs = now;
+    return n;
+}
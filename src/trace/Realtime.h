@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+
+// Where the long-lived threads run. Each thread names its role when it
+// starts; the role sets its CPUs, scheduling policy and priority, from
+// src/trace/threads.conf or the built-in defaults for a 4-core Pi:
+//
+//   audio, audio-out   SCHED_FIFO 80/75 on core 2 (capture, DSP, playback)
+//   main, remote       SCHED_FIFO 50/40 on core 3 (servo loop, show control)
+//   ai-reader          normal priority on core 3
+//   session-log        nice 5 on cores 0-1
+//   ai-backend         taro_ai.py and everything it runs, nice 10 on cores
+//                      0-1; llama-server and whisper get one thread per core
+//
+// Nothing is changed until setEnabled(true), which only live runs do, so
+// tests, benches and replays keep default scheduling but still get stats.
+// A policy the kernel refuses (no rtprio limit or CAP_SYS_NICE) falls back
+// to SCHED_OTHER, which the stats show.
+
+enum ThreadRole : uint8_t {
+    ROLE_MAIN,
+    ROLE_AUDIO,
+    ROLE_AUDIO_OUT,
+    ROLE_REMOTE,
+    ROLE_INPUT,
+    ROLE_AI_READER,
+    ROLE_SESSION_LOG,
+    ROLE_AI_BACKEND,
+    ROLE_COUNT
+};
+
+struct ThreadStats {
+    char name[16];
+    int cpu;            // CPU it last ran on
+    bool fifo;          // running SCHED_FIFO
+    int priority;       // FIFO priority, or nice
+    float cpuPct;       // of one core, over the last report interval
+    uint32_t wakes;
+    float wakeAvgUs;    // past the intended wakeup, over the last interval
+    float wakeMaxUs;    // since start
+};
+
+namespace Realtime {
+    // Replace the defaults for the roles the file names. Lines look like
+    //   audio  cpus=2 policy=fifo priority=80
+    // Returns false if the file can't be read.
+    bool configure(const char* path);
+    void setEnabled(bool on);
+
+    // Lock current and future memory (pages lock as they fault in, so idle
+    // thread stacks don't pin 8 MB each), keep freed heap in the process,
+    // and prefault this thread's stack. Skipped unless the memlock limit is
+    // unlimited or we are root; returns whether memory is locked.
+    bool lockMemory();
+    bool memoryLocked();
+
+    // The calling thread takes on the role and prefaults its stack; name
+    // tells apart threads that share a role
+    void enter(ThreadRole role, const char* name = nullptr);
+    // In a forked child before exec: the process and all it starts
+    void enterProcess(ThreadRole role);
+    // CPUs the role may use, at least 1
+    int cpuCount(ThreadRole role);
+
+    // Sleep like usleep(), recording how late the thread woke
+    void sleepUs(unsigned int us);
+    // For threads woken by something else: lateness already measured
+    void wake(uint64_t lateNs);
+
+    // Every registered thread; main thread only. CPU figures refresh at
+    // most once per REPORT_MS.
+    int report(ThreadStats* out, int max);
+
+    static constexpr int MAX_THREADS     = 16;
+    static constexpr int STACK_PREFAULT  = 64 * 1024;
+    static constexpr int REPORT_MS       = 1000;
+}
@@ -0,0 +1,345 @@
+#include "SessionLog.h"
+#include "Realtime.h"
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static constexpr uint32_t SESSION_VERSION   = 1;
+static constexpr int      FLUSH_INTERVAL_MS = 100;
+static constexpr size_t   FLUSH_BYTES       = 64 * 1024;
+
+std::atomic<bool> Session::recordingFlag(false);
+std::atomic<bool> Session::replayFlag(false);
+std::atomic<uint64_t> Session::replayNs(0);
+
+// Recording state. Producers (main, audio and AI reader threads) append to
+// pending under the lock; the writer thread swaps it out and writes it.
+static std::mutex logLock;
+static std::condition_variable logWake;
+static std::vector<uint8_t> pending;
+static std::thread writer;
+static int logFd = -1;
+static bool writerStop = false;
+static uint64_t startNs = 0;
+static uint64_t lastUs = 0;
+
+static FILE* servoOut = nullptr;
+static std::mutex servoLock;
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+static void put32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Caller holds logLock. The timestamp is taken under the lock so deltas
+// never go backwards across threads.
+static void appendLocked(SessionEvent type, const uint8_t* payload, size_t len) {
+    uint64_t us = (Trace::nowNs() - startNs) / 1000;
+    pending.push_back(static_cast<uint8_t>(type));
+    putVarint(pending, us - lastUs);
+    putVarint(pending, len);
+    pending.insert(pending.end(), payload, payload + len);
+    lastUs = us;
+    if (pending.size() >= FLUSH_BYTES) logWake.notify_one();
+}
+
+static void append(SessionEvent type, const uint8_t* payload, size_t len) {
+    std::lock_guard<std::mutex> g(logLock);
+    if (logFd >= 0) appendLocked(type, payload, len);
+}
+
+static void writeAll(const std::vector<uint8_t>& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = ::write(logFd, data.data() + off, data.size() - off);
+        if (n <= 0) return;
+        off += n;
+    }
+}
+
+static void writerLoop() {
+    Trace::setThreadName("session-log");
+    Realtime::enter(ROLE_SESSION_LOG);
+    std::vector<uint8_t> out;
+    std::unique_lock<std::mutex> lock(logLock);
+    while (true) {
+        logWake.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+        bool last = writerStop;
+        out.swap(pending);
+        lock.unlock();
+        writeAll(out);
+        out.clear();
+        lock.lock();
+        if (last) return;
+    }
+}
+
+bool Session::start(const char* path, unsigned int sampleRate, int blockFrames) {
+    if (recording()) return false;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return false;
+
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    std::vector<uint8_t> header(4);
+    memcpy(header.data(), "TSL1", 4);
+    put32(header, SESSION_VERSION);
+    put32(header, sampleRate);
+    put32(header, static_cast<uint32_t>(blockFrames));
+    uint64_t wall = static_cast<uint64_t>(tv.tv_sec) * 1000000000ULL + tv.tv_usec * 1000ULL;
+    put32(header, static_cast<uint32_t>(wall));
+    put32(header, static_cast<uint32_t>(wall >> 32));
+
+    std::lock_guard<std::mutex> g(logLock);
+    logFd = fd;
+    writeAll(header);
+    pending.clear();
+    startNs = Trace::nowNs();
+    lastUs = 0;
+    writerStop = false;
+    writer = std::thread(writerLoop);
+    recordingFlag = true;
+    return true;
+}
+
+void Session::stop() {
+    if (!recording()) return;
+    recordingFlag = false;
+    {
+        std::lock_guard<std::mutex> g(logLock);
+        writerStop = true;
+    }
+    logWake.notify_one();
+    writer.join();
+    std::lock_guard<std::mutex> g(logLock);
+    close(logFd);
+    logFd = -1;
+}
+
+void Session::tick() {
+    if (recording()) append(SessionEvent::TICK, nullptr, 0);
+}
+
+void Session::key(char c) {
+    if (recording()) append(SessionEvent::KEY, reinterpret_cast<const uint8_t*>(&c), 1);
+}
+
+void Session::ai(const char* data, size_t len) {
+    if (recording()) append(SessionEvent::AI, reinterpret_cast<const uint8_t*>(data), len);
+}
+
+void Session::seed(uint32_t value) {
+    if (!recording()) return;
+    std::vector<uint8_t> p;
+    put32(p, value);
+    append(SessionEvent::SEED, p.data(), p.size());
+}
+
+void Session::audio(const short* samples, int frames) {
+    if (!recording()) return;
+    // Encoded outside the lock; varints of zigzagged sample deltas
+    thread_local std::vector<uint8_t> p;
+    p.clear();
+    putVarint(p, static_cast<uint64_t>(frames));
+    int prev = 0;
+    for (int i = 0; i < frames; i++) {
+        int d = samples[i] - prev;
+        prev = samples[i];
+        putVarint(p, (static_cast<uint32_t>(d) << 1) ^ static_cast<uint32_t>(d >> 31));
+    }
+    append(SessionEvent::AUDIO, p.data(), p.size());
+}
+
+void Session::servo(uint8_t channel, uint16_t off) {
+    if (replaying()) {
+        std::lock_guard<std::mutex> g(servoLock);
+        if (servoOut) fprintf(servoOut, "%.3f servo %u %u\n", replayNs.load() / 1e6, channel, off);
+        return;
+    }
+    if (!recording()) return;
+    uint8_t p[3] = { channel, static_cast<uint8_t>(off), static_cast<uint8_t>(off >> 8) };
+    append(SessionEvent::SERVO, p, sizeof(p));
+}
+
+void Session::setpoint(uint8_t joint, uint16_t value) {
+    if (!recording()) return;
+    uint8_t p[3] = { joint, static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) };
+    append(SessionEvent::SETPOINT, p, sizeof(p));
+}
+
+void Session::stick(uint8_t joint, uint16_t value) {
+    if (!recording()) return;
+    uint8_t p[3] = { joint, static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8) };
+    append(SessionEvent::STICK, p, sizeof(p));
+}
+
+void Session::beginReplay(FILE* out) {
+    std::lock_guard<std::mutex> g(servoLock);
+    servoOut = out;
+    replayNs = 0;
+    replayFlag = true;
+}
+
+void Session::endReplay() {
+    std::lock_guard<std::mutex> g(servoLock);
+    replayFlag = false;
+    if (servoOut) fflush(servoOut);
+    servoOut = nullptr;
+}
+
+void Session::sleepUs(unsigned int us) {
+    // Replay time only moves with the log
+    if (!replaying()) usleep(us);
+}
+
+bool Session::decodeAudio(const SessionRecord& rec, std::vector<short>& out) {
+    const uint8_t* p = rec.data.data();
+    const uint8_t* end = p + rec.data.size();
+    uint64_t frames, z;
+    if (rec.type != SessionEvent::AUDIO || !getVarint(p, end, frames)) return false;
+    out.resize(frames);
+    int prev = 0;
+    for (uint64_t i = 0; i < frames; i++) {
+        if (!getVarint(p, end, z)) return false;
+        int d = static_cast<int>(z >> 1) ^ -static_cast<int>(z & 1);
+        prev += d;
+        out[i] = static_cast<short>(prev);
+    }
+    return true;
+}
+
+void Session::print(FILE* out, const SessionRecord& rec) {
+    double ms = rec.tNs / 1e6;
+    const std::vector<uint8_t>& d = rec.data;
+    switch (rec.type) {
+        case SessionEvent::TICK:
+            fprintf(out, "%.3f tick\n", ms);
+            break;
+        case SessionEvent::KEY:
+            if (d.size() == 1) fprintf(out, "%.3f key %d\n", ms, d[0]);
+            break;
+        case SessionEvent::AUDIO: {
+            std::vector<short> pcm;
+            long long sum = 0;
+            if (decodeAudio(rec, pcm))
+                for (size_t i = 0; i < pcm.size(); i++) sum += pcm[i] < 0 ? -pcm[i] : pcm[i];
+            fprintf(out, "%.3f audio %zu mean %lld\n", ms, pcm.size(),
+                    pcm.empty() ? 0LL : sum / static_cast<long long>(pcm.size()));
+            break;
+        }
+        case SessionEvent::AI:
+            fprintf(out, "%.3f ai %.*s\n", ms, static_cast<int>(d.size()), d.data());
+            break;
+        case SessionEvent::SEED:
+            if (d.size() == 4) fprintf(out, "%.3f seed %u\n", ms, get32(d.data()));
+            break;
+        case SessionEvent::SERVO:
+            if (d.size() == 3) fprintf(out, "%.3f servo %u %u\n", ms, d[0], d[1] | (d[2] << 8));
+            break;
+        case SessionEvent::SETPOINT:
+            if (d.size() == 3) fprintf(out, "%.3f setpoint %u %u\n", ms, d[0], d[1] | (d[2] << 8));
+            break;
+        case SessionEvent::STICK:
+            if (d.size() == 3) fprintf(out, "%.3f stick %u %u\n", ms, d[0], d[1] | (d[2] << 8));
+            break;
+    }
+}
+
+SessionReader::SessionReader()
+    : file(nullptr), rate(0), frames(0), lastUs(0), haveAhead(false) {}
+
+SessionReader::~SessionReader() {
+    if (file) fclose(file);
+}
+
+bool SessionReader::open(const char* path) {
+    file = fopen(path, "rb");
+    if (!file) return false;
+    uint8_t header[24];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, "TSL1", 4) != 0 || get32(header + 4) != SESSION_VERSION) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    rate = get32(header + 8);
+    frames = static_cast<int>(get32(header + 12));
+    return true;
+}
+
+bool SessionReader::read(SessionRecord& out) {
+    if (!file) return false;
+    int type = fgetc(file);
+    if (type == EOF) return false;
+
+    // Varints straight from the file; a truncated tail ends the log
+    uint64_t v[2];
+    for (int k = 0; k < 2; k++) {
+        v[k] = 0;
+        for (int shift = 0;; shift += 7) {
+            int b = fgetc(file);
+            if (b == EOF || shift >= 64) return false;
+            v[k] |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+    }
+    out.type = static_cast<SessionEvent>(type);
+    lastUs += v[0];
+    out.tNs = lastUs * 1000;
+    out.data.resize(v[1]);
+    return v[1] == 0 || fread(out.data.data(), 1, v[1], file) == v[1];
+}
+
+bool SessionReader::next(SessionRecord& out) {
+    if (haveAhead) {
+        out.type = ahead.type;
+        out.tNs = ahead.tNs;
+        out.data.swap(ahead.data);
+        haveAhead = false;
+        return true;
+    }
+    return read(out);
+}
+
+const SessionRecord* SessionReader::peek() {
+    if (!haveAhead) haveAhead = read(ahead);
+    return haveAhead ? &ahead : nullptr;
+}
+
+bool SessionReader::findSeed(const char* path, uint32_t& seed) {
+    SessionReader r;
+    if (!r.open(path)) return false;
+    SessionRecord rec;
+    while (r.next(rec)) {
+        if (rec.type == SessionEvent::SEED && rec.data.size() == 4) {
+            seed = get32(rec.data.data());
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "Trace.h"
+
+// Session recorder. Every input that drives the control code is appended
+// to a compact binary log with monotonic timestamps, so a bad moment at an
+// event can be replayed later against stub hardware:
+//
+//   "TSL1" u32 version, u32 sample rate, u32 block frames, u64 wall clock ns
+//   then records: u8 type, varint us since the previous record,
+//                 varint payload length, payload
+//
+// Audio blocks are stored as zigzag varint deltas (quiet rooms cost about
+// a byte a sample). Servo commands are outputs, logged only so a live
+// session can be diffed against its replay.
+//
+// Control code reads time through Session::nowNs()/nowMs() and sleeps
+// through Session::sleepUs(); during replay these follow the log's timeline
+// instead of the wall clock, which is what makes a fast replay deterministic.
+
+enum class SessionEvent : uint8_t {
+    TICK = 1,   // main loop iteration
+    KEY,        // one stdin byte
+    AUDIO,      // one capture block
+    AI,         // bytes read from the Python backend
+    SEED,       // u32 PRNG seed
+    SERVO,      // u8 channel, u16 PWM off count
+    SETPOINT,   // u8 joint, u16 value from the remote socket
+    STICK       // u8 joint, u16 pulse (0 = released) from a joystick axis
+};
+
+struct SessionRecord {
+    SessionEvent type;
+    uint64_t tNs;                 // since the start of the recording
+    std::vector<uint8_t> data;
+};
+
+namespace Session {
+    extern std::atomic<bool> recordingFlag;
+    extern std::atomic<bool> replayFlag;
+    extern std::atomic<uint64_t> replayNs;
+
+    inline bool recording() { return recordingFlag.load(std::memory_order_relaxed); }
+    inline bool replaying() { return replayFlag.load(std::memory_order_relaxed); }
+
+    // Record to path until stop(); a writer thread does the file I/O
+    bool start(const char* path, unsigned int sampleRate, int blockFrames);
+    void stop();
+
+    void tick();
+    void key(char c);
+    void audio(const short* samples, int frames);
+    void ai(const char* data, size_t len);
+    void seed(uint32_t value);
+    void servo(uint8_t channel, uint16_t off);
+    void setpoint(uint8_t joint, uint16_t value);
+    void stick(uint8_t joint, uint16_t value);
+
+    // Replay: time comes from the log; servo commands go to out as text
+    void beginReplay(FILE* servoOut);
+    inline void setReplayTime(uint64_t ns) { replayNs.store(ns); }
+    void endReplay();
+
+    inline uint64_t nowNs() { return replaying() ? replayNs.load() : Trace::nowNs(); }
+    inline long long nowMs() { return static_cast<long long>(nowNs() / 1000000); }
+    void sleepUs(unsigned int us);
+
+    bool decodeAudio(const SessionRecord& rec, std::vector<short>& out);
+    // One line per record, servo lines in the same form replay writes
+    void print(FILE* out, const SessionRecord& rec);
+}
+
+// Sequential reader with one record of lookahead
+class SessionReader {
+public:
+    SessionReader();
+    ~SessionReader();
+
+    bool open(const char* path);
+    bool next(SessionRecord& out);
+    const SessionRecord* peek();
+
+    unsigned int sampleRate() const { return rate; }
+    int blockFrames() const { return frames; }
+
+    // First SEED in the log (scans from the start), false if none
+    static bool findSeed(const char* path, uint32_t& seed);
+
+private:
+    FILE* file;
+    unsigned int rate;
+    int frames;
+    uint64_t lastUs;
+    SessionRecord ahead;
+    bool haveAhead;
+
+    bool read(SessionRecord& out);
+
+    SessionReader(const SessionReader&) = delete;
+    SessionReader& operator=(const SessionReader&) = delete;
+};
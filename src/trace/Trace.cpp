@@ -0,0 +1,164 @@
+#include "Trace.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+static const char* const TRACE_NAMES[TRACE_NAME_COUNT] = {
+    "loop.tick",
+    "ui.draw",
+    "audio.read",
+    "audio.block",
+    "audio.dsp",
+    "audio.write",
+    "audio.switch",
+    "audio.xrun",
+    "audio.spectrum",
+    "audio.echo",
+    "audio.barge_in",
+    "mouth.frame",
+    "mouth.set",
+    "i2c.pwm",
+    "i2c.freq",
+    "i2c.wake",
+    "i2c.frame",
+    "serial.frame",
+    "serial.ack",
+    "anim.mix",
+    "ai.message",
+    "key",
+};
+
+static constexpr int      MAX_RINGS     = 16;
+static constexpr uint64_t RING_CAPACITY = 16384;  // power of two, 256 KB per thread
+
+struct ThreadRing {
+    std::atomic<uint64_t> head;
+    std::atomic<bool> inUse;
+    int tid;
+    char name[32];
+    TraceEvent events[RING_CAPACITY];
+};
+
+static ThreadRing* rings[MAX_RINGS];
+static std::atomic<int> ringCount(0);
+static std::mutex registryLock;
+static std::atomic<uint64_t> sessionStartNs(0);
+
+std::atomic<bool> Trace::enabledFlag(false);
+
+// Returns the calling thread's ring to the pool when the thread exits, so a
+// restarted worker with the same name continues on the same timeline.
+struct RingOwner {
+    ThreadRing* ring;
+    RingOwner() : ring(nullptr) {}
+    ~RingOwner() { if (ring) ring->inUse.store(false); }
+};
+
+static thread_local RingOwner owner;
+
+static ThreadRing* acquireRing(const char* name) {
+    std::lock_guard<std::mutex> lock(registryLock);
+    int n = ringCount.load();
+    ThreadRing* ring = nullptr;
+
+    if (name) {
+        for (int i = 0; i < n && !ring; i++) {
+            if (!rings[i]->inUse.load() && strcmp(rings[i]->name, name) == 0)
+                ring = rings[i];
+        }
+    }
+    if (!ring) {
+        if (n >= MAX_RINGS) return nullptr;
+        ring = new ThreadRing();
+        ring->head.store(0);
+        ring->name[0] = '\0';
+        rings[n] = ring;
+        ringCount.store(n + 1);
+    }
+
+    ring->inUse.store(true);
+    ring->tid = static_cast<int>(syscall(SYS_gettid));
+    if (name) {
+        strncpy(ring->name, name, sizeof(ring->name) - 1);
+        ring->name[sizeof(ring->name) - 1] = '\0';
+    }
+    owner.ring = ring;
+    return ring;
+}
+
+void Trace::setEnabled(bool on) {
+    if (on && !enabled()) sessionStartNs.store(nowNs());
+    enabledFlag.store(on);
+}
+
+void Trace::setThreadName(const char* name) {
+    if (owner.ring) {
+        std::lock_guard<std::mutex> lock(registryLock);
+        strncpy(owner.ring->name, name, sizeof(owner.ring->name) - 1);
+        return;
+    }
+    acquireRing(name);
+}
+
+void Trace::record(TraceName name, uint64_t startNs, uint32_t durNs, int16_t arg) {
+    ThreadRing* ring = owner.ring ? owner.ring : acquireRing(nullptr);
+    if (!ring) return;
+
+    uint64_t h = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& e = ring->events[h & (RING_CAPACITY - 1)];
+    e.startNs = startNs;
+    e.durNs   = durNs;
+    e.name    = name;
+    e.arg     = arg;
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+bool Trace::dump(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+
+    static TraceEvent snapshot[RING_CAPACITY];
+    uint64_t since = sessionStartNs.load();
+    int pid = static_cast<int>(getpid());
+    bool first = true;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    int n = ringCount.load();
+    for (int r = 0; r < n; r++) {
+        ThreadRing* ring = rings[r];
+
+        // Copy, then drop anything the writer may have lapped meanwhile
+        uint64_t end   = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = end > RING_CAPACITY ? end - RING_CAPACITY : 0;
+        for (uint64_t i = begin; i < end; i++)
+            snapshot[i - begin] = ring->events[i & (RING_CAPACITY - 1)];
+        uint64_t after = ring->head.load(std::memory_order_acquire);
+        uint64_t valid = after > RING_CAPACITY ? after - RING_CAPACITY : 0;
+        if (valid < begin) valid = begin;
+
+        fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,"
+                   "\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", pid, ring->tid, ring->name[0] ? ring->name : "thread");
+        first = false;
+
+        for (uint64_t i = valid; i < end; i++) {
+            const TraceEvent& e = snapshot[i - begin];
+            if (e.startNs < since || e.name >= TRACE_NAME_COUNT) continue;
+            double ts = (e.startNs - since) / 1000.0;
+            if (e.durNs) {
+                fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,"
+                           "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%d}}",
+                        TRACE_NAMES[e.name], pid, ring->tid, ts, e.durNs / 1000.0, e.arg);
+            } else {
+                fprintf(f, ",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,"
+                           "\"ts\":%.3f,\"args\":{\"arg\":%d}}",
+                        TRACE_NAMES[e.name], pid, ring->tid, ts, e.arg);
+            }
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <time.h>
+
+// In-process tracing. Each thread records compact binary events into its
+// own ring buffer (single writer, no locks); dump() converts whatever is
+// still in the rings into Chrome trace JSON that Perfetto can open.
+//
+// Disabled tracing costs one relaxed atomic load per span.
+
+enum TraceName : uint16_t {
+    TRACE_LOOP_TICK,
+    TRACE_UI_DRAW,
+    TRACE_AUDIO_READ,
+    TRACE_AUDIO_BLOCK,
+    TRACE_AUDIO_DSP,
+    TRACE_AUDIO_WRITE,
+    TRACE_AUDIO_SWITCH,
+    TRACE_AUDIO_XRUN,
+    TRACE_AUDIO_SPECTRUM,
+    TRACE_AUDIO_ECHO,
+    TRACE_AUDIO_BARGE_IN,
+    TRACE_MOUTH_FRAME,
+    TRACE_MOUTH_SET,
+    TRACE_I2C_PWM,
+    TRACE_I2C_FREQ,
+    TRACE_I2C_WAKE,
+    TRACE_I2C_FRAME,
+    TRACE_SERIAL_FRAME,
+    TRACE_SERIAL_ACK,
+    TRACE_ANIM_MIX,
+    TRACE_AI_MESSAGE,
+    TRACE_KEYPRESS,
+    TRACE_NAME_COUNT
+};
+
+struct TraceEvent {
+    uint64_t startNs;
+    uint32_t durNs;     // 0 for instant events
+    uint16_t name;
+    int16_t  arg;
+};
+
+namespace Trace {
+    extern std::atomic<bool> enabledFlag;
+
+    inline bool enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+    void setEnabled(bool on);
+
+    inline uint64_t nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // Name the calling thread in the exported trace
+    void setThreadName(const char* name);
+
+    void record(TraceName name, uint64_t startNs, uint32_t durNs, int16_t arg);
+    inline void instant(TraceName name, int16_t arg = 0) {
+        if (enabled()) record(name, nowNs(), 0, arg);
+    }
+
+    // Write every buffered event to path as Chrome trace JSON
+    bool dump(const char* path);
+}
+
+// Records a complete ("X") event covering the enclosing scope
+class TraceSpan {
+public:
+    explicit TraceSpan(TraceName name, int16_t arg = 0)
+        : name(name), arg(arg), start(Trace::enabled() ? Trace::nowNs() : 0) {}
+    ~TraceSpan() { end(); }
+
+    void setArg(int16_t a) { arg = a; }
+    // Close the span before the end of scope (e.g. ahead of a sleep)
+    void end() {
+        if (start) Trace::record(name, start, static_cast<uint32_t>(Trace::nowNs() - start), arg);
+        start = 0;
+    }
+
+private:
+    TraceName name;
+    int16_t arg;
+    uint64_t start;
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
@@ -0,0 +1,356 @@
+// Steady-state allocation check.
+// Replaces malloc/calloc/realloc and operator new with counting versions,
+// builds the components main() runs (stub I2C bus, Audio on a real-time
+// FileBackend with the shipped effect chain and the spectral stage, Mouth,
+// Neck, Wings and their behaviors, the random and music controllers, AIVoice fed protocol
+// messages, RemoteServer with a subscribed client streaming setpoints and
+// keys, JoystickInput reading a pipe of stick events, the animation mixer, per-thread stats and a TaroUI frame every tick) and drives a 10 ms loop shaped like
+// main's. After a warmup every allocation on any thread counts, and the
+// test fails if there were any.
+//
+//   make alloctest
+//   ./build/taro_alloc_test --seconds 10
+//
+// Set ALLOC_TEST_ABORT=1 to abort at the first counted allocation, so a
+// debugger shows where it came from. Needs glibc (__libc_malloc and friends).
+// Speech clips are out of scope: loading one allocates its PCM by design.
+
+#include "../src/i2c/PCA9685.h"
+#include "../src/audio/FileBackend.h"
+#include "../src/actuation/AnimationMixer.h"
+#include "../src/actuation/Mouth.h"
+#include "../src/actuation/Neck.h"
+#include "../src/actuation/Wings.h"
+#include "../src/control/MusicController.h"
+#include "../src/control/JoystickInput.h"
+#include "../src/control/RandomController.h"
+#include "../src/control/RemoteServer.h"
+#include "../src/control/TaroUI.h"
+#include "../src/ai/AIVoice.h"
+#include "../src/trace/Realtime.h"
+#include "../src/trace/SessionLog.h"
+#include "../src/trace/Trace.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void  __libc_free(void* p);
+}
+
+static constexpr int LOOP_US    = 10000;
+static constexpr int WARMUP_SEC = 1;
+static constexpr int MAX_SEEN   = 8;
+
+static std::atomic<bool> armed(false);
+static std::atomic<unsigned long> counted(0);
+static std::atomic<size_t> seenSize[MAX_SEEN];
+static bool abortOnAlloc = false;
+
+static void countAlloc(size_t size) {
+    if (!armed.load(std::memory_order_relaxed)) return;
+    unsigned long n = counted++;
+    if (n < static_cast<unsigned long>(MAX_SEEN)) seenSize[n] = size;
+    if (abortOnAlloc) abort();
+}
+
+extern "C" {
+void* malloc(size_t size)              { countAlloc(size); return __libc_malloc(size); }
+void* calloc(size_t n, size_t size)    { countAlloc(n * size); return __libc_calloc(n, size); }
+void* realloc(void* p, size_t size)    { countAlloc(size); return __libc_realloc(p, size); }
+void  free(void* p)                    { __libc_free(p); }
+}
+
+void* operator new(size_t size) {
+    countAlloc(size);
+    void* p = __libc_malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { __libc_free(p); }
+void operator delete[](void* p) noexcept { __libc_free(p); }
+void operator delete(void* p, size_t) noexcept { __libc_free(p); }
+void operator delete[](void* p, size_t) noexcept { __libc_free(p); }
+
+// Show-control client: neck setpoints every 20 ms, a key every second,
+// STATE frames at 100 Hz; fixed buffers only
+class Client {
+public:
+    std::atomic<unsigned long> setpoints;
+    std::atomic<unsigned long> keys;
+    std::atomic<unsigned long> states;
+
+    Client(const char* path) : setpoints(0), keys(0), states(0), running(true), fd(-1) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd < 0) return;
+        uint8_t subscribe[2] = { REMOTE_SUBSCRIBE, static_cast<uint8_t>(RemoteServer::MAX_RATE_HZ) };
+        send(fd, subscribe, sizeof(subscribe), MSG_NOSIGNAL);
+        thread = std::thread(&Client::run, this);
+    }
+
+    bool connected() const { return fd >= 0; }
+
+    void stop() {
+        running = false;
+        if (thread.joinable()) thread.join();
+        if (fd >= 0) close(fd);
+    }
+
+private:
+    std::atomic<bool> running;
+    int fd;
+    std::thread thread;
+
+    void run() {
+        static const char KEYS[] = { 'm', 'e', 'a', 'd', 'r', 'm', 'x', 'a', 'd', 'x' };
+        uint8_t frame[REMOTE_MAX_FRAME];
+        for (unsigned long i = 0; running; i++) {
+            uint8_t sp[1 + REMOTE_SETPOINT_BYTES] = { REMOTE_SETPOINTS, JOINT_NECK };
+            remotePut16(sp + 2, static_cast<uint16_t>(i % 2 ? 1900 : 1100));
+            if (send(fd, sp, sizeof(sp), MSG_NOSIGNAL) > 0) setpoints++;
+            if (i % 50 == 0) {
+                uint8_t key[2] = { REMOTE_KEY, static_cast<uint8_t>(KEYS[(i / 50) % sizeof(KEYS)]) };
+                if (send(fd, key, sizeof(key), MSG_NOSIGNAL) > 0) keys++;
+            }
+            ssize_t len;
+            while ((len = recv(fd, frame, sizeof(frame), MSG_DONTWAIT)) > 0)
+                if (frame[0] == REMOTE_STATE) states++;
+            usleep(20000);
+        }
+    }
+};
+
+static void emit(int fd, uint16_t type, uint16_t code, int32_t value) {
+    struct input_event e;
+    memset(&e, 0, sizeof(e));
+    e.type = type;
+    e.code = code;
+    e.value = value;
+    if (write(fd, &e, sizeof(e)) < 0) perror("write");
+}
+
+// Music-like capture: a 110 Hz tone with kick-like hits at 120 BPM
+static std::vector<short> musicSignal(int seconds) {
+    std::vector<short> pcm(static_cast<size_t>(seconds) * Audio::SAMPLE_RATE);
+    size_t beat = Audio::SAMPLE_RATE / 2;
+    for (size_t i = 0; i < pcm.size(); i++) {
+        size_t j = i % beat;
+        double env = exp(-static_cast<double>(j) / (Audio::SAMPLE_RATE / 100));
+        double s = 3000.0 * sin(2.0 * M_PI * 110.0 * i / Audio::SAMPLE_RATE)
+                 + 12000.0 * env * sin(2.0 * M_PI * 70.0 * j / Audio::SAMPLE_RATE);
+        pcm[i] = static_cast<short>(s);
+    }
+    return pcm;
+}
+
+int main(int argc, char** argv) {
+    int seconds = 5;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: taro_alloc_test [--seconds n]\n");
+            return 2;
+        }
+    }
+    if (seconds < 1) seconds = 1;
+    const char* env = getenv("ALLOC_TEST_ABORT");
+    abortOnAlloc = env && env[0] == '1';
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/taro_alloc_test.%d.sock", static_cast<int>(getpid()));
+
+    Trace::setEnabled(true);
+    StubI2CTransport bus;
+    PCA9685 pwm(&bus);
+    FileBackend backend(musicSignal(seconds + WARMUP_SEC + 1));
+    AnimationMixer mixer(&pwm);
+    BehaviorScheduler behaviors;
+    Mouth mouth(&mixer, &backend);
+    Neck neck(&mixer, &behaviors);
+    Wings wings(mixer, behaviors);
+    pwm.enableIdleRelease(300, 200);
+    mouth.getAudio().setDspChain(
+        DspChain::fromFile("src/audio/dsp.conf", Audio::SAMPLE_RATE, Audio::FRAMES));
+
+    RemoteServer remote;
+    if (!remote.start(path)) {
+        fprintf(stderr, "cannot listen on %s\n", path);
+        return 1;
+    }
+    Client client(path);
+    if (!client.connected()) {
+        perror("connect");
+        return 1;
+    }
+
+    // A stick on a pipe, written from the loop below
+    const char* stickConf = "build/alloc_joystick.conf";
+    FILE* f = fopen(stickConf, "w");
+    if (f) {
+        fputs("axis ABS_X neck raw=0-1000\nbutton BTN_SOUTH e\n", f);
+        fclose(f);
+    }
+    JoystickInput joystick;
+    int stickPipe[2];
+    if (!joystick.configure(stickConf) || pipe(stickPipe) != 0) {
+        fprintf(stderr, "cannot set up the joystick pipe\n");
+        return 1;
+    }
+    joystick.addDevice(stickPipe[0], "pipe pad");
+    joystick.start(nullptr);
+    JoystickReport stickReport;
+    unsigned long stickEvents = 0;
+
+    TaroUI ui(false);
+    AIVoice ai;
+    RandomController random(neck, wings, behaviors, 1);
+    MusicController music(neck, wings);
+    random.increaseActivity();
+    random.increaseActivity();
+
+    DspReport dspReport;
+    AudioDeviceStats audioStats[4];
+    SpectralFeatures spectrum;
+    memset(&spectrum, 0, sizeof(spectrum));
+    char transcript[REMOTE_MAX_FRAME];
+    ThreadStats threadStats[Realtime::MAX_THREADS];
+    char message[128];
+    static const char* const STATES[] = { "LISTENING", "PROCESSING", "SPEAKING", "DONE_SPEAKING" };
+
+    Realtime::enter(ROLE_MAIN);
+    int ticks = (seconds + WARMUP_SEC) * 1000000 / LOOP_US;
+    int warmupTicks = WARMUP_SEC * 1000000 / LOOP_US;
+    unsigned long aiMessages = 0;
+    uint32_t remoteSeq = 0;
+    for (int t = 0; t < ticks; t++) {
+        if (t == warmupTicks) armed = true;
+        TraceSpan tick(TRACE_LOOP_TICK);
+        Session::tick();
+
+        // The stick sweeps every tick; its button once a second
+        emit(stickPipe[1], EV_ABS, ABS_X, (t * 37) % 1000);
+        if (t % 100 == 0) emit(stickPipe[1], EV_KEY, BTN_SOUTH, 1);
+        if (t % 100 == 1) emit(stickPipe[1], EV_KEY, BTN_SOUTH, 0);
+        emit(stickPipe[1], EV_SYN, SYN_REPORT, 0);
+        stickEvents++;
+
+        char ch;
+        while (remote.takeKey(ch) || joystick.takeKey(ch)) {
+            Trace::instant(TRACE_KEYPRESS, ch);
+            Session::key(ch);
+            if      (ch == 'x') { music.setActive(false); random.setActive(!random.isActive()); }
+            else if (ch == 'm') { random.setActive(false); music.setActive(!music.isActive()); }
+            else if (ch == 'e') wings.flapWings();
+            else if (ch == 'a') neck.turnLeft();
+            else if (ch == 'd') neck.turnRight();
+            else if (ch == 'r') neck.recenter();
+        }
+        for (int j = 0; j < JOINT_COUNT; j++) {
+            RemoteJoint joint = static_cast<RemoteJoint>(j);
+            uint16_t value;
+            if (!remote.takeSetpoint(joint, value)) continue;
+            Session::setpoint(joint, value);
+            if (random.isActive() || music.isActive()) continue;
+            if (joint == JOINT_NECK) neck.setTarget(value, LAYER_SCRIPTED);
+        }
+        for (int j = 0; j < JOINT_COUNT; j++) {
+            RemoteJoint joint = static_cast<RemoteJoint>(j);
+            uint16_t value;
+            if (!joystick.takeSetpoint(joint, value)) continue;
+            Session::stick(joint, value);
+            if (random.isActive() || music.isActive() || joint != JOINT_NECK) continue;
+            if (value == JoystickInput::RELEASED) neck.release(LAYER_MANUAL);
+            else                                   neck.setTarget(value, LAYER_MANUAL);
+        }
+
+        // Backend traffic: a partial transcript most ticks, a state change,
+        // a final transcript and a first-audio time now and then. PLAY: and
+        // CACHE: load a clip, which is allowed to allocate, so they stay out.
+        int n;
+        if (t % 25 == 0) n = snprintf(message, sizeof(message), "%s\n", STATES[(t / 25) % 4]);
+        else if (t % 100 == 50) n = snprintf(message, sizeof(message), "TRANSCRIPT:tick %d, what a lovely cup of tea\n", t);
+        else if (t % 100 == 30) n = snprintf(message, sizeof(message), "TTFA:%d\n", 300 + t % 200);
+        else n = snprintf(message, sizeof(message), "PARTIAL:tick %d, what a lovely\n", t);
+        ai.feed(message, n);
+        aiMessages++;
+
+        mouth.update();
+        mouth.getAudio().getSpectrum(spectrum);
+        music.update(spectrum);
+        behaviors.tick();
+        mixer.evaluate(Session::nowNs());
+        pwm.updateIdle();
+
+        mouth.getAudio().getDspReport(dspReport);
+        ui.setDspReport(dspReport);
+        ui.setTimeToFirstAudio(ai.getTimeToFirstAudioMs());
+        ui.setServoPower(pwm.getPowerStats());
+        ui.setSpectrum(spectrum, music.isActive());
+        ui.setLayers(mixer);
+        joystick.getReport(stickReport);
+        ui.setJoystick(stickReport);
+        ui.setAudioStats(audioStats, mouth.getAudio().getDeviceStats(audioStats, 4));
+        ui.setThreads(threadStats, Realtime::report(threadStats, Realtime::MAX_THREADS), Realtime::memoryLocked());
+        if (random.isActive())
+            ui.render(neck.getServoPulse(), mouth.getServoPulse(), wings, random.getActivityLevel(), ai.getState());
+        else
+            ui.render(neck.getServoPulse(), mouth.getServoPulse(), wings, ai.getState());
+
+        RemoteState state;
+        state.seq = ++remoteSeq;
+        state.timeMs = static_cast<uint32_t>(Session::nowMs());
+        state.aiState = static_cast<uint8_t>(ai.getState());
+        state.flags = (random.isActive() ? REMOTE_RANDOM_ACTIVE : 0) |
+                      (music.isActive() ? REMOTE_MUSIC_ACTIVE : 0);
+        state.neckUs = neck.getServoPulse();
+        state.mouthUs = static_cast<uint16_t>(mouth.getServoPulse());
+        state.activity = static_cast<uint8_t>(random.getActivityLevel());
+        if (!ai.getPartialTranscript(transcript, sizeof(transcript)))
+            ai.getLastTranscript(transcript, sizeof(transcript));
+        remote.publish(state, transcript);
+
+        tick.end();
+        Realtime::sleepUs(LOOP_US);
+    }
+    armed = false;
+    unsigned long allocations = counted.load();
+
+    client.stop();
+    remote.stop();
+    close(stickPipe[1]);
+    joystick.stop();
+    unlink(stickConf);
+    mouth.stop();
+    Trace::setEnabled(false);
+
+    printf("%d s of simulated operation after a %d s warmup: %d ticks, %u audio blocks, "
+           "%lu setpoints, %lu keys, %lu states, %lu AI messages, %lu stick reports\n",
+           seconds, WARMUP_SEC, ticks - warmupTicks, spectrum.block,
+           client.setpoints.load(), client.keys.load(), client.states.load(), aiMessages, stickEvents);
+    bool ok = allocations == 0 && spectrum.block > 0 && client.states.load() > 0;
+    printf("%s  %lu allocations in steady state\n", ok ? "ok  " : "FAIL", allocations);
+    for (unsigned long i = 0; i < allocations && i < static_cast<unsigned long>(MAX_SEEN); i++)
+        printf("      #%lu: %zu bytes\n", i + 1, seenSize[i].load());
+    return ok ? 0 : 1;
+}
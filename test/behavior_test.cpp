@@ -0,0 +1,232 @@
+// Behavior scheduler checks on a stub I2C bus with a synthetic 10 ms clock.
+// Steps run in order and resume on the tick they are due, an awaited step
+// hands back to its caller in the same tick, moveTo() glides a joint over
+// its duration, many behaviors run side by side up to the slot limit, and
+// cancelling one (from outside or from inside its own step) runs its
+// guards and returns its frames to the pool. A frame too big for the pool
+// is refused rather than allocated. Then the wing flap, neck recentering
+// and random mode, which are behaviors now, and last a count of heap
+// allocations over all of it, which must be zero.
+//
+//   make behaviortest
+
+#include "../src/actuation/Behavior.h"
+#include "../src/actuation/Neck.h"
+#include "../src/actuation/Wings.h"
+#include "../src/control/RandomController.h"
+#include "../src/i2c/PCA9685.h"
+#include "check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static constexpr long long TICK_MS = 10;
+
+static long long fakeMs = 0;
+static long long fakeClock() { return fakeMs; }
+
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static void tick(BehaviorScheduler& behaviors, AnimationMixer& mixer, int n = 1) {
+    for (int i = 0; i < n; i++) {
+        fakeMs += TICK_MS;
+        behaviors.tick();
+        mixer.evaluate(static_cast<uint64_t>(fakeMs) * 1000000ULL);
+    }
+}
+
+// What ran when: each entry is a step number and the fake time it ran at
+struct Trail {
+    int steps[16];
+    long long at[16];
+    int n;
+    void mark(int step) {
+        if (n < 16) {
+            steps[n] = step;
+            at[n++] = fakeMs;
+        }
+    }
+};
+
+static Behavior child(Trail& trail) {
+    trail.mark(2);
+    co_await delay(20);
+    trail.mark(3);
+}
+
+static Behavior parent(Trail& trail) {
+    trail.mark(1);
+    co_await child(trail);
+    trail.mark(4);
+    co_await nextTick();
+    trail.mark(5);
+}
+
+// Counts its own destruction, wherever it is suspended
+struct Guard {
+    int& count;
+    ~Guard() { count++; }
+};
+
+static Behavior guarded(int& destroyed, long long ms) {
+    Guard g = { destroyed };
+    co_await delay(ms);
+}
+
+static Behavior guardedParent(int& destroyed) {
+    Guard g = { destroyed };
+    co_await guarded(destroyed, 1000);
+}
+
+static uint32_t selfId = 0;
+static Behavior cancelsItself(BehaviorScheduler& behaviors, int& destroyed) {
+    Guard g = { destroyed };
+    co_await nextTick();
+    behaviors.cancel(selfId);
+    co_await delay(1000);
+}
+
+static volatile int sink = 0;
+static Behavior tooBig() {
+    char buf[2 * BehaviorScheduler::FRAME_BYTES];
+    memset(buf, 1, sizeof(buf));
+    co_await nextTick();
+    sink = sink + buf[5];
+}
+
+static Behavior nod(Neck& neck) {
+    co_await neck.moveTo(2100, 300);
+    co_await delay(100);
+    co_await neck.moveTo(1500, 300);
+}
+
+static void schedulerChecks(BehaviorScheduler& behaviors, AnimationMixer& mixer) {
+    Trail trail;
+    trail.n = 0;
+    long long t0 = fakeMs;
+    uint32_t id = behaviors.start(parent(trail));
+    check(id && trail.n == 2 && trail.steps[0] == 1 && trail.steps[1] == 2 && trail.at[1] == t0,
+          "start: runs into the awaited step at once");
+    tick(behaviors, mixer);
+    check(trail.n == 2, "delay: not resumed early");
+    tick(behaviors, mixer);
+    check(trail.n == 4 && trail.steps[2] == 3 && trail.steps[3] == 4 && trail.at[2] == t0 + 20 &&
+          trail.at[3] == t0 + 20, "delay: resumed when due, and the caller continues in the same tick");
+    check(behaviors.running(id), "nextTick: still running after the step");
+    tick(behaviors, mixer);
+    check(trail.n == 5 && trail.at[4] == t0 + 30 && !behaviors.running(id) &&
+          BehaviorScheduler::framesInUse() == 0, "nextTick: one tick later; its frames go back when done");
+
+    Neck neck(&mixer, &behaviors);
+    id = behaviors.start(nod(neck));
+    tick(behaviors, mixer, 15);
+    float mid = mixer.target(LAYER_SCRIPTED, MIX_NECK);
+    tick(behaviors, mixer, 15);
+    check(mid > 1750 && mid < 1850 && mixer.target(LAYER_SCRIPTED, MIX_NECK) == 2100,
+          "moveTo: halfway at half the duration, on target at the end");
+    tick(behaviors, mixer, 45);
+    check(!behaviors.running(id) && mixer.target(LAYER_SCRIPTED, MIX_NECK) == 1500, "moveTo: steps chain");
+    mixer.releaseLayer(LAYER_SCRIPTED, 0);
+
+    int destroyed = 0;
+    uint32_t ids[BehaviorScheduler::MAX_BEHAVIORS];
+    for (int i = 0; i < BehaviorScheduler::MAX_BEHAVIORS; i++)
+        ids[i] = behaviors.start(guarded(destroyed, 10 * (i + 1)));
+    check(ids[BehaviorScheduler::MAX_BEHAVIORS - 1] && behaviors.active() == BehaviorScheduler::MAX_BEHAVIORS &&
+          !behaviors.start(guarded(destroyed, 10)) && destroyed == 0,
+          "slots: all run side by side, one more is turned away");
+    tick(behaviors, mixer, 8);
+    check(behaviors.active() == BehaviorScheduler::MAX_BEHAVIORS - 8 && destroyed == 8,
+          "slots: each ends on its own tick");
+    behaviors.cancel(ids[12]);
+    check(!behaviors.running(ids[12]) && behaviors.active() == 7 && destroyed == 9, "cancel: one of many");
+    tick(behaviors, mixer, 10);
+    check(behaviors.active() == 0 && BehaviorScheduler::framesInUse() == 0, "slots: the rest finish");
+
+    destroyed = 0;
+    id = behaviors.start(guardedParent(destroyed));
+    tick(behaviors, mixer);
+    check(BehaviorScheduler::framesInUse() == 2, "cancel: a nested step holds two frames");
+    behaviors.cancel(id);
+    check(destroyed == 2 && BehaviorScheduler::framesInUse() == 0,
+          "cancel: unwinds the step it is suspended in and its caller");
+
+    destroyed = 0;
+    selfId = behaviors.start(cancelsItself(behaviors, destroyed));
+    tick(behaviors, mixer);
+    check(!behaviors.running(selfId) && destroyed == 1 && BehaviorScheduler::framesInUse() == 0,
+          "cancel: from inside its own step, freed once it suspends");
+
+    unsigned int refused = BehaviorScheduler::framesRefused();
+    check(!behaviors.start(tooBig()) && BehaviorScheduler::framesRefused() == refused + 1,
+          "pool: a frame bigger than a slot is refused");
+}
+
+static void actuationChecks(BehaviorScheduler& behaviors, AnimationMixer& mixer) {
+    Wings wings(mixer, behaviors);
+    check(wings.flapWings() && mixer.driving(LAYER_MANUAL, MIX_WING_1) &&
+          mixer.target(LAYER_MANUAL, MIX_WING_1) == WING_1_UP_US,
+          "flap: wings up at once");
+    check(!wings.flapWings(), "flap: cooldown");
+    tick(behaviors, mixer, WING_UP_DELAY_US / 1000 / TICK_MS - 1);
+    check(mixer.driving(LAYER_MANUAL, MIX_WING_1), "flap: held");
+    tick(behaviors, mixer);
+    check(!mixer.driving(LAYER_MANUAL, MIX_WING_1) && !mixer.driving(LAYER_MANUAL, MIX_WING_2) &&
+          behaviors.active() == 0, "flap: lowered after the hold");
+    uint32_t id = behaviors.start(wings.flap(LAYER_SCRIPTED));
+    tick(behaviors, mixer, 5);
+    behaviors.cancel(id);
+    check(!mixer.driving(LAYER_SCRIPTED, MIX_WING_1), "flap: cancelled mid-air still lowers the wings");
+
+    Neck neck(&mixer, &behaviors);
+    neck.setTarget(2300);
+    tick(behaviors, mixer, 100);
+    neck.recenter();
+    tick(behaviors, mixer);
+    neck.turnLeft();
+    check(neck.isRecentering() && mixer.target(LAYER_MANUAL, MIX_NECK) == NeckJoint::REST_US,
+          "recenter: keys wait while the neck goes home");
+    tick(behaviors, mixer, 100);
+    check(!neck.isRecentering() && abs(neck.getServoPulse() - NeckJoint::REST_US) <= 1,
+          "recenter: ends when the neck is home");
+    neck.setTarget(2300);
+    tick(behaviors, mixer, 100);
+    neck.recenter();
+    tick(behaviors, mixer);
+    neck.setTarget(1000);
+    check(!neck.isRecentering() && behaviors.active() == 0, "recenter: a manual target cancels it");
+    neck.release(LAYER_MANUAL);
+
+    RandomController random(neck, wings, behaviors, 7);
+    for (int i = 0; i < 9; i++) random.increaseActivity();
+    random.setActive(true);
+    check(random.isActive() && behaviors.active() >= 1, "random: runs while switched on");
+    tick(behaviors, mixer, 500);
+    random.setActive(false);
+    tick(behaviors, mixer, 100);
+    check(!random.isActive() && behaviors.active() == 0 && !mixer.driving(LAYER_RANDOM, MIX_NECK) &&
+          BehaviorScheduler::framesInUse() == 0, "random: switching off cancels it and releases the neck");
+}
+
+int main() {
+    StubI2CTransport bus;
+    PCA9685 pwm(&bus);
+    AnimationMixer mixer(&pwm);
+    BehaviorScheduler behaviors(fakeClock);
+
+    unsigned long before = allocations;
+    schedulerChecks(behaviors, mixer);
+    actuationChecks(behaviors, mixer);
+    check(allocations == before, "no heap allocation by any behavior");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,324 @@
+// Microbenchmarks for the per-tick and per-block hot paths.
+// Links the real sources against a stub I2C transport and prints one JSON
+// document to stdout so runs can be diffed across builds and Pi models.
+//
+//   make bench > bench.json
+
+#include "../src/i2c/PCA9685.h"
+#include "../src/audio/Effects.h"
+#include "../src/audio/DspChain.h"
+#include "../src/audio/DriftResampler.h"
+#include "../src/audio/SpeechClipFile.h"
+#include "../src/audio/SpectralAnalyzer.h"
+#include "../src/actuation/AnimationMixer.h"
+#include "../src/actuation/Neck.h"
+#include "../src/actuation/LipSync.h"
+#include "../src/actuation/Wings.h"
+#include "../src/control/TaroUI.h"
+#include "../src/ai/AIVoice.h"
+#include "../src/trace/Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#ifndef BENCH_CXXFLAGS
+#define BENCH_CXXFLAGS "unknown"
+#endif
+
+// Global allocation counters, bumped by the operator new overrides below
+static unsigned long long g_allocs = 0;
+static unsigned long long g_allocBytes = 0;
+
+void* operator new(size_t size) {
+    g_allocs++;
+    g_allocBytes += size;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static constexpr int FRAMES = 1024;
+static constexpr double MIN_BENCH_SECONDS = 0.25;
+
+struct Result {
+    std::string name;
+    unsigned long long iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+};
+
+static std::vector<Result> results;
+
+// Runs fn in growing batches until MIN_BENCH_SECONDS elapse, after one
+// untimed warmup batch so lazily grown state doesn't count as steady state.
+template <typename Fn>
+static void bench(const char* name, Fn fn) {
+    typedef std::chrono::steady_clock Clock;
+    for (int i = 0; i < 16; i++) fn();
+
+    unsigned long long batch = 16, total = 0;
+    unsigned long long allocs = 0, bytes = 0;
+    double elapsed = 0.0;
+    while (elapsed < MIN_BENCH_SECONDS) {
+        unsigned long long a0 = g_allocs, b0 = g_allocBytes;
+        Clock::time_point t0 = Clock::now();
+        for (unsigned long long i = 0; i < batch; i++) fn();
+        Clock::time_point t1 = Clock::now();
+        allocs += g_allocs - a0;
+        bytes  += g_allocBytes - b0;
+        elapsed += std::chrono::duration<double>(t1 - t0).count();
+        total += batch;
+        batch *= 2;
+    }
+
+    Result r;
+    r.name        = name;
+    r.iterations  = total;
+    r.nsPerOp     = elapsed * 1e9 / total;
+    r.allocsPerOp = static_cast<double>(allocs) / total;
+    r.bytesPerOp  = static_cast<double>(bytes) / total;
+    results.push_back(r);
+}
+
+static std::string readFirstLine(const char* path) {
+    std::ifstream f(path);
+    std::string s;
+    std::getline(f, s);
+    // device-tree strings are NUL terminated
+    s.erase(std::remove(s.begin(), s.end(), '\0'), s.end());
+    return s;
+}
+
+static std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) { out += ' '; }
+        else out += c;
+    }
+    return out;
+}
+
+static void printJson() {
+    struct utsname u;
+    uname(&u);
+    std::string model = readFirstLine("/proc/device-tree/model");
+
+    printf("{\n");
+    printf("  \"machine\": \"%s\",\n", jsonEscape(u.machine).c_str());
+    printf("  \"kernel\": \"%s\",\n", jsonEscape(u.release).c_str());
+    printf("  \"model\": \"%s\",\n", jsonEscape(model).c_str());
+    printf("  \"compiler\": \"%s\",\n", jsonEscape(__VERSION__).c_str());
+    printf("  \"cxxflags\": \"%s\",\n", jsonEscape(BENCH_CXXFLAGS).c_str());
+    printf("  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, "
+               "\"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}%s\n",
+               r.name.c_str(), r.iterations, r.nsPerOp, r.allocsPerOp, r.bytesPerOp,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+int main() {
+    // Speech-like test block: a 220 Hz tone with some noise on top
+    std::vector<short> source(FRAMES);
+    srand(1);
+    for (int i = 0; i < FRAMES; i++) {
+        double tone = 8000.0 * std::sin(2.0 * M_PI * 220.0 * i / 48000.0);
+        source[i] = static_cast<short>(tone + (rand() % 2000) - 1000);
+    }
+    std::vector<short> block(source);
+
+    StubI2CTransport bus;
+    PCA9685 pwm(&bus);
+    AnimationMixer mixer(&pwm);
+    BehaviorScheduler behaviors;
+    Neck neck(&mixer, &behaviors);
+    Wings wings(mixer, behaviors);
+    TaroUI ui(false);
+    AIVoice ai;
+
+    volatile double sink = 0.0;
+
+    bench("amplitude_block_1024", [&]() {
+        sink = meanAbsAmplitude(&block[0], FRAMES);
+    });
+
+    std::vector<float> work(FRAMES);
+    RubberBand rubberBand(FRAMES);
+    bench("rubber_band_effect_1024", [&]() {
+        DspChain::toFloat(&source[0], &work[0], FRAMES);
+        rubberBand.process(&work[0], FRAMES, 0.15);
+    });
+
+    // The shipped chain config, including the int16 conversions either side
+    DspChain* chain = DspChain::fromFile("src/audio/dsp.conf", 48000, FRAMES);
+    bench("dsp_chain_block_1024", [&]() {
+        DspChain::toFloat(&source[0], &work[0], FRAMES);
+        chain->process(&work[0], FRAMES);
+        DspChain::toShort(&work[0], &block[0], FRAMES);
+    });
+    DspReport report;
+    chain->report(report);
+    for (int i = 0; i < report.nodes; i++)
+        fprintf(stderr, "dsp node %-24s avg %.1f us\n", report.node[i].name, report.node[i].avgUs);
+    delete chain;
+
+    // One block through an output writer's ring and drift resampler, with
+    // the loop running a 100 ppm correction
+    SampleRing ring(FRAMES * 2);
+    DriftResampler resampler(2.0 * FRAMES);
+    resampler.update(2.0 * FRAMES + 8000.0, 0);
+    bench("drift_resample_block_1024", [&]() {
+        ring.push(&source[0], FRAMES);
+        while (resampler.produce(ring, &block[0], 256) == 256) {}
+    });
+
+    // Music-mode analysis of one capture block: window, FFT, bands, flux,
+    // plus the tempo autocorrelation every eighth block
+    SpectralAnalyzer spectral(48000, FRAMES);
+    bench("spectral_block_1024", [&]() {
+        spectral.process(&source[0]);
+    });
+
+    // Trajectory for one second of speech-like audio, done once per TTS clip
+    std::vector<short> speech(48000);
+    for (size_t i = 0; i < speech.size(); i++)
+        speech[i] = static_cast<short>(12000.0 * std::sin(i * 0.06) * (0.5 + 0.5 * std::sin(i * 0.0008)));
+    bench("lipsync_analyze_1s", [&]() {
+        LipSync track(&speech[0], speech.size(), 48000, MouthJoint::MIN_US, MouthJoint::MAX_US);
+        volatile uint16_t p = track.pulseAt(24000.0);
+        (void)p;
+    });
+
+    // The same second as a speech cache hit: map, validate, copy out the
+    // PCM and wrap the stored track
+    {
+        LipSync track(&speech[0], speech.size(), 48000, MouthJoint::MIN_US, MouthJoint::MAX_US);
+        const char* path = "/tmp/taro_bench_clip.tsc";
+        SpeechClipFile::write(path, &speech[0], speech.size(), 48000,
+                              track.track().data(), track.track().size(), track.hopFrames());
+        std::vector<short> pcm;
+        pcm.reserve(speech.size());
+        bench("speech_cache_hit_1s", [&]() {
+            SpeechClipFile clip;
+            clip.open(path);
+            pcm.assign(clip.pcm(), clip.pcm() + clip.frames());
+            LipSync stored(clip.track(), clip.hops(), clip.hopFrames(), clip.frames(), MouthJoint::MIN_US, MouthJoint::MAX_US);
+        });
+        unlink(path);
+    }
+
+    // One turn's worth of protocol traffic, fed in pipe-sized pieces:
+    // partial transcripts while the guest talks, then a reply of six clips
+    std::string traffic = "LISTENING\n";
+    std::string heard;
+    for (int i = 0; i < 20; i++) {
+        heard += i ? " word" : "word";
+        traffic += "PARTIAL:" + heard + "\n";
+    }
+    traffic += "TRANSCRIPT:" + heard + "\nPROCESSING\nSPEAKING\nTTFA:412\n";
+    for (int i = 0; i < 6; i++)
+        traffic += "PLAY:/tmp/taro_clip_" + std::to_string(i) + ".wav\t/tmp/taro_cache/" + std::to_string(i) + ".tclip\n";
+    traffic += "CACHE:/tmp/taro_filler.wav\t/tmp/taro_cache/filler.tclip\nDONE_SPEAKING\nREADY\n";
+    const int trafficMessages = static_cast<int>(std::count(traffic.begin(), traffic.end(), '\n'));
+    SpeechRequest clipReq;
+    bench("aivoice_parse_message", [&]() {
+        for (size_t off = 0; off < traffic.size(); off += 511) {
+            size_t n = std::min<size_t>(511, traffic.size() - off);
+            ai.feed(traffic.data() + off, n);
+        }
+        while (ai.takeSpeech(clipReq)) {}
+    });
+    // Report per message rather than per batch of traffic
+    results.back().nsPerOp     /= trafficMessages;
+    results.back().allocsPerOp /= trafficMessages;
+    results.back().bytesPerOp  /= trafficMessages;
+
+    // Three devices on screen, as on the robot
+    AudioDeviceStats devices[3];
+    for (int i = 0; i < 3; i++) {
+        memset(&devices[i], 0, sizeof(devices[i]));
+        snprintf(devices[i].name, sizeof(devices[i].name), i ? "out%d" : "mic", i);
+        devices[i].periodFrames = 256;
+        devices[i].bufferFrames = 2048;
+    }
+    ui.setAudioStats(devices, 3);
+
+    // And the five startup stages, part-way through loading
+    Startup startup;
+    const char* stageNames[] = { "servo", "audio", "stt", "tts", "llm" };
+    for (int i = 0; i < 5; i++) startup.add(stageNames[i]);
+    for (int i = 0; i < 4; i++) startup.set(i, i < 3 ? StageState::READY : StageState::LOADING, 120 * i);
+    StartupStage stages[Startup::MAX_STAGES];
+    ui.setStartup(stages, startup.report(stages, Startup::MAX_STAGES), startup.totalMs());
+
+    uint16_t head = 500;
+    bench("taroui_render_frame", [&]() {
+        head = (head >= 2500) ? 500 : head + 7;
+        ui.render(head, 1000, wings, AIState::READY);
+    });
+
+    // One control tick's worth of mixing: three layers live, the random
+    // one crossfading in and out, one frame to the bus
+    int step = 0;
+    uint64_t mixNs = 0;
+    mixer.set(LAYER_SPEECH, MIX_MOUTH, 1100);
+    bench("anim_mixer_evaluate", [&]() {
+        if (++step % 50 == 0) neck.setTarget((step / 50) % 2 ? 2400 : 600, LAYER_SCRIPTED);
+        if (step % 80 == 0) neck.setTarget(900, LAYER_RANDOM);
+        if (step % 80 == 40) neck.release(LAYER_RANDOM);
+        mixer.evaluate(mixNs += 10000000);
+    });
+
+    uint16_t off = 0;
+    bench("pca9685_setpwm", [&]() {
+        off = (off + 1) & 0x0FFF;
+        pwm.setPWM(3, 0, off);
+    });
+
+    // Idle release: every op puts the chip to sleep and wakes it with a
+    // change, so this is the full wake path (oscillator wait + burst)
+    StubI2CTransport idleBus;
+    PCA9685 idlePwm(&idleBus);
+    idlePwm.setPWM(0, 0, 307);
+    idlePwm.setPWM(2, 0, 307);
+    idlePwm.enableIdleRelease(0, 0);
+    uint16_t wakeOff = 300;
+    bench("pca9685_sleep_wake", [&]() {
+        idlePwm.updateIdle();
+        wakeOff = wakeOff == 300 ? 310 : 300;
+        idlePwm.setPWM(2, 0, wakeOff);
+    });
+
+    // Tracing must stay near free while disabled; compare with enabled cost
+    bench("trace_span_disabled", [&]() {
+        TraceSpan span(TRACE_LOOP_TICK);
+    });
+    Trace::setEnabled(true);
+    bench("trace_span_enabled", [&]() {
+        TraceSpan span(TRACE_LOOP_TICK);
+    });
+    Trace::setEnabled(false);
+
+    printJson();
+    return 0;
+}
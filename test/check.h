@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdio>
+
+// Pass/fail line for the check-style tests; main returns failures ? 1 : 0
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%s  %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
@@ -0,0 +1,106 @@
+// Clip queue checks on a running audio engine (FileBackend, real time).
+// A reply arrives as clips queued back to back, the next one before the
+// current one ends. Each must follow the last in the next block without a
+// gap, isClipPlaying() must drop when the last one ends, and a later clip
+// must still play. Nothing here calls collect(), like a caller that only
+// queues clips. Last, an engine whose devices fail to open (a USB device
+// unplugged at startup) reports it and shuts down cleanly.
+//
+//   make cliptest
+
+#include "../src/audio/Audio.h"
+#include "../src/audio/FileBackend.h"
+#include "check.h"
+#include <atomic>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
+
+static constexpr int RATE   = Audio::SAMPLE_RATE;
+static constexpr int FRAMES = Audio::FRAMES;
+static constexpr int CLIP_BLOCKS = 4;
+static constexpr int MAX_BLOCKS  = 512;
+
+// First sample of every block the audio thread handled; each clip is a
+// constant level, the silent capture is 0
+static short firstSample[MAX_BLOCKS];
+static std::atomic<int> blocks(0);
+
+static void onFrame(short* buffer, int size) {
+    (void)size;
+    int n = blocks.load();
+    if (n < MAX_BLOCKS) firstSample[n] = buffer[0];
+    blocks.store(n + 1);
+}
+
+// Every device missing
+class UnpluggedBackend : public AudioBackend {
+public:
+    bool open(unsigned int, int, int) { return false; }
+    void close() {}
+    int read(short*, int) { return -1; }
+    int write(int, const short*, int frames) { return frames; }
+    int outputCount() const { return 2; }
+};
+
+static bool waitIdle(Audio& audio) {
+    for (int i = 0; i < 200 && audio.isClipPlaying(); i++) usleep(10000);
+    return !audio.isClipPlaying();
+}
+
+static void span(short level, int& first, int& last) {
+    first = last = -1;
+    int n = blocks.load();
+    if (n > MAX_BLOCKS) n = MAX_BLOCKS;
+    for (int b = 0; b < n; b++) {
+        if (firstSample[b] != level) continue;
+        if (first < 0) first = b;
+        last = b;
+    }
+}
+
+int main() {
+    std::vector<short> silence(static_cast<size_t>(RATE) * 4, 0);
+    FileBackend backend(silence, true);
+    std::vector<short> clipA(CLIP_BLOCKS * FRAMES, 1000);
+    std::vector<short> clipB(CLIP_BLOCKS * FRAMES, 2000);
+    std::vector<short> clipC(CLIP_BLOCKS * FRAMES, 3000);
+    {
+        Audio audio(onFrame, &backend);
+        for (int i = 0; i < 100 && !audio.isOpen(); i++) usleep(10000);
+        usleep(50000);
+
+        uint32_t a = audio.playClip(&clipA[0], clipA.size());
+        usleep(30000);
+        uint32_t b = audio.playClip(&clipB[0], clipB.size());
+        check(a && b, "queue: the second clip is accepted while the first plays");
+        check(waitIdle(audio), "queue: isClipPlaying() drops after the last clip");
+
+        int firstA, lastA, firstB, lastB;
+        span(1000, firstA, lastA);
+        span(2000, firstB, lastB);
+        check(firstA >= 0 && lastA - firstA == CLIP_BLOCKS - 1, "queue: first clip plays whole");
+        check(firstB == lastA + 1 && lastB - firstB == CLIP_BLOCKS - 1,
+              "queue: second clip starts in the block after the first ends");
+        ClipClock clock;
+        check(audio.getClipClock(clock) && clock.id == b, "queue: the clip clock reaches the second clip");
+
+        uint32_t c = audio.playClip(&clipC[0], clipC.size());
+        bool idle = waitIdle(audio);
+        int firstC, lastC;
+        span(3000, firstC, lastC);
+        check(c && idle && firstC > lastB && lastC - firstC == CLIP_BLOCKS - 1,
+              "queue: a later clip still plays once both have retired");
+        printf("blocks: A %d-%d, B %d-%d, C %d-%d\n", firstA, lastA, firstB, lastB, firstC, lastC);
+        audio.stop();
+    }
+    {
+        UnpluggedBackend unplugged;
+        Audio audio(onFrame, &unplugged);
+        for (int i = 0; i < 100 && !audio.openFailed(); i++) usleep(10000);
+        check(audio.openFailed() && !audio.isOpen(), "open: a failed open is reported");
+        // Destroying it must join the finished thread rather than abort
+    }
+    check(true, "open: the engine shuts down after a failed open");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,365 @@
+// Joystick input checks and input-to-servo latency.
+//
+// Checks the deadzone and expo curve, then feeds JoystickInput a pipe of
+// input_events the way the kernel would deliver them: an axis only moves
+// its joint at SYN_REPORT, a frame cut by SYN_DROPPED is thrown away,
+// buttons hand out their key on press only, and both the deadzone and an
+// unplugged device release the joint. If /dev/uinput can be opened (root,
+// or the uinput group) the same is repeated with a virtual gamepad found
+// through /dev/input, which also covers discovery and the evdev ioctls.
+//
+// Last, it streams unique axis positions through the pipe into a 10 ms
+// control loop shaped like main's (stick onto the manual layer, one mixer
+// frame) over a stub I2C bus and prints the event-to-register latency as
+// JSON:
+//
+//   make sticktest
+//   ./build/taro_joystick_test --rate 125 --count 300
+
+#include "../src/i2c/PCA9685.h"
+#include "../src/actuation/AnimationMixer.h"
+#include "../src/actuation/Neck.h"
+#include "../src/control/JoystickInput.h"
+#include "../src/trace/Trace.h"
+#include "check.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+
+static constexpr int LOOP_US   = 10000;   // main loop tick
+static constexpr int RAW_RANGE = 2000;    // pipe axis 0..2000: 1 us per step at expo 0
+
+static constexpr uint8_t NECK_OFF_L = LED0_ON_L + 4 * NeckJoint::CHANNEL + 2;
+static constexpr uint8_t NECK_OFF_H = NECK_OFF_L + 1;
+
+static void emit(int fd, uint16_t type, uint16_t code, int32_t value) {
+    struct input_event e;
+    memset(&e, 0, sizeof(e));
+    e.type = type;
+    e.code = code;
+    e.value = value;
+    if (write(fd, &e, sizeof(e)) != sizeof(e)) perror("write");
+}
+
+static void syn(int fd) { emit(fd, EV_SYN, SYN_REPORT, 0); }
+
+// The newest setpoint within a few loop ticks, or -1
+static int32_t waitSetpoint(JoystickInput& stick, RemoteJoint joint) {
+    uint16_t value;
+    for (int i = 0; i < 50; i++) {
+        if (stick.takeSetpoint(joint, value)) return value;
+        usleep(1000);
+    }
+    return -1;
+}
+
+static int waitKey(JoystickInput& stick) {
+    char key;
+    for (int i = 0; i < 50; i++) {
+        if (stick.takeKey(key)) return key;
+        usleep(1000);
+    }
+    return -1;
+}
+
+static bool writeConfig(const char* path, const char* text) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    fputs(text, f);
+    fclose(f);
+    return true;
+}
+
+static void shapeChecks() {
+    check(JoystickInput::shape(0.05f, 0.1f, 0.0f) == 0.0f, "shape: inside the deadzone is 0");
+    check(fabsf(JoystickInput::shape(-0.55f, 0.1f, 0.0f) + 0.5f) < 1e-5f,
+          "shape: the deadzone is rescaled out, sign kept");
+    check(fabsf(JoystickInput::shape(0.5f, 0.0f, 1.0f) - 0.125f) < 1e-5f, "shape: full expo is cubic");
+    check(JoystickInput::shape(1.0f, 0.1f, 0.3f) == 1.0f, "shape: full deflection stays full");
+
+    JoystickAxisMap m = { ABS_X, JOINT_NECK, 0.1f, 0.0f, false, false,
+                          NeckJoint::MIN_US, NeckJoint::MAX_US, 0, 0 };
+    check(JoystickInput::toPulse(m, 0, -100, 100) == JoystickInput::RELEASED &&
+          JoystickInput::toPulse(m, 100, -100, 100) == NeckJoint::MAX_US &&
+          JoystickInput::toPulse(m, -100, -100, 100) == NeckJoint::MIN_US,
+          "pulse: stick centre releases, the ends reach the joint's limits");
+    m.invert = true;
+    check(JoystickInput::toPulse(m, 100, -100, 100) == NeckJoint::MIN_US, "pulse: invert");
+    JoystickAxisMap t = { ABS_RZ, JOINT_MOUTH, 0.05f, 0.0f, false, true,
+                          MouthJoint::MIN_US, MouthJoint::MAX_US, 0, 255 };
+    check(JoystickInput::toPulse(t, 0, 0, 1023) == JoystickInput::RELEASED &&
+          JoystickInput::toPulse(t, 255, 0, 1023) == MouthJoint::MAX_US,
+          "pulse: trigger rests released, raw= overrides the device range");
+}
+
+static void pipeChecks() {
+    const char* conf = "build/joystick_test.conf";
+    bool written = writeConfig(conf,
+        "axis   ABS_X   neck   deadzone=0.1 expo=0 raw=0-1000\n"
+        "axis   ABS_RZ  mouth  trigger raw=0-255\n"
+        "button BTN_SOUTH e\n");
+    JoystickInput stick;
+    int fds[2];
+    if (!written || !stick.configure(conf) || pipe(fds) != 0) {
+        check(false, "pipe: set up");
+        return;
+    }
+    stick.addDevice(fds[0], "pipe pad");
+    stick.start(nullptr);
+
+    emit(fds[1], EV_ABS, ABS_X, 1000);
+    check(waitSetpoint(stick, JOINT_NECK) == -1, "pipe: nothing moves before SYN_REPORT");
+    syn(fds[1]);
+    check(waitSetpoint(stick, JOINT_NECK) == NeckJoint::MAX_US, "pipe: full right at SYN_REPORT");
+
+    emit(fds[1], EV_ABS, ABS_RZ, 255);
+    syn(fds[1]);
+    check(waitSetpoint(stick, JOINT_MOUTH) == MouthJoint::MAX_US, "pipe: trigger opens the jaw");
+
+    emit(fds[1], EV_ABS, ABS_X, 100);
+    emit(fds[1], EV_SYN, SYN_DROPPED, 0);
+    emit(fds[1], EV_ABS, ABS_X, 200);
+    syn(fds[1]);
+    check(waitSetpoint(stick, JOINT_NECK) == -1, "pipe: a frame cut by SYN_DROPPED is dropped");
+
+    emit(fds[1], EV_KEY, BTN_SOUTH, 1);
+    emit(fds[1], EV_KEY, BTN_SOUTH, 2);
+    emit(fds[1], EV_KEY, BTN_SOUTH, 0);
+    syn(fds[1]);
+    int first = waitKey(stick);
+    int second = waitKey(stick);
+    check(first == 'e' && second == -1, "pipe: a button press is one key");
+
+    emit(fds[1], EV_ABS, ABS_X, 520);
+    syn(fds[1]);
+    check(waitSetpoint(stick, JOINT_NECK) == JoystickInput::RELEASED, "pipe: back in the deadzone releases");
+
+    emit(fds[1], EV_ABS, ABS_X, 0);
+    syn(fds[1]);
+    waitSetpoint(stick, JOINT_NECK);
+    close(fds[1]);
+    check(waitSetpoint(stick, JOINT_NECK) == JoystickInput::RELEASED &&
+          waitSetpoint(stick, JOINT_MOUTH) == JoystickInput::RELEASED,
+          "pipe: unplugging releases the joints it held");
+
+    JoystickReport report;
+    stick.getReport(report);
+    check(report.devices == 0 && report.events > 0, "pipe: the device is gone from the report");
+    stick.stop();
+    unlink(conf);
+}
+
+// A virtual gamepad through uinput, found by watching /dev/input
+static void uinputChecks() {
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        printf("skip  uinput: /dev/uinput not available (%s)\n", strerror(errno));
+        return;
+    }
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    ioctl(fd, UI_SET_KEYBIT, BTN_SOUTH);
+    ioctl(fd, UI_SET_EVBIT, EV_ABS);
+    const int codes[] = { ABS_X, ABS_RZ };
+    for (int i = 0; i < 2; i++) {
+        struct uinput_abs_setup abs;
+        memset(&abs, 0, sizeof(abs));
+        abs.code = codes[i];
+        abs.absinfo.minimum = codes[i] == ABS_X ? -32768 : 0;
+        abs.absinfo.maximum = codes[i] == ABS_X ? 32767 : 1023;
+        ioctl(fd, UI_SET_ABSBIT, codes[i]);
+        ioctl(fd, UI_ABS_SETUP, &abs);
+    }
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    snprintf(setup.name, sizeof(setup.name), "taro test pad");
+
+    JoystickInput stick;   // built-in mapping
+    stick.start("/dev/input");
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+        printf("skip  uinput: cannot create a device (%s)\n", strerror(errno));
+        stick.stop();
+        close(fd);
+        return;
+    }
+    JoystickReport report;
+    memset(&report, 0, sizeof(report));
+    for (int i = 0; i < 200 && report.devices == 0; i++) {
+        usleep(10000);
+        stick.getReport(report);
+    }
+    check(report.devices > 0, "uinput: the virtual gamepad is found when plugged in");
+
+    emit(fd, EV_ABS, ABS_X, 32767);
+    syn(fd);
+    check(waitSetpoint(stick, JOINT_NECK) == NeckJoint::MAX_US, "uinput: stick right turns the head");
+    emit(fd, EV_KEY, BTN_SOUTH, 1);
+    syn(fd);
+    emit(fd, EV_KEY, BTN_SOUTH, 0);
+    syn(fd);
+    check(waitKey(stick) == 'e', "uinput: BTN_SOUTH flaps");
+
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+    int32_t released = -1;
+    for (int i = 0; i < 20 && released < 0; i++) released = waitSetpoint(stick, JOINT_NECK);
+    check(released == JoystickInput::RELEASED, "uinput: unplugging releases the head");
+    stick.stop();
+}
+
+// Stub bus that timestamps the last write reaching the neck channel
+class NeckTransport : public StubI2CTransport {
+public:
+    std::atomic<uint64_t> lastNs;
+
+    NeckTransport() : lastNs(0) {}
+
+    bool write(const uint8_t* data, size_t len) {
+        bool ok = StubI2CTransport::write(data, len);
+        if (len >= 2 && data[0] <= NECK_OFF_H && NECK_OFF_H <= data[0] + len - 2) lastNs = Trace::nowNs();
+        return ok;
+    }
+};
+
+struct Applied {
+    uint16_t value;
+    uint64_t writeNs;
+};
+
+// What main does with a stick each tick
+class ControlLoop {
+public:
+    ControlLoop(JoystickInput* stick, AnimationMixer* mixer, Neck* neck, NeckTransport* bus)
+        : stick(stick), mixer(mixer), neck(neck), bus(bus), running(true),
+          thread(&ControlLoop::run, this) {}
+
+    void stop() {
+        running = false;
+        thread.join();
+    }
+
+    std::vector<Applied> take() {
+        std::lock_guard<std::mutex> g(lock);
+        std::vector<Applied> out;
+        out.swap(applied);
+        return out;
+    }
+
+private:
+    JoystickInput* stick;
+    AnimationMixer* mixer;
+    Neck* neck;
+    NeckTransport* bus;
+    std::atomic<bool> running;
+    std::mutex lock;
+    std::vector<Applied> applied;
+    std::thread thread;
+
+    void run() {
+        Trace::setThreadName("main");
+        while (running) {
+            uint16_t value;
+            bool got = stick->takeSetpoint(JOINT_NECK, value) && value != JoystickInput::RELEASED;
+            if (got) neck->setTarget(value, LAYER_MANUAL);
+            mixer->evaluate(Trace::nowNs());
+            if (got) {
+                Applied a = { value, bus->lastNs.load() };
+                std::lock_guard<std::mutex> g(lock);
+                applied.push_back(a);
+            }
+            usleep(LOOP_US);
+        }
+    }
+};
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+static void latency(int rate, int count) {
+    const char* conf = "build/joystick_latency.conf";
+    char text[128];
+    snprintf(text, sizeof(text), "axis ABS_X neck deadzone=0 expo=0 raw=0-%d\n", RAW_RANGE);
+    JoystickInput stick;
+    int fds[2];
+    if (!writeConfig(conf, text) || !stick.configure(conf) || pipe(fds) != 0) {
+        check(false, "latency: set up");
+        return;
+    }
+    NeckTransport bus;
+    PCA9685 pwm(&bus);
+    AnimationMixer mixer(&pwm);
+    BehaviorScheduler behaviors;
+    Neck neck(&mixer, &behaviors);
+    stick.addDevice(fds[0], "pipe pad");
+    stick.start(nullptr);
+    ControlLoop loop(&stick, &mixer, &neck, &bus);
+
+    // Alternate sides so every position moves the neck; each is unique
+    JoystickAxisMap m = { ABS_X, JOINT_NECK, 0.0f, 0.0f, false, false,
+                          NeckJoint::MIN_US, NeckJoint::MAX_US, 0, RAW_RANGE };
+    std::map<uint16_t, uint64_t> sentAt;
+    for (int i = 0; i < count; i++) {
+        int32_t raw = i % 2 ? RAW_RANGE - 100 - i / 2 : 100 + i / 2;
+        sentAt[JoystickInput::toPulse(m, raw, 0, RAW_RANGE)] = Trace::nowNs();
+        emit(fds[1], EV_ABS, ABS_X, raw);
+        syn(fds[1]);
+        usleep(1000000 / rate);
+    }
+    usleep(3 * LOOP_US);
+    std::vector<Applied> applied = loop.take();
+    loop.stop();
+    close(fds[1]);
+    stick.stop();
+    unlink(conf);
+
+    std::vector<double> latencyUs;
+    for (size_t i = 0; i < applied.size(); i++) {
+        std::map<uint16_t, uint64_t>::const_iterator it = sentAt.find(applied[i].value);
+        if (it != sentAt.end() && applied[i].writeNs >= it->second)
+            latencyUs.push_back((applied[i].writeNs - it->second) / 1000.0);
+    }
+    check(!latencyUs.empty(), "latency: stick positions reach the neck register");
+    printf("{\n  \"rate_hz\": %d,\n  \"sent\": %d,\n  \"applied\": %d,\n", rate, count,
+           static_cast<int>(latencyUs.size()));
+    printf("  \"event_to_register_us\": { \"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f }\n}\n",
+           percentile(latencyUs, 0.5), percentile(latencyUs, 0.9), percentile(latencyUs, 0.99),
+           latencyUs.empty() ? 0.0 : *std::max_element(latencyUs.begin(), latencyUs.end()));
+}
+
+int main(int argc, char** argv) {
+    int rate = 125;   // a USB gamepad's report rate
+    int count = 300;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--rate") && i + 1 < argc)       rate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--count") && i + 1 < argc) count = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: taro_joystick_test [--rate hz] [--count n]\n");
+            return 2;
+        }
+    }
+    if (rate < 1) rate = 1;
+    if (count > 1600) count = 1600;   // keeps positions unique on each side
+
+    shapeChecks();
+    pipeChecks();
+    uinputChecks();
+    latency(rate, count);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,342 @@
+// End-to-end audio-to-mouth latency harness.
+// Injects synthetic signals (or a recorded WAV) through FileBackend into the
+// real Audio/Mouth pipeline, ticked through the animation mixer like the
+// main loop, and timestamps each mouth channel register write as it reaches
+// a stub I2C transport. Prints one JSON document with the onset-to-servo
+// latency distribution and envelope tracking error, plus how long
+// pause/resume/clip requests take to reach the audio thread. Speech clips
+// are measured separately: there the mouth should lead the audio.
+//
+//   make latency > latency.json
+//   ./build/taro_latency --wav speech.wav --count 20
+
+#include "../src/i2c/PCA9685.h"
+#include "../src/audio/FileBackend.h"
+#include "../src/audio/Effects.h"
+#include "../src/actuation/AnimationMixer.h"
+#include "../src/actuation/Mouth.h"
+#include "../src/trace/Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static constexpr unsigned int RATE   = 48000;
+static constexpr int          FRAMES = 1024;   // matches Audio::FRAMES
+
+// LEDn_OFF_H is the last register written for a channel
+static constexpr uint8_t MOUTH_OFF_L = LED0_ON_L + 4 * MouthJoint::CHANNEL + 2;
+static constexpr uint8_t MOUTH_OFF_H = MOUTH_OFF_L + 1;
+static constexpr int     TICK_US     = 10000;   // main loop tick
+
+struct ServoWrite {
+    uint64_t ns;
+    double pulseUs;
+};
+
+// Stub bus that timestamps every completed mouth channel update, alone or
+// in a mixer frame
+class RecordingTransport : public StubI2CTransport {
+public:
+    std::vector<ServoWrite> writes;
+    std::mutex lock;
+
+    bool write(const uint8_t* data, size_t len) {
+        bool ok = StubI2CTransport::write(data, len);
+        if (len >= 2 && data[0] <= MOUTH_OFF_H && MOUTH_OFF_H <= data[0] + len - 2) {
+            uint16_t counts = reg(MOUTH_OFF_L) | (reg(MOUTH_OFF_H) << 8);
+            ServoWrite w = { Trace::nowNs(), counts * 20000.0 / 4096.0 };
+            std::lock_guard<std::mutex> g(lock);
+            writes.push_back(w);
+        }
+        return ok;
+    }
+};
+
+struct Signal {
+    std::string name;
+    std::vector<short> samples;
+    std::vector<size_t> onsets;   // sample indices where sound starts
+};
+
+static void appendSilence(std::vector<short>& s, double seconds) {
+    s.insert(s.end(), static_cast<size_t>(seconds * RATE), 0);
+}
+
+static Signal makeImpulses(int count) {
+    Signal sig;
+    sig.name = "impulse";
+    appendSilence(sig.samples, 0.5);
+    for (int n = 0; n < count; n++) {
+        sig.onsets.push_back(sig.samples.size());
+        // 2 ms full-scale click: a single sample would sit under SOUND_MIN_THRESHOLD
+        sig.samples.insert(sig.samples.end(), RATE / 500, 30000);
+        appendSilence(sig.samples, 0.4);
+    }
+    return sig;
+}
+
+static Signal makeToneBursts(int count) {
+    Signal sig;
+    sig.name = "tone_burst";
+    appendSilence(sig.samples, 0.5);
+    for (int n = 0; n < count; n++) {
+        sig.onsets.push_back(sig.samples.size());
+        size_t len = static_cast<size_t>(0.15 * RATE);
+        for (size_t i = 0; i < len; i++)
+            sig.samples.push_back(static_cast<short>(10000.0 * std::sin(2.0 * M_PI * 440.0 * i / RATE)));
+        appendSilence(sig.samples, 0.35);
+    }
+    return sig;
+}
+
+// Onsets in recorded speech: a loud block after at least 200 ms of quiet ones
+static Signal makeSpeech(const char* path) {
+    Signal sig;
+    sig.name = "speech";
+    if (!FileBackend::loadWav(path, RATE, sig.samples)) {
+        fprintf(stderr, "latency: cannot read %s (16-bit PCM WAV expected)\n", path);
+        exit(1);
+    }
+    const int quietBlocksNeeded = static_cast<int>(0.2 * RATE / FRAMES);
+    int quiet = quietBlocksNeeded;
+    for (size_t b = 0; b + FRAMES <= sig.samples.size(); b += FRAMES) {
+        double amp = meanAbsAmplitude(&sig.samples[b], FRAMES);
+        if (amp >= 2 * Mouth::SOUND_MIN_THRESHOLD) {
+            if (quiet >= quietBlocksNeeded) sig.onsets.push_back(b);
+            quiet = 0;
+        } else {
+            quiet++;
+        }
+    }
+    appendSilence(sig.samples, 0.5);
+    return sig;
+}
+
+// Pulse the mouth would ideally show for a block: closed in silence,
+// otherwise the same amplitude mapping Mouth uses, without any smoothing
+static double envelopePulse(const short* block) {
+    double amp = meanAbsAmplitude(block, FRAMES);
+    if (amp < Mouth::SOUND_MIN_THRESHOLD) return Mouth::SERVO_MIN_PULSE;
+    double normalized = std::min((amp / 32768.0) * 2.0, 1.0);
+    return Mouth::SERVO_MIN_PULSE + normalized * (Mouth::SERVO_MAX_PULSE - Mouth::SERVO_MIN_PULSE);
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t idx = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    return v[idx];
+}
+
+static void runSignal(const Signal& sig, bool first) {
+    RecordingTransport bus;
+    PCA9685 pwm(&bus);
+    FileBackend backend(sig.samples, true);
+    AnimationMixer mixer(&pwm);
+    uint64_t startNs;
+    {
+        // The main loop's part: the jaw onto its layer, one mixer frame a tick
+        Mouth mouth(&mixer, &backend);
+        uint64_t drainNs = 0;
+        while (!drainNs || Trace::nowNs() < drainNs) {
+            if (!drainNs && backend.finished()) drainNs = Trace::nowNs() + 100000000ULL;
+            mouth.update();
+            mixer.evaluate(Trace::nowNs());
+            usleep(TICK_US);
+        }
+        startNs = backend.streamStartNs();
+        mouth.stop();
+    }
+
+    std::vector<ServoWrite> writes;
+    {
+        std::lock_guard<std::mutex> g(bus.lock);
+        writes = bus.writes;
+    }
+    // Keep only writes made while the signal was streaming, which drops the
+    // parking writes from construction and shutdown
+    uint64_t endNs = startNs + sig.samples.size() * 1000000000ULL / RATE;
+    std::vector<ServoWrite> live;
+    for (size_t i = 0; i < writes.size(); i++)
+        if (writes[i].ns > startNs && writes[i].ns <= endNs) live.push_back(writes[i]);
+
+    // Latency: onset sample time -> first mouth write after it, as long as
+    // that write lands before the next onset
+    std::vector<double> latencies;
+    for (size_t n = 0; n < sig.onsets.size(); n++) {
+        uint64_t onsetNs = startNs + sig.onsets[n] * 1000000000ULL / RATE;
+        uint64_t limitNs = n + 1 < sig.onsets.size()
+            ? startNs + sig.onsets[n + 1] * 1000000000ULL / RATE : endNs;
+        for (size_t i = 0; i < live.size(); i++) {
+            if (live[i].ns < onsetNs) continue;
+            if (live[i].ns < limitNs) latencies.push_back((live[i].ns - onsetNs) / 1e6);
+            break;
+        }
+    }
+
+    // Tracking: commanded pulse (sample and hold of writes) at each block end
+    // against the block's ideal envelope, at zero lag and at the best lag
+    size_t blocks = sig.samples.size() / FRAMES;
+    std::vector<double> envelope(blocks), commanded(blocks);
+    size_t w = 0;
+    double held = Mouth::SERVO_MIN_PULSE;
+    for (size_t b = 0; b < blocks; b++) {
+        envelope[b] = envelopePulse(&sig.samples[b * FRAMES]);
+        uint64_t t = startNs + (b + 1) * FRAMES * 1000000000ULL / RATE;
+        while (w < live.size() && live[w].ns <= t) held = live[w++].pulseUs;
+        commanded[b] = held;
+    }
+    double zeroLagRms = 0.0, bestRms = 1e9;
+    int bestLag = 0;
+    const int maxLag = 20;
+    for (int lag = 0; lag <= maxLag; lag++) {
+        double sum = 0.0;
+        size_t n = 0;
+        for (size_t b = 0; b + lag < blocks; b++, n++) {
+            double e = commanded[b + lag] - envelope[b];
+            sum += e * e;
+        }
+        double rms = n ? std::sqrt(sum / n) : 0.0;
+        if (lag == 0) zeroLagRms = rms;
+        if (rms < bestRms) { bestRms = rms; bestLag = lag; }
+    }
+
+    double mean = 0.0;
+    for (size_t i = 0; i < latencies.size(); i++) mean += latencies[i];
+    if (!latencies.empty()) mean /= latencies.size();
+
+    printf("%s    {\"name\": \"%s\", \"onsets\": %zu, \"detected\": %zu, \"servo_writes\": %zu,\n",
+           first ? "" : ",\n", sig.name.c_str(), sig.onsets.size(), latencies.size(), live.size());
+    printf("     \"latency_ms\": {\"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, "
+           "\"max\": %.2f, \"mean\": %.2f},\n",
+           percentile(latencies, 0.0), percentile(latencies, 0.5), percentile(latencies, 0.9),
+           percentile(latencies, 0.99), percentile(latencies, 1.0), mean);
+    printf("     \"tracking\": {\"rms_us\": %.1f, \"best_lag_ms\": %.1f, \"best_lag_rms_us\": %.1f}}",
+           zeroLagRms, bestLag * FRAMES * 1000.0 / RATE, bestRms);
+    fflush(stdout);
+}
+
+// Tone bursts played as a speech clip. Latency is measured against when
+// each onset reaches the (file backend's) speaker, so with the lookahead
+// trajectory it should come out negative, about SPEECH_LEAD_MS early.
+static void runLipSync(const Signal& sig) {
+    RecordingTransport bus;
+    PCA9685 pwm(&bus);
+    std::vector<short> silence(sig.samples.size() + RATE, 0);
+    FileBackend backend(silence, true);
+    std::vector<ServoWrite> writes;
+    ClipClock start = { 0, 0, 0 };
+    AnimationMixer mixer(&pwm);
+    {
+        Mouth mouth(&mixer, &backend);
+        mouth.pause();
+        usleep(100000);
+        mouth.speak(&sig.samples[0], sig.samples.size());
+        while (mouth.isSpeaking()) {
+            mouth.update();
+            mixer.evaluate(Trace::nowNs());
+            if (!start.id) mouth.getAudio().getClipClock(start);
+            usleep(TICK_US);
+        }
+        mouth.stop();
+    }
+    {
+        std::lock_guard<std::mutex> g(bus.lock);
+        writes = bus.writes;
+    }
+
+    // The first clock reading is for clip frame 0 or one block after it
+    uint64_t clipStartNs = start.audibleNs - start.frame * 1000000000ULL / RATE;
+    std::vector<double> leads;
+    for (size_t n = 0; n < sig.onsets.size(); n++) {
+        int64_t onsetNs = clipStartNs + sig.onsets[n] * 1000000000ULL / RATE;
+        // First opening write within 200 ms either side of the onset
+        for (size_t i = 0; i < writes.size(); i++) {
+            int64_t d = static_cast<int64_t>(writes[i].ns) - onsetNs;
+            if (d < -200000000LL || writes[i].pulseUs <= Mouth::SERVO_MIN_PULSE + 1) continue;
+            if (d < 200000000LL) leads.push_back(d / 1e6);
+            break;
+        }
+    }
+    printf("  \"lipsync_ms\": {\"lead_target\": %d, \"onsets\": %zu, \"detected\": %zu, "
+           "\"p50\": %.2f, \"p90\": %.2f, \"min\": %.2f, \"max\": %.2f},\n",
+           Mouth::SPEECH_LEAD_MS, sig.onsets.size(), leads.size(), percentile(leads, 0.5),
+           percentile(leads, 0.9), percentile(leads, 0.0), percentile(leads, 1.0));
+}
+
+// Toggle pause/resume and start short clips on a running engine, reading
+// back the request-to-applied time after each one
+static void runModeSwitch(int count) {
+    StubI2CTransport bus;
+    PCA9685 pwm(&bus);
+    std::vector<short> silence(static_cast<size_t>((count * 0.3 + 1.0) * RATE), 0);
+    std::vector<short> clip(FRAMES * 4, 8000);
+    FileBackend backend(silence, true);
+    std::vector<double> pauses, resumes, clips;
+    AnimationMixer mixer(&pwm);
+    {
+        Mouth mouth(&mixer, &backend);
+        Audio& audio = mouth.getAudio();
+        usleep(100000);
+        AudioSwitchStats stats;
+        for (int n = 0; n < count; n++) {
+            mouth.pause();
+            usleep(50000);
+            audio.getSwitchStats(stats);
+            pauses.push_back(stats.lastUs / 1000.0);
+
+            audio.playClip(&clip[0], clip.size());
+            usleep(50000);
+            audio.getSwitchStats(stats);
+            clips.push_back(stats.lastUs / 1000.0);
+            while (audio.isClipPlaying()) usleep(5000);
+
+            mouth.resume();
+            usleep(50000);
+            audio.getSwitchStats(stats);
+            resumes.push_back(stats.lastUs / 1000.0);
+        }
+        mouth.stop();
+    }
+
+    const char* names[3] = { "pause", "clip", "resume" };
+    std::vector<double>* sets[3] = { &pauses, &clips, &resumes };
+    printf("  \"mode_switch_ms\": {");
+    for (int i = 0; i < 3; i++)
+        printf("%s\n    \"%s\": {\"p50\": %.2f, \"p90\": %.2f, \"max\": %.2f}", i ? "," : "",
+               names[i], percentile(*sets[i], 0.5), percentile(*sets[i], 0.9), percentile(*sets[i], 1.0));
+    printf("\n  }\n");
+}
+
+int main(int argc, char** argv) {
+    const char* wavPath = nullptr;
+    int count = 12;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--wav") && i + 1 < argc)        wavPath = argv[++i];
+        else if (!strcmp(argv[i], "--count") && i + 1 < argc) count = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--wav speech.wav] [--count N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("{\n  \"params\": {\"smoothing_factor\": %.3f, \"max_servo_speed\": %d, "
+           "\"sound_min_threshold\": %d, \"movement_threshold\": %.1f, \"tick_us\": %d},\n",
+           Mouth::SMOOTHING_FACTOR, Mouth::MAX_SERVO_SPEED, Mouth::SOUND_MIN_THRESHOLD,
+           Mouth::SERVO_MOVEMENT_THRESHOLD, TICK_US);
+    printf("  \"signals\": [\n");
+    runSignal(makeImpulses(count), true);
+    runSignal(makeToneBursts(count), false);
+    if (wavPath) runSignal(makeSpeech(wavPath), false);
+    printf("\n  ],\n");
+    runLipSync(makeToneBursts(count));
+    runModeSwitch(count);
+    printf("}\n");
+    return 0;
+}
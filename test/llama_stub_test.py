@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Checks the llama-server request builder against a local stub server.
+
+The stub speaks just enough of llama-server's HTTP API (/tokenize and a
+streamed /completion with timings) to confirm that every turn:
+  - starts with the identical system prompt prefix,
+  - asks for cache_prompt on a fixed slot,
+  - carries real history, newest first to survive, within --ctx-size.
+It also runs the startup warmup, which must report every stage and
+prefill the system prompt into that same slot.
+Speech output is stubbed, so piper and the audio engine aren't needed.
+
+  make aitest
+"""
+import http.server
+import importlib.util
+import json
+import os
+import sys
+import tempfile
+import threading
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+spec = importlib.util.spec_from_file_location("taro_ai", os.path.join(HERE, "..", "src", "ai", "taro_ai.py"))
+taro_ai = importlib.util.module_from_spec(spec)
+spec.loader.exec_module(taro_ai)
+
+requests = []
+
+class StubLlama(http.server.BaseHTTPRequestHandler):
+    def log_message(self, *args):
+        pass
+
+    def do_GET(self):
+        if self.path == "/health":
+            self._reply("application/json", '{"status": "ok"}')
+        else:
+            self.send_error(404)
+
+    def do_POST(self):
+        body = json.loads(self.rfile.read(int(self.headers["Content-Length"])))
+        if self.path == "/tokenize":
+            # One token per whitespace-separated word, plus one per newline
+            text = body["content"]
+            tokens = list(range(len(text.split()) + text.count("\n")))
+            self._reply("application/json", json.dumps({"tokens": tokens}))
+        elif self.path == "/completion":
+            requests.append(body)
+            words = ["squawk", "i", "am", "taro", "and", "i", "fly", "rockets"]
+            events = [{"content": " " + w, "stop": False} for w in words]
+            events.append({"content": "", "stop": True, "tokens_cached": 300,
+                           "timings": {"prompt_n": 12, "prompt_ms": 80.0, "cache_n": 200,
+                                       "predicted_n": len(words), "predicted_ms": 400.0}})
+            self._reply("text/event-stream",
+                        "".join(f"data: {json.dumps(e)}\n\n" for e in events))
+        else:
+            self.send_error(404)
+
+    def _reply(self, kind, text):
+        data = text.encode()
+        self.send_response(200)
+        self.send_header("Content-Type", kind)
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+def main():
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), StubLlama)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    taro_ai.LLAMA_PORT = server.server_address[1]
+
+    sent = []
+    taro_ai.send = sent.append
+    taro_ai._prepare = lambda text: ("PLAY:stub", 0.0, None)
+    taro_ai._cache_trim = lambda: None
+
+    failures = []
+    def check(cond, what):
+        print(("ok    " if cond else "FAIL  ") + what)
+        if not cond:
+            failures.append(what)
+
+    # The backend's per-turn log lines go to stderr; keep the report readable
+    log, sys.stderr = sys.stderr, open(os.devnull, "w")
+
+    # Warmup with stand-in model files; piper's model is missing
+    model = tempfile.NamedTemporaryFile(delete=False)
+    model.write(b"\0" * 4096)
+    model.close()
+    taro_ai.WHISPER_BIN = taro_ai.WHISPER_MODEL = taro_ai.PIPER_BIN = model.name
+    taro_ai.PIPER_VOICE = model.name + ".missing"
+    taro_ai._cache_prewarm = lambda: None
+    taro_ai.warmup()
+    os.unlink(model.name)
+    warm = list(requests)
+    stages = [m for m in sent if m.startswith("STAGE:")]
+    del requests[:]
+    del sent[:]
+
+    history = []
+    for turn in range(30):
+        history.append({"role": "user", "content": f"question number {turn} " + "blah " * 10})
+        reply = taro_ai.get_response(history)
+        history.append({"role": "assistant", "content": reply})
+    sys.stderr = log
+
+    prefix = taro_ai.SYSTEM_PROMPT + "\n"
+    for name in ("llm", "stt"):
+        check(f"STAGE:{name}:LOADING" in stages and
+              any(m.startswith(f"STAGE:{name}:READY:") for m in stages), f"{name} stage reports ready")
+    check(any(m.startswith("STAGE:tts:FAILED:") for m in stages), "missing voice fails the tts stage")
+    check(len(warm) == 1 and warm[0]["prompt"] == prefix and warm[0]["n_predict"] == 0 and
+          warm[0].get("id_slot") == taro_ai.LLAMA_SLOT, "warmup prefills the system prompt into the slot")
+    check(len(requests) == 30, "one completion request per turn")
+    check(all(r["prompt"].startswith(prefix) for r in requests), "system prompt prefix is identical every turn")
+    check(all(r.get("cache_prompt") is True for r in requests), "cache_prompt requested")
+    check(all(r.get("id_slot") == taro_ai.LLAMA_SLOT for r in requests), "pinned to one slot")
+    check("question number 29" in requests[-1]["prompt"], "newest user message included")
+    check("Taro: squawk i am taro" in requests[5]["prompt"], "earlier replies included as history")
+    check("question number 0 " not in requests[-1]["prompt"], "oldest turns dropped once over budget")
+    worst = max(taro_ai.count_tokens(r["prompt"]) + r["n_predict"] for r in requests)
+    check(worst <= taro_ai.LLAMA_CTX, f"prompt + n_predict fits the context ({worst}/{taro_ai.LLAMA_CTX})")
+    check(requests[-1]["prompt"].endswith("\nTaro:"), "prompt ends on Taro's turn")
+    check("SPEAKING" in sent and "DONE_SPEAKING" in sent, "speech state messages sent")
+
+    server.shutdown()
+    print(f"{len(failures)} failure(s)")
+    sys.exit(1 if failures else 0)
+
+if __name__ == "__main__":
+    main()
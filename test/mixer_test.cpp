@@ -0,0 +1,111 @@
+// Animation mixer checks on a stub I2C bus with a synthetic 10 ms clock.
+// A higher layer overrides a lower one, crossfades take their fade time
+// and never jump, releasing a layer hands the joint back to the one below,
+// priorities can be reordered, and a tick that moves several joints is one
+// bus transaction while a tick that moves nothing is none.
+//
+//   make mixertest
+
+#include "../src/actuation/AnimationMixer.h"
+#include "../src/i2c/PCA9685.h"
+#include "check.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static constexpr uint64_t TICK_NS = 10000000ULL;
+
+// Run ticks; the largest single-tick neck move and the tick it settled on
+struct Run {
+    int maxStep;
+    int settledTick;   // -1 if it never reached target
+};
+
+static Run run(AnimationMixer& mixer, uint64_t& now, int ticks, int target) {
+    Run r = { 0, -1 };
+    int prev = mixer.pulse(MIX_NECK);
+    for (int t = 0; t < ticks; t++) {
+        mixer.evaluate(now += TICK_NS);
+        int step = abs(mixer.pulse(MIX_NECK) - prev);
+        if (step > r.maxStep) r.maxStep = step;
+        prev = mixer.pulse(MIX_NECK);
+        if (r.settledTick < 0 && prev == target) r.settledTick = t;
+    }
+    return r;
+}
+
+int main() {
+    StubI2CTransport bus;
+    PCA9685 pwm(&bus);
+    uint64_t now = 0;
+
+    unsigned long before = bus.getWriteCount();
+    AnimationMixer mixer(&pwm);
+    check(bus.getWriteCount() - before == 1 && mixer.pulse(MIX_NECK) == NeckJoint::REST_US &&
+          mixer.pulse(MIX_MOUTH) == MouthJoint::REST_US,
+          "construction parks every joint at rest in one frame");
+
+    mixer.evaluate(now += TICK_NS);
+    before = bus.getWriteCount();
+    mixer.evaluate(now += TICK_NS);
+    check(bus.getWriteCount() == before && mixer.framesWritten() == 0, "a tick that moves nothing writes nothing");
+
+    // Three joints on different layers in the same tick
+    mixer.set(LAYER_SCRIPTED, MIX_NECK, 2000, 0);
+    mixer.set(LAYER_SPEECH, MIX_MOUTH, 1200, 0);
+    mixer.set(LAYER_MANUAL, MIX_WING_1, WING_1_UP_US, 0);
+    before = bus.getWriteCount();
+    mixer.evaluate(now += TICK_NS);
+    check(bus.getWriteCount() - before == 1 && mixer.framesWritten() == 1 &&
+          mixer.pulse(MIX_MOUTH) == 1200 && mixer.pulse(MIX_WING_1) == WING_1_UP_US,
+          "three joints moving on three layers go out as one bus write");
+    uint8_t mouthOff = LED0_ON_L + 4 * MouthJoint::CHANNEL + 2;
+    check((bus.reg(mouthOff) | (bus.reg(mouthOff + 1) << 8)) == MouthJoint::counts(1200),
+          "the frame carries the mouth's off count");
+
+    Run r = run(mixer, now, 100, 2000);
+    check(r.settledTick >= 0 && r.maxStep <= NeckJoint::MAX_STEP_US, "neck eases to the scripted target within its step limit");
+
+    // Manual over scripted: an instant cut would be a 1000 us jump
+    mixer.set(LAYER_MANUAL, MIX_NECK, 1000);
+    mixer.evaluate(now += TICK_NS);
+    int firstStep = 2000 - mixer.pulse(MIX_NECK);
+    r = run(mixer, now, 100, 1000);
+    check(r.settledTick >= 0, "manual layer overrides the scripted one");
+    check(firstStep < 100 && r.maxStep <= NeckJoint::MAX_STEP_US, "the override crossfades in without a pop");
+
+    // Half way through the manual fade-out the blend sits half way
+    mixer.release(LAYER_MANUAL, MIX_NECK, 200);
+    for (int t = 0; t < 10; t++) mixer.evaluate(now += TICK_NS);
+    float half = mixer.weight(LAYER_MANUAL, MIX_NECK);
+    r = run(mixer, now, 100, 2000);
+    check(fabsf(half - 0.5f) < 0.06f, "a 200 ms release is half way after 100 ms");
+    check(r.settledTick >= 0, "releasing the manual layer hands the neck back to scripted");
+
+    mixer.releaseLayer(LAYER_MANUAL, 0);
+    mixer.releaseLayer(LAYER_SCRIPTED, 0);
+    r = run(mixer, now, 100, NeckJoint::REST_US);
+    check(r.settledTick >= 0 && mixer.pulse(MIX_WING_1) == Wing1Joint::REST_US,
+          "with every layer released the joints return to the idle pose");
+
+    // Random below manual by default; raised above it, it wins
+    mixer.set(LAYER_MANUAL, MIX_NECK, 900, 0);
+    mixer.set(LAYER_RANDOM, MIX_NECK, 2200, 0);
+    r = run(mixer, now, 100, 900);
+    check(r.settledTick >= 0, "random sits under manual by default");
+    mixer.setPriority(LAYER_RANDOM, 100);
+    r = run(mixer, now, 100, 2200);
+    check(r.settledTick >= 0, "raising random's priority puts it on top");
+
+    // The fade time is the default one when none is given
+    mixer.setPriority(LAYER_RANDOM, 10);
+    mixer.releaseLayer(LAYER_RANDOM, 0);
+    mixer.setFadeMs(LAYER_SPEECH, 100);
+    mixer.release(LAYER_SPEECH, MIX_MOUTH, 0);
+    mixer.evaluate(now += TICK_NS);
+    mixer.set(LAYER_SPEECH, MIX_MOUTH, 1300);
+    for (int t = 0; t < 5; t++) mixer.evaluate(now += TICK_NS);
+    check(fabsf(mixer.weight(LAYER_SPEECH, MIX_MOUTH) - 0.5f) < 0.06f, "set() fades in over the layer's fade time");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,240 @@
+// Remote control loopback benchmark.
+// Runs RemoteServer with a 10 ms control loop shaped like main's (take the
+// newest neck setpoint onto the scripted layer, then one mixer frame) over a
+// stub I2C bus, and streams neck setpoints at it from a client on the same
+// socket. Each
+// setpoint carries a unique value, so the register write that carries it can
+// be matched to the moment it was sent. Prints one JSON document with the
+// command-to-register latency distribution, how many setpoints a burst
+// coalesced into, and the STATE rate a subscriber received.
+//
+//   make remotebench
+//   ./build/taro_remote_bench --rate 50 --count 500
+
+#include "../src/i2c/PCA9685.h"
+#include "../src/actuation/AnimationMixer.h"
+#include "../src/actuation/Neck.h"
+#include "../src/control/RemoteServer.h"
+#include "../src/trace/Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static constexpr int      LOOP_US    = 10000;   // main loop tick
+static constexpr int      BURST_SIZE = 50;
+static constexpr uint16_t LOW_BASE   = 1000;
+static constexpr uint16_t HIGH_BASE  = 2000;
+
+static constexpr uint8_t NECK_OFF_L = LED0_ON_L + 4 * NeckJoint::CHANNEL + 2;
+static constexpr uint8_t NECK_OFF_H = NECK_OFF_L + 1;
+
+// Stub bus that timestamps the last write reaching the neck channel, alone
+// or as part of a frame burst
+class NeckTransport : public StubI2CTransport {
+public:
+    std::atomic<uint64_t> lastNs;
+
+    NeckTransport() : lastNs(0) {}
+
+    bool write(const uint8_t* data, size_t len) {
+        bool ok = StubI2CTransport::write(data, len);
+        if (len >= 2 && data[0] <= NECK_OFF_H && NECK_OFF_H <= data[0] + len - 2) lastNs = Trace::nowNs();
+        return ok;
+    }
+};
+
+struct Applied {
+    uint16_t value;
+    uint64_t writeNs;
+};
+
+// The control loop: what main does with a neck setpoint each tick
+class ControlLoop {
+public:
+    ControlLoop(RemoteServer* remote, AnimationMixer* mixer, Neck* neck, NeckTransport* bus)
+        : remote(remote), mixer(mixer), neck(neck), bus(bus), running(true), seq(0),
+          thread(&ControlLoop::run, this) {}
+
+    void stop() {
+        running = false;
+        thread.join();
+    }
+
+    std::vector<Applied> take() {
+        std::lock_guard<std::mutex> g(lock);
+        std::vector<Applied> out;
+        out.swap(applied);
+        return out;
+    }
+
+private:
+    RemoteServer* remote;
+    AnimationMixer* mixer;
+    Neck* neck;
+    NeckTransport* bus;
+    std::atomic<bool> running;
+    uint32_t seq;
+    std::mutex lock;
+    std::vector<Applied> applied;
+    std::thread thread;
+
+    void run() {
+        Trace::setThreadName("main");
+        while (running) {
+            uint16_t value;
+            bool got = remote->takeSetpoint(JOINT_NECK, value);
+            if (got) neck->setTarget(value, LAYER_SCRIPTED);
+            mixer->evaluate(Trace::nowNs());
+            if (got) {
+                Applied a = { value, bus->lastNs.load() };
+                std::lock_guard<std::mutex> g(lock);
+                applied.push_back(a);
+            }
+            RemoteState s;
+            memset(&s, 0, sizeof(s));
+            s.seq = ++seq;
+            s.timeMs = static_cast<uint32_t>(Trace::nowNs() / 1000000);
+            s.neckUs = neck->getServoPulse();
+            remote->publish(s, "");
+            usleep(LOOP_US);
+        }
+    }
+};
+
+static int connectTo(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void sendSetpoint(int fd, uint16_t value) {
+    uint8_t frame[1 + REMOTE_SETPOINT_BYTES] = { REMOTE_SETPOINTS, JOINT_NECK };
+    remotePut16(frame + 2, value);
+    if (send(fd, frame, sizeof(frame), MSG_NOSIGNAL) < 0) perror("send");
+}
+
+// Count and discard whatever STATE frames are waiting
+static int drainStates(int fd) {
+    uint8_t frame[REMOTE_MAX_FRAME];
+    RemoteState s;
+    int n = 0;
+    ssize_t len;
+    while ((len = recv(fd, frame, sizeof(frame), MSG_DONTWAIT)) > 0)
+        if (remoteDecodeState(frame, len, s)) n++;
+    return n;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+int main(int argc, char** argv) {
+    int rate = 100;
+    int count = 300;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--rate") && i + 1 < argc)       rate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--count") && i + 1 < argc) count = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: taro_remote_bench [--rate hz] [--count n]\n");
+            return 2;
+        }
+    }
+    if (rate < 1) rate = 1;
+    if (count > 900) count = 900;   // keeps values unique on each side
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/taro_remote_bench.%d.sock", static_cast<int>(getpid()));
+
+    NeckTransport bus;
+    PCA9685 pwm(&bus);
+    AnimationMixer mixer(&pwm);
+    BehaviorScheduler behaviors;
+    Neck neck(&mixer, &behaviors);
+    RemoteServer remote;
+    if (!remote.start(path)) {
+        fprintf(stderr, "cannot listen on %s\n", path);
+        return 1;
+    }
+    int fd = connectTo(path);
+    if (fd < 0) {
+        perror("connect");
+        return 1;
+    }
+    uint8_t subscribe[2] = { REMOTE_SUBSCRIBE, static_cast<uint8_t>(RemoteServer::MAX_RATE_HZ) };
+    send(fd, subscribe, sizeof(subscribe), MSG_NOSIGNAL);
+
+    ControlLoop loop(&remote, &mixer, &neck, &bus);
+
+    // Streamed: alternate sides so every command moves the neck
+    std::map<uint16_t, uint64_t> sentAt;
+    int states = 0;
+    uint64_t streamStart = Trace::nowNs();
+    for (int i = 0; i < count; i++) {
+        uint16_t value = i % 2 ? HIGH_BASE - i / 2 : LOW_BASE + i / 2;
+        sentAt[value] = Trace::nowNs();
+        sendSetpoint(fd, value);
+        usleep(1000000 / rate);
+        states += drainStates(fd);
+    }
+    usleep(3 * LOOP_US);
+    double streamSec = (Trace::nowNs() - streamStart) / 1e9;
+    states += drainStates(fd);
+    std::vector<Applied> streamed = loop.take();
+
+    // Burst: only the last of a back-to-back run should reach the servo
+    uint64_t burstLastNs = 0;
+    for (int i = 0; i < BURST_SIZE; i++) {
+        burstLastNs = Trace::nowNs();
+        sendSetpoint(fd, static_cast<uint16_t>(1200 + i));
+    }
+    usleep(3 * LOOP_US);
+    std::vector<Applied> burst = loop.take();
+
+    loop.stop();
+    close(fd);
+    remote.stop();
+
+    std::vector<double> latencyUs;
+    for (size_t i = 0; i < streamed.size(); i++) {
+        std::map<uint16_t, uint64_t>::const_iterator it = sentAt.find(streamed[i].value);
+        if (it != sentAt.end() && streamed[i].writeNs >= it->second)
+            latencyUs.push_back((streamed[i].writeNs - it->second) / 1000.0);
+    }
+    bool burstLastApplied = !burst.empty() && burst.back().value == 1200 + BURST_SIZE - 1;
+
+    printf("{\n");
+    printf("  \"rate_hz\": %d,\n", rate);
+    printf("  \"loop_ms\": %d,\n", LOOP_US / 1000);
+    printf("  \"sent\": %d,\n", count);
+    printf("  \"applied\": %zu,\n", latencyUs.size());
+    printf("  \"superseded\": %zu,\n", count - latencyUs.size());
+    printf("  \"command_to_register_us\": { \"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f },\n",
+           percentile(latencyUs, 0.5), percentile(latencyUs, 0.9), percentile(latencyUs, 0.99),
+           percentile(latencyUs, 1.0));
+    printf("  \"burst\": { \"sent\": %d, \"applied\": %zu, \"last_applied\": %s, \"last_us\": %.0f },\n",
+           BURST_SIZE, burst.size(), burstLastApplied ? "true" : "false",
+           burstLastApplied ? (burst.back().writeNs - burstLastNs) / 1000.0 : 0.0);
+    printf("  \"state_hz\": %.1f,\n", states / streamSec);
+    printf("  \"states_dropped\": %u\n", remote.droppedStates());
+    printf("}\n");
+    return burstLastApplied && !latencyUs.empty() ? 0 : 1;
+}
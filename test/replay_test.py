@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Replays a synthetic session log through tea_animatronic and checks that
+the servo command stream is deterministic.
+
+The log holds what a short live session would: a PRNG seed, 10 ms loop
+ticks, microphone blocks with a loud burst in the middle, keypresses (flap,
+turn, random mode on and off), a remote neck setpoint, a joystick sweep
+and AI backend lines.
+It is replayed twice as fast as possible and once in real time; all three
+servo streams must match.
+
+  make replaytest
+"""
+import math
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, "..")
+BINARY = os.path.join(ROOT, "tea_animatronic")
+
+RATE = 48000
+FRAMES = 1024
+SECONDS = 3.0
+
+TICK, KEY, AUDIO, AI, SEED, SERVO, SETPOINT, STICK = range(1, 9)
+
+def varint(v):
+    out = bytearray()
+    while v >= 0x80:
+        out.append((v & 0x7F) | 0x80)
+        v >>= 7
+    out.append(v)
+    return bytes(out)
+
+def audio_payload(samples):
+    out = bytearray(varint(len(samples)))
+    prev = 0
+    for s in samples:
+        d = s - prev
+        prev = s
+        out += varint(((d << 1) ^ (d >> 31)) & 0xFFFFFFFF)
+    return bytes(out)
+
+def build_log(path):
+    events = [(0, SEED, struct.pack("<I", 1234))]
+    t = 0.0
+    while t < SECONDS:
+        events.append((t, TICK, b""))
+        t += 0.010
+    block = 0
+    while block * FRAMES / RATE < SECONDS:
+        start = block * FRAMES
+        loud = 0.5 <= start / RATE < 1.5
+        amp = 12000 if loud else 40
+        samples = [int(amp * math.sin(2 * math.pi * 220 * (start + i) / RATE)) for i in range(FRAMES)]
+        events.append(((block + 1) * FRAMES / RATE, AUDIO, audio_payload(samples)))
+        block += 1
+    for when, key in ((0.205, b"e"), (0.305, b"a"), (0.405, b"a"), (1.805, b"x"),
+                      (1.905, b"d"), (2.805, b"x"), (2.855, b"r")):
+        events.append((when, KEY, key))
+    events.append((0.605, SETPOINT, struct.pack("<BH", 0, 2100)))
+    for i, us in enumerate((1200, 1000, 800, 0)):
+        events.append((1.005 + 0.1 * i, STICK, struct.pack("<BH", 0, us)))
+    events.append((0.05, AI, b"STAGE:llm:LOADING\nSTAGE:llm:READY:900\n"))
+    events.append((0.06, AI, b"READY\n"))
+
+    # Same order the recorder would produce: by time, keys right after their tick
+    events.sort(key=lambda e: (round(e[0] * 1e6), e[1] != TICK))
+    with open(path, "wb") as f:
+        f.write(b"TSL1" + struct.pack("<IIIQ", 1, RATE, FRAMES, int(time.time() * 1e9)))
+        last = 0
+        for when, kind, payload in events:
+            us = int(round(when * 1e6))
+            f.write(bytes([kind]) + varint(us - last) + varint(len(payload)) + payload)
+            last = us
+    return sum(1 for e in events if e[1] == TICK)
+
+def replay(log, fast):
+    out = tempfile.NamedTemporaryFile(suffix=".txt", delete=False)
+    out.close()
+    args = [BINARY, "--replay", log, "--servo-out", out.name] + (["--fast"] if fast else [])
+    t0 = time.monotonic()
+    subprocess.run(args, cwd=ROOT, stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL, timeout=60)
+    took = time.monotonic() - t0
+    with open(out.name) as f:
+        lines = f.read().splitlines()
+    os.unlink(out.name)
+    return lines, took
+
+def main():
+    if not os.path.exists(BINARY):
+        print("build tea_animatronic first")
+        sys.exit(1)
+    log = tempfile.NamedTemporaryFile(suffix=".tsl", delete=False)
+    log.close()
+    ticks = build_log(log.name)
+
+    first, fast_took = replay(log.name, True)
+    second, _ = replay(log.name, True)
+    real, real_took = replay(log.name, False)
+    dump = subprocess.run([BINARY, "--dump", log.name], capture_output=True, text=True).stdout
+    os.unlink(log.name)
+
+    failures = []
+    def check(cond, what):
+        print(("ok    " if cond else "FAIL  ") + what)
+        if not cond:
+            failures.append(what)
+
+    channels = {int(l.split()[2]) for l in first}
+    check(len(first) > 0, f"servo commands written ({len(first)})")
+    check({0, 1, 2, 3} <= channels, "wings, neck and mouth all moved")
+    check(any(l.split()[2] == "2" and int(l.split()[3]) > 400 for l in first),
+          "remote setpoint turned the neck")
+    check(any(l.split()[2] == "2" and int(l.split()[3]) < 200 for l in first),
+          "joystick turned the neck the other way")
+    check(first == second, "two fast replays give identical servo streams")
+    check(first == real, "real-time replay matches the fast one")
+    check(real_took >= SECONDS, f"real time replay keeps the log's pace ({real_took:.2f} s)")
+    check(fast_took < real_took, f"fast replay is faster ({fast_took:.2f} s)")
+    check(dump.count(" tick\n") == ticks and " seed 1234" in dump and " setpoint 0 2100" in dump and " stick 0 800" in dump,
+          "dump lists every record")
+    print(f"{len(failures)} failure(s)")
+    sys.exit(1 if failures else 0)
+
+if __name__ == "__main__":
+    main()
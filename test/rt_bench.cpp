@@ -0,0 +1,123 @@
+// Thread placement benchmark.
+// A waker thread sleeps 10 ms at a time, like the servo loop, while hog
+// threads spin the way inference does. Runs twice: with default scheduling,
+// then with Realtime enabled (the waker as the main role, the hogs as the
+// AI backend, placed by src/trace/threads.conf). Prints one JSON document
+// with the waker's wakeup lateness in each phase and the per-thread stats
+// the UI shows.
+//
+//   make rtbench
+//   ./build/taro_rt_bench --seconds 5 --hogs 4
+//
+// SCHED_FIFO needs root or an rtprio limit; without it the second phase
+// only moves threads between cores, and "fifo" reads false.
+
+#include "../src/trace/Realtime.h"
+#include "../src/trace/Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static constexpr int LOOP_US = 10000;   // main loop tick
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t i = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+struct Phase {
+    std::vector<double> lateUs;
+    ThreadStats stats[Realtime::MAX_THREADS];
+    int statCount;
+};
+
+static void runPhase(Phase& phase, int seconds, int hogs) {
+    std::atomic<bool> running(true);
+    std::atomic<bool> measured(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < hogs; i++) {
+        threads.push_back(std::thread([&running, i]() {
+            char name[16];
+            snprintf(name, sizeof(name), "hog%d", i);
+            Realtime::enter(ROLE_AI_BACKEND, name);
+            volatile unsigned long spin = 0;
+            while (running.load(std::memory_order_relaxed)) spin = spin + 1;
+        }));
+    }
+
+    std::thread waker([&phase, &running, &measured, seconds]() {
+        Realtime::enter(ROLE_MAIN, "waker");
+        int ticks = seconds * 1000000 / LOOP_US;
+        phase.lateUs.reserve(ticks);
+        for (int t = 0; t < ticks; t++) {
+            uint64_t due = Trace::nowNs() + LOOP_US * 1000ULL;
+            Realtime::sleepUs(LOOP_US);
+            uint64_t now = Trace::nowNs();
+            phase.lateUs.push_back(now > due ? (now - due) / 1000.0 : 0.0);
+        }
+        // Stay registered until the stats are read
+        measured = true;
+        while (running.load()) usleep(1000);
+    });
+
+    // One report to start the CPU window, one at the end to read it
+    ThreadStats scratch[Realtime::MAX_THREADS];
+    usleep(Realtime::REPORT_MS * 1000);
+    Realtime::report(scratch, Realtime::MAX_THREADS);
+    while (!measured.load()) usleep(1000);
+    phase.statCount = Realtime::report(phase.stats, Realtime::MAX_THREADS);
+
+    running = false;
+    waker.join();
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+static void printPhase(const char* name, const Phase& phase, bool last) {
+    printf("  \"%s\": {\n", name);
+    printf("    \"wake_late_us\": { \"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f },\n",
+           percentile(phase.lateUs, 0.5), percentile(phase.lateUs, 0.99), percentile(phase.lateUs, 1.0));
+    printf("    \"threads\": [");
+    for (int i = 0; i < phase.statCount; i++) {
+        const ThreadStats& t = phase.stats[i];
+        printf("%s\n      { \"name\": \"%s\", \"cpu\": %d, \"fifo\": %s, \"priority\": %d, \"cpu_pct\": %.0f }",
+               i ? "," : "", t.name, t.cpu, t.fifo ? "true" : "false", t.priority, t.cpuPct);
+    }
+    printf("\n    ]\n  }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char** argv) {
+    int seconds = 3;
+    int hogs = Realtime::cpuCount(ROLE_AI_BACKEND) + 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc)   seconds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--hogs") && i + 1 < argc) hogs = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--seconds N] [--hogs N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (seconds < 2) seconds = 2;   // the CPU window needs a full report interval
+
+    Realtime::configure("src/trace/threads.conf");
+
+    Phase normal, placed;
+    runPhase(normal, seconds, hogs);
+    Realtime::setEnabled(true);
+    runPhase(placed, seconds, hogs);
+
+    printf("{\n");
+    printf("  \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("  \"hogs\": %d,\n", hogs);
+    printf("  \"loop_ms\": %d,\n", LOOP_US / 1000);
+    printPhase("default", normal, false);
+    printPhase("realtime", placed, true);
+    printf("}\n");
+    return placed.lateUs.empty() ? 1 : 0;
+}
@@ -0,0 +1,315 @@
+// Serial servo link checks.
+//
+// First the wire format on its own: the CRC against its check value, COBS
+// round trips (zeros, a run longer than a code byte can hold), a decoder
+// that drops a corrupted frame and is back in step at the next delimiter,
+// and the interpolation profiles.
+//
+// Then SerialServo end to end against a stand-in microcontroller on a pty:
+// a thread that reads frames, answers each with an ACK and interpolates
+// every channel at 1 kHz, as the firmware would. The animation mixer drives
+// it in a 10 ms loop like main's; the neck must arrive where the mixer put
+// it, in 1 ms steps much finer than the mixer's 10 ms ones. A corrupted
+// frame is counted by the device and superseded by the next, idle release
+// switches the outputs off and the next move brings them back, and a single
+// eased moveTo() glides on its own. Link throughput and acknowledgement
+// latency are printed as JSON:
+//
+//   make serialtest
+
+#include "../src/serial/SerialServo.h"
+#include "../src/actuation/AnimationMixer.h"
+#include "../src/trace/Trace.h"
+#include "check.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+static constexpr int LOOP_US = 10000;   // main loop tick
+
+static void protocolChecks() {
+    const uint8_t digits[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    check(serialCrc16(digits, sizeof(digits)) == 0x29B1, "crc: CCITT-FALSE check value");
+
+    uint8_t in[300], enc[310], dec[310];
+    for (int i = 0; i < 300; i++) in[i] = i % 7 ? static_cast<uint8_t>(i) : 0;
+    size_t n = serialCobsEncode(in, sizeof(in), enc);
+    size_t m = serialCobsDecode(enc, n, dec);
+    check(memchr(enc, 0, n) == nullptr && m == sizeof(in) && !memcmp(in, dec, m),
+          "cobs: zeros round trip, none on the wire");
+    for (int i = 0; i < 300; i++) in[i] = static_cast<uint8_t>(i % 255 + 1);
+    n = serialCobsEncode(in, sizeof(in), enc);
+    m = serialCobsDecode(enc, n, dec);
+    check(n == sizeof(in) + 2 && m == sizeof(in) && !memcmp(in, dec, m), "cobs: a run past 254 bytes");
+
+    uint8_t payload[SERIAL_SEGMENT_BYTES];
+    SerialSegment s = { 2, 1834, 10, SERIAL_PROFILE_EASE };
+    serialPutSegment(payload, s);
+    uint8_t frame[SERIAL_MAX_ENCODED];
+    size_t len = serialEncodeFrame(SERIAL_SEGMENTS, 7, payload, sizeof(payload), frame);
+    SerialDecoder rx;
+    frame[3] ^= 0x40;
+    bool got = false;
+    for (size_t i = 0; i < len; i++) got |= rx.push(frame[i]);
+    check(!got && rx.rejected == 1, "decoder: a corrupted frame is rejected");
+    frame[3] ^= 0x40;
+    got = false;
+    for (size_t i = 0; i < len; i++) got |= rx.push(frame[i]);
+    SerialSegment back = serialGetSegment(rx.payload());
+    check(got && rx.type == SERIAL_SEGMENTS && rx.seq == 7 && rx.len == SERIAL_SEGMENT_BYTES &&
+          back.channel == 2 && back.targetUs == 1834 && back.durationMs == 10 &&
+          back.profile == SERIAL_PROFILE_EASE,
+          "decoder: the next frame decodes whole");
+
+    check(serialInterpolate(1000, 2000, 5000, 10000, SERIAL_PROFILE_LINEAR) == 1500 &&
+          serialInterpolate(1000, 2000, 5000, 10000, SERIAL_PROFILE_EASE) == 1500 &&
+          serialInterpolate(1000, 2000, 2000, 10000, SERIAL_PROFILE_EASE) <
+              serialInterpolate(1000, 2000, 2000, 10000, SERIAL_PROFILE_LINEAR) &&
+          serialInterpolate(1000, 2000, 20000, 10000, SERIAL_PROFILE_EASE) == 2000,
+          "interpolate: linear and ease meet at the midpoint, ease starts gently");
+}
+
+struct NeckSample {
+    uint64_t us;
+    uint16_t pulse;
+};
+
+// What the firmware does, on the master side of a pty
+class StandInDevice {
+public:
+    // Takes ownership of the pty master
+    explicit StandInDevice(int masterFd) : corruptNext(false), fd(masterFd), running(true),
+                                           recording(false), frames(0) {
+        memset(outputs, 0, sizeof(outputs));
+        samples.reserve(100000);
+        thread = std::thread(&StandInDevice::run, this);
+    }
+    ~StandInDevice() {
+        running = false;
+        thread.join();
+        close(fd);
+    }
+
+    std::atomic<bool> corruptNext;   // flip a bit in the next frame received
+
+    uint16_t output(int channel) {
+        std::lock_guard<std::mutex> g(lock);
+        return outputs[channel].now;
+    }
+    uint32_t rejected() {
+        std::lock_guard<std::mutex> g(lock);
+        return rx.rejected;
+    }
+    unsigned int received() {
+        std::lock_guard<std::mutex> g(lock);
+        return frames;
+    }
+    // The neck at every 1 ms step while recording, with when it was taken
+    void record(bool on) {
+        std::lock_guard<std::mutex> g(lock);
+        recording = on;
+        if (on) samples.clear();
+    }
+    std::vector<NeckSample> neckSamples() {
+        std::lock_guard<std::mutex> g(lock);
+        return samples;
+    }
+
+private:
+    struct Output {
+        uint16_t from, to, now;
+        uint64_t startUs;
+        uint32_t durationUs;
+        uint8_t profile;
+    };
+
+    int fd;
+    std::atomic<bool> running;
+    std::thread thread;
+    std::mutex lock;
+    SerialDecoder rx;
+    Output outputs[PCA9685_CHANNELS];
+    bool recording;
+    std::vector<NeckSample> samples;
+    unsigned int frames;
+
+    void apply(uint64_t nowUs) {
+        for (size_t i = 0; i + SERIAL_SEGMENT_BYTES <= rx.len; i += SERIAL_SEGMENT_BYTES) {
+            SerialSegment s = serialGetSegment(rx.payload() + i);
+            if (s.channel >= PCA9685_CHANNELS) continue;
+            Output& o = outputs[s.channel];
+            o.from = o.now;
+            o.to = s.targetUs;
+            o.startUs = nowUs;
+            o.durationUs = o.now && s.targetUs ? s.durationMs * 1000u : 0;
+            o.profile = s.profile;
+            if (!o.durationUs) o.now = o.to;
+        }
+        uint8_t ack[3];
+        ack[0] = rx.seq;
+        serialPut16(ack + 1, static_cast<uint16_t>(rx.rejected));
+        uint8_t out[SERIAL_MAX_ENCODED];
+        size_t n = serialEncodeFrame(SERIAL_ACK, rx.seq, ack, sizeof(ack), out);
+        if (write(fd, out, n) != static_cast<ssize_t>(n)) perror("ack");
+    }
+
+    void run() {
+        uint64_t next = Trace::nowNs();
+        while (running) {
+            next += 1000000;
+            uint64_t now = Trace::nowNs();
+            if (next > now) usleep((next - now) / 1000);
+            uint64_t nowUs = Trace::nowNs() / 1000;
+
+            std::lock_guard<std::mutex> g(lock);
+            uint8_t buf[256];
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0) {
+                if (corruptNext.exchange(false)) buf[0] ^= 0x10;
+                for (ssize_t i = 0; i < n; i++) {
+                    if (!rx.push(buf[i]) || rx.type != SERIAL_SEGMENTS) continue;
+                    frames++;
+                    apply(nowUs);
+                }
+            }
+            for (int ch = 0; ch < PCA9685_CHANNELS; ch++) {
+                Output& o = outputs[ch];
+                o.now = serialInterpolate(o.from, o.to, static_cast<uint32_t>(nowUs - o.startUs),
+                                          o.durationUs, o.profile);
+            }
+            if (recording && samples.size() < samples.capacity()) {
+                NeckSample sample = { nowUs, outputs[NeckJoint::CHANNEL].now };
+                samples.push_back(sample);
+            }
+        }
+    }
+};
+
+// The mixer's neck pulse as the device generates it
+static uint16_t onWire(int pulseUs) { return SerialServo::countsToUs(NeckJoint::counts(pulseUs)); }
+
+static bool near(int a, int b, int tolerance) { return abs(a - b) <= tolerance; }
+
+// Ticks of main's loop, just the parts that touch the servos; the largest
+// neck move the mixer made in one tick
+static int loop(AnimationMixer& mixer, SerialServo& servo, int ticks) {
+    int maxStep = 0;
+    for (int t = 0; t < ticks; t++) {
+        int before = mixer.pulse(MIX_NECK);
+        mixer.evaluate(Trace::nowNs());
+        servo.updateIdle();
+        int step = abs(mixer.pulse(MIX_NECK) - before);
+        if (step > maxStep) maxStep = step;
+        usleep(LOOP_US);
+    }
+    return maxStep;
+}
+
+static void linkChecks() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master)) {
+        printf("skip  no pty available\n");
+        return;
+    }
+    struct termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    char path[64];
+    snprintf(path, sizeof(path), "%s", ptsname(master));
+
+    SerialServo servo(path);
+    check(servo.isOpen(), "link: the pty opens as a servo port");
+    StandInDevice device(master);
+    AnimationMixer mixer(&servo);
+    loop(mixer, servo, 10);
+    check(device.output(NeckJoint::CHANNEL) == onWire(NeckJoint::REST_US),
+          "link: the mixer's rest pose reaches the device");
+
+    // A long move through the mixer's per-tick easing
+    uint64_t startNs = Trace::nowNs();
+    SerialLinkStats before = servo.getLinkStats();
+    device.record(true);
+    mixer.set(LAYER_SCRIPTED, MIX_NECK, 2100, 0);
+    int tickStep = loop(mixer, servo, 80);
+    device.record(false);
+    std::vector<NeckSample> samples = device.neckSamples();
+    int msStep = 0;
+    for (size_t i = 1; i < samples.size(); i++) {
+        // Per millisecond, so a late wakeup of the device thread isn't a jump
+        uint64_t dt = samples[i].us - samples[i - 1].us;
+        int step = abs(samples[i].pulse - samples[i - 1].pulse) * 1000 / static_cast<int>(dt > 1000 ? dt : 1000);
+        if (step > msStep) msStep = step;
+    }
+    printf("      neck: largest step %d us per 10 ms tick, %d us per 1 ms on the device\n", tickStep, msStep);
+    check(near(device.output(NeckJoint::CHANNEL), onWire(2100), 3), "link: the neck arrives where the mixer put it");
+    check(tickStep > 0 && msStep * 4 <= tickStep, "link: the device moves in steps a quarter of the tick's or less");
+
+    SerialLinkStats link = servo.getLinkStats();
+    double seconds = (Trace::nowNs() - startNs) / 1e9;
+    unsigned int moveFrames = link.framesSent - before.framesSent;
+    double bytesPerS = (link.bytesSent - before.bytesSent) / seconds;
+    check(link.acks > 0 && link.lost == 0 && link.deviceRejected == 0 && link.framesDropped == 0,
+          "link: every frame acknowledged, none lost");
+
+    // One frame corrupted on the way; the next carries newer positions
+    device.corruptNext = true;
+    mixer.set(LAYER_SCRIPTED, MIX_NECK, 1700, 0);
+    loop(mixer, servo, 60);
+    link = servo.getLinkStats();
+    check(link.deviceRejected == 1 && device.rejected() == 1 && link.lost == 1, "link: a corrupted frame is rejected and counted as lost");
+    check(near(device.output(NeckJoint::CHANNEL), onWire(1700), 3), "link: the next frames supersede it");
+
+    // Idle release: every output off, then the next move wakes them
+    servo.enableIdleRelease(100, 50);
+    loop(mixer, servo, 30);
+    PwmPowerStats power = servo.getPowerStats();
+    check(power.asleep && device.output(NeckJoint::CHANNEL) == 0 && device.output(MouthJoint::CHANNEL) == 0,
+          "idle: held-still outputs are switched off");
+    mixer.set(LAYER_SCRIPTED, MIX_NECK, 1900, 0);
+    loop(mixer, servo, 3);
+    power = servo.getPowerStats();
+    check(power.wakes == 1 && !power.asleep && device.output(NeckJoint::CHANNEL) != 0 &&
+          device.output(MouthJoint::CHANNEL) == onWire(MouthJoint::REST_US),
+          "idle: the next move brings every output back");
+    loop(mixer, servo, 40);
+
+    // One eased glide, interpolated on the device alone
+    device.record(true);
+    uint64_t moveUs = Trace::nowNs() / 1000;
+    servo.moveTo(NeckJoint::CHANNEL, 1200, 200);
+    // 250 ms: done gliding, and not yet idle for the 100 ms release time
+    for (int t = 0; t < 25; t++) {
+        servo.updateIdle();
+        usleep(LOOP_US);
+    }
+    device.record(false);
+    samples = device.neckSamples();
+    // 20 ms into 200 ms: linear would have covered 70 us of the 700, ease 20
+    int early = -1;
+    for (size_t i = 0; i < samples.size() && early < 0; i++)
+        if (samples[i].us >= moveUs + 20000) early = samples[i].pulse;
+    check(near(early, onWire(1900), 40) && near(device.output(NeckJoint::CHANNEL), 1200, 1),
+          "moveTo: an eased glide starts gently and arrives");
+
+    link = servo.getLinkStats();
+    check(device.received() == link.framesSent - 1, "link: the device saw every frame but the corrupted one");
+    printf("{\n  \"move_frames\": %u,\n  \"move_bytes_per_s\": %.0f,\n  \"frames\": %u,\n"
+           "  \"bytes_per_frame\": %.1f,\n  \"last_ack_read_us\": %u\n}\n",
+           moveFrames, bytesPerS, link.framesSent,
+           link.framesSent ? static_cast<double>(link.bytesSent) / link.framesSent : 0.0, link.lastAckUs);
+}
+
+int main() {
+    protocolChecks();
+    linkChecks();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+// Spectral stage checks on synthetic audio.
+// Tones land in the right band at the right level (which only holds if the
+// FFT and its split pass are correct), silence never fires an onset, and
+// click tracks at several tempos give one onset per click and a tempo
+// estimate and beat count that match.
+//
+//   make spectrumtest
+
+#include "../src/audio/SpectralAnalyzer.h"
+#include "check.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static constexpr int RATE    = 48000;
+static constexpr int FRAMES  = 1024;
+static constexpr float SECONDS = 12.0f;
+
+static SpectralFeatures run(const std::vector<short>& pcm) {
+    SpectralAnalyzer a(RATE, FRAMES);
+    SpectralFeatures f;
+    for (size_t i = 0; i + FRAMES <= pcm.size(); i += FRAMES) a.process(&pcm[i]);
+    a.latest(f);
+    return f;
+}
+
+// Hann-windowed sine of amplitude A sums to 1.5 A^2 over its main lobe
+static void toneTest(float hz, int band) {
+    std::vector<short> pcm(FRAMES * 4);
+    for (size_t i = 0; i < pcm.size(); i++)
+        pcm[i] = static_cast<short>(16384.0 * sin(2.0 * M_PI * hz * i / RATE));
+    SpectralFeatures f = run(pcm);
+    float expected = 10.0f * log10f(1.5f * 0.25f);
+    bool others = true;
+    for (int b = 0; b < SPECTRAL_BANDS; b++)
+        if (b != band && f.bandDb[b] > expected - 30.0f) others = false;
+    char what[96];
+    snprintf(what, sizeof(what), "%.0f Hz tone: band %d at %.1f dB (expect %.1f), others below",
+             hz, band, f.bandDb[band], expected);
+    check(fabsf(f.bandDb[band] - expected) < 1.0f && others, what);
+}
+
+// Kick-like clicks (decaying low thump plus a noise transient) over a
+// quiet noise floor
+static std::vector<short> clickTrack(float bpm, int& clicks) {
+    std::vector<short> pcm(static_cast<size_t>(SECONDS * RATE));
+    srand(7);
+    for (size_t i = 0; i < pcm.size(); i++) pcm[i] = static_cast<short>(rand() % 200 - 100);
+    size_t interval = static_cast<size_t>(60.0f * RATE / bpm);
+    clicks = 0;
+    for (size_t start = RATE / 4; start < pcm.size(); start += interval) {
+        clicks++;
+        for (size_t j = 0; j < static_cast<size_t>(RATE / 20) && start + j < pcm.size(); j++) {
+            double env = exp(-static_cast<double>(j) / (RATE / 100));
+            double s = 12000.0 * env * sin(2.0 * M_PI * 70.0 * j / RATE) + 6000.0 * env * (rand() % 2001 - 1000) / 1000.0;
+            pcm[start + j] = static_cast<short>(pcm[start + j] + s);
+        }
+    }
+    return pcm;
+}
+
+static void tempoTest(float bpm) {
+    int clicks;
+    SpectralFeatures f = run(clickTrack(bpm, clicks));
+    char what[128];
+    snprintf(what, sizeof(what), "%.0f BPM clicks: %u onsets for %d clicks", bpm, f.onsets, clicks);
+    check(abs(static_cast<int>(f.onsets) - clicks) <= 1, what);
+    snprintf(what, sizeof(what), "%.0f BPM clicks: tempo %.1f, confidence %.2f", bpm, f.bpm, f.tempoConfidence);
+    check(fabsf(f.bpm - bpm) < bpm * 0.03f && f.tempoConfidence >= SpectralAnalyzer::MIN_CONFIDENCE, what);
+    // Beats start once the first tempo estimate is in, about half the history
+    float expectedBeats = (SECONDS - 3.0f) * bpm / 60.0f;
+    snprintf(what, sizeof(what), "%.0f BPM clicks: %u beats (about %.0f)", bpm, f.beats, expectedBeats);
+    check(f.beats >= expectedBeats * 0.8f && f.beats <= static_cast<uint32_t>(clicks), what);
+}
+
+int main() {
+    toneTest(250.0f, 1);
+    toneTest(1000.0f, 2);
+    toneTest(3000.0f, 3);
+
+    SpectralFeatures quiet = run(std::vector<short>(RATE * 4, 0));
+    check(quiet.onsets == 0 && quiet.beats == 0 && quiet.bpm == 0.0f, "silence: no onsets, beats or tempo");
+
+    tempoTest(90.0f);
+    tempoTest(120.0f);
+    tempoTest(150.0f);
+
+    SpectralFeatures cost = run(std::vector<short>(RATE * 2, 0));
+    printf("cost %.1f us avg, %.1f us peak of a %.0f us block\n", cost.avgUs, cost.peakUs, cost.deadlineUs);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,228 @@
+#!/usr/bin/env python3
+"""Streaming transcription against the fixed recording, on stub backends.
+
+A synthetic utterance (eight tone-burst "words" from 0.6 s to 3.0 s of a
+5 s window) is played into the backend in real time as the microphone.
+whisper is a stub script that takes time in proportion to the audio it is
+given and "hears" every word that ends inside it. The llama-server stub
+keeps one slot's prompt cache and charges a fixed time per token it has
+to evaluate, so speculative prefill pays off the way it does on the Pi.
+
+Each turn runs both ways, and the time from the end of speech to the
+first reply token is compared. The checks:
+  - partial transcripts are sent while the user is still talking,
+  - the turn ends at the pause, not after the full recording,
+  - the final transcript is complete,
+  - the stable words were prefilled, as a prefix of the final prompt,
+  - the streamed turn reaches its first token sooner,
+  - silence times out with no transcript.
+
+  make stttest
+"""
+import array
+import http.server
+import importlib.util
+import json
+import math
+import os
+import stat
+import sys
+import tempfile
+import threading
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+spec = importlib.util.spec_from_file_location("taro_ai", os.path.join(HERE, "..", "src", "ai", "taro_ai.py"))
+taro_ai = importlib.util.module_from_spec(spec)
+spec.loader.exec_module(taro_ai)
+
+RATE = taro_ai.MIC_RATE
+WORDS = ["what", "is", "your", "favourite", "rocket", "to", "launch", "today"]
+SPEECH_START = 0.6
+WORD_SECONDS = 0.22
+GAP_SECONDS = 0.08
+SPEECH_END = SPEECH_START + len(WORDS) * (WORD_SECONDS + GAP_SECONDS) - GAP_SECONDS
+
+WHISPER_FIXED = 0.25          # seconds per run, plus...
+WHISPER_PER_SECOND = 0.12     # ...this per second of audio
+PREFILL_PER_TOKEN = 0.02      # llama-server prompt evaluation
+HISTORY = [
+    {"role": "user", "content": "hello taro how are you doing on this fine afternoon"},
+    {"role": "assistant", "content": "squawk i am great i just got back from a test flight over the ocean"},
+]
+
+# Word i spans [start, end) seconds
+def word_times():
+    t = SPEECH_START
+    for w in WORDS:
+        yield w, t, t + WORD_SECONDS
+        t += WORD_SECONDS + GAP_SECONDS
+
+def utterance(seconds, speech=True):
+    samples = array.array("h", [0]) * int(seconds * RATE)
+    for i in range(len(samples)):
+        samples[i] = (i * 7919) % 97 - 48          # quiet noise floor
+    if speech:
+        for _, start, end in word_times():
+            for i in range(int(start * RATE), int(end * RATE)):
+                samples[i] = int(6000 * math.sin(2 * math.pi * 220 * i / RATE))
+    return samples.tobytes()
+
+STUB_WHISPER = f'''#!/usr/bin/env python3
+import sys, time, wave
+path = sys.argv[sys.argv.index("-f") + 1]
+with wave.open(path, "rb") as wf:
+    seconds = wf.getnframes() / wf.getframerate()
+time.sleep({WHISPER_FIXED} + {WHISPER_PER_SECOND} * seconds)
+words = {[(w, end) for w, _, end in word_times()]!r}
+heard = [w for w, end in words if end <= seconds]
+print(" ".join(heard) if heard else "[BLANK_AUDIO]")
+'''
+
+class PacedMic:
+    """Hands out PCM no faster than it would be recorded."""
+
+    def __init__(self, pcm):
+        self.pcm = pcm
+        self.pos = 0
+        self.t0 = time.monotonic()
+        self.closed = None
+
+    def read(self, n):
+        chunk = self.pcm[self.pos:self.pos + n]
+        self.pos += len(chunk)
+        due = self.t0 + self.pos / 2 / RATE
+        if chunk and due > time.monotonic():
+            time.sleep(due - time.monotonic())
+        return chunk
+
+    def close(self):
+        self.closed = time.monotonic() - self.t0
+
+# Slot cache: the token (word) list of the last prompt evaluated
+slot_lock = threading.Lock()
+slot = {"cached": [], "first_token": None, "requests": []}
+
+class StubLlama(http.server.BaseHTTPRequestHandler):
+    def log_message(self, *args):
+        pass
+
+    def do_POST(self):
+        body = json.loads(self.rfile.read(int(self.headers["Content-Length"])))
+        if self.path == "/tokenize":
+            text = body["content"]
+            tokens = list(range(len(text.split()) + text.count("\n")))
+            self._reply("application/json", json.dumps({"tokens": tokens}))
+            return
+        tokens = body["prompt"].replace("\n", " \n ").split(" ")
+        with slot_lock:
+            cached = slot["cached"]
+            n = 0
+            while n < len(cached) and n < len(tokens) and cached[n] == tokens[n]:
+                n += 1
+            time.sleep((len(tokens) - n) * PREFILL_PER_TOKEN)
+            slot["cached"] = tokens
+            slot["requests"].append((body, len(tokens) - n))
+            if body["n_predict"] == 0:
+                self._reply("application/json", json.dumps({"content": "", "stop": True}))
+                return
+            slot["first_token"] = time.monotonic()
+        events = [{"content": " squawk rockets", "stop": False},
+                  {"content": "", "stop": True, "timings": {"prompt_n": len(tokens) - n}}]
+        self._reply("text/event-stream", "".join(f"data: {json.dumps(e)}\n\n" for e in events))
+
+    def _reply(self, kind, text):
+        data = text.encode()
+        self.send_response(200)
+        self.send_header("Content-Type", kind)
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+def run_turn(streaming, sent):
+    """One LISTEN turn. Returns (transcript, seconds from end of speech to
+    the first reply token, seconds of audio heard before the mic closed)."""
+    pcm = utterance(taro_ai.RECORD_SECONDS)
+    with slot_lock:
+        slot["cached"] = (taro_ai.SYSTEM_PROMPT + "\n").replace("\n", " \n ").split(" ")
+        del slot["requests"][:]
+    del sent[:]
+    taro_ai.STT_STREAMING = streaming
+    mic = PacedMic(pcm)
+    taro_ai.ArecordMic = lambda: mic
+
+    def record():
+        # The fixed recording: the whole window, in real time
+        while mic.read(4096):
+            pass
+        return taro_ai._write_wav(pcm)
+    taro_ai.record = record
+
+    text, _ = taro_ai.hear(list(HISTORY))
+    ended = mic.closed if mic.closed is not None else mic.pos / 2 / RATE
+    history = HISTORY + [{"role": "user", "content": text}]
+    taro_ai.get_response(history)
+    return text, slot["first_token"] - (mic.t0 + SPEECH_END), ended
+
+def main():
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), StubLlama)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    taro_ai.LLAMA_PORT = server.server_address[1]
+
+    whisper = tempfile.NamedTemporaryFile("w", suffix=".py", delete=False)
+    whisper.write(STUB_WHISPER)
+    whisper.close()
+    os.chmod(whisper.name, os.stat(whisper.name).st_mode | stat.S_IXUSR)
+    taro_ai.WHISPER_BIN = whisper.name
+
+    sent = []
+    taro_ai.send = sent.append
+    taro_ai._prepare = lambda text: ("PLAY:stub", 0.0, None)
+    taro_ai._cache_trim = lambda: None
+
+    failures = []
+    def check(cond, what):
+        print(("ok    " if cond else "FAIL  ") + what)
+        if not cond:
+            failures.append(what)
+
+    log, sys.stderr = sys.stderr, open(os.devnull, "w")
+    batch_text, batch_ms, batch_end = run_turn(False, sent)
+    batch_prefill = slot["requests"][-1][1]
+    stream_text, stream_ms, stream_end = run_turn(True, sent)
+    stream_sent = list(sent)
+    requests = list(slot["requests"])
+    taro_ai.RECORD_SECONDS = 1.5
+    taro_ai.ArecordMic = lambda: PacedMic(utterance(taro_ai.RECORD_SECONDS, speech=False))
+    del sent[:]
+    quiet_text, _ = taro_ai.listen([])
+    quiet_sent = list(sent)
+    sys.stderr = log
+    os.unlink(whisper.name)
+
+    partials = [m for m in stream_sent if m.startswith("PARTIAL:")]
+    processing = stream_sent.index("PROCESSING") if "PROCESSING" in stream_sent else len(stream_sent)
+    check(len(partials) >= 2 and stream_sent.index(partials[0]) < processing,
+          f"partial transcripts sent while talking ({len(partials)})")
+    check(stream_end < SPEECH_END + taro_ai.ENDPOINT_SILENCE + 0.3,
+          f"turn ends at the pause ({stream_end:.2f} s, speech ended {SPEECH_END:.2f} s)")
+    check(stream_text == " ".join(WORDS) and batch_text == stream_text, "final transcript is complete")
+    prefills = [b for b, _ in requests if b["n_predict"] == 0]
+    final = [b for b, _ in requests if b["n_predict"] != 0]
+    check(prefills and final and all(final[-1]["prompt"].startswith(p["prompt"]) for p in prefills),
+          f"stable words prefilled as a prefix of the final prompt ({len(prefills)} prefills)")
+    stream_prefill = [n for b, n in requests if b["n_predict"] != 0][-1]
+    check(stream_prefill < batch_prefill,
+          f"final request evaluates fewer tokens ({stream_prefill} vs {batch_prefill})")
+    check(stream_ms < batch_ms, "streamed turn reaches the first token sooner")
+    check(quiet_text == "" and not any(m.startswith("PARTIAL:") for m in quiet_sent),
+          "silence times out with no transcript")
+    print(f"end of speech to first token: batch {batch_ms * 1000:.0f} ms, streaming {stream_ms * 1000:.0f} ms, "
+          f"saved {(batch_ms - stream_ms) * 1000:.0f} ms per turn")
+
+    server.shutdown()
+    print(f"{len(failures)} failure(s)")
+    sys.exit(1 if failures else 0)
+
+if __name__ == "__main__":
+    main()